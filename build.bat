@@ -7,12 +7,39 @@ g++ -std=c++14 -Wall -Wextra -Iinclude ^
     -DWIN32_LEAN_AND_MEAN ^
     src\socket_wrapper.cpp ^
     src\server.cpp ^
+    src\admission.cpp ^
+    src\cidr_trie.cpp ^
+    src\websocket.cpp ^
     src\client.cpp ^
     src\network_manager.cpp ^
     src\message.cpp ^
+    src\message_ops.cpp ^
     src\chat_session.cpp ^
     src\client_handler.cpp ^
+    src\outbound_queue.cpp ^
     src\room.cpp ^
+    src\flood_filter.cpp ^
+    src\chat_frame.cpp ^
+    src\io_loop.cpp ^
+    src\thread_scaler.cpp ^
+    src\metrics.cpp ^
+    src\fiber.cpp ^
+    src\epoch.cpp ^
+    src\federation.cpp ^
+    src\link_writer.cpp ^
+    src\hub_log.cpp ^
+    src\history_file.cpp ^
+    src\history_archive.cpp ^
+    src\history_compactor.cpp ^
+    src\history_export.cpp ^
+    src\history_index.cpp ^
+    src\history_query.cpp ^
+    src\lz_block.cpp ^
+    src\crc32c.cpp ^
+    src\sequencer.cpp ^
+    src\cluster.cpp ^
+    src\relay_tree.cpp ^
+    src\relay_node.cpp ^
     src\main.cpp ^
     -o build\LAN_Chat.exe ^
     -lws2_32
@@ -0,0 +1,141 @@
+#pragma once
+/**
+ * @file admission.h
+ * @brief Who may connect: CIDR allow / deny lists and a per-address rate.
+ *
+ * Server asks check() about every accepted socket before any handshake
+ * runs, and closes refused ones at once. A connection is refused if
+ *
+ *   - its address falls under the deny list (the longest matching prefix
+ *     across both lists decides, so an allowed host inside a denied range
+ *     gets in);
+ *   - an allow list is given and the address is not on it (an empty or
+ *     all-comment allow list refuses everyone, with a warning);
+ *   - its address already opened `rate` connections in the last second
+ *     (a token bucket per address, refilled at `rate` per second).
+ *
+ * The lists are text files with one address or CIDR range per line ("#"
+ * starts a comment). Both are compiled into one CidrTrie, published
+ * through an atomic pointer: a lookup takes no lock, and a background
+ * thread that sees either file change builds a new trie off to the side
+ * and swaps it in. A file that fails to parse on reload is reported and
+ * the rules in force are kept.
+ *
+ * Usage:
+ *   AdmissionOptions options;
+ *   options.deny_file = "deny.txt";
+ *   Admission admission(options);     // throws on a bad list
+ *   admission.start();                // follow edits to the files
+ *   server.set_admission(&admission);
+ */
+
+#include "cidr_trie.h"
+#include "compat.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+/// Admission configuration.
+struct AdmissionOptions {
+  std::string allow_file; ///< Only these addresses may connect ("" = all)
+  std::string deny_file;  ///< These may not ("" = none)
+  unsigned rate = 0;      ///< Connections per second per address (0 = any)
+
+  /// @return true if any check is configured.
+  bool enabled() const {
+    return !allow_file.empty() || !deny_file.empty() || rate != 0;
+  }
+};
+
+/**
+ * @class Admission
+ * @brief Compiled address rules plus per-address connection buckets.
+ *
+ * Thread-safe: check() may be called from several accept threads.
+ */
+class Admission {
+public:
+  /// How often the list files are checked for changes.
+  static constexpr unsigned POLL_MS = 1000;
+
+  enum class Verdict {
+    Admit,
+    Denied,     ///< By the allow / deny lists
+    RateLimited ///< Too many connections from the address
+  };
+
+  /**
+   * @brief Load the lists named in @p options.
+   * @throws std::runtime_error if a list cannot be read or parsed.
+   */
+  explicit Admission(const AdmissionOptions &options);
+  ~Admission();
+
+  // Non-copyable (owns a thread)
+  Admission(const Admission &) = delete;
+  Admission &operator=(const Admission &) = delete;
+
+  /// Start following changes to the list files.
+  void start();
+  void stop();
+
+  /**
+   * @brief Decide on a connection from @p address (host byte order).
+   * Denied and rate-limited connections are counted in HubMetrics.
+   */
+  Verdict check(uint32_t address);
+
+  /// @return One line describing the rules in force.
+  std::string describe() const;
+
+private:
+  /// One compiled version of the lists; never changed once published.
+  struct Rules {
+    CidrTrie trie;
+    bool allow_only = false; ///< An allow list is given: deny by default
+    std::size_t allowed = 0; ///< Entries on the allow list
+    std::size_t denied = 0;  ///< Entries on the deny list
+  };
+
+  /// A list file as last seen, to notice edits.
+  struct Stamp {
+    uint64_t write_time = 0;
+    uint64_t size = 0;
+  };
+
+  /// Connections an address may still open, refilled over time.
+  struct Bucket {
+    double tokens = 0;
+    uint64_t updated_ns = 0;
+  };
+
+  AdmissionOptions options_;
+  std::atomic<const Rules *> rules_;
+  Stamp allow_stamp_; ///< (watcher thread only, after construction)
+  Stamp deny_stamp_;
+
+  Mutex buckets_mutex_;
+  std::unordered_map<uint32_t, Bucket> buckets_; ///< Guarded by mutex
+  uint64_t swept_ns_ = 0;                        ///< Guarded by mutex
+
+  std::atomic<bool> running_{false};
+  Thread thread_;
+
+  /// Build rules from both files. @throws std::runtime_error.
+  Rules *compile() const;
+
+  /// Add every entry of @p path to @p rules. @return Entries read.
+  static std::size_t load(const std::string &path, CidrTrie::Rule rule,
+                          Rules &rules);
+
+  /// @return @p path's size and last write time (zero if missing).
+  static Stamp stamp_of(const std::string &path);
+
+  /// Take a token for @p address. @return false if it has none left.
+  bool take_token(uint32_t address);
+
+  /// Reloads the lists when they change until stop().
+  void run();
+};
@@ -0,0 +1,139 @@
+#pragma once
+/**
+ * @file chat_frame.h
+ * @brief Binary chat frames: a fixed schema read in place, written in place.
+ *
+ * Every chat message the hub sends to clients is one frame laid out as
+ *
+ *   offset  field        type
+ *        0  kind         u8    CHAT_KIND (never 'C', so not "CMD:...")
+ *        1  flags        u8    CHAT_EDITED, ...
+ *        2  sender_len   u16
+ *        4  body_len     u32
+ *        8  seq          u64
+ *       16  hlc          u64   HLC stamp from the origin hub
+ *       24  parent       u64   thread root (0 = top level)
+ *       32  sender       sender_len bytes
+ *           body         body_len bytes
+ *
+ * in little-endian order, the byte order of every machine the hub and its
+ * clients run on, so reading a field is one bounds-checked load. The field
+ * list below is the schema: CHAT_FRAME_FIELDS generates the ChatView
+ * accessors and the offsets, so adding a field is one line there.
+ *
+ * encode_chat() builds a frame straight into a pooled buffer, wire header
+ * (native length prefix or WebSocket binary frame header) first. The
+ * SharedFrame's control block comes from a pool too, so a broadcast
+ * allocates nothing once the pools are warm. ChatView reads a
+ * received frame where it lies; sender() and body() point into it.
+ *
+ * Usage:
+ *   SharedFrame wire = encode_chat(WireProtocol::Native, entry);
+ *
+ *   ChatView view;
+ *   if (ChatView::parse(frame.data(), frame.size(), view)) {
+ *     uint64_t seq = view.seq();
+ *     std::string text = view.body().str();
+ *   }
+ */
+
+#include "hub_log.h"
+#include "socket_wrapper.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/// First byte of a chat frame.
+constexpr uint8_t CHAT_KIND = 0x01;
+
+// Flag bits
+constexpr uint8_t CHAT_EDITED = 0x01; ///< Text was replaced by its author
+
+/// X(type, name, offset) for each fixed-width field, in wire order.
+#define CHAT_FRAME_FIELDS(X)                                                   \
+  X(uint8_t, kind, 0)                                                          \
+  X(uint8_t, flags, 1)                                                         \
+  X(uint16_t, sender_len, 2)                                                   \
+  X(uint32_t, body_len, 4)                                                     \
+  X(uint64_t, seq, 8)                                                          \
+  X(uint64_t, hlc, 16)                                                         \
+  X(uint64_t, parent, 24)
+
+/// Bytes before the sender name.
+constexpr std::size_t CHAT_HEADER = 32;
+
+/// A run of bytes inside a frame (C++14 has no std::string_view).
+struct ByteRange {
+  const char *data = nullptr;
+  std::size_t size = 0;
+
+  std::string str() const { return std::string(data, size); }
+};
+
+/**
+ * @class ChatView
+ * @brief Read-only view of a chat frame in someone else's buffer.
+ *
+ * Holds a pointer, not a copy: the buffer must outlive the view.
+ */
+class ChatView {
+public:
+  /**
+   * @brief Point @p out at the chat frame in [data, data + size).
+   * @return false (leaving @p out alone) if it is not a whole chat frame.
+   */
+  static bool parse(const char *data, std::size_t size, ChatView &out) {
+    ChatView v(data, size);
+    if (size < CHAT_HEADER || v.kind() != CHAT_KIND ||
+        size - CHAT_HEADER !=
+            static_cast<std::size_t>(v.sender_len()) + v.body_len())
+      return false;
+    out = v;
+    return true;
+  }
+
+  ChatView() = default;
+
+#define CHAT_FRAME_GET(type, name, offset)                                     \
+  type name() const { return load<type>(offset); }
+  CHAT_FRAME_FIELDS(CHAT_FRAME_GET)
+#undef CHAT_FRAME_GET
+
+  ByteRange sender() const {
+    return ByteRange{data_ + CHAT_HEADER, sender_len()};
+  }
+
+  ByteRange body() const {
+    return ByteRange{data_ + CHAT_HEADER + sender_len(), body_len()};
+  }
+
+  bool edited() const { return (flags() & CHAT_EDITED) != 0; }
+
+private:
+  const char *data_ = nullptr;
+  std::size_t size_ = 0;
+
+  ChatView(const char *data, std::size_t size) : data_(data), size_(size) {}
+
+  /// @return The field at @p offset, or 0 past the end of the frame.
+  template <typename T> T load(std::size_t offset) const {
+    T v = 0;
+    if (offset + sizeof(T) <= size_) {
+      std::memcpy(&v, data_ + offset, sizeof(T));
+    }
+    return v;
+  }
+};
+
+/// @return Bytes the chat frame for @p entry takes (wire header excluded).
+std::size_t chat_size(const LogEntry &entry);
+
+/**
+ * @brief Encode @p entry as a chat frame ready to send over @p protocol.
+ *
+ * The frame is built in place in a buffer from a shared pool; the buffer
+ * goes back to the pool when the last recipient has sent it.
+ */
+SharedFrame encode_chat(WireProtocol protocol, const LogEntry &entry);
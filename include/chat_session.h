@@ -5,12 +5,32 @@
  *
  * Thread-safe: add() may be called from the receive thread while the main
  * thread reads history.
+ *
+ * The history is append-only and kept in fixed-capacity chunks: arrays of
+ * CHUNK slots, each constructed once, in place. A stored message is never
+ * moved or changed and nothing a reader touches is ever written again, so
+ * a reader only needs to know how many have been published (a release
+ * store after the message, an acquire load before it) and where the
+ * chunks are. snapshot() reads both without a lock (the chunk list under
+ * an EpochDomain guard), keeps the chunks alive by reference, and then
+ * formats at leisure: printing a long history never holds up add() on the
+ * receive path. Writers take a mutex only among themselves.
+ *
+ * Usage:
+ *   ChatSession session;
+ *   session.add(Message("Peer", "hi"));          // receive thread
+ *   ChatSession::Snapshot view = session.snapshot();
+ *   for (std::size_t i = 0; i < view.size(); ++i)
+ *     std::cout << view[i].format() << "\n";
  */
 
 #include "message.h"
 
 #include "compat.h"
 
+#include <atomic>
+#include <cstddef>
+#include <memory>
 #include <vector>
 
 /**
@@ -19,7 +39,65 @@
  */
 class ChatSession {
 public:
-  ChatSession() = default;
+  /// Messages per chunk.
+  static constexpr std::size_t CHUNK = 1024;
+
+private:
+  /// Up to CHUNK messages, constructed in place and never moved.
+  struct Chunk {
+    Chunk() = default;
+    ~Chunk() {
+      for (std::size_t i = size.load(); i != 0; --i) {
+        at(i - 1).~Message();
+      }
+    }
+    Chunk(const Chunk &) = delete;
+    Chunk &operator=(const Chunk &) = delete;
+
+    Message &at(std::size_t index) {
+      return reinterpret_cast<Message *>(slots)[index];
+    }
+    const Message &at(std::size_t index) const {
+      return reinterpret_cast<const Message *>(slots)[index];
+    }
+
+    alignas(Message) unsigned char slots[CHUNK * sizeof(Message)];
+    /// Slots constructed; stored (release) after each message
+    std::atomic<std::size_t> size{0};
+  };
+  using Chunks = std::vector<std::shared_ptr<const Chunk>>;
+
+public:
+  /**
+   * @class Snapshot
+   * @brief The history as it was when snapshot() was called.
+   *
+   * Holds its chunks by reference, so it stays valid (and unchanged) while
+   * the session goes on growing or is destroyed.
+   */
+  class Snapshot {
+  public:
+    /// @return Messages in the snapshot.
+    std::size_t size() const { return count_; }
+
+    /// @return Message @p index, oldest first (index < size()).
+    const Message &operator[](std::size_t index) const {
+      return chunks_[index / CHUNK]->at(index % CHUNK);
+    }
+
+  private:
+    friend class ChatSession;
+
+    Chunks chunks_;
+    std::size_t count_ = 0;
+  };
+
+  ChatSession();
+  ~ChatSession();
+
+  // Non-copyable (atomics)
+  ChatSession(const ChatSession &) = delete;
+  ChatSession &operator=(const ChatSession &) = delete;
 
   /**
    * @brief Add a message to the history (thread-safe).
@@ -27,9 +105,13 @@ public:
    */
   void add(const Message &msg);
 
+  /// @return A consistent view of the history, taken without locking.
+  Snapshot snapshot() const;
+
   /**
    * @brief Print all stored messages to stdout.
-   * Useful for showing history after reconnect or on startup.
+   * Useful for showing history after reconnect or on startup. Prints a
+   * snapshot: messages added meanwhile are stored but not shown.
    */
   void print_history() const;
 
@@ -37,6 +119,12 @@ public:
   std::size_t size() const;
 
 private:
-  mutable Mutex mutex_;
-  std::vector<Message> history_;
+  Mutex mutex_; ///< Serializes writers; readers never take it
+  Chunk *tail_ = nullptr; ///< Chunk being filled (guarded by mutex_)
+
+  /// Every chunk so far; replaced, never changed, once a chunk is added
+  std::atomic<const Chunks *> chunks_;
+
+  /// Messages readers may see; stored after the message (and its chunk)
+  std::atomic<std::size_t> published_{0};
 };
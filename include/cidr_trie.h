@@ -0,0 +1,100 @@
+#pragma once
+/**
+ * @file cidr_trie.h
+ * @brief IPv4 prefix rules with longest-prefix lookup (a Patricia trie).
+ *
+ * Each inserted prefix ("10.0.0.0/8") carries a rule. lookup() returns the
+ * rule of the longest prefix containing the address, so a narrow entry
+ * overrides a wide one ("allow 10.0.0.0/8, deny 10.0.5.0/24"). Chains of
+ * nodes with a single child are collapsed into one node holding the whole
+ * run of bits, so a lookup visits at most one node per prefix length that
+ * actually occurs, however many entries the trie holds.
+ *
+ * Nodes live in one vector and refer to each other by index. Once the trie
+ * is complete, pack() puts them in breadth-first order and, for large
+ * tries, builds a table indexed by an address's top 16 bits that skips the
+ * first levels (the dense ones, where every step would be a cache miss).
+ * Not thread-safe to build; once built, lookup() may run on any number of
+ * threads.
+ *
+ * Usage:
+ *   CidrTrie trie;
+ *   uint32_t net; unsigned bits;
+ *   if (CidrTrie::parse("192.168.1.0/24", net, bits))
+ *     trie.insert(net, bits, CidrTrie::Rule::Deny);
+ *   if (trie.lookup(address) == CidrTrie::Rule::Deny) ...
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @class CidrTrie
+ * @brief Path-compressed binary trie over IPv4 addresses (host order).
+ */
+class CidrTrie {
+public:
+  enum class Rule : uint8_t {
+    None,  ///< No prefix matches
+    Allow, ///< Longest match is on the allow list
+    Deny   ///< Longest match is on the deny list
+  };
+
+  CidrTrie();
+
+  /**
+   * @brief Add @p network / @p bits with @p rule. Host bits are ignored.
+   * The same prefix inserted as both Allow and Deny stays Deny.
+   */
+  void insert(uint32_t network, unsigned bits, Rule rule);
+
+  /// Nodes from which pack() adds the top-16-bit table (512 KB).
+  static constexpr std::size_t JUMP_NODES = 4096;
+
+  /**
+   * @brief Lay the nodes out for lookups: breadth first, so the levels
+   * every lookup visits share cache lines, plus the top-16-bit table for
+   * large tries. Call once when done inserting.
+   */
+  void pack();
+
+  /// @return The rule of the longest prefix containing @p address.
+  Rule lookup(uint32_t address) const;
+
+  /// @return Prefixes inserted (counting each distinct one once).
+  std::size_t size() const { return prefixes_; }
+
+  /**
+   * @brief Parse "a.b.c.d" (a /32) or "a.b.c.d/n".
+   * @return false if @p text is not one of those.
+   */
+  static bool parse(const std::string &text, uint32_t &network,
+                    unsigned &bits);
+
+private:
+  struct Node {
+    uint32_t key;         ///< Prefix bits (the rest zero)
+    uint8_t bits;         ///< Prefix length, 0–32
+    Rule rule;            ///< None for nodes that only join branches
+    uint32_t child[2];    ///< Next bit 0 / 1 (0 = none; the root is never
+                          ///< anyone's child)
+  };
+
+  /// Where a lookup for one top-16-bit value resumes.
+  struct Jump {
+    uint32_t next; ///< Node to go on from (0 = nothing longer matches)
+    Rule rule;     ///< Longest match within the first 16 bits
+  };
+
+  std::vector<Node> nodes_; ///< nodes_[0] is the root, 0.0.0.0/0
+  std::vector<Jump> jump_;  ///< By top 16 bits; empty unless packed large
+  std::size_t prefixes_ = 0;
+
+  /// Append a node. @return Its index.
+  uint32_t add_node(uint32_t key, unsigned bits, Rule rule);
+
+  /// Set @p node's rule to @p rule (Deny wins over Allow).
+  void set_rule(Node &node, Rule rule);
+};
@@ -3,13 +3,35 @@
  * @file client.h
  * @brief TCP client that connects to a remote server by IP and port.
  *
+ * Connection attempts are non-blocking and raced: every resolved address
+ * (and every fallback hub given to connect_any) gets its own attempt,
+ * started CONNECT_STAGGER_MS after the previous one or at once when the
+ * previous one fails. The first to complete wins and the rest are closed.
+ * The whole race is bounded by a deadline, so a wrong or stale address
+ * fails in seconds instead of the OS default of 20 s or more.
+ *
+ * The address that answered is remembered per endpoint and raced first,
+ * without a DNS lookup, on the next connect to the same endpoint.
+ *
  * Usage:
  *   Client cli;
  *   SocketWrapper conn = cli.connect_to("192.168.1.10", 54000);
  */
 
 #include "socket_wrapper.h"
+
+#include "compat.h"
+
+#include <cstdint>
+#include <map>
 #include <string>
+#include <vector>
+
+/// Default deadline for one connect_to / connect_any call.
+constexpr unsigned int DEFAULT_CONNECT_TIMEOUT_MS = 5000;
+
+/// Head start each attempt gets before the next one is launched.
+constexpr unsigned int CONNECT_STAGGER_MS = 250;
 
 /**
  * @class Client
@@ -17,13 +39,17 @@
  */
 class Client {
 public:
-    Client();
+    /// @param timeout_ms Deadline for each connect call.
+    explicit Client(unsigned int timeout_ms = DEFAULT_CONNECT_TIMEOUT_MS);
     ~Client() = default;
 
     // Non-copyable
     Client(const Client&) = delete;
     Client& operator=(const Client&) = delete;
 
+    /// Change the deadline for later connect calls.
+    void set_timeout(unsigned int timeout_ms) { timeout_ms_ = timeout_ms; }
+
     /**
      * @brief Connect to a remote server.
      * @param host IPv4 address or hostname of the server.
@@ -34,7 +60,42 @@ public:
     SocketWrapper connect_to(const std::string& host,
                              unsigned short port = DEFAULT_PORT);
 
+    /**
+     * @brief Race connections to several servers; the first to answer wins.
+     * @param endpoints "host[:port]" entries in order of preference.
+     * @param winner    If non-null, receives the entry that connected.
+     * @return A SocketWrapper for the established connection.
+     * @throws std::runtime_error if none connects before the deadline.
+     */
+    SocketWrapper connect_any(const std::vector<std::string>& endpoints,
+                              std::string* winner = nullptr);
+
 private:
+    /// One address being raced.
+    struct Attempt {
+        std::size_t endpoint;         ///< Index into the endpoint list
+        sockaddr_in addr;
+        SOCKET sock = INVALID_SOCKET;
+    };
+
     /// Initialise Winsock (called once in constructor).
     static void init_winsock();
+
+    /// Resolve @p endpoint and append its addresses to @p out.
+    static void resolve(const std::string& endpoint, std::size_t index,
+                        std::vector<Attempt>& out, std::string& error);
+
+    /**
+     * @brief Run attempts in order until one connects or @p deadline passes.
+     * @param won   Receives the index of the winning attempt.
+     * @param error Receives the last failure code if none connects.
+     * @return The connected (blocking) socket, or INVALID_SOCKET.
+     */
+    static SOCKET race(std::vector<Attempt>& attempts, uint64_t deadline,
+                       std::size_t& won, int& error);
+
+    unsigned int timeout_ms_;
+
+    mutable Mutex cache_mutex_;
+    std::map<std::string, sockaddr_in> last_good_; ///< Endpoint → address
 };
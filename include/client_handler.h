@@ -4,10 +4,25 @@
  * @brief Manages one connected client in the multi-PC chat room.
  *
  * Each accepted client connection gets its own ClientHandler, which owns
- * the socket and a background receive thread. When a message arrives it
- * invokes a broadcast callback so the Room can forward it to all other clients.
+ * the socket and either a background receive thread (Blocking mode) or a
+ * registration with a shared IoLoop (Poll / BusyPoll modes). When a message
+ * arrives it invokes a broadcast callback so the Room can forward it to all
+ * other clients.
+ *
+ * The socket's WireProtocol decides how frames are encoded and decoded:
+ * native clients and browsers (WebSocket) are handled alike.
+ *
+ * Sending never blocks the caller, so a client that stops reading cannot
+ * hold up a broadcast. Frames the socket will not take at once wait in the
+ * handler's OutboundQueue and are written as it drains: by the IO thread
+ * when the loop sees the socket writable (Poll / BusyPoll), by completed
+ * overlapped sends (Completion), or by a writer thread started for the
+ * first backlog (Blocking).
  */
 
+#include "fiber.h"
+#include "io_loop.h"
+#include "outbound_queue.h"
 #include "socket_wrapper.h"
 
 #include "compat.h"
@@ -16,14 +31,15 @@
 #include <cstdint>
 #include <functional>
 #include <string>
+#include <vector>
 
 /**
  * @class ClientHandler
  * @brief Owns one peer connection and drives its receive loop.
  *
- * Non-copyable, non-movable (owns a live thread).
+ * Non-copyable, non-movable (owns a live thread or IoLoop registration).
  */
-class ClientHandler {
+class ClientHandler : public IoSource {
 public:
   /**
    * @brief Callback invoked on the receive thread when a message arrives.
@@ -42,43 +58,119 @@ public:
   using DisconnectCallback = std::function<void(uint32_t handler_id)>;
 
   /**
-   * @brief Construct and immediately start the receive thread.
-   * @param id       Unique identifier assigned by the Room.
-   * @param name     Human-readable name (peer IP or nickname).
-   * @param socket   Moved-in connected socket.
-   * @param on_msg   Called when a message is received.
-   * @param on_disc  Called when the peer disconnects.
+   * @brief Conversation run before the client joins the room.
+   *
+   * Written as straight-line code with read_frame() / write_frame(). In
+   * Blocking mode it runs on the handler's receive thread; with an IoLoop
+   * it runs on a pooled Fiber and suspends whenever the socket is not ready.
+   *
+   * @return The client's display name, or an empty string to disconnect.
+   */
+  using Handshake = std::function<std::string(ClientHandler &conn)>;
+
+  /**
+   * @brief Construct and immediately start receiving.
+   * @param id        Unique identifier assigned by the Room.
+   * @param name      Human-readable name (peer IP or nickname).
+   * @param socket    Moved-in connected socket.
+   * @param on_msg    Called when a message is received.
+   * @param on_disc   Called when the peer disconnects.
+   * @param loop      Shared IO loop to register with, or nullptr to spawn a
+   *                  dedicated blocking receive thread.
+   * @param handshake Optional conversation to run first; the handler is not
+   *                  active (receives no broadcasts) until it succeeds.
+   * @param out_budget Hub-wide memory for queued frames (see OutboundQueue).
    */
   ClientHandler(uint32_t id, std::string name, SocketWrapper socket,
-                MessageCallback on_msg, DisconnectCallback on_disc);
+                MessageCallback on_msg, DisconnectCallback on_disc,
+                IoLoop *loop = nullptr, Handshake handshake = nullptr,
+                uint64_t out_budget = OutboundQueue::DEFAULT_BUDGET);
 
-  ~ClientHandler();
+  ~ClientHandler() override;
 
   // Non-copyable, non-movable
   ClientHandler(const ClientHandler &) = delete;
   ClientHandler &operator=(const ClientHandler &) = delete;
 
   /// Send a message to this client (thread-safe).
-  void send(const std::string &message);
+  void send(const std::string &message, SendClass cls = SendClass::Chat);
+
+  /**
+   * @brief Send a pre-encoded frame (thread-safe, never blocks).
+   *
+   * Lets the Room encode a broadcast once for all recipients. If nothing is
+   * queued the frame is written at once, as far as the socket takes it;
+   * otherwise it waits in its class's lane (see OutboundQueue). In
+   * Completion mode it goes out in a gathered overlapped send.
+   */
+  void send_frame(const SharedFrame &frame, SendClass cls = SendClass::Chat);
 
   /// @return Unique ID of this handler.
   uint32_t id() const { return id_; }
 
+  /// @return How this client's frames are encoded.
+  WireProtocol protocol() const { return protocol_; }
+
   /// @return Display name (peer IP / nickname).
   const std::string &name() const { return name_; }
 
-  /// @return true if the receive thread is still running.
-  bool is_active() const { return running_.load(); }
+  /// @return true once the handshake succeeded and while still connected.
+  bool is_active() const { return running_.load() && joined_.load(); }
+
+  /// @return true if the handshake succeeded (even if since disconnected).
+  bool joined() const { return joined_.load(); }
+
+  // ── Handshake API (only valid inside the Handshake callback)
+
+  /**
+   * @brief Read the next frame, suspending the handshake until it arrives.
+   * @return The frame, or an empty string if the peer disconnected.
+   */
+  std::string read_frame();
+
+  /// Write one frame; suspends (never blocks the IO thread) if needed.
+  void write_frame(const std::string &message);
+
+  /// Write a binary payload with the same framing.
+  void write_binary(const char *data, uint32_t len);
+
+  /// Write bytes as they are, unframed (e.g. an HTTP upgrade response).
+  void write_raw(const std::string &bytes);
 
   /// Request the receive thread to stop (does not block).
   void stop();
 
+  // IoSource (driven by the IoLoop in Poll / BusyPoll modes)
+  SOCKET io_handle() const override { return socket_.handle(); }
+  Status on_readable(const ReadBudget &budget) override;
+  bool wants_write() const override;
+  void on_writable() override;
+  void on_closed() override;
+  void on_send_complete(bool ok) override;
+
 private:
   uint32_t id_;
   std::string name_;
   SocketWrapper socket_;
+  WireProtocol protocol_;
+  IoLoop *loop_;
   std::atomic<bool> running_{false};
-  Mutex send_mutex_;
+  std::atomic<bool> joined_{false};
+
+  Handshake handshake_;
+  Fiber *fiber_ = nullptr;     ///< Runs handshake_ in IoLoop modes
+  std::string handshake_name_; ///< Result of handshake_
+
+  Mutex send_mutex_;           ///< Guards the send state below
+  bool send_closed_ = false;   ///< stop() ran; drop further frames
+  bool send_in_flight_ = false; ///< Completion mode: a WSASend is pending
+  OutboundQueue outq_;         ///< Frames not yet written or posted
+  std::vector<SharedFrame> unsent_; ///< Taken from outq_, not yet written
+  std::size_t unsent_next_ = 0;     ///< First frame of unsent_ left
+  std::size_t unsent_offset_ = 0;   ///< Bytes of it already written
+  std::atomic<bool> backlog_{false}; ///< Frames wait for the socket
+  CondVar send_cv_;            ///< Blocking mode: wakes send_thread_
+  Thread send_thread_;         ///< Blocking mode: writes the backlog
 
   MessageCallback on_message_;
   DisconnectCallback on_disconnect_;
@@ -86,4 +178,29 @@ private:
 
   /// Background receive loop entry point.
   void receive_loop();
+
+  /// Mark inactive and notify the Room (exactly once per handler).
+  void notify_disconnect();
+
+  /// Write or post queued frames until the socket is full or the queue
+  /// empty (send_mutex_ held).
+  void flush_queued();
+
+  /// Completion mode part of flush_queued(): post gathered batches.
+  void post_queued();
+
+  /// Have the backlog written once the socket drains (send_mutex_ held).
+  void wake_writer();
+
+  /// Blocking mode: writer thread entry point.
+  void send_loop();
+
+  /// Shared by write_frame() / write_binary().
+  void write_encoded(const SharedFrame &frame);
+
+  /// Adopt the handshake result. @return false to disconnect.
+  bool finish_handshake(std::string name);
+
+  /// Let a suspended handshake unwind, then recycle its fiber.
+  void cancel_handshake();
 };
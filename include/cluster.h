@@ -0,0 +1,192 @@
+#pragma once
+/**
+ * @file cluster.h
+ * @brief Leader election and log replication between a hub and its standbys.
+ *
+ * Every member of a cluster runs the same binary. Exactly one is the leader
+ * and serves clients; the others are standbys that copy the leader's
+ * HubLog and wait. Members announce themselves with UDP heartbeats on the
+ * cluster port every 100 ms:
+ *
+ *   HEARTBEAT { u64 node_id, u64 term, u8 role, u32 priority,
+ *               u64 last_seq, u16 port, str client_endpoint }
+ *
+ * When no leader has been heard for the lease (500 ms), the live member
+ * with the most complete log (then highest priority, then id) promotes
+ * itself under a new term. If two leaders ever meet, the older term (or
+ * smaller id) steps down. Standbys stream the log over TCP on the same
+ * port:
+ *
+ *   FOLLOW { u64 node_id, u64 after_seq }   standby → leader, once
+ *   ENTRY  { u64 seq, u64 hlc, u64 parent, str sender, str text }
+ *                                           leader → standby, repeated
+ *   UPDATE { str frame }                    leader → standby, an edit or
+ *                                           delete (see message_ops.h)
+ *
+ * After FOLLOW the leader first sends an UPDATE for every edited or
+ * deleted message in its log, then new entries and every later update as
+ * it happens; a standby holds an update that overtakes its entry until
+ * the entry arrives. Each standby's stream is queued (see
+ * link_writer.h), so a slow standby never holds up the leader.
+ *
+ * Clients are told every member's client endpoint ("CMD:HUBS:a,b,...") and
+ * reconnect to whichever member is leader when theirs disappears.
+ *
+ * Usage:
+ *   ClusterOptions co;
+ *   co.port = 54100;
+ *   co.members.push_back("192.168.1.21:54100");
+ *   co.advertise = "192.168.1.20:54000";
+ *   HubCluster cluster(room, co);
+ *   cluster.set_on_role_change([](HubRole r) { ... });
+ *   cluster.start();
+ */
+
+#include "client.h"
+#include "room.h"
+#include "server.h"
+
+#include "compat.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// Whether this hub currently serves clients.
+enum class HubRole { Standby, Leader };
+
+/// @return "standby" or "leader".
+const char *hub_role_name(HubRole role);
+
+/// Failover configuration.
+struct ClusterOptions {
+  unsigned short port = 0;          ///< UDP heartbeats + TCP log stream
+  std::vector<std::string> members; ///< Other members, as "host[:port]"
+  unsigned priority = 0;            ///< Preferred leader when logs tie
+  std::string advertise;            ///< "host:port" clients reach us on
+
+  /// @return true if this hub is part of a failover cluster.
+  bool enabled() const { return port != 0; }
+};
+
+/**
+ * @class HubCluster
+ * @brief Runs the election and keeps the Room's HubLog replicated.
+ *
+ * Thread-safe. The role callback runs on the cluster's heartbeat thread.
+ */
+class HubCluster {
+public:
+  using RoleCallback = std::function<void(HubRole role)>;
+
+  /// Missed-heartbeat window after which a member is considered gone.
+  static constexpr unsigned LEASE_MS = 500;
+  static constexpr unsigned HEARTBEAT_MS = 100;
+
+  /**
+   * @param room    Local room whose log is replicated; must outlive this.
+   * @param options Cluster port, members and advertised client endpoint.
+   */
+  HubCluster(Room &room, const ClusterOptions &options);
+  ~HubCluster();
+
+  // Non-copyable, non-movable (owns live threads)
+  HubCluster(const HubCluster &) = delete;
+  HubCluster &operator=(const HubCluster &) = delete;
+
+  /// Register the callback fired on promotion / demotion (before start()).
+  void set_on_role_change(RoleCallback cb);
+
+  /// Open the cluster port and join the election as a standby.
+  /// @throws std::runtime_error if the port cannot be bound.
+  void start();
+
+  /// Leave the cluster and stop all threads.
+  void stop();
+
+  /// @return Current role.
+  HubRole role() const { return role_.load(); }
+
+  /// @return Current election term.
+  uint64_t term() const { return term_.load(); }
+
+  /// @return This member's id (random per process start).
+  uint64_t node_id() const { return node_id_; }
+
+  /// @return Client endpoints of all live members, leader first.
+  std::string client_endpoints() const;
+
+  /// @return One-line status for the /stats command.
+  std::string describe() const;
+
+private:
+  class ReplicaLink;
+
+  /// Room update tap: pass @p frame on to every standby.
+  void on_update(const std::string &frame);
+
+  /// What we last heard from another member.
+  struct Member {
+    uint64_t heard_ns = 0;
+    uint64_t term = 0;
+    HubRole role = HubRole::Standby;
+    unsigned priority = 0;
+    uint64_t last_seq = 0;
+    std::string control; ///< "ip:port" of its log stream
+    std::string client;  ///< Advertised client endpoint
+  };
+
+  Room &room_;
+  ClusterOptions options_;
+  uint64_t node_id_;
+  RoleCallback on_role_change_;
+
+  std::atomic<bool> running_{false};
+  std::atomic<HubRole> role_{HubRole::Standby};
+  std::atomic<uint64_t> term_{0};
+  uint64_t leader_seen_ns_ = 0; ///< Heartbeat thread only
+
+  Client client_;    ///< Also initialises Winsock
+  SOCKET udp_ = INVALID_SOCKET;
+  std::vector<sockaddr_in> targets_;
+  std::unique_ptr<Server> log_server_;
+  Thread heartbeat_thread_;
+  Thread follow_thread_;
+
+  mutable Mutex mutex_; ///< Guards everything below
+  std::unordered_map<uint64_t, Member> members_;
+  uint64_t leader_id_ = 0;        ///< 0 = none known
+  std::string leader_control_;    ///< Where standbys stream from
+  std::string hubs_sent_;         ///< Last CMD:HUBS list sent to clients
+  SocketWrapper *follow_sock_ = nullptr;
+  std::vector<std::unique_ptr<ReplicaLink>> replicas_;
+  std::vector<std::unique_ptr<ReplicaLink>> retired_;
+
+  /// Send heartbeats, read peers' and run the election.
+  void heartbeat_loop();
+  void send_heartbeat();
+  void receive_heartbeats(unsigned wait_ms);
+  void elect();
+
+  /// Switch role, notify the callback and drop stale connections.
+  void set_role(HubRole role);
+
+  /// Standby side: stream the leader's log into the room's HubLog.
+  void follow_loop();
+
+  /// Leader side: accept a standby's log stream.
+  void add_replica(SocketWrapper socket);
+
+  /// A replica thread ended: retire it. Replica thread only.
+  void replica_closed(ReplicaLink *link);
+
+  /// Destroy retired replica links (never from a replica thread).
+  void reap_retired();
+
+  /// Tell clients about membership changes (leader only).
+  void announce_hubs();
+};
@@ -3,9 +3,9 @@
  * @file compat.h
  * @brief Compatibility layer for MinGW g++ 6.3.0 (win32 threading model).
  *
- * Provides Thread, Mutex, and LockGuard as replacements for std::thread,
- * std::mutex, and std::lock_guard which are unavailable when MinGW is
- * built with --threads=win32.
+ * Provides Thread, Mutex, LockGuard and CondVar as replacements for
+ * std::thread, std::mutex, std::lock_guard and std::condition_variable,
+ * which are unavailable when MinGW is built with --threads=win32.
  *
  * Also provides a fallback inet_ntop for older MinGW ws2tcpip.h.
  */
@@ -19,6 +19,7 @@
 #include <ws2tcpip.h>
 
 
+#include <cstdint>
 #include <cstring>
 #include <functional>
 
@@ -65,6 +66,11 @@ public:
 
   bool joinable() const { return handle_ != nullptr; }
 
+  /// @return true when called from the thread this object represents.
+  bool is_current() const {
+    return handle_ != nullptr && id_ == GetCurrentThreadId();
+  }
+
   void join() {
     if (handle_) {
       WaitForSingleObject(handle_, INFINITE);
@@ -99,6 +105,7 @@ public:
   void unlock() { LeaveCriticalSection(&cs_); }
 
 private:
+  friend class CondVar;
   CRITICAL_SECTION cs_;
 };
 
@@ -116,6 +123,47 @@ private:
   M &mutex_;
 };
 
+// ── CondVar (replaces std::condition_variable) ─────────────────────
+
+class CondVar {
+public:
+  CondVar() { InitializeConditionVariable(&cv_); }
+
+  CondVar(const CondVar &) = delete;
+  CondVar &operator=(const CondVar &) = delete;
+
+  /// Release @p m (held by the caller), wait, and re-acquire it.
+  /// @return false if @p timeout_ms elapsed without a notification.
+  bool wait_for(Mutex &m, DWORD timeout_ms) {
+    return SleepConditionVariableCS(&cv_, &m.cs_, timeout_ms) != 0;
+  }
+
+  void notify_all() { WakeAllConditionVariable(&cv_); }
+
+private:
+  CONDITION_VARIABLE cv_;
+};
+
+// ── Timing / spinning helpers ──────────────────────────────────────
+
+/// Monotonic timestamp in nanoseconds (QueryPerformanceCounter based).
+inline uint64_t monotonic_ns() {
+  static const uint64_t freq = [] {
+    LARGE_INTEGER f;
+    QueryPerformanceFrequency(&f);
+    return static_cast<uint64_t>(f.QuadPart);
+  }();
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  uint64_t ticks = static_cast<uint64_t>(now.QuadPart);
+  // Split to avoid overflowing ticks * 1e9
+  return (ticks / freq) * 1000000000ull +
+         (ticks % freq) * 1000000000ull / freq;
+}
+
+/// Hint to the CPU that we are in a spin-wait loop (PAUSE on x86).
+inline void cpu_relax() { YieldProcessor(); }
+
 // ── inet_ntop fallback ─────────────────────────────────────────────
 
 #ifndef COMPAT_INET_NTOP_DEFINED
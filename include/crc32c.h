@@ -0,0 +1,22 @@
+#pragma once
+/**
+ * @file crc32c.h
+ * @brief CRC-32C (Castagnoli) checksums for on-disk records.
+ *
+ * Uses the SSE4.2 CRC32 instruction when the CPU has it (8 bytes per
+ * instruction) and a table otherwise; both give the same result, so files
+ * move freely between machines.
+ *
+ * Usage:
+ *   uint32_t crc = crc32c(data.data(), data.size());
+ *   crc = crc32c(more, more_len, crc);   // continue over several pieces
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Checksum @p len bytes at @p data.
+ * @param crc Result of a previous call to continue from (0 to start).
+ */
+uint32_t crc32c(const void *data, std::size_t len, uint32_t crc = 0);
@@ -0,0 +1,133 @@
+#pragma once
+/**
+ * @file epoch.h
+ * @brief Epoch-based reclamation for data read without locks.
+ *
+ * Readers wrap their access in an EpochDomain::Guard, which announces the
+ * current epoch in a slot of its own (a cache line no other reader
+ * writes). Writers swap in a new version of the data, then call advance()
+ * for a stamp, or retire() a function that frees the old version. Anything
+ * unlinked before a stamp was taken may be freed once no guard that
+ * announced an epoch at or below the stamp is still open: every later
+ * reader can only have seen the new version.
+ *
+ * Unlike sharing the data through shared_ptr, readers never write to a
+ * line that other threads write to, so fan-out over the roster does not
+ * bounce a reference count between cores. The cost moves to the writer,
+ * which frees late and scans the slots (joins and leaves, not messages).
+ *
+ * Guards are meant to be short: one open guard holds back everything
+ * retired after it was opened. Guards may nest, and a guard may be closed
+ * on another thread than the one it was opened on (it belongs to a slot,
+ * not a thread).
+ *
+ * Usage:
+ *   {
+ *     EpochDomain::Guard guard;
+ *     const Roster *r = roster.load();   // safe until the guard closes
+ *     for (...) send(r->members[i]);
+ *   }
+ *   const Roster *old = roster.exchange(fresh);
+ *   EpochDomain::instance().retire([old] { delete old; });
+ */
+
+#include "compat.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+/**
+ * @class EpochDomain
+ * @brief Global epoch, reader slots and a list of deferred frees.
+ *
+ * Thread-safe.
+ */
+class EpochDomain {
+public:
+  /// Guards that can be open at once; more wait for a slot to free up.
+  static constexpr std::size_t SLOTS = 256;
+
+  /**
+   * @class Guard
+   * @brief Keeps what a reader loads while it is open from being freed.
+   */
+  class Guard {
+  public:
+    explicit Guard(EpochDomain &domain = EpochDomain::instance());
+    ~Guard();
+
+    Guard(const Guard &) = delete;
+    Guard &operator=(const Guard &) = delete;
+
+  private:
+    EpochDomain &domain_;
+    std::size_t slot_;
+  };
+
+  EpochDomain();
+
+  // Non-copyable (atomics)
+  EpochDomain(const EpochDomain &) = delete;
+  EpochDomain &operator=(const EpochDomain &) = delete;
+
+  /// @return The process-wide domain (never destroyed).
+  static EpochDomain &instance();
+
+  /**
+   * @brief Start a new epoch. Call after unlinking data from every shared
+   * pointer to it.
+   * @return A stamp for reclaimable().
+   */
+  uint64_t advance();
+
+  /// @return true if nothing unlinked before @p stamp can still be read.
+  bool reclaimable(uint64_t stamp) const;
+
+  /// Wait until everything unlinked so far is reclaimable. Must not be
+  /// called with a guard open on this thread.
+  void synchronize();
+
+  /**
+   * @brief Run @p reclaim once nothing unlinked so far can still be read.
+   *
+   * Runs on whichever thread collects next (possibly this one, now), so it
+   * must only free memory, not take locks or join threads.
+   */
+  void retire(std::function<void()> reclaim);
+
+  /// Run the retired functions that are due. @return How many ran.
+  std::size_t collect();
+
+  /// @return Retired functions not run yet.
+  std::size_t pending() const;
+
+private:
+  /// One reader's announced epoch (0 = no guard), alone on a cache line.
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> epoch{0};
+  };
+
+  struct Retired {
+    uint64_t stamp;
+    std::function<void()> reclaim;
+  };
+
+  Slot slots_[SLOTS];
+  std::atomic<uint64_t> epoch_{1};
+
+  mutable Mutex mutex_;
+  std::deque<Retired> retired_; ///< In stamp order (guarded by mutex_)
+
+  /// Claim a free slot and announce the current epoch in it.
+  std::size_t enter();
+
+  /// Release @p slot.
+  void leave(std::size_t slot);
+
+  /// @return The lowest epoch announced by an open guard (UINT64_MAX if
+  ///         none is open).
+  uint64_t oldest() const;
+};
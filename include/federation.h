@@ -0,0 +1,142 @@
+#pragma once
+/**
+ * @file federation.h
+ * @brief Hub-to-hub links that bridge one Room across several servers.
+ *
+ * Every hub keeps serving its own clients. Messages that originate locally
+ * are also sent to each peer hub, tagged with the origin hub's id and a
+ * per-origin sequence number. A hub that receives a peer message delivers
+ * it to its local clients and forwards it to its other peers; the
+ * (origin, seq) pair is checked against a SeqWindow first, so every
+ * message is delivered and forwarded at most once even in a mesh or ring.
+ *
+ * Each link has its own writer thread: relaying only queues the frame, so
+ * a slow peer never holds up the local fan-out or the other links. A peer
+ * more than 64 MB behind is unlinked.
+ *
+ * Links use their own port and a binary protocol (see wire.h):
+ *   HELLO  { u64 hub_id, str name }
+ *   MSG    { u64 origin, u64 seq, u64 origin_ns, u64 hlc, str sender,
+ *            str text }
+ *
+ * hlc is the origin hub's hybrid logical clock stamp. Receiving hubs keep
+ * it on the message and merge it into their own clock, so stamps order
+ * messages consistently with causality across hubs.
+ *
+ * Usage:
+ *   FederationOptions fo;
+ *   fo.port = DEFAULT_FEDERATION_PORT;
+ *   fo.peers.push_back("192.168.1.20:54001");
+ *   Federation fed(room, fo);
+ *   fed.start();
+ *   ...
+ *   fed.stop();
+ */
+
+#include "room.h"
+#include "seq_window.h"
+#include "server.h"
+#include "socket_wrapper.h"
+
+#include "compat.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// Default TCP port for hub-to-hub links.
+constexpr unsigned short DEFAULT_FEDERATION_PORT = DEFAULT_PORT + 1;
+
+/// Hub-to-hub configuration.
+struct FederationOptions {
+  unsigned short port = 0;        ///< Port to accept peer hubs on (0 = none)
+  std::vector<std::string> peers; ///< Hubs to dial, as "host[:port]"
+  std::string name;               ///< Shown to peers (default: hub id)
+
+  /// @return true if this hub takes part in a federation at all.
+  bool enabled() const { return port != 0 || !peers.empty(); }
+};
+
+/**
+ * @class Federation
+ * @brief Owns the peer links of one hub and relays messages over them.
+ *
+ * Thread-safe: publish() may be called from any thread.
+ */
+class Federation {
+public:
+  /**
+   * @brief Prepare (but do not start) federation for @p room.
+   * @param room    Local room; must outlive this object.
+   * @param options Listen port and peers to dial.
+   */
+  Federation(Room &room, const FederationOptions &options);
+  ~Federation();
+
+  // Non-copyable, non-movable (owns live threads)
+  Federation(const Federation &) = delete;
+  Federation &operator=(const Federation &) = delete;
+
+  /// Start listening / dialing and hook into the room's local messages.
+  void start();
+
+  /// Close all links and stop background threads. Blocks until they exit.
+  void stop();
+
+  /**
+   * @brief Send a locally originated message to every peer hub.
+   * @param entry The message as this hub logged it (sender, text, hlc).
+   */
+  void publish(const LogEntry &entry);
+
+  /// @return This hub's id (random per process start).
+  uint64_t hub_id() const { return hub_id_; }
+
+  /// @return Number of established peer links.
+  std::size_t peer_count() const;
+
+private:
+  class PeerLink;
+
+  Room &room_;
+  FederationOptions options_;
+  uint64_t hub_id_;
+  std::string name_;
+  std::atomic<uint64_t> next_seq_{1};
+  std::atomic<bool> running_{false};
+
+  std::unique_ptr<Server> listener_;
+  Thread dialer_thread_;
+
+  mutable Mutex mutex_; ///< Guards links_, retired_ and target_hub_
+  std::vector<std::shared_ptr<PeerLink>> links_; ///< relay() copies them
+  std::vector<std::shared_ptr<PeerLink>> retired_;
+  std::unordered_map<std::string, uint64_t> target_hub_; ///< dial → hub id
+
+  Mutex seen_mutex_;
+  std::unordered_map<uint64_t, SeqWindow> seen_; ///< Per origin hub
+
+  /// Background loop that (re)dials configured peers.
+  void dial_loop();
+
+  /// Take ownership of a connected socket and start its link thread.
+  void add_link(SocketWrapper socket, std::string peer, std::string target);
+
+  /// HELLO received: decide whether this link survives. Link thread only.
+  bool register_link(PeerLink *link);
+
+  /// A link's thread ended: retire it. Link thread only.
+  void link_closed(PeerLink *link);
+
+  /// Handle one MSG frame received on @p from.
+  void on_message(PeerLink *from, const std::string &frame);
+
+  /// Queue @p frame on every established link except @p except.
+  void relay(const SharedFrame &frame, const PeerLink *except);
+
+  /// Destroy retired links (never from a link thread).
+  void reap_retired();
+};
@@ -0,0 +1,105 @@
+#pragma once
+/**
+ * @file fiber.h
+ * @brief Pooled stackful coroutines (Win32 fibers) for connection logic.
+ *
+ * Lets code that reads like a blocking loop ("read a frame, answer, read the
+ * next frame") run on an IoLoop thread without blocking it. When the code
+ * would block, it calls Fiber::yield(); the IO thread resumes it once the
+ * socket is ready again. Fibers, and their stacks, are recycled through a
+ * FiberPool instead of being created per connection.
+ *
+ * Usage (on an IoLoop thread, which is already a fiber):
+ *   Fiber *f = FiberPool::instance().acquire([&] { run_handshake(); });
+ *   f->resume();                 // runs until the task yields or returns
+ *   ...                          // later, when the socket is readable:
+ *   f->resume();
+ *   if (f->finished()) FiberPool::instance().release(f);
+ */
+
+#include "compat.h"
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/**
+ * @class Fiber
+ * @brief One reusable stackful coroutine.
+ */
+class Fiber {
+public:
+  /// @return The pooled fiber running on this thread, or nullptr.
+  static Fiber *current();
+
+  /// Suspend the current fiber and return to whoever resumed it.
+  static void yield();
+
+  /**
+   * @brief Run the task until it yields or returns.
+   *
+   * The calling thread is converted to a fiber for the duration of the call
+   * if it is not one already, so this may be used from any thread (for
+   * example to let a cancelled task unwind from a destructor).
+   */
+  void resume();
+
+  /// @return true once the task has returned.
+  bool finished() const { return finished_; }
+
+  /// Set by a task that yielded until its socket becomes writable.
+  void set_waiting_for_write(bool waiting) { waiting_for_write_ = waiting; }
+
+  /// @return true if the task is suspended waiting to write.
+  bool waiting_for_write() const { return waiting_for_write_; }
+
+private:
+  friend class FiberPool;
+
+  explicit Fiber(std::size_t stack_size);
+  ~Fiber();
+
+  Fiber(const Fiber &) = delete;
+  Fiber &operator=(const Fiber &) = delete;
+
+  LPVOID handle_ = nullptr;
+  LPVOID caller_ = nullptr;
+  std::function<void()> task_;
+  bool finished_ = true;
+  bool waiting_for_write_ = false;
+
+  static void WINAPI entry(LPVOID param);
+};
+
+/**
+ * @class FiberPool
+ * @brief Process-wide free list of fibers (thread-safe).
+ */
+class FiberPool {
+public:
+  /// Stack reserved per fiber; only touched pages are committed.
+  static constexpr std::size_t STACK_SIZE = 256 * 1024;
+
+  /// Idle fibers kept for reuse; extra ones are deleted on release.
+  static constexpr std::size_t MAX_IDLE = 256;
+
+  /// @return The singleton instance.
+  static FiberPool &instance();
+
+  /**
+   * @brief Take an idle fiber (or create one) and give it @p task.
+   * @throws std::runtime_error if a new fiber cannot be created.
+   */
+  Fiber *acquire(std::function<void()> task);
+
+  /// Return a finished fiber to the pool.
+  void release(Fiber *fiber);
+
+  ~FiberPool();
+
+private:
+  FiberPool() = default;
+
+  Mutex mutex_;
+  std::vector<Fiber *> idle_;
+};
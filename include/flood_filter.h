@@ -0,0 +1,76 @@
+#pragma once
+/**
+ * @file flood_filter.h
+ * @brief Recognises a sender repeating the same line within a time window.
+ *
+ * A rotating pair of Bloom filters over (sender, text), where the sender
+ * is the connection's session key (see Room::session_key()), not a name
+ * anyone may take. Each half-window the older filter is cleared and
+ * becomes the current one; a line is a repeat if it is in either, so
+ * repeats are caught for at least half a window and at most a whole one
+ * after the previous copy. Every copy is recorded again, so a line resent
+ * steadily stays suppressed however long it goes on.
+ *
+ * Memory is fixed (two filters of BITS bits) and a check is one hash of
+ * the line plus HASHES atomic bit operations, whatever the traffic. There
+ * is no lock: IO threads on every shard check and record concurrently
+ * with fetch_or. A Bloom filter can only err one way, taking a new line
+ * for a repeat; at BITS per filter that stays around one in a million
+ * for up to ~7,000 distinct lines per half-window. While a filter is
+ * being cleared, lines are checked against the other one only.
+ *
+ * A filter's period works as a sequence lock: a check reads the period,
+ * touches the bits and reads the period again, and ignores a filter that
+ * was rotated in between, since its bits may have been half cleared.
+ *
+ * Usage:
+ *   FloodFilter repeats(10000);                 // 10 s window
+ *   if (repeats.repeated(author, "spam")) drop();
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @class FloodFilter
+ * @brief Lock-free, fixed-size duplicate detector with a sliding window.
+ *
+ * Thread-safe.
+ */
+class FloodFilter {
+public:
+  /// Bits per filter (128 KB each).
+  static constexpr std::size_t BITS = std::size_t{1} << 20;
+
+  /// Bits set per line.
+  static constexpr unsigned HASHES = 4;
+
+  /// @param window_ms How long a line counts as a repeat (at least 2).
+  explicit FloodFilter(unsigned window_ms);
+
+  // Non-copyable (atomics)
+  FloodFilter(const FloodFilter &) = delete;
+  FloodFilter &operator=(const FloodFilter &) = delete;
+
+  /**
+   * @brief Record @p text from @p sender (a session key).
+   * @return true if the same sender sent the same text within the window.
+   */
+  bool repeated(uint64_t sender, const std::string &text);
+
+private:
+  struct Generation {
+    /// Half-window this filter holds (CLEARING while it is wiped)
+    std::atomic<uint64_t> period{0};
+    std::atomic<uint64_t> words[BITS / 64];
+  };
+
+  uint64_t half_ns_;
+  Generation generations_[2];
+
+  /// Make @p generation the empty filter for @p period, unless another
+  /// thread is doing so already.
+  static void rotate(Generation &generation, uint64_t period);
+};
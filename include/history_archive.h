@@ -0,0 +1,149 @@
+#pragma once
+/**
+ * @file history_archive.h
+ * @brief Block-compressed, indexed archive of one sealed history segment.
+ *
+ * build() reads a sealed journal segment, folds edits and deletes of the
+ * segment's own messages into those messages, and writes the records in
+ * compressed blocks of about BLOCK_BYTES:
+ *
+ *   "LCARC01\n"
+ *   block*  { u32 packed_len, u32 raw_len, u32 crc32c(packed), packed }
+ *   index   { u64 first_seq, u64 offset, u32 packed_len, u32 raw_len }*
+ *   footer  { u64 index_offset, u64 last_seq, u32 blocks,
+ *             u32 crc32c(index), "LCARCEND" }
+ *
+ * A block decompresses (lz_block.h) to ordinary history records, so a
+ * lookup reads the small index once and then one block per message. The
+ * archive is written beside its final name and renamed into place once
+ * flushed, so a crash never leaves a half-written archive behind.
+ *
+ * Edits and deletes of archived messages that arrive after the segment
+ * was sealed stay as records in later segments.
+ *
+ * Usage:
+ *   ArchiveStats stats;
+ *   HistoryArchive::build(segment, archive, pace, stats);
+ *   HistoryArchive arc(archive);
+ *   LogEntry entry;
+ *   if (arc.get(42, entry)) { ... }
+ */
+
+#include "history_record.h"
+#include "hub_log.h"
+
+#include "compat.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/// What build() wrote.
+struct ArchiveStats {
+  uint64_t raw_bytes = 0;  ///< Segment size
+  uint64_t file_bytes = 0; ///< Archive size
+  uint64_t blocks = 0;
+  uint64_t records = 0; ///< Records written
+  uint64_t folded = 0;  ///< Edits and deletes folded into their messages
+};
+
+/**
+ * @class HistoryArchive
+ * @brief Reader for one archive; thread-safe.
+ */
+class HistoryArchive {
+public:
+  /// Uncompressed bytes per block.
+  static constexpr std::size_t BLOCK_BYTES = 64 * 1024;
+
+  /// Called after each block with the segment bytes consumed; return
+  /// false to abandon the build.
+  using Pace = std::function<bool(std::size_t)>;
+
+  /**
+   * @brief Open @p path and load its block index.
+   * @throws std::runtime_error if it is missing or damaged.
+   */
+  explicit HistoryArchive(const std::string &path);
+  ~HistoryArchive();
+
+  // Non-copyable (owns a file handle)
+  HistoryArchive(const HistoryArchive &) = delete;
+  HistoryArchive &operator=(const HistoryArchive &) = delete;
+
+  /**
+   * @brief Compress sealed segment @p segment into @p archive.
+   * @return false if the segment could not be read, the archive could not
+   *         be written, or @p pace gave up (nothing is left behind then).
+   */
+  static bool build(const std::string &segment, const std::string &archive,
+                    const Pace &pace, ArchiveStats &stats);
+
+  /// @return Oldest message in the archive (0 if none).
+  uint64_t first_seq() const {
+    return blocks_.empty() ? 0 : blocks_.front().first_seq;
+  }
+
+  /// @return Newest message in the archive (0 if none).
+  uint64_t last_seq() const { return last_seq_; }
+
+  /// @return Sum of the blocks' uncompressed sizes.
+  uint64_t raw_bytes() const { return raw_bytes_; }
+
+  /// @return Size of the archive file.
+  uint64_t file_bytes() const { return file_bytes_; }
+
+  /// @return Number of compressed blocks.
+  std::size_t blocks() const { return blocks_.size(); }
+
+  /**
+   * @brief Look up message @p seq (one block read and decompressed).
+   * @return false if it is not in this archive.
+   */
+  bool get(uint64_t seq, LogEntry &out);
+
+  /**
+   * @brief Replay every record from the block holding message @p seq to
+   * the end of the archive.
+   * @return false if a block was damaged (records before it were replayed).
+   */
+  bool read_from(uint64_t seq, const HistoryReplay &replay);
+
+  /// Replay every record in block @p i. @return false if it is damaged.
+  bool read_block(std::size_t i, const HistoryReplay &replay);
+
+  /// @return true if every block decompresses to intact records.
+  bool verify();
+
+private:
+  struct Block {
+    /// First message in it; the next one if it holds only edits and
+    /// deletes, so the index stays sorted
+    uint64_t first_seq = 0;
+    uint64_t offset = 0;
+    uint32_t packed_len = 0;
+    uint32_t raw_len = 0;
+  };
+
+  std::string path_;
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  Mutex mutex_; ///< Serialises reads of file_
+  std::vector<Block> blocks_;
+  uint64_t last_seq_ = 0;
+  uint64_t raw_bytes_ = 0;
+  uint64_t file_bytes_ = 0;
+
+  /// @return Index of the first block that may hold message @p seq.
+  std::size_t locate(uint64_t seq) const;
+
+  /// Read and decompress block @p i into @p raw. @return false if damaged.
+  bool load(std::size_t i, std::string &raw);
+
+  /// Call @p visit for each record in @p raw; stop when it returns false.
+  /// @return false if a record was damaged.
+  static bool each_record(
+      const std::string &raw,
+      const std::function<bool(LogChange, const LogEntry &)> &visit);
+};
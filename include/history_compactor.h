@@ -0,0 +1,67 @@
+#pragma once
+/**
+ * @file history_compactor.h
+ * @brief Background archiving of sealed history segments.
+ *
+ * HistoryFile seals its journal into numbered segments as it grows. The
+ * compactor picks each sealed segment up, builds its compressed archive
+ * (see history_archive.h), checks every block of the result and times a
+ * few random lookups, then deletes the segment.
+ *
+ * It must never slow the live path down, so it runs at idle thread
+ * priority, reads at most RATE_BYTES_PER_SEC, and handles one segment at
+ * a time. Archive sizes and lookup times show up in /stats.
+ *
+ * Usage:
+ *   HistoryCompactor compactor("chat.history");
+ *   compactor.start();
+ *   ...
+ *   compactor.stop();   // abandons a build in progress
+ */
+
+#include "compat.h"
+
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include <string>
+
+/**
+ * @class HistoryCompactor
+ * @brief Turns sealed segments of one journal into archives.
+ */
+class HistoryCompactor {
+public:
+  /// How often to look for newly sealed segments.
+  static constexpr unsigned POLL_MS = 2000;
+
+  /// Segment bytes read per second, at most.
+  static constexpr uint64_t RATE_BYTES_PER_SEC = 16ull << 20;
+
+  /// Random lookups timed on each new archive.
+  static constexpr unsigned SEEK_SAMPLES = 8;
+
+  /// @param path The journal's path (as given to HistoryFile).
+  explicit HistoryCompactor(const std::string &path);
+  ~HistoryCompactor();
+
+  // Non-copyable (owns a thread)
+  HistoryCompactor(const HistoryCompactor &) = delete;
+  HistoryCompactor &operator=(const HistoryCompactor &) = delete;
+
+  void start();
+  void stop();
+
+private:
+  std::string path_;
+  std::atomic<bool> running_{false};
+  Thread thread_;
+  unsigned next_ = 1; ///< Lowest segment not yet archived (thread only)
+  std::mt19937_64 rng_; ///< Picks the timed lookups (thread only)
+
+  /// Archive segment @p n. @return false if stopped part way.
+  bool archive(unsigned n);
+
+  /// Archives segments as they appear until stop().
+  void run();
+};
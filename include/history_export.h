@@ -0,0 +1,79 @@
+#pragma once
+/**
+ * @file history_export.h
+ * @brief Streams a hub's on-disk history out as JSON Lines or CSV.
+ *
+ * Reads every archive, sealed segment and the live journal of a history
+ * path (see history_file.h), oldest first, and writes one line per
+ * recorded change:
+ *
+ *   {"seq":7,"time":"2026-10-18T09:30:00.125Z","hlc":...,"parent":0,
+ *    "op":"message","sender":"ana","text":"hi","edited":false,
+ *    "deleted":false}
+ *
+ *   seq,time,hlc,parent,op,sender,text,edited,deleted      (CSV, RFC 4180)
+ *
+ * op is "message", "edit" or "delete". Archives already carry edits of
+ * their own messages folded in; later edits follow as their own lines.
+ *
+ * Nothing is held in memory beyond one archive block and two output
+ * buffers. Segments and the journal are memory-mapped and prefetched
+ * ahead of the reader; text is scanned 16 bytes at a time for characters
+ * that need escaping, so plain text is copied in bulk. A second thread
+ * writes one buffer while the next is filled.
+ *
+ * Safe to run against the history of a running hub: what is on disk when
+ * the export starts is exported, up to the last complete record.
+ *
+ * Usage:
+ *   HistoryExport exporter("chat.history", ExportFormat::JsonLines);
+ *   ExportStats stats = exporter.write("audit.jsonl");
+ */
+
+#include "history_record.h"
+#include "hub_log.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// Output format of HistoryExport.
+enum class ExportFormat { JsonLines, Csv };
+
+/// Parse "jsonl" / "json" / "csv". @return false if unknown.
+bool parse_export_format(const std::string &name, ExportFormat &format);
+
+/// What write() did.
+struct ExportStats {
+  uint64_t records = 0;     ///< Lines written (excluding a CSV header)
+  uint64_t files = 0;       ///< Archives, segments and journal read
+  uint64_t input_bytes = 0; ///< Size of those files
+  uint64_t output_bytes = 0;
+  uint64_t elapsed_ns = 0;
+};
+
+/**
+ * @class HistoryExport
+ * @brief One-shot exporter for one history path.
+ */
+class HistoryExport {
+public:
+  /// Size of each output buffer handed to the writer thread.
+  static constexpr std::size_t OUT_BUFFER = 4 << 20;
+
+  /// How far ahead of the reader mapped input is prefetched.
+  static constexpr std::size_t PREFETCH_BYTES = 8 << 20;
+
+  HistoryExport(const std::string &history, ExportFormat format);
+
+  /**
+   * @brief Export everything to @p out_path (replaced if it exists).
+   * @throws std::runtime_error if there is no history at the path, the
+   *         output cannot be written, or a file is damaged before its end.
+   */
+  ExportStats write(const std::string &out_path);
+
+private:
+  std::string history_;
+  ExportFormat format_;
+};
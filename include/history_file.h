@@ -0,0 +1,161 @@
+#pragma once
+/**
+ * @file history_file.h
+ * @brief Crash-safe on-disk journal of a hub's message log.
+ *
+ * Every change to the HubLog (new message, edit, delete) is appended to
+ * one file, after an 8-byte "LCHIST1\n" tag, as a checksummed record (see
+ * history_record.h).
+ *
+ * A background thread writes records in batches and flushes each batch
+ * to disk before the next, so a crash (or kill -9, or power loss) can only
+ * damage the last batch. On startup recover() stops at the first record
+ * whose length or checksum does not add up and truncates the file there.
+ *
+ * Recovery does not read the whole file. Every CHECKPOINT_EVERY messages a
+ * checkpoint { u64 offset, u64 seq } is appended to "<path>.idx" (framed
+ * the same way) once the data it points to is on disk. recover() starts
+ * from the newest checkpoint that still leaves @p keep messages to replay,
+ * so startup time depends on the log's ring size, not the file's size.
+ *
+ * Once the journal reaches SEGMENT_BYTES it is sealed: renamed (with its
+ * index) to segment_path(path, n) and a new journal is started. Sealed
+ * segments are never written again; HistoryCompactor turns them into
+ * compressed archives in the background. If the new journal is still too
+ * short to fill the ring, recover() takes the rest from the newest
+ * segment or its archive.
+ *
+ * Usage:
+ *   HistoryFile history("chat.history");
+ *   history.recover(HubLog::DEFAULT_CAPACITY,
+ *                   [&](LogChange c, const LogEntry &e) { ... });
+ *   log.set_journal([&](LogChange c, const LogEntry &e) {
+ *     history.record(c, e);
+ *   });
+ *   history.start();
+ *   ...
+ *   history.stop();   // writes what is pending
+ */
+
+#include "history_record.h"
+#include "hub_log.h"
+
+#include "compat.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// What recover() found.
+struct HistoryRecovery {
+  uint64_t records = 0;       ///< Records replayed
+  uint64_t file_bytes = 0;    ///< Size of the journal before recovery
+  uint64_t skipped_bytes = 0; ///< Not read thanks to the checkpoint
+  uint64_t torn_bytes = 0;    ///< Incomplete tail that was cut off
+  uint64_t elapsed_ns = 0;
+};
+
+/**
+ * @class HistoryFile
+ * @brief Append-only, checksummed journal with checkpointed recovery.
+ *
+ * record() is thread-safe and does not block on disk; the rest is meant
+ * for the owning thread.
+ */
+class HistoryFile {
+public:
+  /// Messages between checkpoints.
+  static constexpr uint64_t CHECKPOINT_EVERY = 1024;
+
+  /// Journal size at which it is sealed into a segment.
+  static constexpr uint64_t SEGMENT_BYTES = 64ull << 20;
+
+  using Replay = HistoryReplay;
+
+  /**
+   * @brief Open (or create) the journal at @p path.
+   * @throws std::runtime_error if the file cannot be opened or is not a
+   *         history file.
+   */
+  explicit HistoryFile(const std::string &path);
+  ~HistoryFile();
+
+  // Non-copyable (owns file handles and a thread)
+  HistoryFile(const HistoryFile &) = delete;
+  HistoryFile &operator=(const HistoryFile &) = delete;
+
+  /// @return Name of sealed segment @p n (1 = oldest) of journal @p path.
+  static std::string segment_path(const std::string &path, unsigned n);
+
+  /// @return Name of the compressed archive of segment @p n.
+  static std::string archive_path(const std::string &path, unsigned n);
+
+  /**
+   * @brief Drop a torn tail and replay the newest records, oldest first.
+   *
+   * Call once, before start(). Changes come back as they were recorded.
+   *
+   * @param keep   Messages the caller wants back (its ring capacity).
+   * @param replay Receives each record.
+   */
+  HistoryRecovery recover(std::size_t keep, const Replay &replay);
+
+  /// Queue one log change for writing (a HubLog::Journal; never blocks
+  /// on disk).
+  void record(LogChange change, const LogEntry &entry);
+
+  /// Start the writer thread.
+  void start();
+
+  /// Write everything queued, then stop the writer thread.
+  void stop();
+
+  /// @return The journal's path.
+  const std::string &path() const { return path_; }
+
+private:
+  std::string path_;
+  HANDLE data_ = INVALID_HANDLE_VALUE;  ///< The journal
+  HANDLE index_ = INVALID_HANDLE_VALUE; ///< "<path>.idx" checkpoints
+  std::atomic<bool> running_{false};
+  Thread thread_;
+
+  Mutex mutex_;          ///< Guards the pending_ fields
+  CondVar wake_;
+  std::string pending_;  ///< Encoded records not yet written
+  uint64_t pending_entries_ = 0; ///< Messages (not ops) in pending_
+  uint64_t pending_last_ = 0;    ///< Newest message seq in pending_
+
+  // Writer thread only (and recover(), before it starts)
+  uint64_t end_ = 0;              ///< File offset of the next record
+  uint64_t index_end_ = 0;        ///< Same, in the index
+  uint64_t last_seq_ = 0;         ///< Newest message seq on disk
+  uint64_t since_checkpoint_ = 0; ///< Messages written since the last one
+  unsigned segments_ = 0;         ///< Sealed segments so far
+  bool failed_ = false;           ///< A write failed (reported once)
+
+  /// Open the journal and its index, tagging a new journal.
+  /// @throws std::runtime_error as the constructor.
+  void open_live();
+
+  /// Close both files.
+  void close_live();
+
+  /// Replay the tail of the newest sealed segment (or its archive).
+  /// @return Records replayed.
+  uint64_t replay_previous(std::size_t keep, const Replay &replay);
+
+  /// Write and flush one batch, then checkpoint if due.
+  void write_batch(const std::string &batch, uint64_t entries,
+                   uint64_t last_seq);
+
+  /// Append checkpoint { offset, seq } to the index and flush it.
+  void checkpoint(uint64_t offset, uint64_t seq);
+
+  /// Rename the journal to the next segment and start a new one.
+  void seal();
+
+  /// Writes batches until stop().
+  void run();
+};
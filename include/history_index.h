@@ -0,0 +1,163 @@
+#pragma once
+/**
+ * @file history_index.h
+ * @brief In-memory index over a hub's on-disk history, for queries.
+ *
+ * The history (see history_file.h) is cut into chunks of about
+ * CHUNK_BYTES of records: one per archive block, and runs of records in
+ * sealed segments and the live journal. For each chunk the index keeps
+ * where it lives, its message numbers, the range of its message times
+ * (the wall-clock part of their HLC stamps) and the set of its senders:
+ *
+ *   time range   → skip every chunk whose time range misses the query
+ *   sender       → skip every chunk that sender wrote nothing in
+ *
+ * so a query reads only the chunks that can hold an answer. A chunk
+ * costs about 100 bytes plus 4 per distinct sender in it: a 50 million
+ * message history with 50 busy senders indexes into about 25 MB.
+ *
+ * Edits and deletes stored after their message (in a later segment or
+ * the journal) are kept in a side table and applied to what is returned;
+ * deleted messages are left out.
+ *
+ * refresh() follows the history as it grows: it indexes new journal
+ * records, notices when the journal is sealed (the file is renamed, so
+ * offsets stay valid) and when a segment is replaced by its archive.
+ *
+ * Not thread-safe: one thread builds and queries it.
+ *
+ * Usage:
+ *   HistoryIndex index("chat.history");
+ *   index.refresh();
+ *   std::vector<LogEntry> page;
+ *   index.range(from_ms, to_ms, 0, UINT64_MAX, 100, page);
+ *   index.by_sender("ana", UINT64_MAX, 20, page);
+ */
+
+#include "history_archive.h"
+#include "hub_log.h"
+
+#include "compat.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class HistoryIndex
+ * @brief Chunk index (time range and senders) over one history path.
+ */
+class HistoryIndex {
+public:
+  /// Journal bytes per chunk (archive chunks are one block).
+  static constexpr std::size_t CHUNK_BYTES = 64 * 1024;
+
+  /// @param path The journal's path (as given to HistoryFile).
+  explicit HistoryIndex(const std::string &path);
+  ~HistoryIndex();
+
+  // Non-copyable (owns file handles)
+  HistoryIndex(const HistoryIndex &) = delete;
+  HistoryIndex &operator=(const HistoryIndex &) = delete;
+
+  /// Index what was written since the last call.
+  void refresh();
+
+  /**
+   * @brief Messages stamped within [from_ms, to_ms], oldest first.
+   * @param from_seq  Lowest message number to return.
+   * @param below_seq Return only messages numbered below this.
+   * @param max       Stop after appending this many to @p out.
+   */
+  void range(uint64_t from_ms, uint64_t to_ms, uint64_t from_seq,
+             uint64_t below_seq, std::size_t max, std::vector<LogEntry> &out);
+
+  /**
+   * @brief Messages from @p sender numbered below @p below_seq, newest
+   * first.
+   * @param max Stop after appending this many to @p out.
+   */
+  void by_sender(const std::string &sender, uint64_t below_seq,
+                 std::size_t max, std::vector<LogEntry> &out);
+
+  /// @return Messages indexed.
+  uint64_t messages() const;
+
+  /// @return Chunks indexed.
+  std::size_t chunks() const;
+
+private:
+  struct Chunk {
+    uint64_t first_seq = 0;
+    uint64_t last_seq = 0;
+    uint64_t min_ms = UINT64_MAX;
+    uint64_t max_ms = 0;
+    uint64_t rising_ms = 0; ///< Largest max_ms up to here (for searching)
+    uint64_t begin = 0;     ///< File offset, or archive block number
+    uint64_t end = 0;       ///< File offset past its last record
+    std::vector<uint32_t> senders; ///< Sorted sender ids
+  };
+
+  /// An archive, a sealed segment or the live journal.
+  struct Source {
+    unsigned n = 0; ///< Segment number (0 = live journal)
+    std::unique_ptr<HistoryArchive> archive;
+    HANDLE file = INVALID_HANDLE_VALUE; ///< Segment or journal
+    uint64_t indexed = 0;               ///< File offset indexed up to
+    uint64_t messages = 0;
+    std::vector<Chunk> chunks;
+
+    ~Source() {
+      if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+    }
+  };
+
+  /// Edit or delete recorded after its message.
+  struct Change {
+    std::string text;
+    bool deleted = false;
+    unsigned segment = 0; ///< Where it was recorded (later ones win)
+  };
+
+  std::string path_;
+  std::vector<std::unique_ptr<Source>> sources_; ///< Oldest first
+  unsigned sealed_ = 0;   ///< Sealed segments in sources_
+  bool has_live_ = false; ///< sources_.back() is the journal
+  std::unordered_map<uint64_t, Change> changes_;
+  std::unordered_map<std::string, uint32_t> sender_ids_;
+  std::string buf_; ///< Chunk read buffer
+
+  /// @return Sealed segments (or archives) on disk now.
+  unsigned count_sealed() const;
+
+  /// Add sealed segment @p n (its archive if it has one) and index it.
+  void add_sealed(unsigned n);
+
+  /// Open the journal as the newest source. @return false if missing.
+  bool add_live();
+
+  /// Replace segment @p s with its archive, if that is ready.
+  void use_archive(Source &s);
+
+  /// Index the records of @p s past s.indexed.
+  void scan(Source &s);
+
+  /// Index every block of archive source @p s.
+  void scan_archive(Source &s);
+
+  /// Add message @p e to @p chunk.
+  void note(Chunk &chunk, const LogEntry &e);
+
+  /// Remember an edit or delete recorded in segment @p segment (archives
+  /// hold only those of older segments' messages; their own are folded
+  /// in).
+  void note_change(unsigned segment, LogChange change, const LogEntry &e);
+
+  /// Call @p visit with each message in @p chunk, changes applied.
+  template <typename Visit>
+  void read(Source &s, const Chunk &chunk, Visit visit);
+};
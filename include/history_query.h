@@ -0,0 +1,118 @@
+#pragma once
+/**
+ * @file history_query.h
+ * @brief Answers clients' history queries on a low-priority thread.
+ *
+ * Clients ask for past messages with
+ *   CMD:QUERY:<id>:RANGE:<from ms>:<to ms>:<cursor>
+ *       messages stamped between two times (ms since 1970, UTC), oldest
+ *       first
+ *   CMD:QUERY:<id>:LAST:<count>:<cursor>:<sender>
+ *       the newest <count> messages from <sender>, newest first
+ * and get one page back:
+ *   CMD:RESULT:<id>:<next cursor>:<n>
+ *   <seq>:<hlc>:<parent>:[Sender]: text        (n lines, each after '\n')
+ *
+ * A page holds at most PAGE_MESSAGES. A next cursor of 0 means there is
+ * nothing more; otherwise the client sends the same query again with that
+ * cursor (and, for LAST, the count still wanted) for the next page.
+ * Cursors are message numbers, so the hub keeps no state between pages.
+ *
+ * The newest messages come from the room's HubLog, with live edits and
+ * deletes applied. Older ones come from a HistoryIndex over the on-disk
+ * history, if the hub keeps one. Deleted messages are never returned.
+ *
+ * Queries are queued to one worker thread at below-normal priority. The
+ * worker only reads the log (under its lock, briefly) and the history
+ * files, so a heavy query never holds up live fan-out. At most
+ * MAX_PENDING queries wait; more are refused with "CMD:ERROR:".
+ *
+ * Usage:
+ *   HistoryQuery queries(room, "chat.history");   // or "" for memory only
+ *   queries.start();   // before clients connect
+ *   ...
+ *   queries.stop();    // after room.stop_all()
+ */
+
+#include "history_index.h"
+#include "hub_log.h"
+#include "room.h"
+
+#include "compat.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @class HistoryQuery
+ * @brief Query worker for one Room; thread-safe.
+ */
+class HistoryQuery {
+public:
+  /// Most messages in one result frame.
+  static constexpr std::size_t PAGE_MESSAGES = 100;
+
+  /// Most queries waiting for the worker.
+  static constexpr std::size_t MAX_PENDING = 64;
+
+  /// How often an idle worker indexes new history.
+  static constexpr unsigned REFRESH_MS = 1000;
+
+  /// @param history On-disk history path ("" = the in-memory log only).
+  HistoryQuery(Room &room, const std::string &history);
+  ~HistoryQuery();
+
+  // Non-copyable (owns a thread)
+  HistoryQuery(const HistoryQuery &) = delete;
+  HistoryQuery &operator=(const HistoryQuery &) = delete;
+
+  /// Take over query frames from the room and start the worker.
+  void start();
+
+  /// Stop the worker; queued queries are dropped.
+  void stop();
+
+private:
+  struct Request {
+    uint32_t client = 0;
+    uint64_t id = 0;
+    bool by_sender = false; ///< LAST rather than RANGE
+    uint64_t from_ms = 0;
+    uint64_t to_ms = 0;
+    std::size_t count = 0;
+    uint64_t cursor = 0;
+    std::string sender;
+    uint64_t queued_ns = 0;
+  };
+
+  Room &room_;
+  std::string history_;
+  std::unique_ptr<HistoryIndex> index_; ///< Worker only
+  std::atomic<bool> running_{false};
+  Thread thread_;
+
+  Mutex mutex_; ///< Guards pending_
+  CondVar wake_;
+  std::deque<Request> pending_;
+
+  /// Room query handler: parse and queue, or refuse.
+  void submit(uint32_t client, const std::string &message);
+
+  /// Run one query and send its page.
+  void answer(const Request &r);
+
+  /// Messages for RANGE, oldest first, at most PAGE_MESSAGES + 1.
+  void run_range(const Request &r, std::vector<LogEntry> &out);
+
+  /// Messages for LAST, newest first, at most count + 1.
+  void run_last(const Request &r, std::size_t count,
+                std::vector<LogEntry> &out);
+
+  /// Answers queries until stop().
+  void run();
+};
@@ -0,0 +1,250 @@
+#pragma once
+/**
+ * @file history_record.h
+ * @brief Record framing shared by the history journal and its archives.
+ *
+ * A record is one HubLog change:
+ *
+ *   u32 length | u32 crc32c(payload) | payload
+ *   payload = { u8 change, u8 flags, u64 seq, u64 hlc, u64 parent,
+ *               str sender, str text }                    (see wire.h)
+ *
+ * where change is a LogChange and flags carry LogEntry::edited (1) and
+ * LogEntry::deleted (2). Journal segments are a tag followed by records;
+ * archive blocks decompress to a run of the same records.
+ *
+ * Usage:
+ *   std::string out;
+ *   history::append_record(out, history::encode_change(change, entry));
+ *
+ *   history::RecordReader reader(file, offset);
+ *   while (reader.next(payload) &&
+ *          history::decode_change(payload, change, entry)) { ... }
+ */
+
+#include "compat.h"
+#include "crc32c.h"
+#include "hub_log.h"
+#include "wire.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/// Receives HubLog changes read back from disk, oldest first.
+using HistoryReplay = std::function<void(LogChange, const LogEntry &)>;
+
+namespace history {
+
+/// Tag at the start of every journal segment, before the first record.
+const char JOURNAL_TAG[] = "LCHIST1\n";
+constexpr std::size_t JOURNAL_TAG_LEN = 8;
+
+/// u32 length + u32 crc32c
+constexpr std::size_t HEADER_LEN = 8;
+
+/// Largest record accepted on reading; anything longer is damage.
+constexpr uint32_t MAX_RECORD = 1u << 20;
+
+/// Bytes read per ReadFile() while scanning.
+constexpr std::size_t READ_CHUNK = 1 << 20;
+
+constexpr uint8_t FLAG_EDITED = 1;
+constexpr uint8_t FLAG_DELETED = 2;
+
+// ── Records
+// ───────────────────────────────────────────────────────────────────
+
+/// Append "length | crc | payload" to @p out.
+inline void append_record(std::string &out, const std::string &payload) {
+  WireWriter header;
+  header.put_u32(static_cast<uint32_t>(payload.size()));
+  header.put_u32(crc32c(payload.data(), payload.size()));
+  out += header.data();
+  out += payload;
+}
+
+inline std::string encode_change(LogChange change, const LogEntry &entry) {
+  WireWriter w;
+  w.put_u8(static_cast<uint8_t>(change));
+  w.put_u8(static_cast<uint8_t>((entry.edited ? FLAG_EDITED : 0) |
+                                (entry.deleted ? FLAG_DELETED : 0)));
+  w.put_u64(entry.seq);
+  w.put_u64(entry.hlc);
+  w.put_u64(entry.parent);
+  w.put_str(entry.sender);
+  w.put_str(entry.text);
+  return w.release();
+}
+
+/// @return false if the @p len bytes at @p payload are not a valid change.
+inline bool decode_change(const char *payload, std::size_t len,
+                          LogChange &change, LogEntry &entry) {
+  WireReader r(payload, len);
+  uint8_t kind = 0;
+  uint8_t flags = 0;
+  if (!r.get_u8(kind) || !r.get_u8(flags) || !r.get_u64(entry.seq) ||
+      !r.get_u64(entry.hlc) || !r.get_u64(entry.parent) ||
+      !r.get_str(entry.sender) || !r.get_str(entry.text)) {
+    return false;
+  }
+  if (kind < static_cast<uint8_t>(LogChange::Append) ||
+      kind > static_cast<uint8_t>(LogChange::Delete)) {
+    return false;
+  }
+  change = static_cast<LogChange>(kind);
+  entry.edited = (flags & FLAG_EDITED) != 0;
+  entry.deleted = (flags & FLAG_DELETED) != 0;
+  return true;
+}
+
+inline bool decode_change(const std::string &payload, LogChange &change,
+                          LogEntry &entry) {
+  return decode_change(payload.data(), payload.size(), change, entry);
+}
+
+/**
+ * @brief Split the record at the front of @p data.
+ * @return Bytes it takes (0 if @p data is cut short, oversized or fails
+ *         its checksum).
+ */
+inline std::size_t parse_record(const char *data, std::size_t len,
+                                const char *&payload,
+                                std::size_t &payload_len) {
+  if (len < HEADER_LEN)
+    return 0;
+  WireReader header(data, HEADER_LEN);
+  uint32_t size = 0;
+  uint32_t crc = 0;
+  header.get_u32(size);
+  header.get_u32(crc);
+  if (size > MAX_RECORD || size > len - HEADER_LEN ||
+      crc32c(data + HEADER_LEN, size) != crc) {
+    return 0;
+  }
+  payload = data + HEADER_LEN;
+  payload_len = size;
+  return HEADER_LEN + size;
+}
+
+// ── Files
+// ─────────────────────────────────────────────────────────────────────
+
+/// @return Size of @p file in bytes (0 if unknown).
+inline uint64_t file_size(HANDLE file) {
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size))
+    return 0;
+  return static_cast<uint64_t>(size.QuadPart);
+}
+
+inline bool seek(HANDLE file, uint64_t offset) {
+  LARGE_INTEGER pos;
+  pos.QuadPart = static_cast<LONGLONG>(offset);
+  return SetFilePointerEx(file, pos, nullptr, FILE_BEGIN) != 0;
+}
+
+/// Read exactly @p len bytes. @return false on error or end of file.
+inline bool read_all(HANDLE file, char *data, std::size_t len) {
+  while (len > 0) {
+    DWORD chunk = static_cast<DWORD>(len > READ_CHUNK ? READ_CHUNK : len);
+    DWORD got = 0;
+    if (!ReadFile(file, data, chunk, &got, nullptr) || got == 0)
+      return false;
+    data += got;
+    len -= got;
+  }
+  return true;
+}
+
+inline bool write_all(HANDLE file, const char *data, std::size_t len) {
+  while (len > 0) {
+    DWORD chunk = static_cast<DWORD>(len > READ_CHUNK ? READ_CHUNK : len);
+    DWORD written = 0;
+    if (!WriteFile(file, data, chunk, &written, nullptr) || written == 0)
+      return false;
+    data += written;
+    len -= written;
+  }
+  return true;
+}
+
+/// @return true if @p path names an existing file.
+inline bool file_exists(const std::string &path) {
+  return GetFileAttributesA(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+}
+
+/// Open an existing file for reading (INVALID_HANDLE_VALUE if missing).
+inline HANDLE open_read(const std::string &path) {
+  return CreateFileA(path.c_str(), GENERIC_READ,
+                     FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                     OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+}
+
+/**
+ * @class RecordReader
+ * @brief Reads records front to back through a large buffer.
+ *
+ * Stops at end of file or at the first record that is cut short,
+ * oversized or fails its checksum; offset() is then where that record
+ * starts.
+ */
+class RecordReader {
+public:
+  RecordReader(HANDLE file, uint64_t offset)
+      : file_(file), offset_(offset), ok_(seek(file, offset)) {}
+
+  /// @return false at end of file or at a damaged record.
+  bool next(std::string &payload) {
+    if (!ok_ || !fill(HEADER_LEN))
+      return false;
+    WireReader header(buf_.data() + pos_, HEADER_LEN);
+    uint32_t len = 0;
+    header.get_u32(len);
+    if (len > MAX_RECORD || !fill(HEADER_LEN + len))
+      return false;
+    const char *body = nullptr;
+    std::size_t body_len = 0;
+    std::size_t used =
+        parse_record(buf_.data() + pos_, buf_.size() - pos_, body, body_len);
+    if (used == 0)
+      return false;
+    payload.assign(body, body_len);
+    pos_ += used;
+    offset_ += used;
+    return true;
+  }
+
+  /// @return File offset of the next (unread) record.
+  uint64_t offset() const { return offset_; }
+
+private:
+  HANDLE file_;
+  uint64_t offset_;
+  bool ok_;
+  std::string buf_;
+  std::size_t pos_ = 0;
+
+  /// Make @p need bytes available at pos_. @return false at end of file.
+  bool fill(std::size_t need) {
+    while (buf_.size() - pos_ < need) {
+      buf_.erase(0, pos_);
+      pos_ = 0;
+      std::size_t want = need > READ_CHUNK ? need : READ_CHUNK;
+      std::size_t have = buf_.size();
+      buf_.resize(have + want);
+      DWORD got = 0;
+      if (!ReadFile(file_, &buf_[have], static_cast<DWORD>(want), &got,
+                    nullptr)) {
+        got = 0;
+      }
+      buf_.resize(have + got);
+      if (got == 0)
+        return false;
+    }
+    return true;
+  }
+};
+
+} // namespace history
@@ -0,0 +1,83 @@
+#pragma once
+/**
+ * @file hlc.h
+ * @brief Hybrid logical clock for ordering messages across hubs.
+ *
+ * A stamp packs wall-clock milliseconds into the upper 48 bits and a
+ * logical counter into the lower 16. Stamps only grow: a hub whose clock
+ * is behind (or that receives a stamp from a hub whose clock is ahead)
+ * keeps counting from the largest stamp it has seen instead of going
+ * back. So if message A could have been seen by whoever wrote B, A's
+ * stamp is smaller, and no hub needs a synchronised clock. The physical
+ * part stays within the worst clock skew of real time, which makes it
+ * good enough to show people.
+ *
+ * Each tick is a compare, an add and one compare-and-swap.
+ *
+ * Usage:
+ *   HybridClock clock;
+ *   uint64_t stamp = clock.now();        // local message
+ *   clock.observe(remote_stamp);         // message from another hub
+ *   uint64_t ms = hlc_physical_ms(stamp);
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/// Low bits of a stamp used for the logical counter.
+constexpr int HLC_LOGICAL_BITS = 16;
+
+/// @return The wall-clock part of @p stamp, in ms since 1970.
+inline uint64_t hlc_physical_ms(uint64_t stamp) {
+  return stamp >> HLC_LOGICAL_BITS;
+}
+
+/**
+ * @class HybridClock
+ * @brief Thread-safe, lock-free hybrid logical clock.
+ */
+class HybridClock {
+public:
+  HybridClock() = default;
+
+  // Non-copyable (atomic)
+  HybridClock(const HybridClock &) = delete;
+  HybridClock &operator=(const HybridClock &) = delete;
+
+  /// @return A stamp for a local event, larger than any returned before.
+  uint64_t now() { return tick(0); }
+
+  /**
+   * @brief Merge a stamp received from another hub.
+   * @return A stamp for the receipt, larger than @p remote and than any
+   *         returned before.
+   */
+  uint64_t observe(uint64_t remote) { return tick(remote); }
+
+  /// @return The largest stamp issued or observed so far.
+  uint64_t last() const { return last_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> last_{0};
+
+  uint64_t tick(uint64_t floor) {
+    using namespace std::chrono;
+    uint64_t wall = static_cast<uint64_t>(
+                        duration_cast<milliseconds>(
+                            system_clock::now().time_since_epoch())
+                            .count())
+                    << HLC_LOGICAL_BITS;
+    if (wall < floor + 1)
+      wall = floor + 1;
+
+    // Physical time if it moved on, else one logical step past the last
+    uint64_t last = last_.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+      next = wall > last ? wall : last + 1;
+    } while (!last_.compare_exchange_weak(last, next,
+                                          std::memory_order_relaxed));
+    return next;
+  }
+};
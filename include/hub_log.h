@@ -0,0 +1,189 @@
+#pragma once
+/**
+ * @file hub_log.h
+ * @brief Sequenced, bounded history of the messages a hub has delivered.
+ *
+ * Every broadcast is recorded under the sequence number the room's
+ * Sequencer gave it. Clients see that number, so after reconnecting they
+ * can ask for what they missed; standby hubs copy the log from the leader
+ * so a promoted standby carries on with the same numbering and recent
+ * history.
+ *
+ * Replies name the thread they belong to (the top-level message they
+ * answer), and the log keeps a root → replies index so a thread can be
+ * read without scanning.
+ *
+ * Edits and deletes are recorded as overlays beside the entry they change
+ * (a map insert, no search through the ring) and are visible to readers
+ * at once; compact() later folds them into the entries themselves. Only
+ * the session that wrote an entry may change it: authorship is checked by
+ * session key, never by the display name anyone can pick.
+ *
+ * A journal hook (set_journal()) is told about every change in the order
+ * it is made, so the log can be kept on disk (see history_file.h).
+ *
+ * Usage:
+ *   HubLog log;
+ *   log.apply(entry);
+ *   for (const LogEntry& e : log.since(last_seen, 100)) { ... }
+ */
+
+#include "compat.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// One delivered chat message.
+struct LogEntry {
+  uint64_t seq = 0;
+  uint64_t hlc = 0; ///< Hybrid logical clock stamp from the origin hub
+  uint64_t parent = 0; ///< Thread root this replies to (0 = top level)
+  /// Session key of the client that wrote it here (see Room::session_key());
+  /// 0 if it came from another hub, history or the console. Kept in memory
+  /// only: it authorises edits, and sessions end with the connection.
+  uint64_t author = 0;
+  std::string sender;
+  std::string text;
+  bool edited = false;  ///< text was replaced by its author
+  bool deleted = false; ///< Removed by its author (text is empty)
+};
+
+/// Kind of change passed to a HubLog::Journal (values are stored on disk).
+enum class LogChange : uint8_t {
+  Append = 1, ///< New entry (all fields)
+  Edit = 2,   ///< seq, sender (the author) and the new text
+  Delete = 3, ///< seq and sender (the author)
+};
+
+/**
+ * @class HubLog
+ * @brief Thread-safe ring of the most recent LogEntry records.
+ */
+class HubLog {
+public:
+  /// Entries kept before the oldest are dropped.
+  static constexpr std::size_t DEFAULT_CAPACITY = 4096;
+
+  /// Author for changes already authorised elsewhere (history replay,
+  /// copies from the leader): skips the author check.
+  static constexpr uint64_t ANY_AUTHOR = ~0ull;
+
+  /// Called with the log's mutex held, so it must be quick and must not
+  /// call back into the log.
+  using Journal = std::function<void(LogChange, const LogEntry &)>;
+
+  explicit HubLog(std::size_t capacity = DEFAULT_CAPACITY);
+
+  // Non-copyable
+  HubLog(const HubLog &) = delete;
+  HubLog &operator=(const HubLog &) = delete;
+
+  /// @return Number of entries kept in memory.
+  std::size_t capacity() const { return capacity_; }
+
+  /// Report every later change to @p journal (nullptr to stop).
+  void set_journal(Journal journal);
+
+  /**
+   * @brief Record an entry under its own sequence number.
+   * @return false if @p entry is not newer than last_seq().
+   */
+  bool apply(const LogEntry &entry);
+
+  /**
+   * @brief Replace the text of an entry, as its author.
+   * @param author Session key of the client asking, or ANY_AUTHOR.
+   * @return false if the entry is gone, deleted, or not by @p author.
+   */
+  bool edit(uint64_t seq, uint64_t author, const std::string &text);
+
+  /**
+   * @brief Delete an entry, as its author. Its number stays taken.
+   * @param author Session key of the client asking, or ANY_AUTHOR.
+   * @return false if the entry is gone, already deleted, or not by @p author.
+   */
+  bool erase(uint64_t seq, uint64_t author);
+
+  /**
+   * @brief Fold pending edits and deletes into their entries.
+   * @return Number of overlays folded.
+   */
+  std::size_t compact();
+
+  /// @return Edits and deletes not yet folded by compact().
+  std::size_t overlay_count() const;
+
+  /// @return Sequence number of the newest entry (0 if none).
+  uint64_t last_seq() const;
+
+  /// @return Sequence number of the oldest entry kept (0 if none).
+  uint64_t first_seq() const;
+
+  /**
+   * @brief Look up one entry, with edits and deletes applied.
+   * @return false if it is not (or no longer) in the log.
+   */
+  bool get(uint64_t seq, LogEntry &out) const;
+
+  /// @return Replies logged under thread root @p root.
+  std::size_t reply_count(uint64_t root) const;
+
+  /**
+   * @brief Replies in thread @p root, oldest first, with edits and deletes
+   * applied.
+   * @param max Upper bound on the number of entries returned (the newest
+   *            are kept).
+   */
+  std::vector<LogEntry> thread(uint64_t root, std::size_t max) const;
+
+  /**
+   * @brief Entries newer than @p after_seq, oldest first, with edits and
+   * deletes applied.
+   * @param after_seq Last sequence number the caller already has.
+   * @param max       Upper bound on the number of entries returned.
+   */
+  std::vector<LogEntry> since(uint64_t after_seq, std::size_t max) const;
+
+  /**
+   * @brief Block until an entry newer than @p after_seq exists.
+   * @return false if @p timeout_ms elapsed first.
+   */
+  bool wait_newer(uint64_t after_seq, unsigned timeout_ms) const;
+
+private:
+  /// A pending change to one entry.
+  struct Overlay {
+    std::string text; ///< Replacement text if edited
+    bool edited = false;
+    bool deleted = false;
+  };
+
+  mutable Mutex mutex_;
+  mutable CondVar changed_;
+  std::deque<LogEntry> entries_; ///< Ascending by seq
+  std::unordered_map<uint64_t, Overlay> overlays_;
+  /// Thread root → reply seqs, ascending (entries still in the ring)
+  std::unordered_map<uint64_t, std::deque<uint64_t>> replies_;
+  std::size_t capacity_;
+  uint64_t last_seq_ = 0;
+  Journal journal_;
+
+  /// Add @p entry and trim to capacity (mutex_ held).
+  void push(LogEntry entry);
+
+  /// @return The entry numbered @p seq, or nullptr (mutex_ held).
+  LogEntry *find(uint64_t seq);
+  const LogEntry *find(uint64_t seq) const;
+
+  /// Copy @p entry into @p out with its overlay applied (mutex_ held).
+  void read(const LogEntry &entry, std::vector<LogEntry> &out) const;
+
+  /// @return The overlay for entry @p seq if @p author may change it, else
+  ///         nullptr; @p sender is set to the entry's (mutex_ held).
+  Overlay *overlay_for(uint64_t seq, uint64_t author, std::string &sender);
+};
@@ -0,0 +1,267 @@
+#pragma once
+/**
+ * @file io_loop.h
+ * @brief Shared receive loop that drives many non-blocking connections.
+ *
+ * In the default Blocking mode every ClientHandler owns a thread parked in
+ * recv(). IoLoop replaces that with a fixed set of IO threads, each
+ * servicing a shard of non-blocking sockets:
+ *
+ *   Poll     – wait for readiness with WSAPoll(), sleep when idle.
+ *   BusyPoll – spin over the shard calling recv() and never sleep while
+ *              traffic is flowing. Lowest latency, one busy core per IO
+ *              thread. When idle the thread backs off adaptively
+ *              (pause → yield → 1 ms sleep) and snaps back on the next frame.
+ *   Completion – one I/O completion port per IO thread. Each connection
+ *              keeps a zero-byte overlapped receive armed, so no buffer is
+ *              committed until data arrives; the thread then drains the
+ *              socket into pooled memory. Sends are gathered into a single
+ *              overlapped WSASend per batch, sockets are associated with
+ *              the port once, and completions are reaped in batches with
+ *              GetQueuedCompletionStatusEx(). Falls back to Poll if the
+ *              port cannot be created.
+ *
+ * Reads are fair: each pass gives every ready source a read budget
+ * (IoOptions::read_frames / read_bytes) and moves on when it is spent, so
+ * a client flooding the hub gets its turn in round robin with the others
+ * instead of holding the IO thread until its socket is empty. A source cut
+ * short is served again on the next pass without waiting for readiness:
+ * Poll mode polls with no timeout while one is owed a turn, Completion mode
+ * queues it behind the completions already reaped.
+ *
+ * With IoOptions::max_threads above threads, the number of IO threads
+ * awake follows the load (see thread_scaler.h). A sampling thread measures
+ * how busy the awake threads are; when they run hot another one wakes up
+ * and takes over half the connections of the fullest shard, and when they
+ * idle the last one hands its connections to the others and parks on a
+ * condition variable. New connections only go to awake threads. In
+ * Completion mode a socket stays on the port it was first associated with,
+ * so scaling only steers new connections; a thread with nothing to reap
+ * already sleeps in the kernel.
+ *
+ * Sends never block an IO thread. Frames a client cannot take yet wait in
+ * its OutboundQueue; in Poll and BusyPoll modes the client asks for a turn
+ * with notify() and the loop calls on_writable() once the socket drains.
+ *
+ * Usage:
+ *   IoOptions opts;
+ *   opts.mode = IoMode::BusyPoll;
+ *   IoLoop loop(opts);
+ *   loop.start();
+ *   loop.add(&handler);    // handler implements IoSource
+ *   ...
+ *   loop.stop();
+ */
+
+#include "outbound_queue.h"
+#include "socket_wrapper.h"
+
+#include "compat.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// How the server waits for incoming data.
+enum class IoMode {
+  Blocking, ///< One thread per client blocked in recv() (default)
+  Poll,     ///< Shared IO threads waiting in WSAPoll()
+  BusyPoll, ///< Shared IO threads spinning on non-blocking sockets
+  Completion ///< Shared IO threads reaping an I/O completion port
+};
+
+/// Tuning knobs for the server receive path.
+struct IoOptions {
+  IoMode mode = IoMode::Blocking;
+  unsigned threads = 1;    ///< IO threads (fewest awake when scaling)
+  unsigned max_threads = 0; ///< Scale between threads and this (0 = fixed)
+  int busy_poll_usec = 50; ///< SO_BUSY_POLL budget where the OS supports it
+  /// Memory for queued outbound frames, all clients together, before
+  /// backlogs spill to disk (0 = no limit).
+  uint64_t out_budget = OutboundQueue::DEFAULT_BUDGET;
+  /// Read credit per connection per pass: frames and payload bytes a source
+  /// may consume before the loop moves on to the next one (0 = no limit).
+  unsigned read_frames = 32;
+  std::size_t read_bytes = 64 * 1024;
+};
+
+/// What a source may consume in one on_readable() call (0 = no limit).
+struct ReadBudget {
+  unsigned frames = 0;
+  std::size_t bytes = 0;
+};
+
+/**
+ * @brief Parse an IO mode name ("blocking", "poll", "busy-poll", "iocp").
+ * @return false if @p text is not a known mode.
+ */
+bool parse_io_mode(const std::string &text, IoMode &out);
+
+/// @return The canonical name of @p mode.
+const char *io_mode_name(IoMode mode);
+
+/// Per-source overlapped I/O state (Completion mode only).
+struct IoCompletion;
+
+/**
+ * @class IoSource
+ * @brief A connection that can be driven by an IoLoop.
+ */
+class IoSource {
+public:
+  /// Outcome of one on_readable() call.
+  enum class Status {
+    Idle,     ///< Nothing was available
+    Progress, ///< At least one frame was consumed
+    More,     ///< The budget ran out; input may still be waiting
+    Closed    ///< The connection is gone; the loop drops the source
+  };
+
+  virtual ~IoSource() = default;
+
+  /// @return The socket to poll for readability.
+  virtual SOCKET io_handle() const = 0;
+
+  /// Consume what is available without blocking, within @p budget.
+  virtual Status on_readable(const ReadBudget &budget) = 0;
+
+  /// Poll mode: also wake on_readable() and on_writable() when the socket
+  /// becomes writable.
+  virtual bool wants_write() const { return false; }
+
+  /// Poll / BusyPoll modes: the socket became writable (or notify() asked
+  /// for a turn). Write what is queued without blocking.
+  virtual void on_writable() {}
+
+  /// Called once, after the loop has dropped the source, when it closed.
+  virtual void on_closed() = 0;
+
+  /// Completion mode: an overlapped send started by post_send() finished.
+  virtual void on_send_complete(bool ok) { (void)ok; }
+
+private:
+  friend class IoLoop;
+  std::atomic<std::size_t> io_shard_{static_cast<std::size_t>(-1)};
+  IoCompletion *io_completion_ = nullptr;
+  bool io_more_ = false; ///< Poll mode: serve again without waiting
+  std::atomic<bool> io_notified_{false}; ///< notify() awaits on_writable()
+  // io_shard_ changes when the loop moves the source to another shard
+};
+
+/**
+ * @class IoLoop
+ * @brief Owns the IO threads and the per-thread shards of sources.
+ *
+ * IO threads run as fibers, so a source may drive a pooled Fiber from
+ * on_readable() (see fiber.h).
+ *
+ * Thread-safe: add() and remove() may be called from any thread, including
+ * from inside a source callback. remove() returns only once the source is
+ * no longer being serviced, so the caller may destroy it afterwards.
+ */
+class IoLoop {
+public:
+  explicit IoLoop(const IoOptions &options);
+  ~IoLoop();
+
+  // Non-copyable, non-movable (owns live threads)
+  IoLoop(const IoLoop &) = delete;
+  IoLoop &operator=(const IoLoop &) = delete;
+
+  /// Start the IO threads.
+  void start();
+
+  /// Stop the IO threads. Blocks until they exit.
+  void stop();
+
+  /// Register a source (its socket must already be non-blocking).
+  void add(IoSource *source);
+
+  /// Unregister a source; no-op if it is not registered.
+  void remove(IoSource *source);
+
+  /**
+   * @brief Poll / BusyPoll modes: have the IO thread serving @p source call
+   * its on_writable() soon, and poll it for writability from then on while
+   * it wants_write(). Thread-safe; never blocks.
+   */
+  void notify(IoSource *source);
+
+  /// Outcome of post_send().
+  enum class SendResult {
+    Pending,   ///< Queued; on_send_complete() will follow on an IO thread
+    Completed, ///< Finished synchronously; no callback will follow
+    Failed     ///< Socket error or source not registered
+  };
+
+  /**
+   * @brief Completion mode: send @p frames with one gathered WSASend.
+   *
+   * At most one send per source may be outstanding. The frames are kept
+   * alive until the send completes. The caller must not call this after it
+   * has started remove() for @p source.
+   */
+  SendResult post_send(IoSource *source, std::vector<SharedFrame> frames);
+
+  /// @return The options this loop was created with.
+  const IoOptions &options() const { return options_; }
+
+private:
+  struct Shard;
+
+  IoOptions options_;
+  std::atomic<bool> running_{false};
+  std::atomic<std::size_t> next_shard_{0};
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  /// Shards [0, awake_) have their thread running; the rest are parked.
+  std::atomic<std::size_t> awake_{0};
+  Mutex park_mutex_;
+  CondVar park_cv_;  ///< Parked threads and the sampling thread wait here
+  Thread scaler_;    ///< Sampling thread (max_threads > threads only)
+
+  /// IO thread entry point.
+  void run_shard(Shard *shard);
+
+  /// Wait while @p shard is parked. @return false once the loop stops.
+  bool wait_awake(Shard &shard);
+
+  /// Sampling thread: feed the load to a ThreadScaler and apply it.
+  void run_scaler();
+
+  /// Wake or park threads until @p count are awake.
+  void scale_to(std::size_t count);
+
+  /// Hand sources of @p from to the shards in [first, last): all of them,
+  /// or every other one.
+  void migrate(Shard &from, std::size_t first, std::size_t last, bool all);
+
+  /// One WSAPoll() wait + dispatch (Poll mode).
+  void poll_pass(Shard &shard);
+
+  /// One sweep over every source (BusyPoll mode). @return true on progress.
+  bool spin_pass(Shard &shard);
+
+  /// Reap and dispatch one batch of completions (Completion mode).
+  void completion_pass(Shard &shard);
+
+  /// Arm the zero-byte receive; failures surface as a completion.
+  void post_recv(Shard &shard, IoCompletion *ctx);
+
+  /// Read budget spent: come back to @p ctx after the queued completions.
+  void requeue_recv(Shard &shard, IoCompletion *ctx);
+
+  /// Free @p ctx once it is detached and has no operation in flight.
+  void release_if_idle(Shard &shard, IoCompletion *ctx);
+
+  /// @return The read budget handed to each on_readable() call.
+  ReadBudget budget() const;
+
+  /// Call on_readable() on slot @p index; drops the source if it closed.
+  bool service(Shard &shard, std::size_t index);
+
+  /// Merge newly added sources and drop removed ones; loop thread only.
+  static void compact(Shard &shard);
+};
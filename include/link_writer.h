@@ -0,0 +1,77 @@
+#pragma once
+/**
+ * @file link_writer.h
+ * @brief Queued sends for a hub-to-hub or hub-to-relay link.
+ *
+ * send() only queues the frame; a writer thread gathers what is queued into
+ * one write and sends it. A slow peer therefore never holds up the thread
+ * that relays to it (often in the middle of a fan-out) or the other links.
+ * A peer that falls more than the queue limit behind is cut off: the
+ * socket is closed, which also ends the link's receive thread.
+ *
+ * Usage:
+ *   SocketWrapper socket_;
+ *   LinkWriter writer_{socket_};
+ *   writer_.start();
+ *   writer_.send(frame);   // from any thread, never blocks
+ *   writer_.close();
+ *   writer_.join();
+ */
+
+#include "socket_wrapper.h"
+
+#include "compat.h"
+
+#include <cstddef>
+#include <deque>
+
+/**
+ * @class LinkWriter
+ * @brief Writer thread and bounded queue for one link's socket.
+ *
+ * Thread-safe. The socket must outlive the writer.
+ */
+class LinkWriter {
+public:
+  /// Default for the most bytes a link may have queued.
+  static constexpr std::size_t DEFAULT_LIMIT = 64 * 1024 * 1024;
+
+  explicit LinkWriter(SocketWrapper &socket,
+                      std::size_t limit = DEFAULT_LIMIT);
+  ~LinkWriter();
+
+  LinkWriter(const LinkWriter &) = delete;
+  LinkWriter &operator=(const LinkWriter &) = delete;
+
+  /// Start the writer thread.
+  void start();
+
+  /**
+   * @brief Queue @p frame (from encode_frame()). Never blocks.
+   * @return false if the link is closed, or was just closed because its
+   *         queue passed the limit.
+   */
+  bool send(const SharedFrame &frame);
+
+  /// Drop what is queued and close the socket; wakes the writer.
+  void close();
+
+  /// Wait for the writer thread to exit (after close()).
+  void join();
+
+private:
+  SocketWrapper &socket_;
+  std::size_t limit_;
+
+  Mutex mutex_; ///< Guards closed_, the queue and socket_.close()
+  CondVar cv_;  ///< Signals the writer: frame queued or closed
+  bool closed_ = false;
+  std::deque<SharedFrame> queue_;
+  std::size_t queued_bytes_ = 0;
+  Thread thread_;
+
+  void close_locked();
+
+  /// Writer thread: send what is queued until closed.
+  void run();
+};
@@ -0,0 +1,34 @@
+#pragma once
+/**
+ * @file lz_block.h
+ * @brief Small LZ77 block compressor for archived history.
+ *
+ * Writes the LZ4 block format (token, literals, 16-bit offset, match
+ * length), which decodes fast enough that reading one archive block costs
+ * about as much as the disk read itself. Chat text repeats names, words
+ * and record framing, so blocks typically shrink to a third or less.
+ *
+ * Blocks are self-contained: nothing is shared between calls, so any
+ * block can be decompressed on its own.
+ *
+ * Usage:
+ *   std::string packed;
+ *   lz_compress(raw.data(), raw.size(), packed);
+ *   std::string back;
+ *   if (!lz_decompress(packed.data(), packed.size(), raw.size(), back)) ...
+ */
+
+#include <cstddef>
+#include <string>
+
+/// Compress @p len bytes at @p src, appending the block to @p out.
+void lz_compress(const char *src, std::size_t len, std::string &out);
+
+/**
+ * @brief Decompress one block into @p out (replacing its contents).
+ * @param raw_len Exact size of the original data.
+ * @return false if the block is malformed or does not expand to
+ *         @p raw_len bytes.
+ */
+bool lz_decompress(const char *src, std::size_t len, std::size_t raw_len,
+                   std::string &out);
@@ -24,6 +24,9 @@ struct Message {
    */
   Message(std::string sender, std::string content);
 
+  /// @return The timestamp as local "HH:MM:SS".
+  std::string clock_time() const;
+
   /**
    * @brief Format the message for console display.
    * @return A string like "[12:34:56] You: Hello!"
@@ -0,0 +1,119 @@
+#pragma once
+/**
+ * @file message_ops.h
+ * @brief Edits, deletes and reactions on logged messages.
+ *
+ * Clients send small op frames that name a message by sequence number
+ * instead of resending it:
+ *   CMD:EDIT:<seq>:<new text>    author only
+ *   CMD:DELETE:<seq>             author only
+ *   CMD:REACT:<seq>:<emoji>      anyone; sending it again takes it back
+ *
+ * "Author" is the connection that sent the message (its session key, see
+ * Room::session_key()), not its display name: after reconnecting, or once
+ * the hub restarts or fails over, earlier messages can no longer be
+ * changed. Reactions are counted per session key too, so namesakes do not
+ * cancel each other and renaming does not add another.
+ *
+ * Edits and deletes become HubLog overlays and are passed on to every
+ * client, relay and standby, as the same frames, once the message they
+ * change has gone out (standbys apply them with apply_update()).
+ * Reactions are only counted: every REACT_FLUSH_MS the hub sends one
+ * "CMD:REACTS:<seq>:<emoji>=<n>,..." per message whose counts changed, so
+ * 200 thumbs-up become a single update. A background pass folds the log's
+ * overlays into its entries.
+ *
+ * A rejected op is answered with "CMD:ERROR:<reason>" to its sender.
+ *
+ * Ops refer to this hub's numbering, so they stay within one hub, its
+ * relays and its standbys; they are not passed to federated hubs.
+ *
+ * Usage:
+ *   MessageOps ops(room);
+ *   ops.start();   // before clients connect
+ *   ...
+ *   ops.stop();    // after room.stop_all()
+ */
+
+#include "room.h"
+
+#include "compat.h"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+
+/**
+ * @class MessageOps
+ * @brief Applies client ops to a Room's log and batches reaction counts.
+ *
+ * Thread-safe.
+ */
+class MessageOps {
+public:
+  /// How often changed reaction counts are sent.
+  static constexpr unsigned REACT_FLUSH_MS = 500;
+
+  /// How often pending edits and deletes are folded into the log.
+  static constexpr unsigned COMPACT_MS = 5000;
+
+  /// Longest accepted reaction, in bytes (one emoji or a short word).
+  static constexpr std::size_t MAX_REACTION_BYTES = 16;
+
+  /// @param room Room whose client messages and log are used; must
+  ///             outlive this object.
+  explicit MessageOps(Room &room);
+  ~MessageOps();
+
+  // Non-copyable (owns a thread)
+  MessageOps(const MessageOps &) = delete;
+  MessageOps &operator=(const MessageOps &) = delete;
+
+  /// Take over op frames from the room and start the background thread.
+  void start();
+
+  /// Stop the background thread, flushing pending reaction counts.
+  void stop();
+
+  /// @return The update frame announcing that @p seq now reads @p text.
+  static std::string edit_frame(uint64_t seq, const std::string &text);
+
+  /// @return The update frame announcing that @p seq was deleted.
+  static std::string delete_frame(uint64_t seq);
+
+  /**
+   * @brief Apply an edit or delete update frame to @p log, as already
+   * authorised (standbys copying the leader).
+   * @param seq Set to the message it changes (0 if @p frame is neither).
+   * @return true if the log changed.
+   */
+  static bool apply_update(HubLog &log, const std::string &frame,
+                           uint64_t &seq);
+
+private:
+  /// emoji → who reacted with it (session keys)
+  using Reactions = std::map<std::string, std::set<uint64_t>>;
+
+  Room &room_;
+  std::atomic<bool> running_{false};
+  Thread thread_;
+
+  Mutex mutex_; ///< Guards reactions_ and dirty_
+  std::map<uint64_t, Reactions> reactions_; ///< By message seq
+  std::set<uint64_t> dirty_;                ///< Counts not yet sent
+
+  /// Room op handler. @return true if @p message was an op.
+  bool handle(uint32_t sender_id, uint64_t author,
+              const std::string &message);
+
+  /// Toggle @p author's @p emoji on message @p seq.
+  bool react(uint64_t seq, uint64_t author, const std::string &emoji);
+
+  /// Send one CMD:REACTS per changed message.
+  void flush_reactions();
+
+  /// Flushes reactions and compacts the log until stop().
+  void run();
+};
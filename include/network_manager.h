@@ -13,6 +13,10 @@
  *   nm.start();
  *   nm.send("Hello!");
  *   nm.stop();
+ *
+ * With set_reconnect(), a lost connection is replaced instead of ending the
+ * session: the receive thread asks the callback for a new socket, and
+ * messages sent meanwhile are held and delivered once it succeeds.
  */
 
 #include "socket_wrapper.h"
@@ -20,6 +24,7 @@
 #include "compat.h"
 
 #include <atomic>
+#include <deque>
 #include <functional>
 #include <string>
 
@@ -32,6 +37,19 @@ public:
   /// Callback type invoked on the receive thread when a message arrives.
   using MessageCallback = std::function<void(const std::string &message)>;
 
+  /**
+   * @brief Produces a replacement connection after the current one drops.
+   *
+   * Runs on the receive thread. Should give up (return false) once
+   * @p running becomes false.
+   *
+   * @param out     Receives the new, ready-to-use socket.
+   * @param running The manager's running flag.
+   * @return false to end the session (the disconnect callback fires).
+   */
+  using ReconnectCallback =
+      std::function<bool(SocketWrapper &out, const std::atomic<bool> &running)>;
+
   /**
    * @brief Construct with an already-connected socket.
    * @param socket A moved-in SocketWrapper (server or client side).
@@ -55,15 +73,30 @@ public:
    */
   void set_on_disconnect(std::function<void()> cb);
 
+  /**
+   * @brief Register how to replace a dropped connection.
+   * Must be called before start().
+   */
+  void set_reconnect(ReconnectCallback cb);
+
   /// Start the background receive thread.
   void start();
 
   /**
    * @brief Send a message to the remote peer (thread-safe).
    * @param message UTF-8 text to send.
+   * @throws std::runtime_error on socket error, unless a reconnect callback
+   *         is set; then the message is held until the next connection.
    */
   void send(const std::string &message);
 
+  /**
+   * @brief Close the current connection so the reconnect callback runs.
+   * Safe to call from the message callback. Without a reconnect callback
+   * this ends the session.
+   */
+  void drop_connection();
+
   /**
    * @brief Stop the receive thread and close the socket.
    * Blocks until the receive thread exits.
@@ -78,10 +111,15 @@ private:
   Thread recv_thread_;
   std::atomic<bool> running_{false};
   Mutex send_mutex_;
+  std::deque<std::string> held_; ///< Unsent while reconnecting (send_mutex_)
 
   MessageCallback on_message_;
   std::function<void()> on_disconnect_;
+  ReconnectCallback reconnect_;
 
   /// Entry point for the background receive thread.
   void receive_loop();
+
+  /// Swap in a replacement connection. @return false to end the session.
+  bool reconnect();
 };
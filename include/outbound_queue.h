@@ -0,0 +1,183 @@
+#pragma once
+/**
+ * @file outbound_queue.h
+ * @brief A client's unsent frames, by priority class, kept in memory within
+ *        a hub-wide budget and spilled to temp files past it.
+ *
+ * The hub queues frames for a client while its socket cannot take them
+ * (a send in flight, or a full socket buffer). Frames are queued by
+ * SendClass, one lane each:
+ *
+ *   Control   pongs, acks, errors, redirects   always sent first
+ *   Chat      messages, edits, reactions       weight 8
+ *   Presence  thread reply counts              weight 2
+ *   Bulk      history pages, thread catch-up   weight 1
+ *
+ * take() empties the Control lane before anything else and shares the rest
+ * by deficit round robin: each turn a lane may send its weight times
+ * QUANTUM bytes, so a flooded chat lane cannot starve the others and a
+ * long history page cannot hold up chat. A batch is at most
+ * MAX_BATCH_BYTES, so a control frame never waits behind more than one
+ * batch in flight. Order is kept within a lane, not across lanes.
+ *
+ * The queues share one memory budget (--out-mem). When the queued frames
+ * of all clients pass it, a client whose backlog is over its fair share
+ * (the budget split between the clients that have a backlog) moves the
+ * oldest frames of its lowest lanes to a temp file per lane:
+ *
+ *   [ spill file: oldest frames ] [ memory: newer frames ]
+ *
+ * Frames are already encoded, so each file is the lane's byte stream still
+ * owed to the client, cut into segments of whole frames. take() sends a
+ * lane's segments back first, one per turn, then its frames in memory;
+ * the order on the wire within a lane never changes. A file empties itself
+ * once read back and is deleted when the queue is destroyed. Control never
+ * spills. A frame shared by several queues is counted by each, so the
+ * budget is an upper bound.
+ *
+ * push() runs on the broadcast path and never touches the disk: it only
+ * hands the queue to the hub-wide spill thread. That thread cuts a
+ * segment's frames off under the queue's lock, writes them without it and
+ * then records the segment. Until then the frames stay in memory, and a
+ * take() that reaches them sends them from there (the write is dropped).
+ * Memory may therefore pass the budget by what is being written.
+ *
+ * Thread-safe. ClientHandler queues every frame here in all IO modes.
+ *
+ * Usage:
+ *   OutboundQueue q(64 * 1024 * 1024);
+ *   q.push(frame, SendClass::Chat);
+ *   std::vector<SharedFrame> batch;
+ *   if (!q.take(batch, 64)) { ... }   // spill file unreadable
+ */
+
+#include "socket_wrapper.h"
+
+#include "compat.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+/// Priority class of an outbound frame (see OutboundQueue).
+enum class SendClass : uint8_t {
+  Control, ///< Never waits behind other classes
+  Chat,
+  Presence,
+  Bulk,
+};
+
+/// Number of SendClass values.
+constexpr std::size_t SEND_CLASSES = 4;
+
+/**
+ * @class OutboundQueue
+ * @brief Per-class FIFOs of encoded frames with spill files behind them.
+ */
+class OutboundQueue {
+public:
+  /// Default hub-wide budget for queued frames.
+  static constexpr uint64_t DEFAULT_BUDGET = 64u * 1024u * 1024u;
+
+  /// Largest spill segment (bigger frames get a segment of their own).
+  static constexpr std::size_t SPILL_CHUNK = 64 * 1024;
+
+  /// A batch stops growing at this many bytes (it holds at least a frame).
+  static constexpr std::size_t MAX_BATCH_BYTES = 64 * 1024;
+
+  /// Bytes per weight unit a lane may send per round.
+  static constexpr int64_t QUANTUM = 16 * 1024;
+
+  /// @param budget Hub-wide bytes in memory before queues spill (0 = never).
+  explicit OutboundQueue(uint64_t budget = DEFAULT_BUDGET);
+  ~OutboundQueue();
+
+  // Non-copyable (owns file handles)
+  OutboundQueue(const OutboundQueue &) = delete;
+  OutboundQueue &operator=(const OutboundQueue &) = delete;
+
+  /// Queue @p frame behind the others of class @p cls.
+  void push(const SharedFrame &frame, SendClass cls);
+
+  /**
+   * @brief Move the next frames to send into @p batch: all queued control
+   * frames if there are any, otherwise the next turn's share of one lane
+   * (a spill segment, or up to @p max frames).
+   * @return false if a spill file could not be read (the queue is then
+   *         cleared: the client can no longer be sent a gapless stream).
+   */
+  bool take(std::vector<SharedFrame> &batch, std::size_t max);
+
+  /// @return true if nothing is queued.
+  bool empty() const;
+
+  /// Drop everything queued.
+  void clear();
+
+  /// @return Bytes queued in memory by all queues.
+  static uint64_t memory_bytes();
+
+  /// @return Bytes waiting in the spill files of all queues.
+  static uint64_t spilled_bytes();
+
+private:
+  /// One class's frames.
+  struct Lane {
+    std::deque<SharedFrame> frames;
+    uint64_t bytes = 0;  ///< Sum of frames sizes
+    int64_t deficit = 0; ///< Bytes it may still send this round
+
+    HANDLE file = INVALID_HANDLE_VALUE; ///< Spill file, opened on first use
+    uint64_t read_at = 0;  ///< Next byte of the spill file to send
+    uint64_t write_at = 0; ///< End of the spill file's data
+    std::deque<uint32_t> segments; ///< Spilled runs of whole frames
+
+    std::deque<SharedFrame> cut; ///< Oldest frames, being written out
+    uint32_t cuts = 0;    ///< Bumped when the cut is taken back or dropped
+    bool writing = false; ///< The spill thread is writing the cut
+
+    bool empty() const {
+      return frames.empty() && segments.empty() && cut.empty();
+    }
+  };
+
+  mutable Mutex mutex_; ///< Guards the state below, files aside
+  Mutex file_mutex_;    ///< Guards the spill files and their positions
+  uint64_t budget_;
+  Lane lanes_[SEND_CLASSES];
+  uint64_t bytes_ = 0;       ///< In memory, all lanes
+  std::size_t turn_ = 1;     ///< Lane whose round-robin turn it is
+  bool backlogged_ = false;  ///< Counted among the queues sharing the budget
+  bool spill_failed_ = false; ///< Could not write; stay in memory
+  bool spill_due_ = false;   ///< Handed to the spill thread
+  uint64_t keep_ = 0;        ///< Bytes to keep in memory when spilling
+
+  /// Move frames from @p lane into @p batch. @return Bytes moved.
+  std::size_t take_from(Lane &lane, std::vector<SharedFrame> &batch,
+                        std::size_t max);
+
+  /// Move a turn on to the next weighted lane and credit it.
+  void next_turn();
+
+  /// Have the spill thread bring the queue down to keep_ (mutex_ held).
+  void schedule_spill();
+
+  /// Spill thread: move the lowest lanes' oldest frames to their files,
+  /// a segment at a time, until keep_ bytes remain in memory.
+  void spill();
+
+  /// Append @p data to @p lane's file at @p at, opening it on first use.
+  /// @return false if the file cannot be written.
+  bool write_segment(Lane &lane, uint64_t at, const std::string &data);
+
+  /// Spill thread entry point.
+  static void spill_main();
+
+  /// Drop @p lane's frames and spilled data (the file stays open).
+  void clear_lane(Lane &lane);
+
+  /// Keep the count of backlogged queues in step with empty().
+  void update_backlogged();
+};
@@ -0,0 +1,99 @@
+#pragma once
+/**
+ * @file relay_node.h
+ * @brief Relay side of the relay tree (see relay_tree.h).
+ *
+ * A relay serves its own clients like any hub, but does not number or
+ * broadcast their messages itself: it sends them up to the hub, and
+ * delivers everything the hub fans out — including its own clients'
+ * messages, minus the author — under the hub's sequence numbers. Clients
+ * that fail over from a relay to the hub therefore resume seamlessly.
+ *
+ * Usage:
+ *   RelayNodeOptions rn;
+ *   rn.upstream = "192.168.1.20:54200";
+ *   rn.advertise = "192.168.1.31:54000";
+ *   RelayNode node(room, rn);
+ *   node.start();
+ */
+
+#include "client.h"
+#include "room.h"
+
+#include "compat.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/// Relay-side configuration.
+struct RelayNodeOptions {
+  std::string upstream;  ///< Hub's relay port, as "host:port"
+  std::string advertise; ///< "host:port" clients reach this relay on
+
+  /// @return true if this server is a relay.
+  bool enabled() const { return !upstream.empty(); }
+};
+
+/**
+ * @class RelayNode
+ * @brief Keeps a link to the hub and bridges it with the local Room.
+ *
+ * Thread-safe.
+ */
+class RelayNode {
+public:
+  /// Clients-per-relay reports sent this often.
+  static constexpr unsigned LOAD_INTERVAL_MS = 500;
+
+  /**
+   * @param room    Local room; switched to upstream mode on start(). Must
+   *                outlive this object.
+   * @param options Hub address and this relay's client endpoint.
+   */
+  RelayNode(Room &room, const RelayNodeOptions &options);
+  ~RelayNode();
+
+  // Non-copyable, non-movable (owns live threads)
+  RelayNode(const RelayNode &) = delete;
+  RelayNode &operator=(const RelayNode &) = delete;
+
+  /// Connect to the hub (retrying in the background). Call before clients
+  /// connect.
+  void start();
+
+  /// Disconnect and stop background threads.
+  void stop();
+
+  /// @return true while linked to the hub.
+  bool connected() const { return connected_.load(); }
+
+  /// @return This relay and the hub, as a "CMD:HUBS:" list for clients.
+  std::string client_endpoints() const;
+
+private:
+  Room &room_;
+  RelayNodeOptions options_;
+  std::atomic<bool> running_{false};
+  std::atomic<bool> connected_{false};
+  std::atomic<uint64_t> last_fanout_ns_{0}; ///< Reported in LOAD
+
+  Client client_; ///< Also initialises Winsock
+  Thread link_thread_;
+  Thread load_thread_;
+
+  mutable Mutex mutex_; ///< Guards link_ and hub_endpoint_
+  std::unique_ptr<SocketWrapper> link_;
+  std::string hub_endpoint_;
+
+  /// Connect, then handle hub frames until the link drops; repeat.
+  void link_loop();
+  void serve(SocketWrapper &link);
+
+  /// Periodically tell the hub how many clients we hold.
+  void load_loop();
+
+  /// Send one frame to the hub. @return false if not linked.
+  bool send_up(const SharedFrame &frame);
+};
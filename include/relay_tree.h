@@ -0,0 +1,160 @@
+#pragma once
+/**
+ * @file relay_tree.h
+ * @brief Two-level fan-out: the hub sends each message to relays, which
+ *        send it on to their own clients.
+ *
+ * A relay is a second LAN_Chat server started with --relay-of. It keeps
+ * its own clients and Room, forwards their messages to the hub, and
+ * delivers what the hub sends back. With N clients in total the hub keeps
+ * about √N relays busy, each serving about √N clients, so the hub writes
+ * √N + √N frames per message instead of N.
+ *
+ * Each relay link has a writer thread (see link_writer.h), so the fan-out
+ * tap only queues frames and a slow relay never holds up the hub; a relay
+ * more than 64 MB behind is dropped and its clients fail over to the hub.
+ *
+ * The hub places new clients by redirecting them ("CMD:REDIRECT:<relay>")
+ * and rebalances once a second: a relay that joins picks up load from the
+ * hub and busy relays, and clients of a relay that leaves fail over to the
+ * hub and are placed again.
+ *
+ * Relay links use their own port and binary frames (see wire.h):
+ *   HELLO   relay → hub  { str client_endpoint }
+ *   WELCOME hub → relay  { str hub_client_endpoint }
+ *   FANOUT  hub → relay  { u64 hub_ns, u32 exclude, u64 seq,
+ *                          u64 hlc, u64 parent, str sender, str text }
+ *   UP      relay → hub  { u32 client_id, str sender, str text }
+ *   ACK     relay → hub  { u64 hub_ns }          every 16th FANOUT
+ *   LOAD    relay → hub  { u32 clients, u64 fanout_ns }   twice a second
+ *   SHED    hub → relay  { u32 count, str endpoint }
+ *   UPDATE  hub → relay  { str frame }   room-wide update (edit, reactions)
+ *
+ * Usage:
+ *   RelayTreeOptions ro;
+ *   ro.port = 54200;
+ *   ro.advertise = "192.168.1.20:54000";
+ *   RelayTree tree(room, ro);
+ *   tree.start();
+ *   std::string relay = tree.place(); // "" = keep the client here
+ */
+
+#include "room.h"
+#include "server.h"
+#include "socket_wrapper.h"
+
+#include "compat.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// Frame types shared by RelayTree and RelayNode.
+namespace relay {
+constexpr uint8_t HELLO = 1;
+constexpr uint8_t WELCOME = 2;
+constexpr uint8_t FANOUT = 3;
+constexpr uint8_t UP = 4;
+constexpr uint8_t ACK = 5;
+constexpr uint8_t LOAD = 6;
+constexpr uint8_t SHED = 7;
+constexpr uint8_t UPDATE = 8;
+
+/// A relay acknowledges one FANOUT in this many (for hop latency).
+constexpr uint64_t ACK_EVERY = 16;
+} // namespace relay
+
+/// Hub-side relay configuration.
+struct RelayTreeOptions {
+  unsigned short port = 0; ///< Port relays connect to (0 = no relays)
+  std::string advertise;   ///< "host:port" clients reach the hub on
+
+  /// @return true if this hub accepts relays.
+  bool enabled() const { return port != 0; }
+};
+
+/**
+ * @class RelayTree
+ * @brief Hub side of the relay tree: relay links, placement, rebalancing.
+ *
+ * Thread-safe.
+ */
+class RelayTree {
+public:
+  /**
+   * @param room    Hub room; its fan-out is mirrored to relays. Must
+   *                outlive this object.
+   * @param options Relay port and the hub's client endpoint.
+   */
+  RelayTree(Room &room, const RelayTreeOptions &options);
+  ~RelayTree();
+
+  // Non-copyable, non-movable (owns live threads)
+  RelayTree(const RelayTree &) = delete;
+  RelayTree &operator=(const RelayTree &) = delete;
+
+  /// Accept relays and start rebalancing. Call before clients connect.
+  void start();
+
+  /// Drop all relays and stop background threads.
+  void stop();
+
+  /**
+   * @brief Choose where a newly connected client should live.
+   * @return Empty to keep it on the hub, else a relay's client endpoint.
+   */
+  std::string place();
+
+  /// @return Number of connected relays.
+  std::size_t relay_count() const;
+
+  /// @return Multi-line status for the /stats command.
+  std::string describe() const;
+
+private:
+  class RelayLink;
+
+  Room &room_;
+  RelayTreeOptions options_;
+  std::atomic<bool> running_{false};
+
+  std::unique_ptr<Server> listener_;
+  Thread balance_thread_;
+
+  mutable Mutex mutex_; ///< Guards links_ and retired_
+  std::vector<std::shared_ptr<RelayLink>> links_; ///< In join order
+  std::vector<std::shared_ptr<RelayLink>> retired_;
+
+  /// Take ownership of a relay connection and start its thread.
+  void add_link(SocketWrapper socket);
+
+  /// A relay's thread ended: retire it. Relay thread only.
+  void link_closed(RelayLink *link);
+
+  /// @return The relays that finished HELLO, copied under mutex_.
+  std::vector<std::shared_ptr<RelayLink>> ready_links() const;
+
+  /// Room fan-out tap: queue @p entry for every relay.
+  void on_fanout(const LogEntry &entry, uint32_t sender_id);
+
+  /// Room update tap: queue @p frame for every relay.
+  void on_update(const std::string &frame);
+
+  /// Once a second: move clients towards an even √N split.
+  void balance_loop();
+  void rebalance();
+
+  /// Destroy retired links (never from a relay thread).
+  void reap_retired();
+
+  /// Relays in use for @p total clients, and clients per node.
+  /// mutex_ must be held.
+  void shape(std::size_t total, std::size_t &active,
+             std::size_t &per_node) const;
+
+  /// Least-loaded of the first @p active relays, or nullptr.
+  /// mutex_ must be held.
+  RelayLink *least_loaded(std::size_t active, const RelayLink *skip) const;
+};
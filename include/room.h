@@ -8,19 +8,64 @@
  * a message it calls Room::broadcast(), which forwards the message to
  * every other active client.
  *
+ * Chat messages go to clients as binary chat frames (see chat_frame.h):
+ * number, HLC stamp, thread root, sender and text, read in place.
+ * The room's Sequencer numbers each message as it arrives and stamps it
+ * with the hub's hybrid logical clock (messages from other hubs keep the
+ * origin hub's stamp); messages are sent in number order, so every client
+ * sees the same total order. A client that reconnects sends
+ * "CMD:RESUME:<last seq>" and is sent the messages it missed.
+ *
+ * Threads: a client sends "CMD:REPLY:<seq>:text" to answer message <seq>.
+ * Replies (chat frames with a thread root) are sent only to the thread's
+ * followers (its author's connection, everyone who replied, and clients
+ * that sent "CMD:FOLLOW:<root>"); other clients get just
+ * "CMD:THREAD:<root>:<reply count>". "CMD:UNFOLLOW:<root>" stops it.
+ *
+ * With set_flood_filter(), a line a client already sent within the window
+ * (on the same connection, whatever its name) is not published again;
+ * the client is told with a "CMD:ERROR:" frame.
+ *
+ * "CMD:QUERY:" frames (history queries) go to the query handler, if one
+ * is set (see history_query.h).
+ *
+ * "CMD:PING:<token>" is answered with "CMD:PONG:<token>". Frames to a
+ * client have a priority class (see outbound_queue.h): pongs, acks, errors
+ * and redirects go ahead of chat, and thread counts and history pages
+ * after it.
+ *
+ * Native clients and browsers (WebSocket, see websocket.h) share the room.
+ * Each frame is encoded once per protocol in use, not once per recipient.
+ *
+ * Fan-out does not take the room lock. It walks a roster, a read-only
+ * snapshot of the clients that is replaced when one joins or leaves, under
+ * an epoch guard (see epoch.h), and sends while holding it: a send only
+ * queues the frame (see ClientHandler), so the guard stays short. The old
+ * roster and the handler that left are freed only once no fan-out can
+ * still be reading them; a reaper thread frees handlers as they retire.
+ *
  * Usage:
- *   Room room;
+ *   Room room;                     // or Room room(io_options);
  *   room.add_client(std::move(socket), "192.168.1.11");
  *   room.broadcast(sender_id, "Alice", "Hello everyone!");
  *   room.broadcast_all("Server", "Server is shutting down.");
  */
 
 #include "client_handler.h"
+#include "epoch.h"
+#include "flood_filter.h"
+#include "hub_log.h"
+#include "io_loop.h"
+#include "sequencer.h"
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 /**
  * @class Room
@@ -31,7 +76,39 @@
  */
 class Room {
 public:
-  Room() = default;
+  /// Called with every message that originated on this hub, once logged.
+  using LocalMessageHook = std::function<void(const LogEntry &entry)>;
+
+  /// Called after every message is fanned out to local clients.
+  /// @p sender_id is the excluded sender (0 if none).
+  using FanoutTap =
+      std::function<void(const LogEntry &entry, uint32_t sender_id)>;
+
+  /// Takes client messages instead of broadcasting them (relay hubs).
+  using UpstreamHook = std::function<void(uint32_t sender_id,
+                                          const std::string &sender_name,
+                                          const std::string &message)>;
+
+  /// Offered every client message first; returns true if it consumed it
+  /// (an edit, delete or reaction rather than chat). @p author is the
+  /// writer's session key (see session_key()).
+  using OpHandler = std::function<bool(uint32_t sender_id, uint64_t author,
+                                       const std::string &sender_name,
+                                       const std::string &message)>;
+
+  /// Takes "CMD:QUERY:" frames from clients.
+  using QueryHandler =
+      std::function<void(uint32_t sender_id, const std::string &message)>;
+
+  /// Called with every send_update() frame (to pass it on to relays).
+  using UpdateTap = std::function<void(const std::string &frame)>;
+
+  /**
+   * @brief Create an empty room.
+   * @param io How client sockets are read (see IoMode). Poll and BusyPoll
+   *           start a shared IoLoop owned by the Room.
+   */
+  explicit Room(const IoOptions &io = IoOptions());
   ~Room();
 
   // Non-copyable
@@ -40,11 +117,15 @@ public:
 
   /**
    * @brief Register a new connected client.
-   * @param socket Connected socket (moved in).
-   * @param name   Display name for this client (e.g. peer IP).
+   * @param socket    Connected socket (moved in).
+   * @param name      Display name for this client (e.g. peer IP).
+   * @param handshake Optional conversation run on the client's own receive
+   *                  context before it joins; its result becomes the name.
+   *                  Returns immediately, so the accept loop never waits.
    * @return The unique ID assigned to the new client.
    */
-  uint32_t add_client(SocketWrapper socket, const std::string &name);
+  uint32_t add_client(SocketWrapper socket, const std::string &name,
+                      ClientHandler::Handshake handshake = nullptr);
 
   /**
    * @brief Remove a client by ID (called from disconnect callback).
@@ -52,14 +133,63 @@ public:
    */
   void remove_client(uint32_t id);
 
+  /**
+   * @brief Route a message from a client: to the op handler, else up the
+   * relay tree, else publish() it (as a reply if it is "CMD:REPLY:").
+   * @param author Session key of the writer; 0 means client @p sender_id
+   *               itself (relays pass one per relay client).
+   */
+  void submit(uint32_t sender_id, const std::string &sender_name,
+              const std::string &message, uint64_t rx_ns = 0,
+              uint64_t author = 0);
+
   /**
    * @brief Send a message to all clients EXCEPT the sender.
+   *
+   * The sender is sent "CMD:ACK:<seq>" instead.
    * @param sender_id   ID of the originating ClientHandler (excluded).
    * @param sender_name Display name prepended to the message.
    * @param message     Raw message text.
+   * @param rx_ns       monotonic_ns() when the frame was received, or 0.
+   *                    Used to record hub-added latency in HubMetrics.
+   * @param origin_hlc  Stamp from the hub the message came from (see
+   *                    hlc.h), or 0 to stamp it here.
+   * @return The sequence number the message was logged under.
+   *
+   * Concurrent calls are numbered without a lock and sent in number order.
    */
-  void broadcast(uint32_t sender_id, const std::string &sender_name,
-                 const std::string &message);
+  uint64_t broadcast(uint32_t sender_id, const std::string &sender_name,
+                     const std::string &message, uint64_t rx_ns = 0,
+                     uint64_t origin_hlc = 0);
+
+  /**
+   * @brief broadcast() a message that originated on this hub, then pass it
+   * to the local-message hook (see set_on_local_message()).
+   * @param parent Thread root it replies to (0 = top level).
+   * @param author Session key of the writer, logged with the message so
+   *               that only it may edit or delete it (0 = nobody).
+   */
+  void publish(uint32_t sender_id, const std::string &sender_name,
+               const std::string &message, uint64_t rx_ns = 0,
+               uint64_t parent = 0, uint64_t author = 0);
+
+  /**
+   * @brief Fan out an entry numbered by another hub (relay hubs).
+   * @param entry      Logged under its own sequence number.
+   * @param exclude_id Local client not to send it to (0 = none).
+   * @return false if the entry was already delivered.
+   *
+   * Numbering continues after @p entry. Not to be mixed with concurrent
+   * broadcast() calls: a room takes its numbers from one source at a time.
+   */
+  bool deliver(const LogEntry &entry, uint32_t exclude_id = 0);
+
+  /**
+   * @brief Log an entry numbered by another hub without sending it (standby
+   * hubs copying the leader). Numbering continues after @p entry.
+   * @return false if the entry was already logged.
+   */
+  bool restore(const LogEntry &entry);
 
   /**
    * @brief Send a message to ALL connected clients (e.g. server's own
@@ -70,14 +200,177 @@ public:
   void broadcast_all(const std::string &sender_name,
                      const std::string &message);
 
-  /// @return Number of currently active clients.
+  /**
+   * @brief Send a control frame (e.g. "CMD:HUBS:...") to every client.
+   *
+   * Not recorded in the log and not numbered.
+   * @param cls Its priority class (see OutboundQueue).
+   */
+  void send_control(const std::string &frame,
+                    SendClass cls = SendClass::Control);
+
+  /**
+   * @brief Send a room-wide update (e.g. "CMD:EDIT:...") to every client
+   * here and, through the update taps, on relays and standbys.
+   * @param after_seq Message the update changes. The update waits until
+   *                  that message has been queued for everyone, so no one
+   *                  gets a change before what it changes (0 = send now:
+   *                  the update arrives in order already).
+   */
+  void send_update(const std::string &frame, uint64_t after_seq = 0);
+
+  /// Send a frame to one client (no-op if it is not connected here).
+  void send_to(uint32_t id, const std::string &frame,
+               SendClass cls = SendClass::Control);
+
+  /**
+   * @brief Resend logged messages newer than @p after_seq to one client.
+   *
+   * Messages the client wrote itself and deleted ones are skipped; edited
+   * ones are sent as edited. Called when a client reconnects after a
+   * failover.
+   */
+  void replay(uint32_t id, uint64_t after_seq);
+
+  /// @return The room's message history (replicated to standby hubs).
+  HubLog &log() { return log_; }
+
+  /**
+   * @brief Observe messages from local clients and broadcast_all().
+   *
+   * Used to publish them to other hubs. Not synchronised with message
+   * delivery: set it before clients connect and clear it after stop_all().
+   */
+  void set_on_local_message(LocalMessageHook hook);
+
+  /// Register a FanoutTap (before clients connect; same contract as above).
+  void add_fanout_tap(FanoutTap tap);
+
+  /// Set the OpHandler (same contract as set_on_local_message()).
+  void set_op_handler(OpHandler handler);
+
+  /// Set the QueryHandler (same contract as set_on_local_message()).
+  void set_query_handler(QueryHandler handler);
+
+  /// Register an UpdateTap (same contract as set_on_local_message()).
+  void add_update_tap(UpdateTap tap);
+
+  /**
+   * @brief Drop chat a client repeats within @p window_ms (0 = keep all),
+   * before it is numbered or fanned out. Counted in HubMetrics. Same
+   * contract as set_on_local_message().
+   */
+  void set_flood_filter(unsigned window_ms);
+
+  /**
+   * @brief Forward client messages to @p hook instead of broadcasting.
+   *
+   * Makes this room a relay: messages go up the tree and come back through
+   * deliver(). Same contract as set_on_local_message().
+   */
+  void set_upstream(UpstreamHook hook);
+
+  /// @return A fresh id from the client id space, for non-client senders.
+  uint32_t reserve_id();
+
+  /**
+   * @return The session key for client id @p id: what messages from that
+   * connection are logged under as their author. Unique to this room and
+   * process, so a client that reconnects (or moves hub) starts a new
+   * session, and never derived from anything a client sends.
+   */
+  uint64_t session_key(uint32_t id) const {
+    return (static_cast<uint64_t>(session_salt_) << 32) | id;
+  }
+
+  /// @return The client id @p author is the session key of, or 0 if it is
+  ///         not one of this room's.
+  uint32_t client_of(uint64_t author) const;
+
+  /**
+   * @brief Ask up to @p count clients to move to another hub.
+   *
+   * Sends "CMD:REDIRECT:<endpoint>"; the clients reconnect there and resume
+   * from their last sequence number.
+   * @return Number of clients asked.
+   */
+  std::size_t redirect_clients(std::size_t count, const std::string &endpoint);
+
+  /// @return Number of clients that completed their handshake.
   std::size_t client_count() const;
 
   /// Stop all client handlers (called on server shutdown).
   void stop_all();
 
 private:
+  // Declared first so it outlives every handler registered with it
+  std::unique_ptr<IoLoop> io_;
+  uint64_t out_budget_; ///< Memory for clients' queued frames (IoOptions)
+
   mutable Mutex mutex_;
   std::unordered_map<uint32_t, std::unique_ptr<ClientHandler>> clients_;
   uint32_t next_id_{1};
+  uint32_t session_salt_; ///< Random per room; see session_key()
+  LocalMessageHook on_local_message_;
+  UpstreamHook upstream_;
+  OpHandler op_handler_;
+  QueryHandler query_handler_;
+  std::vector<FanoutTap> taps_;
+  std::vector<UpdateTap> update_taps_;
+  std::unique_ptr<FloodFilter> flood_; ///< Null unless set_flood_filter()
+  /// Thread root → clients following it (guarded by mutex_)
+  std::unordered_map<uint64_t, std::unordered_set<uint32_t>> followers_;
+  HubLog log_;
+  Sequencer sequencer_;
+  std::atomic<std::size_t> websocket_clients_{0}; ///< Browsers in clients_
+
+  /// Clients as fan-out sees them; read under an EpochDomain::Guard.
+  struct Roster {
+    std::vector<std::pair<uint32_t, ClientHandler *>> members;
+  };
+  std::atomic<const Roster *> roster_{nullptr};
+
+  /// A removed handler and the epoch stamp it left the roster at.
+  struct Retired {
+    uint64_t stamp;
+    std::unique_ptr<ClientHandler> handler;
+  };
+
+  /// Removed handlers awaiting destruction. A handler is usually removed
+  /// from its own receive thread, which must not destroy (join) itself.
+  std::vector<Retired> retired_;
+
+  CondVar reap_cv_;      ///< A handler retired, or the room is closing
+  bool closing_ = false; ///< Reaper exits (guarded by mutex_)
+  Thread reaper_;        ///< Destroys retired handlers
+
+  /// Destroy retired handlers no fan-out can still be using (never called
+  /// from a handler callback).
+  void reap_retired();
+
+  /// Reaper thread: wait out the epoch of each retired handler and
+  /// destroy it, so they do not wait for the next client to join.
+  void reap_loop();
+
+  /// Replace the roster with one built from clients_ (caller holds mutex_).
+  /// @return The epoch stamp after which the old one is unreachable.
+  uint64_t publish_roster();
+
+  /// Start or stop sending thread @p root to client @p id; starting sends
+  /// the replies so far.
+  void follow(uint32_t id, uint64_t root, bool on);
+
+  /// Number and stamp @p entry, then log and fan it out in turn.
+  void post(LogEntry &entry, uint32_t exclude_id, uint64_t rx_ns,
+            uint64_t origin_hlc);
+
+  /// @return @p entry as a chat frame, encoded ahead for every protocol
+  /// in use (the FrameSet refers to @p entry).
+  FrameSet chat_frame(const LogEntry &entry) const;
+
+  /// Queue @p frames (encoding @p entry) for every active client except
+  /// @p exclude_id, then run the fan-out taps. Never waits on a socket:
+  /// post() calls it inside the sequencer turn.
+  void fanout(const LogEntry &entry, FrameSet &frames, uint32_t exclude_id,
+              uint64_t rx_ns);
 };
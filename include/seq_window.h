@@ -0,0 +1,101 @@
+#pragma once
+/**
+ * @file seq_window.h
+ * @brief Duplicate filter for sequence numbers.
+ *
+ * Remembers the number below which everything has been accepted, plus which
+ * of the next WINDOW numbers were accepted out of order, so redelivered or
+ * reordered messages are recognised in constant space. Used for hub-to-hub
+ * relaying and for clients that resume after a failover.
+ *
+ * A number missing for longer than the window (WINDOW newer numbers have
+ * arrived since) is given up on: it is counted in skipped() and refused if
+ * it turns up after all, so a late arrival is never mistaken for new.
+ *
+ * Usage:
+ *   SeqWindow seen;
+ *   if (seen.accept(seq)) { deliver(msg); }
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class SeqWindow
+ * @brief Accepts each sequence number once (not thread-safe).
+ */
+class SeqWindow {
+public:
+  /// Numbers tracked above the contiguous prefix.
+  static constexpr std::size_t WINDOW = 4096;
+
+  /**
+   * @return true the first time @p seq is offered. Numbers start at 1; the
+   *         first one offered starts the sequence, and lower ones are refused.
+   */
+  bool accept(uint64_t seq) {
+    if (!started_) {
+      started_ = true;
+      base_ = seq != 0 ? seq - 1 : 0;
+    }
+    if (seq <= base_)
+      return false;
+    if (seq - base_ > WINDOW) {
+      give_up(seq - WINDOW);
+    }
+    uint64_t &word = bits_[(seq / 64) % WORDS];
+    uint64_t mask = uint64_t(1) << (seq % 64);
+    if (word & mask)
+      return false;
+    word |= mask;
+    if (seq > highest_)
+      highest_ = seq;
+    advance();
+    return true;
+  }
+
+  /// @return The highest number accepted (0 before the first).
+  uint64_t highest() const { return highest_; }
+
+  /// @return Numbers never accepted because the window moved past them.
+  uint64_t skipped() const { return skipped_; }
+
+private:
+  static constexpr std::size_t WORDS = WINDOW / 64;
+
+  bool started_ = false;
+  uint64_t base_ = 0;     ///< Everything <= base_ is accepted or given up
+  uint64_t highest_ = 0;  ///< Highest number accepted
+  uint64_t skipped_ = 0;  ///< Numbers given up on
+  uint64_t bits_[WORDS] = {}; ///< Bit for n: n accepted, for n in the window
+
+  /// @return true if @p seq (in the window) was accepted; clears its bit.
+  bool take(uint64_t seq) {
+    uint64_t &word = bits_[(seq / 64) % WORDS];
+    uint64_t mask = uint64_t(1) << (seq % 64);
+    bool set = (word & mask) != 0;
+    word &= ~mask;
+    return set;
+  }
+
+  /// Move base_ up to @p to, counting the numbers that never arrived.
+  void give_up(uint64_t to) {
+    uint64_t gap = to - base_;
+    if (gap > WINDOW) {
+      // Nothing beyond the window can have been accepted
+      skipped_ += gap - WINDOW;
+      base_ = to - WINDOW;
+    }
+    while (base_ < to) {
+      if (!take(++base_))
+        ++skipped_;
+    }
+  }
+
+  /// Fold numbers accepted in order into base_.
+  void advance() {
+    while (base_ < highest_ && take(base_ + 1)) {
+      ++base_;
+    }
+  }
+};
@@ -0,0 +1,103 @@
+#pragma once
+/**
+ * @file sequencer.h
+ * @brief Lock-free message numbering with in-order publication.
+ *
+ * Every message a room accepts takes a ticket: the next 64-bit sequence
+ * number (one atomic increment) and a hybrid logical clock stamp (see
+ * hlc.h), or the stamp its origin hub gave it. Threads
+ * then build their frames in parallel and take turns only for the sends,
+ * in ticket order, so every client receives messages in the same total
+ * order without a lock around numbering and encoding.
+ *
+ * The sequence number is the order. Stamps are taken with the ticket,
+ * before the turn, so two messages arriving together may be stamped in
+ * the opposite order to their numbers (and messages from other hubs keep
+ * their origin's stamp): the HLC is a message's time, for showing and for
+ * causality across hubs, not a key to sort a room's messages by.
+ *
+ * Usage:
+ *   Sequencer::Ticket t = seq.next();
+ *   Sequencer::Turn turn(seq, t.seq);               // owns the ticket
+ *   SharedFrame frame = encode(t.seq, t.hlc, text); // in parallel
+ *   turn.wait();                                    // waits for t.seq - 1
+ *   queue_for_everyone(frame);
+ *   // turn destroyed: lets t.seq + 1 go, even if encode() threw
+ */
+
+#include "hlc.h"
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @class Sequencer
+ * @brief Hands out sequence numbers and orders their publication.
+ */
+class Sequencer {
+public:
+  /// A message's place in the room's total order.
+  struct Ticket {
+    uint64_t seq; ///< Starts at 1, no gaps
+    uint64_t hlc; ///< Hybrid logical clock stamp
+  };
+
+  /**
+   * @class Turn
+   * @brief Owns a ticket from next() on. wait() waits for every earlier
+   * ticket to finish; destruction finishes this one (waiting first if
+   * wait() was not reached), so an exception cannot strand later tickets.
+   * Keep the work after wait() short: later tickets spin on it.
+   */
+  class Turn {
+  public:
+    Turn(Sequencer &sequencer, uint64_t seq);
+    ~Turn();
+
+    Turn(const Turn &) = delete;
+    Turn &operator=(const Turn &) = delete;
+
+    /// Wait until every earlier ticket has finished.
+    void wait();
+
+  private:
+    Sequencer &sequencer_;
+    uint64_t seq_;
+    bool waited_ = false;
+  };
+
+  Sequencer() = default;
+
+  // Non-copyable (atomics)
+  Sequencer(const Sequencer &) = delete;
+  Sequencer &operator=(const Sequencer &) = delete;
+
+  /**
+   * @brief Take the next ticket (thread-safe, lock-free). Pass it to a
+   * Turn straight away: a ticket whose turn never finishes makes every
+   * later ticket wait forever.
+   * @param origin_hlc Stamp from the hub the message came from, kept as
+   *                   the ticket's stamp; 0 stamps it here.
+   */
+  Ticket next(uint64_t origin_hlc = 0);
+
+  /**
+   * @brief Continue numbering after @p seq, which was assigned elsewhere
+   * (entries copied from a leader or upstream hub), and merge @p hlc.
+   *
+   * Must not race with tickets in flight.
+   */
+  void advance(uint64_t seq, uint64_t hlc);
+
+  /// @return The last sequence number whose turn has finished.
+  uint64_t published() const { return done_.load(std::memory_order_acquire); }
+
+  /// Wait until the turn of @p seq (and so every earlier one) has
+  /// finished. @p seq must already be taken.
+  void wait_published(uint64_t seq) const;
+
+private:
+  std::atomic<uint64_t> next_{1};
+  std::atomic<uint64_t> done_{0};
+  HybridClock clock_;
+};
@@ -11,10 +11,14 @@
  *   ...
  *   srv.stop();
  *
+ * With set_admission(), connections the Admission refuses are reset right
+ * after accept and never reach the callback.
+ *
  * Usage (single-client, legacy):
  *   SocketWrapper conn = srv.accept_client();  // blocks
  */
 
+#include "admission.h"
 #include "socket_wrapper.h"
 
 #include "compat.h"
@@ -58,6 +62,13 @@ public:
    */
   void set_on_new_client(NewClientCallback cb);
 
+  /**
+   * @brief Check each accepted connection with @p admission first (null =
+   * admit all). Must be set before calling start_accept_loop(), and
+   * @p admission must outlive the accept loop.
+   */
+  void set_admission(Admission *admission);
+
   /**
    * @brief Start a background thread that continuously accepts new clients.
    * Calls on_new_client callback for each accepted connection.
@@ -90,6 +101,7 @@ private:
   std::atomic<bool> running_{false};
   Thread accept_thread_;
   NewClientCallback on_new_client_;
+  Admission *admission_ = nullptr;
 
   /// Background accept loop entry point.
   void accept_loop();
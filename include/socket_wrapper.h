@@ -10,6 +10,9 @@
  * Wire format (per message):
  *   [4 bytes – uint32_t length (network byte order)] [<length> bytes – UTF-8
  * text]
+ *
+ * Sockets set to WireProtocol::WebSocket carry the same messages as
+ * WebSocket frames instead (see websocket.h).
  */
 
 #ifndef WIN32_LEAN_AND_MEAN
@@ -19,12 +22,54 @@
 #include <ws2tcpip.h>
 
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <stdexcept>
 #include <string>
 
 /// Default TCP port used by both server and client.
 constexpr unsigned short DEFAULT_PORT = 54000;
 
+/// An encoded wire frame (length header + body), shared between recipients.
+using SharedFrame = std::shared_ptr<const std::string>;
+
+/// How a connection frames its messages.
+enum class WireProtocol {
+  Native,   ///< 4-byte length prefix (LAN_Chat clients and hubs)
+  WebSocket ///< WebSocket frames after an HTTP upgrade (browsers)
+};
+
+/**
+ * @class FrameSet
+ * @brief One message encoded at most once per wire protocol.
+ *
+ * A broadcast goes to native and WebSocket clients alike; each encoding is
+ * made the first time a recipient needs it (or by prepare()) and then
+ * shared by every recipient of that protocol. Not thread-safe.
+ */
+class FrameSet {
+public:
+  /// Builds the frame for one protocol (see encode_chat()).
+  using Encoder = std::function<SharedFrame(WireProtocol)>;
+
+  explicit FrameSet(std::string message) : message_(std::move(message)) {}
+
+  /// Frames made by @p encode instead of from a text message; whatever it
+  /// refers to must outlive the FrameSet.
+  explicit FrameSet(Encoder encode) : encode_(std::move(encode)) {}
+
+  /// @return The message framed for @p protocol.
+  const SharedFrame &get(WireProtocol protocol);
+
+  /// Encode for @p protocol now, e.g. before taking a lock.
+  void prepare(WireProtocol protocol) { get(protocol); }
+
+private:
+  std::string message_;
+  Encoder encode_;
+  SharedFrame frames_[2]; ///< Indexed by WireProtocol
+};
+
 /**
  * @class SocketWrapper
  * @brief Owns a Winsock SOCKET and exposes simple string send/receive.
@@ -53,6 +98,25 @@ public:
    */
   void send_message(const std::string &message);
 
+  /**
+   * @brief Encode @p message once so it can be sent to many peers.
+   * @return Length header and body, ready for send_frame().
+   */
+  static SharedFrame encode_frame(const std::string &message);
+
+  /// Encode a binary payload (same framing as send_binary()).
+  static SharedFrame encode_frame(const char *data, uint32_t len);
+
+  /// Encode @p message for a socket speaking @p protocol.
+  static SharedFrame encode_frame(WireProtocol protocol,
+                                  const std::string &message);
+
+  /**
+   * @brief Send a frame produced by encode_frame().
+   * @throws std::runtime_error on socket error.
+   */
+  void send_frame(const std::string &wire);
+
   /**
    * @brief Block until a complete message is received from the remote peer.
    * @return The received UTF-8 string, or an empty string if the peer
@@ -76,6 +140,87 @@ public:
    */
   bool receive_binary(std::string &out);
 
+  /// Result of a non-blocking receive attempt.
+  enum class RecvStatus {
+    Message,    ///< A complete message was stored in the output string
+    WouldBlock, ///< No complete message buffered yet; try again later
+    Closed      ///< Peer disconnected or the socket failed
+  };
+
+  /**
+   * @brief Receive one message without blocking.
+   *
+   * Reads whatever the kernel has buffered and reassembles frames in an
+   * internal buffer, so a message split across TCP segments is returned
+   * once its last byte arrives. Intended for sockets in non-blocking mode.
+   *
+   * @param out Receives the message when RecvStatus::Message is returned.
+   * @throws std::runtime_error if the peer announces an oversized message.
+   */
+  RecvStatus try_receive_message(std::string &out);
+
+  /// Result of a non-blocking send attempt.
+  enum class SendStatus {
+    Sent,       ///< The whole frame is written
+    WouldBlock, ///< The socket buffer is full; the rest must wait
+    Closed      ///< Peer disconnected or the socket failed
+  };
+
+  /**
+   * @brief Write as much of @p wire from @p offset on as the kernel takes,
+   * without blocking (for sockets in non-blocking mode).
+   * @param offset Advanced past the bytes written.
+   */
+  SendStatus try_send(const std::string &wire, std::size_t &offset);
+
+  /**
+   * @brief Wait up to @p timeout_ms for the socket to become writable.
+   * @return false on timeout or error.
+   */
+  bool wait_writable(unsigned timeout_ms);
+
+  /**
+   * @brief Switch the socket between blocking and non-blocking mode.
+   *
+   * The blocking send/receive calls keep working on a non-blocking socket;
+   * they wait for readiness with select() instead of failing, or suspend
+   * the current Fiber when called on one.
+   */
+  void set_non_blocking(bool enabled);
+
+  /**
+   * @brief Choose how messages are framed (before the first receive).
+   *
+   * A WebSocket socket first returns the browser's upgrade request (request
+   * line and headers) as one message; everything after it is frames.
+   */
+  void set_protocol(WireProtocol protocol) { protocol_ = protocol; }
+
+  /// @return How this socket frames its messages.
+  WireProtocol protocol() const { return protocol_; }
+
+  /// Sends a WebSocket control frame (pong or close) on the receive
+  /// path's behalf, so it is serialised with the owner's other sends.
+  using ControlSender = std::function<void(const SharedFrame &frame)>;
+
+  /// Set the ControlSender (by default the frame is written directly).
+  void set_control_sender(ControlSender sender) {
+    control_sender_ = std::move(sender);
+  }
+
+  /// Disable Nagle's algorithm so small frames leave immediately.
+  void set_no_delay(bool enabled);
+
+  /**
+   * @brief Ask the kernel to busy-poll the device queue on receive.
+   * @param usec Busy-poll budget in microseconds.
+   * @return false where SO_BUSY_POLL is not available (e.g. Winsock).
+   */
+  bool set_busy_poll(int usec);
+
+  /// @return The raw OS handle (for readiness polling only).
+  SOCKET handle() const { return sock_; }
+
   /// @return true if the underlying socket handle is valid.
   bool is_valid() const;
 
@@ -84,6 +229,32 @@ public:
 
 private:
   SOCKET sock_;
+  bool non_blocking_ = false;
+  std::string rx_buf_;     ///< Bytes read ahead by try_receive_message()
+  std::size_t rx_off_ = 0; ///< Consumed prefix of rx_buf_
+
+  WireProtocol protocol_ = WireProtocol::Native;
+  bool ws_open_ = false;   ///< WebSocket: upgrade request already returned
+  std::string ws_partial_; ///< WebSocket: fragments of an unfinished message
+  bool ws_fragmented_ = false; ///< WebSocket: ws_partial_ is in use
+  ControlSender control_sender_;
+
+  /**
+   * @brief WebSocket: take the next message out of rx_buf_.
+   * @return WouldBlock if more bytes are needed.
+   * @throws std::runtime_error if the browser breaks the protocol.
+   */
+  RecvStatus next_websocket_message(std::string &out);
+
+  /// WebSocket: send a control frame through control_sender_.
+  void send_control(const SharedFrame &frame);
+
+  /// Drop the consumed prefix of rx_buf_ and read what the kernel has.
+  /// @return The recv() result.
+  int fill_rx_buf();
+
+  /// Wait until the socket is readable (or writable) — non-blocking mode.
+  bool wait_ready(bool for_write);
 
   /**
    * @brief Send exactly @p len bytes from @p buf.
@@ -0,0 +1,60 @@
+#pragma once
+/**
+ * @file thread_scaler.h
+ * @brief Decides how many IO threads to keep awake from measured load.
+ *
+ * IoLoop samples its awake threads every SAMPLE_MS: the share of the
+ * interval they spent servicing sockets, the longest single pass (how long
+ * a ready socket may have waited for its turn), and how many times a
+ * client's read budget ran out with input still waiting. The scaler turns
+ * those samples into a thread count between the configured bounds:
+ *
+ *   hot   busy >= 70%, a pass >= 2 ms, or budgets running out at >= 50%
+ *         → after 2 hot samples in a row wake one more thread
+ *           (double them at >= 90% busy)
+ *   cold  the load would still leave the threads under 35% busy with one
+ *         fewer → after 40 cold samples in a row (10 s) park all but as
+ *           many as keep them under 35%
+ *
+ * Waking is quick so a meeting that starts gets its threads within a
+ * second or two; parking waits so the count does not flap with bursts.
+ * Any change restarts both counts.
+ *
+ * Not thread-safe (only IoLoop's sampling thread uses it).
+ *
+ * Usage:
+ *   ThreadScaler scaler(1, 8);
+ *   unsigned awake = scaler.decide(sample);
+ */
+
+#include <cstdint>
+
+/// What the awake IO threads did during one sampling interval.
+struct ScaleSample {
+  unsigned awake = 0;       ///< Threads awake during the interval
+  double busy = 0;          ///< Their mean share of time spent working, 0–1
+  uint64_t max_pass_ns = 0; ///< Longest pass over a shard
+  uint64_t owed = 0;        ///< Reads cut short by the read budget
+};
+
+/**
+ * @class ThreadScaler
+ * @brief Threshold policy with hysteresis for the number of IO threads.
+ */
+class ThreadScaler {
+public:
+  /// Sampling interval.
+  static constexpr unsigned SAMPLE_MS = 250;
+
+  /// @param min Threads never parked. @param max Most threads awake.
+  ThreadScaler(unsigned min, unsigned max);
+
+  /// @return The number of threads that should be awake after @p sample.
+  unsigned decide(const ScaleSample &sample);
+
+private:
+  unsigned min_;
+  unsigned max_;
+  unsigned hot_ = 0;  ///< Consecutive hot samples
+  unsigned cold_ = 0; ///< Consecutive cold samples
+};
@@ -7,4 +7,4 @@
  * a new version to connecting clients automatically.
  */
 
-constexpr const char *APP_VERSION = "2.0.0";
+constexpr const char *APP_VERSION = "2.7.0";
@@ -0,0 +1,106 @@
+#pragma once
+/**
+ * @file websocket.h
+ * @brief WebSocket (RFC 6455) upgrade handshake and frame codec.
+ *
+ * Browsers reach the hub over WebSocket on a port of their own (see
+ * --ws-port). A connection starts as HTTP: the browser sends an upgrade
+ * request, the hub answers "101 Switching Protocols" with a key derived
+ * from the browser's Sec-WebSocket-Key, and from then on both sides send
+ * frames:
+ *
+ *   [FIN|opcode] [MASK|len] [16- or 64-bit len]? [4-byte mask]? [payload]
+ *
+ * Each WebSocket message holds exactly what a native client sends or
+ * receives in a length-prefixed frame, so WebSocket sessions speak the
+ * ordinary protocol and join the same Room: "CMD:..." commands and chat
+ * lines as text frames, chat messages from the hub as binary frames (see
+ * chat_frame.h). Browser frames are masked; the hub's are not.
+ *
+ * SocketWrapper does the framing for sockets set to WireProtocol::WebSocket
+ * (reassembling fragmented messages, answering pings and closes); this
+ * header is the codec underneath.
+ *
+ * Usage:
+ *   std::string response;
+ *   bool ok = websocket::answer_upgrade(request, response);
+ *   conn.write_raw(response);                       // 101, or 400 if !ok
+ *   SharedFrame frame = websocket::encode_frame("CMD:OK");
+ */
+
+#include "socket_wrapper.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace websocket {
+
+// Frame types (opcodes)
+constexpr uint8_t CONTINUATION = 0x0;
+constexpr uint8_t TEXT = 0x1;
+constexpr uint8_t BINARY = 0x2;
+constexpr uint8_t CLOSE = 0x8;
+constexpr uint8_t PING = 0x9;
+constexpr uint8_t PONG = 0xA;
+
+/// Largest upgrade request accepted (request line and headers).
+constexpr std::size_t MAX_REQUEST = 8 * 1024;
+
+/// Largest message accepted, fragments included (as for native frames).
+constexpr uint64_t MAX_MESSAGE = 64u * 1024u * 1024u;
+
+/// Longest header of a frame the hub sends (64-bit length, no mask).
+constexpr std::size_t MAX_HEADER = 10;
+
+/// A decoded frame header.
+struct Frame {
+  bool fin = false;
+  uint8_t opcode = CONTINUATION;
+  std::size_t header = 0; ///< Bytes before the payload
+  std::size_t length = 0; ///< Payload bytes
+};
+
+/// @return The Sec-WebSocket-Accept value for a Sec-WebSocket-Key.
+std::string accept_key(const std::string &key);
+
+/**
+ * @brief Check an upgrade request and build the hub's answer.
+ * @param request  Request line and headers, through the blank line.
+ * @param response Set to the "101 Switching Protocols" answer, or to a
+ *                 "400 Bad Request" if @p request is not an upgrade.
+ * @return true if the connection speaks WebSocket from here on.
+ */
+bool answer_upgrade(const std::string &request, std::string &response);
+
+/// @return Header bytes of an unmasked frame carrying @p len bytes.
+inline std::size_t header_size(std::size_t len) {
+  return len < 126 ? 2 : len <= 0xFFFF ? 4 : MAX_HEADER;
+}
+
+/**
+ * @brief Write the header of an unmasked, unfragmented frame to @p out.
+ * @return Bytes written (header_size(len)); the payload goes right after.
+ */
+std::size_t write_header(uint8_t opcode, std::size_t len, char *out);
+
+/// @return An unmasked frame of type @p opcode carrying @p len bytes.
+SharedFrame encode_frame(uint8_t opcode, const char *data, std::size_t len);
+
+/// @return An unmasked text frame carrying @p message.
+inline SharedFrame encode_frame(const std::string &message) {
+  return encode_frame(TEXT, message.data(), message.size());
+}
+
+/**
+ * @brief Decode the browser frame at the start of @p data.
+ *
+ * The payload, at data + out.header, is unmasked in place.
+ * @return Bytes the whole frame takes, or 0 if it has not all arrived.
+ * @throws std::runtime_error if the frame breaks the protocol (unmasked,
+ *         reserved bits set, an oversized or fragmented control frame, or
+ *         a payload over MAX_MESSAGE).
+ */
+std::size_t decode_frame(char *data, std::size_t size, Frame &out);
+
+} // namespace websocket
@@ -0,0 +1,125 @@
+#pragma once
+/**
+ * @file wire.h
+ * @brief Minimal big-endian binary encoding for structured frames.
+ *
+ * Chat frames between client and server are plain text, but hub-to-hub
+ * traffic carries ids, sequence numbers and timestamps. WireWriter appends
+ * fixed-width integers and length-prefixed strings; WireReader reads them
+ * back with bounds checks and reports truncation instead of throwing.
+ *
+ * Usage:
+ *   WireWriter w;
+ *   w.put_u8(TYPE_MSG);
+ *   w.put_u64(seq);
+ *   w.put_str(text);
+ *   socket.send_message(w.data());
+ *
+ *   WireReader r(frame);
+ *   uint8_t type; uint64_t seq; std::string text;
+ *   if (!r.get_u8(type) || !r.get_u64(seq) || !r.get_str(text)) { ... }
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @class WireWriter
+ * @brief Appends big-endian fields to a growing byte string.
+ */
+class WireWriter {
+public:
+  void put_u8(uint8_t v) { buf_.push_back(static_cast<char>(v)); }
+
+  void put_u32(uint32_t v) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      buf_.push_back(static_cast<char>((v >> shift) & 0xFF));
+    }
+  }
+
+  void put_u64(uint64_t v) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      buf_.push_back(static_cast<char>((v >> shift) & 0xFF));
+    }
+  }
+
+  /// Length-prefixed (u32) byte string.
+  void put_str(const std::string &s) {
+    put_u32(static_cast<uint32_t>(s.size()));
+    buf_.append(s);
+  }
+
+  /// @return The encoded bytes.
+  const std::string &data() const { return buf_; }
+
+  /// @return The encoded bytes, moved out.
+  std::string release() { return std::move(buf_); }
+
+private:
+  std::string buf_;
+};
+
+/**
+ * @class WireReader
+ * @brief Reads big-endian fields from a byte string without copying it.
+ *
+ * Every getter returns false (and leaves the output untouched) if the
+ * remaining input is too short.
+ */
+class WireReader {
+public:
+  explicit WireReader(const std::string &buf)
+      : data_(buf.data()), size_(buf.size()) {}
+
+  WireReader(const char *data, std::size_t size) : data_(data), size_(size) {}
+
+  bool get_u8(uint8_t &v) {
+    if (remaining() < 1)
+      return false;
+    v = static_cast<uint8_t>(data_[off_++]);
+    return true;
+  }
+
+  bool get_u32(uint32_t &v) {
+    if (remaining() < 4)
+      return false;
+    uint32_t out = 0;
+    for (int i = 0; i < 4; ++i) {
+      out = (out << 8) | static_cast<uint8_t>(data_[off_++]);
+    }
+    v = out;
+    return true;
+  }
+
+  bool get_u64(uint64_t &v) {
+    if (remaining() < 8)
+      return false;
+    uint64_t out = 0;
+    for (int i = 0; i < 8; ++i) {
+      out = (out << 8) | static_cast<uint8_t>(data_[off_++]);
+    }
+    v = out;
+    return true;
+  }
+
+  bool get_str(std::string &v) {
+    std::size_t start = off_;
+    uint32_t len = 0;
+    if (!get_u32(len) || remaining() < len) {
+      off_ = start;
+      return false;
+    }
+    v.assign(data_ + off_, len);
+    off_ += len;
+    return true;
+  }
+
+  /// @return Bytes not yet consumed.
+  std::size_t remaining() const { return size_ - off_; }
+
+private:
+  const char *data_;
+  std::size_t size_;
+  std::size_t off_ = 0;
+};
@@ -0,0 +1,238 @@
+/**
+ * @file admission.cpp
+ * @brief Implementation of Admission – address lists and connection rates.
+ */
+
+#include "admission.h"
+
+#include "epoch.h"
+#include "metrics.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+/// Granularity of waits, so stop() is prompt.
+constexpr unsigned TICK_MS = 100;
+
+/// Buckets kept before full ones are dropped (at most once a second).
+constexpr std::size_t SWEEP_BUCKETS = 1024;
+
+/// @return @p text without surrounding blanks.
+std::string trim(const std::string &text) {
+  const char *blanks = " \t\r\n";
+  std::string::size_type first = text.find_first_not_of(blanks);
+  if (first == std::string::npos)
+    return std::string();
+  return text.substr(first, text.find_last_not_of(blanks) - first + 1);
+}
+
+} // namespace
+
+// ── Construction / Destruction
+// ────────────────────────────────────────────────
+
+Admission::Admission(const AdmissionOptions &options) : options_(options) {
+  rules_.store(compile());
+  allow_stamp_ = stamp_of(options_.allow_file);
+  deny_stamp_ = stamp_of(options_.deny_file);
+}
+
+Admission::~Admission() {
+  stop();
+  delete rules_.load(); // servers stopped checking before we go
+}
+
+// ── Lifecycle
+// ─────────────────────────────────────────────────────────────────
+
+void Admission::start() {
+  if (options_.allow_file.empty() && options_.deny_file.empty())
+    return; // nothing to follow
+  if (running_.exchange(true))
+    return;
+  thread_ = Thread(&Admission::run, this);
+}
+
+void Admission::stop() {
+  if (!running_.exchange(false))
+    return;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+// ── Checking
+// ──────────────────────────────────────────────────────────────────
+
+Admission::Verdict Admission::check(uint32_t address) {
+  HubMetrics &metrics = HubMetrics::instance();
+  {
+    EpochDomain::Guard guard;
+    const Rules *rules = rules_.load();
+    CidrTrie::Rule rule = rules->trie.lookup(address);
+    if (rule == CidrTrie::Rule::Deny ||
+        (rule == CidrTrie::Rule::None && rules->allow_only)) {
+      metrics.conn_denied.fetch_add(1, std::memory_order_relaxed);
+      return Verdict::Denied;
+    }
+  }
+
+  if (options_.rate != 0 && !take_token(address)) {
+    metrics.conn_limited.fetch_add(1, std::memory_order_relaxed);
+    return Verdict::RateLimited;
+  }
+  return Verdict::Admit;
+}
+
+bool Admission::take_token(uint32_t address) {
+  uint64_t now = monotonic_ns();
+  double rate = static_cast<double>(options_.rate);
+
+  LockGuard<Mutex> lock(buckets_mutex_);
+  if (buckets_.size() > SWEEP_BUCKETS && now - swept_ns_ > 1000000000ull) {
+    // Forget addresses that have been quiet long enough to be full again
+    for (auto it = buckets_.begin(); it != buckets_.end();) {
+      double idle_s = static_cast<double>(now - it->second.updated_ns) / 1e9;
+      if (it->second.tokens + idle_s * rate >= rate) {
+        it = buckets_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    swept_ns_ = now;
+  }
+
+  auto found = buckets_.find(address);
+  if (found == buckets_.end()) {
+    Bucket fresh;
+    fresh.tokens = rate;
+    fresh.updated_ns = now;
+    found = buckets_.emplace(address, fresh).first;
+  }
+  Bucket &bucket = found->second;
+  double idle_s = static_cast<double>(now - bucket.updated_ns) / 1e9;
+  bucket.tokens = std::min(rate, bucket.tokens + idle_s * rate);
+  bucket.updated_ns = now;
+  if (bucket.tokens < 1.0)
+    return false;
+  bucket.tokens -= 1.0;
+  return true;
+}
+
+std::string Admission::describe() const {
+  std::ostringstream oss;
+  {
+    EpochDomain::Guard guard;
+    const Rules *rules = rules_.load();
+    if (rules->allow_only) {
+      oss << rules->allowed << " allowed ranges, ";
+    }
+    oss << rules->denied << " denied";
+  }
+  if (options_.rate != 0) {
+    oss << ", " << options_.rate << " connections/s per address";
+  }
+  return oss.str();
+}
+
+// ── Lists
+// ─────────────────────────────────────────────────────────────────────
+
+Admission::Rules *Admission::compile() const {
+  std::unique_ptr<Rules> rules(new Rules);
+  if (!options_.allow_file.empty()) {
+    rules->allow_only = true;
+    rules->allowed =
+        load(options_.allow_file, CidrTrie::Rule::Allow, *rules);
+    if (rules->allowed == 0) {
+      // Still deny by default: an emptied list must not open the hub up
+      std::cerr << "\033[2K\r[Admission] Warning: " << options_.allow_file
+                << " lists no addresses; every client will be refused\n";
+    }
+  }
+  if (!options_.deny_file.empty()) {
+    rules->denied = load(options_.deny_file, CidrTrie::Rule::Deny, *rules);
+  }
+  rules->trie.pack();
+  return rules.release();
+}
+
+std::size_t Admission::load(const std::string &path, CidrTrie::Rule rule,
+                            Rules &rules) {
+  std::ifstream in(path.c_str());
+  if (!in) {
+    throw std::runtime_error("Cannot read address list " + path);
+  }
+
+  std::size_t entries = 0;
+  std::string line;
+  for (unsigned number = 1; std::getline(in, line); ++number) {
+    std::string entry = trim(line.substr(0, line.find('#')));
+    if (entry.empty())
+      continue;
+    uint32_t network = 0;
+    unsigned bits = 0;
+    if (!CidrTrie::parse(entry, network, bits)) {
+      throw std::runtime_error(path + ":" + std::to_string(number) +
+                               ": not an address or CIDR range: " + entry);
+    }
+    rules.trie.insert(network, bits, rule);
+    ++entries;
+  }
+  return entries;
+}
+
+Admission::Stamp Admission::stamp_of(const std::string &path) {
+  Stamp stamp;
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if (!path.empty() &&
+      GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data)) {
+    stamp.write_time =
+        (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) |
+        data.ftLastWriteTime.dwLowDateTime;
+    stamp.size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) |
+                 data.nFileSizeLow;
+  }
+  return stamp;
+}
+
+void Admission::run() {
+  while (running_.load()) {
+    for (unsigned waited = 0; running_.load() && waited < POLL_MS;
+         waited += TICK_MS) {
+      Sleep(TICK_MS);
+    }
+
+    Stamp allow = stamp_of(options_.allow_file);
+    Stamp deny = stamp_of(options_.deny_file);
+    if (allow.write_time == allow_stamp_.write_time &&
+        allow.size == allow_stamp_.size &&
+        deny.write_time == deny_stamp_.write_time &&
+        deny.size == deny_stamp_.size)
+      continue;
+    // Take the new stamps first: a broken file is reported once, not
+    // every poll, and the next save is picked up again
+    allow_stamp_ = allow;
+    deny_stamp_ = deny;
+
+    Rules *fresh = nullptr;
+    try {
+      fresh = compile();
+    } catch (const std::exception &e) {
+      std::cerr << "\033[2K\r[Admission] " << e.what()
+                << " (keeping the previous lists)\n";
+      continue;
+    }
+    const Rules *old = rules_.exchange(fresh);
+    EpochDomain::instance().retire([old] { delete old; });
+    std::cout << "\033[2K\r[Admission] Lists reloaded: " << describe()
+              << "\n"
+              << "You: " << std::flush;
+  }
+}
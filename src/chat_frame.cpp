@@ -0,0 +1,184 @@
+/**
+ * @file chat_frame.cpp
+ * @brief Implementation of the chat frame writer and its buffer pool.
+ */
+
+#include "chat_frame.h"
+
+#include "websocket.h"
+
+#include "compat.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace {
+
+/// Buffers kept for reuse; enough for a burst of broadcasts in flight.
+constexpr std::size_t POOL_MAX = 256;
+
+/// Larger buffers are freed rather than pooled (a rare huge paste).
+constexpr std::size_t POOLED_BYTES_MAX = 64 * 1024;
+
+/// Room for a SharedFrame's control block (pointer, counts, deleter).
+constexpr std::size_t BLOCK_BYTES = 64;
+
+/**
+ * @class FramePool
+ * @brief Free lists of frame buffers and of the control blocks that count
+ * their owners, shared by every broadcast.
+ *
+ * A frame goes out as a SharedFrame whose deleter hands the buffer back
+ * and whose allocator hands the control block back, so both return here
+ * once the last client has sent it. Thread-safe.
+ */
+class FramePool {
+public:
+  static FramePool &instance() {
+    // Never destroyed: frames still queued at exit return to it
+    static FramePool *pool = new FramePool;
+    return *pool;
+  }
+
+  /// @return A buffer of @p size bytes (contents unspecified).
+  std::string *acquire(std::size_t size) {
+    std::string *buf = nullptr;
+    {
+      LockGuard<Mutex> lock(mutex_);
+      if (!free_.empty()) {
+        buf = free_.back();
+        free_.pop_back();
+      }
+    }
+    if (!buf) {
+      buf = new std::string;
+    }
+    buf->resize(size);
+    return buf;
+  }
+
+  void release(std::string *buf) {
+    if (buf->capacity() <= POOLED_BYTES_MAX) {
+      LockGuard<Mutex> lock(mutex_);
+      if (free_.size() < POOL_MAX) {
+        free_.push_back(buf);
+        return;
+      }
+    }
+    delete buf;
+  }
+
+  /// @return Raw storage for a control block of @p size bytes.
+  void *acquire_block(std::size_t size) {
+    if (size <= BLOCK_BYTES) {
+      LockGuard<Mutex> lock(mutex_);
+      if (!free_blocks_.empty()) {
+        void *block = free_blocks_.back();
+        free_blocks_.pop_back();
+        return block;
+      }
+    }
+    return ::operator new(size <= BLOCK_BYTES ? BLOCK_BYTES : size);
+  }
+
+  void release_block(void *block, std::size_t size) {
+    if (size <= BLOCK_BYTES) {
+      LockGuard<Mutex> lock(mutex_);
+      if (free_blocks_.size() < POOL_MAX) {
+        free_blocks_.push_back(block);
+        return;
+      }
+    }
+    ::operator delete(block);
+  }
+
+private:
+  Mutex mutex_;
+  std::vector<std::string *> free_;
+  std::vector<void *> free_blocks_;
+};
+
+/// Allocator that takes SharedFrame control blocks from the FramePool.
+template <typename T> struct BlockAllocator {
+  using value_type = T;
+
+  BlockAllocator() = default;
+  template <typename U> BlockAllocator(const BlockAllocator<U> &) {}
+
+  T *allocate(std::size_t n) {
+    return static_cast<T *>(
+        FramePool::instance().acquire_block(n * sizeof(T)));
+  }
+  void deallocate(T *p, std::size_t n) {
+    FramePool::instance().release_block(p, n * sizeof(T));
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const BlockAllocator<T> &, const BlockAllocator<U> &) {
+  return true;
+}
+template <typename T, typename U>
+bool operator!=(const BlockAllocator<T> &, const BlockAllocator<U> &) {
+  return false;
+}
+
+template <typename T> void store(char *p, std::size_t offset, T v) {
+  std::memcpy(p + offset, &v, sizeof(T));
+}
+
+} // namespace
+
+std::size_t chat_size(const LogEntry &entry) {
+  std::size_t sender = std::min<std::size_t>(entry.sender.size(), 0xFFFF);
+  return CHAT_HEADER + sender + entry.text.size();
+}
+
+SharedFrame encode_chat(WireProtocol protocol, const LogEntry &entry) {
+  std::size_t payload = chat_size(entry);
+  std::size_t header = protocol == WireProtocol::WebSocket
+                           ? websocket::header_size(payload)
+                           : 4;
+
+  FramePool &pool = FramePool::instance();
+  std::string *buf = pool.acquire(header + payload);
+  char *p = &(*buf)[0];
+
+  if (protocol == WireProtocol::WebSocket) {
+    websocket::write_header(websocket::BINARY, payload, p);
+  } else {
+    // Big-endian length, as SocketWrapper::encode_frame() writes it
+    uint32_t len = static_cast<uint32_t>(payload);
+    for (int i = 0; i < 4; ++i) {
+      p[i] = static_cast<char>((len >> (24 - 8 * i)) & 0xFF);
+    }
+  }
+  p += header;
+
+  uint16_t sender_len = static_cast<uint16_t>(
+      std::min<std::size_t>(entry.sender.size(), 0xFFFF));
+#define CHAT_FRAME_OFFSET(type, name, offset)                                  \
+  constexpr std::size_t name##_at = offset;
+  CHAT_FRAME_FIELDS(CHAT_FRAME_OFFSET)
+#undef CHAT_FRAME_OFFSET
+  store<uint8_t>(p, kind_at, CHAT_KIND);
+  store<uint8_t>(p, flags_at, entry.edited ? CHAT_EDITED : 0);
+  store<uint16_t>(p, sender_len_at, sender_len);
+  store<uint32_t>(p, body_len_at, static_cast<uint32_t>(entry.text.size()));
+  store<uint64_t>(p, seq_at, entry.seq);
+  store<uint64_t>(p, hlc_at, entry.hlc);
+  store<uint64_t>(p, parent_at, entry.parent);
+  std::memcpy(p + CHAT_HEADER, entry.sender.data(), sender_len);
+  if (!entry.text.empty()) {
+    std::memcpy(p + CHAT_HEADER + sender_len, entry.text.data(),
+                entry.text.size());
+  }
+
+  return SharedFrame(
+      buf,
+      [&pool](const std::string *done) {
+        pool.release(const_cast<std::string *>(done));
+      },
+      BlockAllocator<char>());
+}
@@ -5,24 +5,62 @@
 
 #include "chat_session.h"
 
+#include "epoch.h"
+
 #include <iostream>
+#include <new>
+
+// ── Construction
+// ──────────────────────────────────────────────────────────────
+
+ChatSession::ChatSession() : chunks_(new Chunks) {}
+
+ChatSession::~ChatSession() { delete chunks_.load(); }
 
 // ── Public API
 // ────────────────────────────────────────────────────────────────
 
 void ChatSession::add(const Message &msg) {
   LockGuard<Mutex> lock(mutex_);
-  history_.push_back(msg);
+
+  std::size_t count = published_.load(std::memory_order_relaxed);
+  if (count % CHUNK == 0) {
+    // Start a chunk: publish a longer list before any message in it
+    auto chunk = std::make_shared<Chunk>();
+    tail_ = chunk.get();
+
+    const Chunks *old = chunks_.load();
+    auto *chunks = new Chunks(*old);
+    chunks->push_back(std::move(chunk));
+    chunks_.store(chunks);
+    EpochDomain::instance().retire([old] { delete old; });
+  }
+
+  // A slot no reader can see yet; the release stores publish it
+  std::size_t slot = count % CHUNK;
+  new (&tail_->at(slot)) Message(msg);
+  tail_->size.store(slot + 1, std::memory_order_release);
+  published_.store(count + 1, std::memory_order_release);
+}
+
+ChatSession::Snapshot ChatSession::snapshot() const {
+  Snapshot view;
+  EpochDomain::Guard guard;
+  // Count first: any list loaded after it covers every counted message
+  view.count_ = published_.load(std::memory_order_acquire);
+  const Chunks *chunks = chunks_.load();
+  view.chunks_.assign(chunks->begin(),
+                      chunks->begin() + (view.count_ + CHUNK - 1) / CHUNK);
+  return view;
 }
 
 void ChatSession::print_history() const {
-  LockGuard<Mutex> lock(mutex_);
-  for (const auto &msg : history_) {
-    std::cout << msg.format() << "\n";
+  Snapshot view = snapshot();
+  for (std::size_t i = 0; i < view.size(); ++i) {
+    std::cout << view[i].format() << "\n";
   }
 }
 
 std::size_t ChatSession::size() const {
-  LockGuard<Mutex> lock(mutex_);
-  return history_.size();
+  return published_.load(std::memory_order_acquire);
 }
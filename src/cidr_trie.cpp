@@ -0,0 +1,216 @@
+/**
+ * @file cidr_trie.cpp
+ * @brief Implementation of CidrTrie – longest-prefix IPv4 rules.
+ */
+
+#include "cidr_trie.h"
+
+#include <cstdlib>
+
+namespace {
+
+/// The top @p bits bits set (0 for 0: shifting by 32 is undefined).
+uint32_t mask(unsigned bits) {
+  return bits == 0 ? 0 : ~uint32_t{0} << (32 - bits);
+}
+
+/// Bit @p index of @p value, counting from the most significant.
+unsigned bit_at(uint32_t value, unsigned index) {
+  return (value >> (31 - index)) & 1;
+}
+
+/// Leading bits @p a and @p b share, at most @p limit.
+unsigned common_bits(uint32_t a, uint32_t b, unsigned limit) {
+  unsigned n = 0;
+  uint32_t diff = a ^ b;
+  while (n < limit && bit_at(diff, n) == 0) {
+    ++n;
+  }
+  return n;
+}
+
+} // namespace
+
+// ── Construction
+// ──────────────────────────────────────────────────────────────
+
+CidrTrie::CidrTrie() { add_node(0, 0, Rule::None); }
+
+// ── Building
+// ──────────────────────────────────────────────────────────────────
+
+void CidrTrie::insert(uint32_t network, unsigned bits, Rule rule) {
+  if (bits > 32)
+    bits = 32;
+  uint32_t key = network & mask(bits);
+
+  // Invariant: the prefix is inside node `at` and at least as long
+  uint32_t at = 0;
+  for (;;) {
+    if (nodes_[at].bits == bits) {
+      if (nodes_[at].rule == Rule::None)
+        ++prefixes_;
+      set_rule(nodes_[at], rule);
+      return;
+    }
+    unsigned side = bit_at(key, nodes_[at].bits);
+    uint32_t next = nodes_[at].child[side];
+    if (next == 0) {
+      uint32_t leaf = add_node(key, bits, rule);
+      nodes_[at].child[side] = leaf;
+      ++prefixes_;
+      return;
+    }
+
+    unsigned shared = common_bits(key, nodes_[next].key,
+                                  bits < nodes_[next].bits ? bits
+                                                           : nodes_[next].bits);
+    if (shared == nodes_[next].bits) {
+      at = next; // the child is a prefix of ours: go down
+      continue;
+    }
+
+    // We part ways inside the child's run of bits: split it there
+    uint32_t fork = add_node(key & mask(shared), shared, Rule::None);
+    nodes_[fork].child[bit_at(nodes_[next].key, shared)] = next;
+    nodes_[at].child[side] = fork;
+    ++prefixes_;
+    if (shared == bits) {
+      nodes_[fork].rule = rule; // ours is the prefix of the child
+    } else {
+      uint32_t leaf = add_node(key, bits, rule);
+      nodes_[fork].child[bit_at(key, shared)] = leaf;
+    }
+    return;
+  }
+}
+
+uint32_t CidrTrie::add_node(uint32_t key, unsigned bits, Rule rule) {
+  Node node;
+  node.key = key;
+  node.bits = static_cast<uint8_t>(bits);
+  node.rule = rule;
+  node.child[0] = node.child[1] = 0;
+  nodes_.push_back(node);
+  return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+void CidrTrie::set_rule(Node &node, Rule rule) {
+  if (node.rule != Rule::Deny) {
+    node.rule = rule;
+  }
+}
+
+void CidrTrie::pack() {
+  std::vector<Node> packed;
+  packed.reserve(nodes_.size());
+  packed.push_back(nodes_[0]);
+  // Each node is copied before its children: fix up their indices as they
+  // are reached
+  for (std::size_t at = 0; at < packed.size(); ++at) {
+    for (uint32_t &child : packed[at].child) {
+      if (child != 0) {
+        packed.push_back(nodes_[child]);
+        child = static_cast<uint32_t>(packed.size() - 1);
+      }
+    }
+  }
+  nodes_.swap(packed);
+
+  jump_.clear();
+  if (nodes_.size() < JUMP_NODES)
+    return;
+  // Walk each top-16-bit value down to the first node whose next step
+  // depends on the lower bits
+  jump_.resize(std::size_t{1} << 16);
+  for (uint32_t top = 0; top < jump_.size(); ++top) {
+    uint32_t address = top << 16;
+    Jump jump{0, Rule::None};
+    uint32_t at = 0;
+    for (;;) {
+      const Node &node = nodes_[at];
+      if (node.bits >= 16) {
+        jump.next = at; // lookup() checks the rest of its run
+        break;
+      }
+      if ((address & mask(node.bits)) != node.key)
+        break;
+      if (node.rule != Rule::None)
+        jump.rule = node.rule;
+      at = node.child[bit_at(address, node.bits)];
+      if (at == 0)
+        break;
+    }
+    jump_[top] = jump;
+  }
+}
+
+// ── Lookup
+// ────────────────────────────────────────────────────────────────────
+
+CidrTrie::Rule CidrTrie::lookup(uint32_t address) const {
+  Rule found = Rule::None;
+  uint32_t at = 0;
+  if (!jump_.empty()) {
+    const Jump &jump = jump_[address >> 16];
+    found = jump.rule;
+    at = jump.next;
+    if (at == 0)
+      return found;
+  }
+  for (;;) {
+    const Node &node = nodes_[at];
+    if ((address & mask(node.bits)) != node.key)
+      break; // a compressed run that does not match
+    if (node.rule != Rule::None)
+      found = node.rule;
+    if (node.bits == 32)
+      break;
+    at = node.child[bit_at(address, node.bits)];
+    if (at == 0)
+      break;
+  }
+  return found;
+}
+
+// ── Parsing
+// ───────────────────────────────────────────────────────────────────
+
+bool CidrTrie::parse(const std::string &text, uint32_t &network,
+                     unsigned &bits) {
+  const char *p = text.c_str();
+  uint32_t address = 0;
+  for (int part = 0; part < 4; ++part) {
+    if (*p < '0' || *p > '9')
+      return false;
+    char *end = nullptr;
+    unsigned long octet = std::strtoul(p, &end, 10);
+    if (octet > 255 || end - p > 3)
+      return false;
+    address = (address << 8) | static_cast<uint32_t>(octet);
+    p = end;
+    if (part < 3) {
+      if (*p != '.')
+        return false;
+      ++p;
+    }
+  }
+
+  unsigned long length = 32;
+  if (*p == '/') {
+    ++p;
+    if (*p < '0' || *p > '9')
+      return false;
+    char *end = nullptr;
+    length = std::strtoul(p, &end, 10);
+    if (length > 32)
+      return false;
+    p = end;
+  }
+  if (*p != '\0')
+    return false;
+
+  network = address;
+  bits = static_cast<unsigned>(length);
+  return true;
+}
@@ -5,10 +5,47 @@
 
 #include "client.h"
 
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 #include <ws2tcpip.h>
 
+namespace {
+
+constexpr uint64_t MS = 1000000ull; // ns per ms
+
+/// Split "host[:port]"; the port defaults to DEFAULT_PORT.
+void split_endpoint(const std::string &endpoint, std::string &host,
+                    std::string &port) {
+  std::size_t colon = endpoint.rfind(':');
+  host = endpoint.substr(0, colon);
+  port = colon != std::string::npos ? endpoint.substr(colon + 1)
+                                    : std::to_string(DEFAULT_PORT);
+}
+
+bool same_address(const sockaddr_in &a, const sockaddr_in &b) {
+  return a.sin_port == b.sin_port &&
+         std::memcmp(&a.sin_addr, &b.sin_addr, sizeof(a.sin_addr)) == 0;
+}
+
+void set_blocking(SOCKET sock, bool blocking) {
+  u_long mode = blocking ? 0 : 1;
+  ::ioctlsocket(sock, FIONBIO, &mode);
+}
+
+/// @return The pending error on a socket whose connect has completed.
+int connect_error(SOCKET sock) {
+  int error = 0;
+  int len = sizeof(error);
+  if (::getsockopt(sock, SOL_SOCKET, SO_ERROR,
+                   reinterpret_cast<char *>(&error), &len) == SOCKET_ERROR)
+    return WSAGetLastError();
+  return error;
+}
+
+} // namespace
+
 // ── Static helper
 // ─────────────────────────────────────────────────────────────
 
@@ -28,50 +65,217 @@ void Client::init_winsock() {
 // ── Construction
 // ──────────────────────────────────────────────────────────────
 
-Client::Client() { init_winsock(); }
+Client::Client(unsigned int timeout_ms) : timeout_ms_(timeout_ms) {
+  init_winsock();
+}
 
 // ── Public API
 // ────────────────────────────────────────────────────────────────
 
 SocketWrapper Client::connect_to(const std::string &host, unsigned short port) {
-  // Resolve the host address
+  return connect_any(
+      std::vector<std::string>(1, host + ":" + std::to_string(port)));
+}
+
+SocketWrapper Client::connect_any(const std::vector<std::string> &endpoints,
+                                  std::string *winner) {
+  const uint64_t deadline = monotonic_ns() + timeout_ms_ * MS;
+  std::string list;
+  for (const std::string &endpoint : endpoints)
+    list += (list.empty() ? "" : ", ") + endpoint;
+
+  // Cached addresses go first and skip DNS; the rest are resolved
+  std::vector<Attempt> attempts;
+  std::vector<std::size_t> cached;
+  std::string resolve_error;
+  {
+    LockGuard<Mutex> lock(cache_mutex_);
+    for (std::size_t i = 0; i < endpoints.size(); ++i) {
+      auto it = last_good_.find(endpoints[i]);
+      if (it == last_good_.end())
+        continue;
+      Attempt a;
+      a.endpoint = i;
+      a.addr = it->second;
+      attempts.push_back(a);
+      cached.push_back(i);
+    }
+  }
+  for (std::size_t i = 0; i < endpoints.size(); ++i) {
+    if (std::find(cached.begin(), cached.end(), i) == cached.end())
+      resolve(endpoints[i], i, attempts, resolve_error);
+  }
+
+  std::size_t won = 0;
+  int error = 0;
+  SOCKET sock = race(attempts, deadline, won, error);
+
+  if (sock == INVALID_SOCKET && !cached.empty()) {
+    // The hub may have moved: forget what we knew and look it up again
+    {
+      LockGuard<Mutex> lock(cache_mutex_);
+      for (std::size_t i : cached)
+        last_good_.erase(endpoints[i]);
+    }
+    attempts.clear();
+    for (std::size_t i : cached)
+      resolve(endpoints[i], i, attempts, resolve_error);
+    if (!attempts.empty() && monotonic_ns() < deadline)
+      sock = race(attempts, deadline, won, error);
+  }
+
+  if (sock == INVALID_SOCKET) {
+    if (error == 0 && !resolve_error.empty())
+      throw std::runtime_error(resolve_error);
+    if (error == WSAETIMEDOUT) {
+      throw std::runtime_error("connect() to " + list + " timed out after " +
+                               std::to_string(timeout_ms_) + " ms");
+    }
+    throw std::runtime_error("connect() failed to " + list +
+                             " (error: " + std::to_string(error) + ")");
+  }
+
+  const std::string &endpoint = endpoints[attempts[won].endpoint];
+  {
+    LockGuard<Mutex> lock(cache_mutex_);
+    last_good_[endpoint] = attempts[won].addr;
+  }
+  if (winner)
+    *winner = endpoint;
+  return SocketWrapper(sock);
+}
+
+// ── Private helpers
+// ───────────────────────────────────────────────────────────
+
+void Client::resolve(const std::string &endpoint, std::size_t index,
+                     std::vector<Attempt> &out, std::string &error) {
+  std::string host, port;
+  split_endpoint(endpoint, host, port);
+
   addrinfo hints{};
   hints.ai_family = AF_INET;
   hints.ai_socktype = SOCK_STREAM;
   hints.ai_protocol = IPPROTO_TCP;
 
   addrinfo *result = nullptr;
-  std::string port_str = std::to_string(port);
-
-  int err = ::getaddrinfo(host.c_str(), port_str.c_str(), &hints, &result);
+  int err = ::getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
   if (err != 0) {
-    throw std::runtime_error("getaddrinfo() failed for host '" + host +
-                             "': " + std::to_string(err));
+    error = "getaddrinfo() failed for host '" + host +
+            "': " + std::to_string(err);
+    return;
   }
 
-  // Try each resolved address until one connects
-  SOCKET sock = INVALID_SOCKET;
   for (addrinfo *ptr = result; ptr != nullptr; ptr = ptr->ai_next) {
-    sock = ::socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
-    if (sock == INVALID_SOCKET)
-      continue;
+    Attempt a;
+    a.endpoint = index;
+    std::memcpy(&a.addr, ptr->ai_addr, sizeof(a.addr));
+    bool seen = false;
+    for (const Attempt &other : out)
+      seen = seen || same_address(other.addr, a.addr);
+    if (!seen)
+      out.push_back(a);
+  }
+  ::freeaddrinfo(result);
+}
+
+SOCKET Client::race(std::vector<Attempt> &attempts, uint64_t deadline,
+                    std::size_t &won, int &error) {
+  std::size_t next = 0;
+  std::size_t pending = 0;
+  uint64_t next_start = 0;
+  SOCKET winner = INVALID_SOCKET;
 
-    if (::connect(sock, ptr->ai_addr, static_cast<int>(ptr->ai_addrlen)) ==
-        SOCKET_ERROR) {
-      ::closesocket(sock);
-      sock = INVALID_SOCKET;
+  while (winner == INVALID_SOCKET) {
+    uint64_t now = monotonic_ns();
+
+    // Launch the next attempt when its turn comes, or at once if none is
+    // in flight (the previous one failed fast)
+    if (next < attempts.size() && pending < FD_SETSIZE &&
+        (pending == 0 || now >= next_start)) {
+      Attempt &a = attempts[next++];
+      next_start = now + CONNECT_STAGGER_MS * MS;
+      a.sock = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+      if (a.sock == INVALID_SOCKET) {
+        error = WSAGetLastError();
+        continue;
+      }
+      set_blocking(a.sock, false);
+      if (::connect(a.sock, reinterpret_cast<const sockaddr *>(&a.addr),
+                    sizeof(a.addr)) == 0) {
+        winner = a.sock;
+        won = next - 1;
+        break;
+      }
+      int code = WSAGetLastError();
+      if (code != WSAEWOULDBLOCK) {
+        error = code;
+        ::closesocket(a.sock);
+        a.sock = INVALID_SOCKET;
+        continue;
+      }
+      ++pending;
       continue;
     }
-    break; // connected successfully
-  }
 
-  ::freeaddrinfo(result);
+    if (pending == 0)
+      break; // every address refused
+    if (now >= deadline) {
+      error = WSAETIMEDOUT;
+      break;
+    }
 
-  if (sock == INVALID_SOCKET) {
-    throw std::runtime_error("connect() failed to " + host + ":" + port_str +
-                             " (error: " + std::to_string(WSAGetLastError()) +
-                             ")");
+    // Wait for a result, the deadline, or the next launch
+    uint64_t until = deadline;
+    if (next < attempts.size() && next_start < until)
+      until = next_start;
+    uint64_t wait_us = (until - now) / 1000;
+    timeval tv;
+    tv.tv_sec = static_cast<long>(wait_us / 1000000);
+    tv.tv_usec = static_cast<long>(wait_us % 1000000);
+
+    fd_set writable, failed;
+    FD_ZERO(&writable);
+    FD_ZERO(&failed);
+    for (std::size_t i = 0; i < next; ++i) {
+      if (attempts[i].sock != INVALID_SOCKET) {
+        FD_SET(attempts[i].sock, &writable);
+        FD_SET(attempts[i].sock, &failed);
+      }
+    }
+    if (::select(0, nullptr, &writable, &failed, &tv) == SOCKET_ERROR) {
+      error = WSAGetLastError();
+      break;
+    }
+
+    for (std::size_t i = 0; i < next; ++i) {
+      Attempt &a = attempts[i];
+      if (a.sock == INVALID_SOCKET)
+        continue;
+      bool done = FD_ISSET(a.sock, &failed) || FD_ISSET(a.sock, &writable);
+      if (!done)
+        continue;
+      int code = connect_error(a.sock);
+      if (code == 0 && !FD_ISSET(a.sock, &failed)) {
+        winner = a.sock;
+        won = i;
+        a.sock = INVALID_SOCKET;
+        break;
+      }
+      error = code != 0 ? code : WSAECONNREFUSED;
+      ::closesocket(a.sock);
+      a.sock = INVALID_SOCKET;
+      --pending;
+    }
   }
 
-  return SocketWrapper(sock);
+  // Cancel the losers
+  for (Attempt &a : attempts) {
+    if (a.sock != INVALID_SOCKET && a.sock != winner)
+      ::closesocket(a.sock);
+    a.sock = INVALID_SOCKET;
+  }
+  if (winner != INVALID_SOCKET)
+    set_blocking(winner, true);
+  return winner;
 }
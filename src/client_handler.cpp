@@ -5,23 +5,70 @@
 
 #include "client_handler.h"
 
+#include "websocket.h"
+
 #include <iostream>
 
+namespace {
+
+/// Most frames taken from the queue for one write pass or gathered send.
+constexpr std::size_t MAX_BATCH = 64;
+
+/// Blocking mode: how long the writer waits for a full socket to drain
+/// before checking whether the handler is stopping.
+constexpr unsigned WRITE_WAIT_MS = 50;
+
+} // namespace
+
 // ── Construction / Destruction
 // ────────────────────────────────────────────────
 
 ClientHandler::ClientHandler(uint32_t id, std::string name,
                              SocketWrapper socket, MessageCallback on_msg,
-                             DisconnectCallback on_disc)
+                             DisconnectCallback on_disc, IoLoop *loop,
+                             Handshake handshake, uint64_t out_budget)
     : id_(id), name_(std::move(name)), socket_(std::move(socket)),
-      on_message_(std::move(on_msg)), on_disconnect_(std::move(on_disc)) {
+      protocol_(socket_.protocol()), loop_(loop),
+      handshake_(std::move(handshake)), outq_(out_budget),
+      on_message_(std::move(on_msg)),
+      on_disconnect_(std::move(on_disc)) {
   running_.store(true);
-  recv_thread_ = Thread(&ClientHandler::receive_loop, this);
+  joined_.store(!handshake_);
+
+  if (protocol_ == WireProtocol::WebSocket) {
+    // Pongs and closes go out in turn with broadcasts
+    socket_.set_control_sender([this](const SharedFrame &frame) {
+      if (joined_.load()) {
+        send_frame(frame, SendClass::Control);
+      } else {
+        write_encoded(frame);
+      }
+    });
+  }
+
+  if (loop_) {
+    if (handshake_) {
+      fiber_ = FiberPool::instance().acquire(
+          [this] { handshake_name_ = handshake_(*this); });
+    }
+    socket_.set_non_blocking(true);
+    if (loop_->options().mode == IoMode::BusyPoll) {
+      socket_.set_no_delay(true);
+      socket_.set_busy_poll(loop_->options().busy_poll_usec);
+    }
+    loop_->add(this);
+  } else {
+    // Broadcasts write without blocking; the receive thread waits in
+    // select() instead of recv()
+    socket_.set_non_blocking(true);
+    recv_thread_ = Thread(&ClientHandler::receive_loop, this);
+  }
 }
 
 ClientHandler::~ClientHandler() {
   stop();
-  if (recv_thread_.joinable()) {
+  // Never join ourselves: the last owner may be released on this thread.
+  if (recv_thread_.joinable() && !recv_thread_.is_current()) {
     recv_thread_.join();
   }
 }
@@ -29,26 +76,146 @@ ClientHandler::~ClientHandler() {
 // ── Public API
 // ────────────────────────────────────────────────────────────────
 
-void ClientHandler::send(const std::string &message) {
+void ClientHandler::send(const std::string &message, SendClass cls) {
+  send_frame(SocketWrapper::encode_frame(protocol_, message), cls);
+}
+
+void ClientHandler::send_frame(const SharedFrame &frame, SendClass cls) {
   LockGuard<Mutex> lock(send_mutex_);
-  if (socket_.is_valid()) {
-    try {
-      socket_.send_message(message);
-    } catch (...) {
-      // Ignore send errors — disconnect will be detected by recv loop
-    }
+  if (send_closed_ || !socket_.is_valid())
+    return;
+
+  // Behind a backlog the frame waits its turn; otherwise it goes out now,
+  // as far as the socket takes it
+  bool idle = !backlog_.load() && !send_in_flight_;
+  outq_.push(frame, cls);
+  if (idle) {
+    flush_queued();
   }
 }
 
 void ClientHandler::stop() {
   running_.store(false);
+  {
+    // After this no new send can be written or posted for this handler
+    LockGuard<Mutex> lock(send_mutex_);
+    send_closed_ = true;
+    outq_.clear();
+    unsent_.clear();
+    unsent_next_ = unsent_offset_ = 0;
+    backlog_.store(false);
+    send_cv_.notify_all();
+  }
+  if (send_thread_.joinable() && !send_thread_.is_current()) {
+    send_thread_.join(); // wakes within WRITE_WAIT_MS
+  }
+  if (loop_) {
+    loop_->remove(this); // waits until the IO thread is done with us
+  }
   socket_.close(); // unblocks recv_all in the receive thread
+  cancel_handshake();
+}
+
+// ── Handshake API
+// ─────────────────────────────────────────────────────────────
+
+std::string ClientHandler::read_frame() {
+  if (!loop_) {
+    try {
+      return socket_.receive_message();
+    } catch (...) {
+      return {};
+    }
+  }
+
+  // On the handshake fiber: suspend until the IO thread sees more data
+  std::string msg;
+  while (running_.load()) {
+    SocketWrapper::RecvStatus status;
+    try {
+      status = socket_.try_receive_message(msg);
+    } catch (...) {
+      return {};
+    }
+    if (status == SocketWrapper::RecvStatus::Message) {
+      return msg;
+    }
+    if (status == SocketWrapper::RecvStatus::Closed) {
+      return {};
+    }
+    Fiber::yield();
+  }
+  return {};
+}
+
+void ClientHandler::write_frame(const std::string &message) {
+  write_encoded(SocketWrapper::encode_frame(protocol_, message));
+}
+
+void ClientHandler::write_binary(const char *data, uint32_t len) {
+  write_encoded(protocol_ == WireProtocol::WebSocket
+                    ? websocket::encode_frame(websocket::BINARY, data, len)
+                    : SocketWrapper::encode_frame(data, len));
+}
+
+void ClientHandler::write_raw(const std::string &bytes) {
+  write_encoded(std::make_shared<const std::string>(bytes));
+}
+
+void ClientHandler::write_encoded(const SharedFrame &frame) {
+  if (!loop_ || loop_->options().mode != IoMode::Completion) {
+    // Nobody else writes before the client joins, so skip send_mutex_ (a
+    // critical section must not be held across a fiber switch). send_all()
+    // suspends the fiber while the socket buffer is full, or waits on the
+    // client's own receive thread in Blocking mode.
+    try {
+      socket_.send_frame(*frame);
+    } catch (...) {
+      // Disconnect is detected by the next read_frame()
+    }
+    return;
+  }
+  send_frame(frame);
+}
+
+bool ClientHandler::finish_handshake(std::string name) {
+  if (name.empty() || !running_.load()) {
+    return false;
+  }
+  name_ = std::move(name);
+  joined_.store(true);
+  return true;
+}
+
+void ClientHandler::cancel_handshake() {
+  if (!fiber_)
+    return;
+  // read_frame() sees running_ == false, so the handshake returns promptly
+  // and unwinds its own stack before the fiber is recycled
+  while (!fiber_->finished()) {
+    fiber_->resume();
+  }
+  FiberPool::instance().release(fiber_);
+  fiber_ = nullptr;
 }
 
 // ── Private: receive loop
 // ─────────────────────────────────────────────────────
 
 void ClientHandler::receive_loop() {
+  if (handshake_) {
+    std::string name;
+    try {
+      name = handshake_(*this);
+    } catch (...) {
+      name.clear();
+    }
+    if (!finish_handshake(std::move(name))) {
+      notify_disconnect();
+      return;
+    }
+  }
+
   while (running_.load()) {
     std::string msg;
     try {
@@ -66,9 +233,170 @@ void ClientHandler::receive_loop() {
     }
   }
 
+  notify_disconnect();
+}
+
+// ── Private: IoLoop callbacks
+// ─────────────────────────────────────────────────
+
+IoSource::Status ClientHandler::on_readable(const ReadBudget &budget) {
+  if (fiber_) {
+    fiber_->resume();
+    if (!fiber_->finished()) {
+      return Status::Idle; // still waiting inside the handshake
+    }
+    FiberPool::instance().release(fiber_);
+    fiber_ = nullptr;
+    if (!finish_handshake(std::move(handshake_name_))) {
+      return Status::Closed;
+    }
+    // Frames that arrived right behind the handshake are drained below
+  }
+
+  unsigned frames = 0;
+  std::size_t bytes = 0;
+  std::string msg;
+  while (running_.load()) {
+    if ((budget.frames != 0 && frames >= budget.frames) ||
+        (budget.bytes != 0 && bytes >= budget.bytes)) {
+      return Status::More; // the rest waits for our next turn
+    }
+    SocketWrapper::RecvStatus status = socket_.try_receive_message(msg);
+    if (status == SocketWrapper::RecvStatus::WouldBlock) {
+      break;
+    }
+    if (status == SocketWrapper::RecvStatus::Closed) {
+      return Status::Closed;
+    }
+    ++frames;
+    bytes += msg.size();
+    if (on_message_) {
+      on_message_(id_, name_, msg);
+    }
+  }
+  return frames != 0 ? Status::Progress : Status::Idle;
+}
+
+bool ClientHandler::wants_write() const {
+  return backlog_.load(std::memory_order_relaxed) ||
+         (fiber_ && fiber_->waiting_for_write());
+}
+
+void ClientHandler::on_writable() {
+  LockGuard<Mutex> lock(send_mutex_);
+  if (backlog_.load() && !send_closed_) {
+    flush_queued();
+  }
+}
+
+void ClientHandler::on_closed() { notify_disconnect(); }
+
+void ClientHandler::on_send_complete(bool ok) {
+  LockGuard<Mutex> lock(send_mutex_);
+  send_in_flight_ = false;
+  if (!ok) {
+    outq_.clear(); // the receive side will report the disconnect
+    return;
+  }
+  flush_queued();
+}
+
+void ClientHandler::flush_queued() {
+  if (loop_ && loop_->options().mode == IoMode::Completion) {
+    post_queued();
+    return;
+  }
+
+  // Write batch by batch, control frames first, until the socket is full
+  while (!send_closed_) {
+    if (unsent_next_ == unsent_.size()) {
+      unsent_.clear();
+      unsent_next_ = 0;
+      if (outq_.empty() || !outq_.take(unsent_, MAX_BATCH))
+        break; // drained (or the spilled frames are lost)
+      continue;
+    }
+    SocketWrapper::SendStatus status =
+        socket_.try_send(*unsent_[unsent_next_], unsent_offset_);
+    if (status == SocketWrapper::SendStatus::WouldBlock)
+      break;
+    if (status == SocketWrapper::SendStatus::Closed) {
+      // The receive side will report the disconnect
+      unsent_.clear();
+      unsent_next_ = 0;
+      outq_.clear();
+      break;
+    }
+    ++unsent_next_;
+    unsent_offset_ = 0;
+  }
+  if (unsent_next_ == unsent_.size()) {
+    unsent_offset_ = 0;
+  }
+
+  bool backlog = unsent_next_ < unsent_.size();
+  if (backlog != backlog_.load()) {
+    backlog_.store(backlog);
+    if (backlog) {
+      wake_writer();
+    }
+  }
+}
+
+void ClientHandler::post_queued() {
+  // What was queued while the previous send was in flight goes out in
+  // gathered WSASends, control frames first
+  while (!outq_.empty() && !send_closed_) {
+    std::vector<SharedFrame> batch;
+    if (!outq_.take(batch, MAX_BATCH))
+      return; // spilled frames lost: the client cannot be caught up
+
+    IoLoop::SendResult result = loop_->post_send(this, std::move(batch));
+    if (result == IoLoop::SendResult::Pending) {
+      send_in_flight_ = true;
+      return;
+    }
+    if (result == IoLoop::SendResult::Failed) {
+      outq_.clear();
+      return;
+    }
+  }
+}
+
+void ClientHandler::wake_writer() {
+  if (loop_) {
+    loop_->notify(this); // polled for writability from now on
+    return;
+  }
+  if (!send_thread_.joinable()) {
+    send_thread_ = Thread(&ClientHandler::send_loop, this);
+  }
+  send_cv_.notify_all();
+}
+
+void ClientHandler::send_loop() {
+  LockGuard<Mutex> lock(send_mutex_);
+  while (!send_closed_) {
+    if (!backlog_.load()) {
+      send_cv_.wait_for(send_mutex_, INFINITE);
+      continue;
+    }
+    // Wait for room without the lock, so that broadcasts keep queueing
+    send_mutex_.unlock();
+    socket_.wait_writable(WRITE_WAIT_MS);
+    send_mutex_.lock();
+    if (!send_closed_) {
+      flush_queued();
+    }
+  }
+}
+
+void ClientHandler::notify_disconnect() {
   running_.store(false);
 
-  if (on_disconnect_) {
-    on_disconnect_(id_);
+  // Copy first: the callback may end up releasing this handler.
+  DisconnectCallback on_disc = on_disconnect_;
+  if (on_disc) {
+    on_disc(id_);
   }
 }
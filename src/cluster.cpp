@@ -0,0 +1,646 @@
+/**
+ * @file cluster.cpp
+ * @brief Implementation of HubCluster – hub failover and log replication.
+ */
+
+#include "cluster.h"
+
+#include "link_writer.h"
+#include "message_ops.h"
+#include "wire.h"
+
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint8_t FRAME_HEARTBEAT = 1;
+constexpr uint8_t FRAME_FOLLOW = 2;
+constexpr uint8_t FRAME_ENTRY = 3;
+constexpr uint8_t FRAME_UPDATE = 4;
+
+/// Entries sent to a standby per batch.
+constexpr std::size_t STREAM_BATCH = 256;
+
+constexpr uint64_t MS = 1000000ull; // ns per ms
+
+/// Random, non-zero id for this process.
+uint64_t make_node_id() {
+  std::random_device rd;
+  uint64_t id = (static_cast<uint64_t>(rd()) << 32) ^ rd() ^ monotonic_ns();
+  return id != 0 ? id : 1;
+}
+
+/// Split "host[:port]"; the port defaults to @p fallback.
+void split_endpoint(const std::string &endpoint, unsigned short fallback,
+                    std::string &host, unsigned short &port) {
+  std::size_t colon = endpoint.rfind(':');
+  host = endpoint.substr(0, colon);
+  port = fallback;
+  if (colon != std::string::npos) {
+    port = static_cast<unsigned short>(std::stoi(endpoint.substr(colon + 1)));
+  }
+}
+
+SharedFrame encode(const WireWriter &w) {
+  const std::string &wire = w.data();
+  return SocketWrapper::encode_frame(wire.data(),
+                                     static_cast<uint32_t>(wire.size()));
+}
+
+SharedFrame update_frame(const std::string &update) {
+  WireWriter w;
+  w.put_u8(FRAME_UPDATE);
+  w.put_str(update);
+  return encode(w);
+}
+
+} // namespace
+
+const char *hub_role_name(HubRole role) {
+  return role == HubRole::Leader ? "leader" : "standby";
+}
+
+// ── ReplicaLink
+// ───────────────────────────────────────────────────────────────
+
+/**
+ * Leader side of one standby's log stream. Its thread reads the FOLLOW
+ * request, then queues every newer entry as it is appended; updates are
+ * queued by whichever thread made them.
+ */
+class HubCluster::ReplicaLink {
+public:
+  ReplicaLink(HubCluster &cluster, SocketWrapper socket)
+      : cluster_(cluster), socket_(std::move(socket)) {}
+
+  ~ReplicaLink() {
+    close();
+    writer_.join();
+    if (thread_.joinable() && !thread_.is_current()) {
+      thread_.join();
+    }
+  }
+
+  ReplicaLink(const ReplicaLink &) = delete;
+  ReplicaLink &operator=(const ReplicaLink &) = delete;
+
+  void start() {
+    writer_.start();
+    thread_ = Thread(&ReplicaLink::run, this);
+  }
+
+  /// Unblock the threads; the stream thread retires the link on its way
+  /// out.
+  void close() { writer_.close(); }
+
+  /// Queue @p frame for the standby. Never blocks.
+  bool send(const SharedFrame &frame) { return writer_.send(frame); }
+
+private:
+  HubCluster &cluster_;
+  SocketWrapper socket_;
+  LinkWriter writer_{socket_};
+  Thread thread_;
+
+  void run() {
+    try {
+      stream();
+    } catch (const std::exception &) {
+      // Standby went away; it reconnects to whoever is leader
+    }
+    close();
+    cluster_.replica_closed(this);
+  }
+
+  void stream() {
+    std::string frame;
+    if (!socket_.receive_binary(frame))
+      return;
+
+    WireReader reader(frame);
+    uint8_t type = 0;
+    uint64_t node_id = 0, sent = 0;
+    if (!reader.get_u8(type) || type != FRAME_FOLLOW ||
+        !reader.get_u64(node_id) || !reader.get_u64(sent)) {
+      return;
+    }
+
+    HubLog &log = cluster_.room_.log();
+
+    // Edits and deletes made so far: ENTRY carries only the text, and the
+    // standby may have missed them on messages it already has. Later ones
+    // reach it through on_update().
+    for (const LogEntry &entry : log.since(0, log.capacity())) {
+      if (entry.deleted) {
+        send(update_frame(MessageOps::delete_frame(entry.seq)));
+      } else if (entry.edited) {
+        send(update_frame(MessageOps::edit_frame(entry.seq, entry.text)));
+      }
+    }
+
+    while (cluster_.running_.load() && socket_.is_valid() &&
+           cluster_.role_.load() == HubRole::Leader) {
+      std::vector<LogEntry> batch = log.since(sent, STREAM_BATCH);
+      if (batch.empty()) {
+        log.wait_newer(sent, HEARTBEAT_MS);
+        continue;
+      }
+      for (const LogEntry &entry : batch) {
+        WireWriter w;
+        w.put_u8(FRAME_ENTRY);
+        w.put_u64(entry.seq);
+        w.put_u64(entry.hlc);
+        w.put_u64(entry.parent);
+        w.put_str(entry.sender);
+        w.put_str(entry.text);
+        if (!send(encode(w)))
+          return; // fell too far behind; it will FOLLOW again
+      }
+      sent = batch.back().seq;
+    }
+  }
+};
+
+// ── Construction / Destruction
+// ────────────────────────────────────────────────
+
+HubCluster::HubCluster(Room &room, const ClusterOptions &options)
+    : room_(room), options_(options), node_id_(make_node_id()) {}
+
+HubCluster::~HubCluster() { stop(); }
+
+void HubCluster::set_on_role_change(RoleCallback cb) {
+  on_role_change_ = std::move(cb);
+}
+
+// ── Lifecycle
+// ─────────────────────────────────────────────────────────────────
+
+void HubCluster::start() {
+  if (running_.load())
+    return;
+
+  // Heartbeat socket, shared by every member on the cluster port
+  udp_ = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (udp_ == INVALID_SOCKET) {
+    throw std::runtime_error("HubCluster: socket() failed: " +
+                             std::to_string(WSAGetLastError()));
+  }
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(options_.port);
+  if (::bind(udp_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) ==
+      SOCKET_ERROR) {
+    int err = WSAGetLastError();
+    ::closesocket(udp_);
+    udp_ = INVALID_SOCKET;
+    throw std::runtime_error("HubCluster: bind() failed on port " +
+                             std::to_string(options_.port) + ": " +
+                             std::to_string(err));
+  }
+
+  for (const std::string &member : options_.members) {
+    std::string host;
+    unsigned short port = 0;
+    split_endpoint(member, options_.port, host, port);
+
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo *result = nullptr;
+    if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints,
+                      &result) != 0) {
+      std::cerr << "[Cluster] Cannot resolve member '" << member << "'\n";
+      continue;
+    }
+    targets_.push_back(*reinterpret_cast<sockaddr_in *>(result->ai_addr));
+    ::freeaddrinfo(result);
+  }
+
+  room_.add_update_tap([this](const std::string &frame) { on_update(frame); });
+
+  log_server_.reset(new Server(options_.port));
+  log_server_->set_on_new_client([this](SocketWrapper sock, std::string) {
+    if (role_.load() == HubRole::Leader) {
+      add_replica(std::move(sock));
+    }
+  });
+
+  running_.store(true);
+  log_server_->start_accept_loop();
+  heartbeat_thread_ = Thread(&HubCluster::heartbeat_loop, this);
+  follow_thread_ = Thread(&HubCluster::follow_loop, this);
+}
+
+void HubCluster::stop() {
+  if (!running_.exchange(false))
+    return;
+
+  if (log_server_) {
+    log_server_->stop();
+  }
+  if (heartbeat_thread_.joinable()) {
+    heartbeat_thread_.join();
+  }
+  ::closesocket(udp_);
+  udp_ = INVALID_SOCKET;
+
+  std::vector<std::unique_ptr<ReplicaLink>> replicas;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    if (follow_sock_) {
+      follow_sock_->close();
+    }
+    for (auto &link : replicas_) {
+      link->close();
+    }
+    replicas.swap(replicas_);
+  }
+  if (follow_thread_.joinable()) {
+    follow_thread_.join();
+  }
+  replicas.clear();
+  reap_retired();
+}
+
+// ── Election
+// ──────────────────────────────────────────────────────────────────
+
+void HubCluster::heartbeat_loop() {
+  // Listen for a full lease before deciding there is no leader
+  leader_seen_ns_ = monotonic_ns();
+
+  while (running_.load()) {
+    reap_retired();
+    send_heartbeat();
+    receive_heartbeats(HEARTBEAT_MS);
+    elect();
+    if (role_.load() == HubRole::Leader) {
+      announce_hubs();
+    }
+  }
+}
+
+void HubCluster::send_heartbeat() {
+  WireWriter w;
+  w.put_u8(FRAME_HEARTBEAT);
+  w.put_u64(node_id_);
+  w.put_u64(term_.load());
+  w.put_u8(static_cast<uint8_t>(role_.load()));
+  w.put_u32(options_.priority);
+  w.put_u64(room_.log().last_seq());
+  w.put_u32(options_.port);
+  w.put_str(options_.advertise);
+
+  const std::string &wire = w.data();
+  for (const sockaddr_in &target : targets_) {
+    ::sendto(udp_, wire.data(), static_cast<int>(wire.size()), 0,
+             reinterpret_cast<const sockaddr *>(&target), sizeof(target));
+  }
+}
+
+void HubCluster::receive_heartbeats(unsigned wait_ms) {
+  uint64_t deadline = monotonic_ns() + wait_ms * MS;
+  char buf[1500];
+
+  for (;;) {
+    uint64_t now = monotonic_ns();
+    if (now >= deadline || !running_.load())
+      return;
+
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(udp_, &readable);
+    timeval tv{};
+    uint64_t left_us = (deadline - now) / 1000;
+    tv.tv_sec = static_cast<long>(left_us / 1000000);
+    tv.tv_usec = static_cast<long>(left_us % 1000000);
+    if (::select(0, &readable, nullptr, nullptr, &tv) <= 0)
+      continue;
+
+    sockaddr_in from{};
+    int from_len = sizeof(from);
+    int n = ::recvfrom(udp_, buf, sizeof(buf), 0,
+                       reinterpret_cast<sockaddr *>(&from), &from_len);
+    if (n <= 0)
+      continue; // e.g. ICMP port unreachable from a member that is down
+
+    WireReader reader(buf, static_cast<std::size_t>(n));
+    uint8_t type = 0, role = 0;
+    uint32_t priority = 0, port = 0;
+    uint64_t id = 0;
+    Member m;
+    if (!reader.get_u8(type) || type != FRAME_HEARTBEAT ||
+        !reader.get_u64(id) || !reader.get_u64(m.term) ||
+        !reader.get_u8(role) || !reader.get_u32(priority) ||
+        !reader.get_u64(m.last_seq) || !reader.get_u32(port) ||
+        !reader.get_str(m.client) || id == node_id_) {
+      continue;
+    }
+
+    char ip[INET_ADDRSTRLEN] = {};
+    compat_inet_ntop(AF_INET, &from.sin_addr, ip, sizeof(ip));
+    m.heard_ns = monotonic_ns();
+    m.role = role ? HubRole::Leader : HubRole::Standby;
+    m.priority = priority;
+    m.control = std::string(ip) + ":" + std::to_string(port);
+
+    LockGuard<Mutex> lock(mutex_);
+    members_[id] = m;
+  }
+}
+
+void HubCluster::elect() {
+  uint64_t now = monotonic_ns();
+  uint64_t my_seq = room_.log().last_seq();
+  HubRole next = role_.load();
+
+  {
+    LockGuard<Mutex> lock(mutex_);
+
+    // Forget members we have not heard from for a while
+    uint64_t best_id = 0;
+    const Member *best = nullptr;
+    uint64_t max_term = term_.load();
+    for (auto it = members_.begin(); it != members_.end();) {
+      if (now - it->second.heard_ns > LEASE_MS * MS) {
+        it = members_.erase(it);
+        continue;
+      }
+      const Member &m = it->second;
+      if (m.term > max_term)
+        max_term = m.term;
+      if (m.role == HubRole::Leader &&
+          (!best || m.term > best->term ||
+           (m.term == best->term && it->first > best_id))) {
+        best = &m;
+        best_id = it->first;
+      }
+      ++it;
+    }
+
+    if (next == HubRole::Leader) {
+      // Two leaders after a partition heals: the newer term wins
+      if (best && (best->term > term_.load() ||
+                   (best->term == term_.load() && best_id > node_id_))) {
+        next = HubRole::Standby;
+      }
+    }
+
+    if (best && next == HubRole::Standby) {
+      leader_id_ = best_id;
+      leader_control_ = best->control;
+      leader_seen_ns_ = now;
+      if (best->term > term_.load())
+        term_.store(best->term);
+    } else if (next == HubRole::Standby) {
+      leader_id_ = 0;
+      if (now - leader_seen_ns_ >= LEASE_MS * MS) {
+        // No leader: the most complete log takes over, so no one's
+        // sequence position goes backwards
+        bool self_best = true;
+        for (auto it = members_.begin(); it != members_.end(); ++it) {
+          const Member &m = it->second;
+          bool outranks = m.last_seq != my_seq ? m.last_seq > my_seq
+                          : m.priority != options_.priority
+                              ? m.priority > options_.priority
+                              : it->first > node_id_;
+          if (outranks) {
+            self_best = false;
+            break;
+          }
+        }
+        if (self_best) {
+          term_.store(max_term + 1);
+          next = HubRole::Leader;
+        }
+      }
+    }
+  }
+
+  if (next != role_.load()) {
+    set_role(next);
+  }
+}
+
+void HubCluster::set_role(HubRole role) {
+  std::vector<std::unique_ptr<ReplicaLink>> replicas;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    role_.store(role);
+    if (role == HubRole::Leader) {
+      leader_id_ = node_id_;
+      leader_control_.clear();
+      if (follow_sock_) {
+        follow_sock_->close();
+      }
+    } else {
+      leader_seen_ns_ = monotonic_ns();
+      hubs_sent_.clear();
+      for (auto &link : replicas_) {
+        link->close();
+      }
+    }
+  }
+
+  std::cout << "\033[2K\r" << "[Cluster] Now " << hub_role_name(role)
+            << " (term " << term_.load() << ", log seq "
+            << room_.log().last_seq() << ")\n"
+            << "You: " << std::flush;
+
+  if (on_role_change_) {
+    on_role_change_(role);
+  }
+}
+
+// ── Replication
+// ───────────────────────────────────────────────────────────────
+
+void HubCluster::follow_loop() {
+  while (running_.load()) {
+    std::string target;
+    {
+      LockGuard<Mutex> lock(mutex_);
+      if (role_.load() == HubRole::Standby && leader_id_ != 0) {
+        target = leader_control_;
+      }
+    }
+    if (target.empty()) {
+      Sleep(HEARTBEAT_MS);
+      continue;
+    }
+
+    // Declared outside the try so follow_sock_ is cleared before it dies
+    SocketWrapper sock(INVALID_SOCKET);
+    try {
+      std::string host;
+      unsigned short port = 0;
+      split_endpoint(target, options_.port, host, port);
+      sock = client_.connect_to(host, port);
+
+      bool current = false;
+      {
+        LockGuard<Mutex> lock(mutex_);
+        current = running_.load() && role_.load() == HubRole::Standby &&
+                  leader_control_ == target;
+        if (current)
+          follow_sock_ = &sock;
+      }
+
+      if (current) {
+        WireWriter w;
+        w.put_u8(FRAME_FOLLOW);
+        w.put_u64(node_id_);
+        w.put_u64(room_.log().last_seq());
+        sock.send_frame(*encode(w));
+
+        // Updates that overtook the entry they change, by its seq
+        std::multimap<uint64_t, std::string> early;
+        HubLog &log = room_.log();
+
+        std::string frame;
+        while (running_.load() && sock.receive_binary(frame)) {
+          WireReader reader(frame);
+          uint8_t type = 0;
+          if (!reader.get_u8(type))
+            break;
+
+          if (type == FRAME_UPDATE) {
+            std::string update;
+            uint64_t seq = 0;
+            if (!reader.get_str(update))
+              break;
+            if (!MessageOps::apply_update(log, update, seq) &&
+                seq > log.last_seq()) {
+              early.emplace(seq, std::move(update));
+            }
+            continue;
+          }
+
+          LogEntry entry;
+          if (type != FRAME_ENTRY || !reader.get_u64(entry.seq) ||
+              !reader.get_u64(entry.hlc) || !reader.get_u64(entry.parent) ||
+              !reader.get_str(entry.sender) || !reader.get_str(entry.text)) {
+            break;
+          }
+          room_.restore(entry);
+          while (!early.empty() && early.begin()->first <= entry.seq) {
+            uint64_t seq = 0;
+            MessageOps::apply_update(log, early.begin()->second, seq);
+            early.erase(early.begin());
+          }
+        }
+      }
+    } catch (const std::exception &) {
+      // Leader unreachable or gone; the election decides who is next
+    }
+
+    {
+      LockGuard<Mutex> lock(mutex_);
+      follow_sock_ = nullptr;
+    }
+    sock.close();
+    Sleep(HEARTBEAT_MS);
+  }
+}
+
+void HubCluster::add_replica(SocketWrapper socket) {
+  std::unique_ptr<ReplicaLink> link(new ReplicaLink(*this, std::move(socket)));
+  ReplicaLink *raw = link.get();
+
+  LockGuard<Mutex> lock(mutex_);
+  if (!running_.load())
+    return;
+  replicas_.push_back(std::move(link));
+  raw->start();
+}
+
+void HubCluster::on_update(const std::string &frame) {
+  if (role_.load() != HubRole::Leader)
+    return;
+  SharedFrame wire = update_frame(frame);
+  LockGuard<Mutex> lock(mutex_);
+  for (auto &link : replicas_) {
+    link->send(wire);
+  }
+}
+
+void HubCluster::replica_closed(ReplicaLink *link) {
+  LockGuard<Mutex> lock(mutex_);
+  for (auto it = replicas_.begin(); it != replicas_.end(); ++it) {
+    if (it->get() == link) {
+      retired_.push_back(std::move(*it));
+      replicas_.erase(it);
+      break;
+    }
+  }
+}
+
+void HubCluster::reap_retired() {
+  std::vector<std::unique_ptr<ReplicaLink>> dead;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    dead.swap(retired_);
+  }
+  // Destructors join replica threads; run them outside the lock
+}
+
+// ── Client notices / queries
+// ──────────────────────────────────────────────────
+
+std::string HubCluster::client_endpoints() const {
+  std::string out;
+  auto add = [&out](const std::string &endpoint) {
+    if (endpoint.empty())
+      return;
+    if (!out.empty())
+      out += ",";
+    out += endpoint;
+  };
+
+  LockGuard<Mutex> lock(mutex_);
+  if (role_.load() == HubRole::Leader) {
+    add(options_.advertise);
+  } else {
+    auto leader = members_.find(leader_id_);
+    if (leader != members_.end())
+      add(leader->second.client);
+  }
+  for (auto it = members_.begin(); it != members_.end(); ++it) {
+    if (it->first != leader_id_)
+      add(it->second.client);
+  }
+  if (role_.load() != HubRole::Leader) {
+    add(options_.advertise);
+  }
+  return out;
+}
+
+void HubCluster::announce_hubs() {
+  std::string hubs = client_endpoints();
+  {
+    LockGuard<Mutex> lock(mutex_);
+    if (hubs == hubs_sent_)
+      return;
+    hubs_sent_ = hubs;
+  }
+  room_.send_control("CMD:HUBS:" + hubs);
+}
+
+std::string HubCluster::describe() const {
+  std::size_t live = 0;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    live = members_.size();
+  }
+  std::ostringstream oss;
+  oss << "  cluster:     " << hub_role_name(role_.load()) << ", term "
+      << term_.load() << ", log seq " << room_.log().last_seq() << ", "
+      << live << " other member(s) live\n";
+  return oss.str();
+}
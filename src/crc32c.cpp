@@ -0,0 +1,95 @@
+/**
+ * @file crc32c.cpp
+ * @brief Implementation of crc32c() – hardware path with a table fallback.
+ */
+
+#include "crc32c.h"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32C_X86 1
+#include <nmmintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define CRC32C_X86 1
+#include <intrin.h>
+#include <nmmintrin.h>
+#endif
+
+namespace {
+
+/// Reflected Castagnoli polynomial.
+constexpr uint32_t POLY = 0x82F63B78u;
+
+struct Table {
+  uint32_t v[256];
+  Table() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? (c >> 1) ^ POLY : c >> 1;
+      }
+      v[i] = c;
+    }
+  }
+};
+
+uint32_t crc_table(const unsigned char *p, std::size_t len, uint32_t crc) {
+  static const Table table;
+  for (std::size_t i = 0; i < len; ++i) {
+    crc = table.v[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#ifdef CRC32C_X86
+
+bool cpu_has_sse42() {
+#if defined(__GNUC__)
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2") != 0;
+#else
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 20)) != 0;
+#endif
+}
+
+#if defined(__GNUC__)
+__attribute__((target("sse4.2")))
+#endif
+uint32_t crc_sse42(const unsigned char *p, std::size_t len, uint32_t crc) {
+#if defined(__x86_64__) || defined(_M_X64)
+  uint64_t c = crc;
+  for (; len >= 8; p += 8, len -= 8) {
+    uint64_t word;
+    std::memcpy(&word, p, 8);
+    c = _mm_crc32_u64(c, word);
+  }
+  crc = static_cast<uint32_t>(c);
+#endif
+  for (; len >= 4; p += 4, len -= 4) {
+    uint32_t word;
+    std::memcpy(&word, p, 4);
+    crc = _mm_crc32_u32(crc, word);
+  }
+  for (; len > 0; ++p, --len) {
+    crc = _mm_crc32_u8(crc, *p);
+  }
+  return crc;
+}
+
+#endif // CRC32C_X86
+
+} // namespace
+
+uint32_t crc32c(const void *data, std::size_t len, uint32_t crc) {
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  crc = ~crc;
+#ifdef CRC32C_X86
+  static const bool hardware = cpu_has_sse42();
+  if (hardware)
+    return ~crc_sse42(p, len, crc);
+#endif
+  return ~crc_table(p, len, crc);
+}
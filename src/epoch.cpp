@@ -0,0 +1,126 @@
+/**
+ * @file epoch.cpp
+ * @brief Implementation of EpochDomain – reader slots and deferred frees.
+ */
+
+#include "epoch.h"
+
+#include <limits>
+#include <new>
+#include <vector>
+
+namespace {
+
+/// Slot this thread used last: usually free again, and nobody else's.
+thread_local std::size_t t_slot_hint = EpochDomain::SLOTS;
+
+} // namespace
+
+// ── Guard
+// ─────────────────────────────────────────────────────────────────────
+
+EpochDomain::Guard::Guard(EpochDomain &domain)
+    : domain_(domain), slot_(domain.enter()) {}
+
+EpochDomain::Guard::~Guard() { domain_.leave(slot_); }
+
+// ── Construction
+// ──────────────────────────────────────────────────────────────
+
+EpochDomain::EpochDomain() = default;
+
+EpochDomain &EpochDomain::instance() {
+  // Never destroyed: guards may still close during static destruction.
+  // Built in static storage, as plain new ignores the slots' alignment
+  // before C++17.
+  alignas(EpochDomain) static char storage[sizeof(EpochDomain)];
+  static EpochDomain *domain = new (storage) EpochDomain;
+  return *domain;
+}
+
+// ── Writers
+// ───────────────────────────────────────────────────────────────────
+
+uint64_t EpochDomain::advance() { return epoch_.fetch_add(1); }
+
+bool EpochDomain::reclaimable(uint64_t stamp) const {
+  return stamp < oldest();
+}
+
+void EpochDomain::synchronize() {
+  uint64_t stamp = advance();
+  while (!reclaimable(stamp)) {
+    SwitchToThread();
+  }
+}
+
+void EpochDomain::retire(std::function<void()> reclaim) {
+  uint64_t stamp = advance();
+  {
+    LockGuard<Mutex> lock(mutex_);
+    retired_.push_back(Retired{stamp, std::move(reclaim)});
+  }
+  collect();
+}
+
+std::size_t EpochDomain::collect() {
+  std::vector<std::function<void()>> due;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    if (retired_.empty())
+      return 0;
+    uint64_t oldest_reader = oldest();
+    while (!retired_.empty() && retired_.front().stamp < oldest_reader) {
+      due.push_back(std::move(retired_.front().reclaim));
+      retired_.pop_front();
+    }
+  }
+  // Outside the lock: a free may retire something else
+  for (auto &reclaim : due) {
+    reclaim();
+  }
+  return due.size();
+}
+
+std::size_t EpochDomain::pending() const {
+  LockGuard<Mutex> lock(mutex_);
+  return retired_.size();
+}
+
+// ── Private
+// ───────────────────────────────────────────────────────────────────
+
+std::size_t EpochDomain::enter() {
+  std::size_t start =
+      t_slot_hint < SLOTS ? t_slot_hint : GetCurrentThreadId() % SLOTS;
+  for (;;) {
+    for (std::size_t n = 0; n < SLOTS; ++n) {
+      std::size_t i = (start + n) % SLOTS;
+      std::atomic<uint64_t> &slot = slots_[i].epoch;
+      // Announce before reading anything shared. An epoch that went stale
+      // between the load and the exchange only makes writers wait longer.
+      uint64_t idle = 0;
+      if (slot.load(std::memory_order_relaxed) == 0 &&
+          slot.compare_exchange_strong(idle, epoch_.load())) {
+        t_slot_hint = i;
+        return i;
+      }
+    }
+    SwitchToThread(); // every slot is open: wait for a guard to close
+  }
+}
+
+void EpochDomain::leave(std::size_t slot) {
+  slots_[slot].epoch.store(0, std::memory_order_release);
+}
+
+uint64_t EpochDomain::oldest() const {
+  uint64_t oldest_reader = std::numeric_limits<uint64_t>::max();
+  for (const Slot &slot : slots_) {
+    uint64_t epoch = slot.epoch.load();
+    if (epoch != 0 && epoch < oldest_reader) {
+      oldest_reader = epoch;
+    }
+  }
+  return oldest_reader;
+}
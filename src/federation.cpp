@@ -0,0 +1,451 @@
+/**
+ * @file federation.cpp
+ * @brief Implementation of Federation – hub-to-hub message relay.
+ */
+
+#include "federation.h"
+
+#include "client.h"
+#include "link_writer.h"
+#include "metrics.h"
+#include "wire.h"
+
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint8_t FRAME_HELLO = 1;
+constexpr uint8_t FRAME_MSG = 2;
+
+/// How often unconnected peers are dialed again.
+constexpr int REDIAL_INTERVAL_MS = 2000;
+constexpr int REDIAL_TICK_MS = 100;
+
+/// Random, non-zero id for this process.
+uint64_t make_hub_id() {
+  std::random_device rd;
+  uint64_t id = (static_cast<uint64_t>(rd()) << 32) ^ rd() ^ monotonic_ns();
+  return id != 0 ? id : 1;
+}
+
+/// Split "host[:port]"; the port defaults to DEFAULT_FEDERATION_PORT.
+void split_target(const std::string &target, std::string &host,
+                  unsigned short &port) {
+  std::size_t colon = target.rfind(':');
+  host = target.substr(0, colon);
+  port = DEFAULT_FEDERATION_PORT;
+  if (colon != std::string::npos) {
+    port = static_cast<unsigned short>(std::stoi(target.substr(colon + 1)));
+  }
+}
+
+/// Origin timestamps are only comparable when both hubs share a clock.
+bool is_loopback(const std::string &host) {
+  return host.compare(0, 4, "127.") == 0 || host == "localhost";
+}
+
+} // namespace
+
+// ── PeerLink
+// ──────────────────────────────────────────────────────────────────
+
+/**
+ * One connection to another hub. Owns a blocking receive thread; sends are
+ * queued for a LinkWriter, so relaying never waits for a slow peer.
+ */
+class Federation::PeerLink {
+public:
+  PeerLink(Federation &fed, SocketWrapper socket, std::string peer,
+           std::string target)
+      : fed_(fed), socket_(std::move(socket)), peer_(std::move(peer)),
+        target_(std::move(target)), loopback_(is_loopback(peer_)) {
+    socket_.set_no_delay(true); // relayed lines go out as they come
+  }
+
+  ~PeerLink() {
+    close();
+    join();
+  }
+
+  PeerLink(const PeerLink &) = delete;
+  PeerLink &operator=(const PeerLink &) = delete;
+
+  void start() {
+    writer_.start();
+    thread_ = Thread(&PeerLink::run, this);
+  }
+
+  /// Unblock both threads; the receive thread retires the link on its way
+  /// out.
+  void close() { writer_.close(); }
+
+  /// Wait for both threads (not from either of them).
+  void join() {
+    writer_.join();
+    if (thread_.joinable() && !thread_.is_current()) {
+      thread_.join();
+    }
+  }
+
+  /**
+   * @brief Queue @p frame for the peer. Never blocks.
+   * @return false if the link is broken (it will be retired shortly).
+   */
+  bool send(const SharedFrame &frame) { return writer_.send(frame); }
+
+  const std::string &peer() const { return peer_; }
+  const std::string &target() const { return target_; }
+  bool outbound() const { return !target_.empty(); }
+  bool loopback() const { return loopback_; }
+
+  // Written by the receive thread before register_link(); read under
+  // Federation::mutex_ afterwards
+  uint64_t remote_id = 0;
+  std::string remote_name;
+  std::atomic<bool> established{false};
+
+private:
+  Federation &fed_;
+  SocketWrapper socket_;
+  LinkWriter writer_{socket_};
+  std::string peer_;   ///< Remote IP (or dialed host)
+  std::string target_; ///< Configured "host:port" if we dialed, else empty
+  bool loopback_;
+  Thread thread_; ///< Receive thread
+
+  void run() {
+    WireWriter hello;
+    hello.put_u8(FRAME_HELLO);
+    hello.put_u64(fed_.hub_id_);
+    hello.put_str(fed_.name_);
+    const std::string &wire = hello.data();
+
+    if (send(SocketWrapper::encode_frame(wire.data(),
+                                         static_cast<uint32_t>(wire.size())))) {
+      std::string frame;
+      try {
+        while (fed_.running_.load() && socket_.receive_binary(frame)) {
+          WireReader reader(frame);
+          uint8_t type = 0;
+          if (!reader.get_u8(type))
+            break;
+
+          if (type == FRAME_HELLO && remote_id == 0) {
+            if (!reader.get_u64(remote_id) || !reader.get_str(remote_name) ||
+                !fed_.register_link(this)) {
+              break;
+            }
+          } else if (type == FRAME_MSG && established) {
+            fed_.on_message(this, frame);
+          }
+          // Unknown frame types are ignored so newer hubs can add some
+        }
+      } catch (const std::exception &) {
+        // Oversized or malformed frame: drop the link
+      }
+    }
+    close(); // stops the writer too
+    fed_.link_closed(this);
+  }
+};
+
+// ── Construction / Destruction
+// ────────────────────────────────────────────────
+
+Federation::Federation(Room &room, const FederationOptions &options)
+    : room_(room), options_(options), hub_id_(make_hub_id()),
+      name_(options.name) {
+  if (name_.empty()) {
+    std::ostringstream oss;
+    oss << std::hex << hub_id_;
+    name_ = oss.str();
+  }
+}
+
+Federation::~Federation() { stop(); }
+
+// ── Lifecycle
+// ─────────────────────────────────────────────────────────────────
+
+void Federation::start() {
+  if (running_.load())
+    return;
+  running_.store(true);
+
+  room_.set_on_local_message(
+      [this](const LogEntry &entry) { publish(entry); });
+
+  if (options_.port != 0) {
+    listener_.reset(new Server(options_.port));
+    listener_->set_on_new_client([this](SocketWrapper sock, std::string ip) {
+      add_link(std::move(sock), std::move(ip), std::string());
+    });
+    listener_->start_accept_loop();
+  }
+
+  if (!options_.peers.empty()) {
+    dialer_thread_ = Thread(&Federation::dial_loop, this);
+  }
+}
+
+void Federation::stop() {
+  if (!running_.exchange(false))
+    return;
+
+  room_.set_on_local_message(nullptr);
+
+  if (listener_) {
+    listener_->stop();
+  }
+  if (dialer_thread_.joinable()) {
+    dialer_thread_.join();
+  }
+
+  // Closing the sockets unblocks the link threads; they are joined outside
+  // the lock because a closing link thread takes it
+  std::vector<std::shared_ptr<PeerLink>> links;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    for (auto &link : links_) {
+      link->close();
+    }
+    links.swap(links_);
+  }
+  for (auto &link : links) {
+    link->join();
+  }
+  links.clear();
+  reap_retired();
+}
+
+// ── Link management
+// ───────────────────────────────────────────────────────────
+
+void Federation::dial_loop() {
+  Client client;
+  while (running_.load()) {
+    reap_retired();
+
+    for (const std::string &target : options_.peers) {
+      bool connected = false;
+      {
+        LockGuard<Mutex> lock(mutex_);
+        auto known = target_hub_.find(target);
+        for (auto &link : links_) {
+          // Dialing, or already linked to that hub in either direction
+          if (link->target() == target ||
+              (known != target_hub_.end() && link->established &&
+               link->remote_id == known->second)) {
+            connected = true;
+            break;
+          }
+        }
+      }
+      if (connected)
+        continue;
+
+      std::string host;
+      unsigned short port = 0;
+      try {
+        split_target(target, host, port);
+        SocketWrapper sock = client.connect_to(host, port);
+        add_link(std::move(sock), host, target);
+      } catch (const std::exception &) {
+        // Peer not up yet; retry on the next pass
+      }
+    }
+
+    for (int waited = 0; waited < REDIAL_INTERVAL_MS && running_.load();
+         waited += REDIAL_TICK_MS) {
+      Sleep(REDIAL_TICK_MS);
+    }
+  }
+}
+
+void Federation::add_link(SocketWrapper socket, std::string peer,
+                          std::string target) {
+  std::shared_ptr<PeerLink> link(new PeerLink(
+      *this, std::move(socket), std::move(peer), std::move(target)));
+  PeerLink *raw = link.get();
+
+  LockGuard<Mutex> lock(mutex_);
+  if (!running_.load())
+    return;
+  links_.push_back(std::move(link));
+  raw->start();
+}
+
+bool Federation::register_link(PeerLink *link) {
+  if (link->remote_id == hub_id_)
+    return false; // dialed ourselves
+
+  std::string replaced;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    if (link->outbound()) {
+      target_hub_[link->target()] = link->remote_id;
+    }
+
+    // Two hubs that dial each other end up with two links. Both sides keep
+    // the one initiated by the smaller hub id, so they agree without talking.
+    auto initiator = [this](const PeerLink *l) {
+      return l->outbound() ? hub_id_ : l->remote_id;
+    };
+    for (auto &other : links_) {
+      if (other.get() == link || !other->established ||
+          other->remote_id != link->remote_id) {
+        continue;
+      }
+      if (initiator(link) >= initiator(other.get()))
+        return false;
+      other->established = false;
+      other->close();
+      replaced = other->peer();
+    }
+    link->established = true;
+  }
+
+  if (replaced.empty()) {
+    std::cout << "\033[2K\r" << "[Federation] Linked to hub '"
+              << link->remote_name << "' (" << link->peer() << ")\n"
+              << "You: " << std::flush;
+  }
+  return true;
+}
+
+void Federation::link_closed(PeerLink *link) {
+  bool was_established = false;
+  LockGuard<Mutex> lock(mutex_);
+  for (auto it = links_.begin(); it != links_.end(); ++it) {
+    if (it->get() == link) {
+      was_established = link->established;
+      link->established = false;
+      retired_.push_back(std::move(*it));
+      links_.erase(it);
+      break;
+    }
+  }
+  if (was_established && running_.load()) {
+    std::cout << "\033[2K\r" << "[Federation] Lost hub '"
+              << link->remote_name << "' (" << link->peer() << ")\n"
+              << "You: " << std::flush;
+  }
+}
+
+void Federation::reap_retired() {
+  std::vector<std::shared_ptr<PeerLink>> dead;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    dead.swap(retired_);
+  }
+  // Join the link threads outside the lock. A relay() still sending may
+  // hold the last reference; by then it only frees memory.
+  for (auto &link : dead) {
+    link->join();
+  }
+}
+
+// ── Messaging
+// ─────────────────────────────────────────────────────────────────
+
+void Federation::publish(const LogEntry &entry) {
+  if (!running_.load())
+    return;
+
+  WireWriter w;
+  w.put_u8(FRAME_MSG);
+  w.put_u64(hub_id_);
+  w.put_u64(next_seq_.fetch_add(1, std::memory_order_relaxed));
+  w.put_u64(monotonic_ns());
+  w.put_u64(entry.hlc);
+  w.put_str(entry.sender);
+  w.put_str(entry.text);
+  const std::string &wire = w.data();
+
+  relay(SocketWrapper::encode_frame(wire.data(),
+                                    static_cast<uint32_t>(wire.size())),
+        nullptr);
+}
+
+void Federation::on_message(PeerLink *from, const std::string &frame) {
+  WireReader reader(frame);
+  uint8_t type = 0;
+  uint64_t origin = 0, seq = 0, origin_ns = 0, hlc = 0;
+  std::string sender, text;
+  if (!reader.get_u8(type) || !reader.get_u64(origin) ||
+      !reader.get_u64(seq) || !reader.get_u64(origin_ns) ||
+      !reader.get_u64(hlc) || !reader.get_str(sender) ||
+      !reader.get_str(text)) {
+    return;
+  }
+
+  HubMetrics &metrics = HubMetrics::instance();
+  bool fresh = origin != hub_id_;
+  uint64_t skipped = 0;
+  if (fresh) {
+    LockGuard<Mutex> lock(seen_mutex_);
+    SeqWindow &window = seen_[origin];
+    uint64_t before = window.skipped();
+    fresh = window.accept(seq);
+    skipped = window.skipped() - before;
+  }
+  if (skipped != 0) {
+    metrics.fed_skipped.fetch_add(skipped, std::memory_order_relaxed);
+  }
+  if (!fresh) {
+    metrics.fed_duplicates.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  metrics.fed_in.fetch_add(1, std::memory_order_relaxed);
+
+  // Forward the frame unchanged before local delivery so the next hub
+  // starts its own fan-out as early as possible
+  relay(SocketWrapper::encode_frame(frame.data(),
+                                    static_cast<uint32_t>(frame.size())),
+        from);
+  room_.broadcast(0, sender, text, 0, hlc);
+
+  if (from->loopback()) {
+    metrics.fed_latency.record(monotonic_ns() - origin_ns);
+  }
+
+  std::cout << "\033[2K\r" << "[" << sender << "]: " << text << "\n"
+            << "You: " << std::flush;
+}
+
+void Federation::relay(const SharedFrame &frame, const PeerLink *except) {
+  // Queue outside mutex_, so relaying never holds up link management
+  std::vector<std::shared_ptr<PeerLink>> targets;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    targets.reserve(links_.size());
+    for (auto &link : links_) {
+      if (link.get() != except && link->established) {
+        targets.push_back(link);
+      }
+    }
+  }
+  uint64_t sent = 0;
+  for (auto &link : targets) {
+    if (link->send(frame)) {
+      ++sent;
+    }
+  }
+  HubMetrics::instance().fed_out.fetch_add(sent, std::memory_order_relaxed);
+}
+
+// ── Queries
+// ───────────────────────────────────────────────────────────────────
+
+std::size_t Federation::peer_count() const {
+  LockGuard<Mutex> lock(mutex_);
+  std::size_t count = 0;
+  for (auto &link : links_) {
+    if (link->established)
+      ++count;
+  }
+  return count;
+}
@@ -0,0 +1,125 @@
+/**
+ * @file fiber.cpp
+ * @brief Implementation of Fiber and FiberPool on top of Win32 fibers.
+ */
+
+#include "fiber.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+/// The pooled fiber currently running on this thread.
+thread_local Fiber *t_current = nullptr;
+
+} // namespace
+
+// ── Fiber
+// ─────────────────────────────────────────────────────────────────────
+
+Fiber::Fiber(std::size_t stack_size) {
+  handle_ = CreateFiberEx(0, stack_size, FIBER_FLAG_FLOAT_SWITCH,
+                          &Fiber::entry, this);
+  if (!handle_) {
+    throw std::runtime_error("CreateFiberEx failed: " +
+                             std::to_string(GetLastError()));
+  }
+}
+
+Fiber::~Fiber() {
+  if (handle_) {
+    DeleteFiber(handle_);
+  }
+}
+
+Fiber *Fiber::current() { return t_current; }
+
+void Fiber::yield() {
+  Fiber *self = t_current;
+  if (self) {
+    SwitchToFiber(self->caller_);
+  }
+}
+
+void Fiber::resume() {
+  if (finished_)
+    return;
+
+  bool converted = false;
+  if (!IsThreadAFiber()) {
+    ConvertThreadToFiber(nullptr);
+    converted = true;
+  }
+
+  Fiber *outer = t_current;
+  caller_ = GetCurrentFiber();
+  t_current = this;
+  SwitchToFiber(handle_);
+  t_current = outer;
+
+  if (converted) {
+    ConvertFiberToThread();
+  }
+}
+
+void WINAPI Fiber::entry(LPVOID param) {
+  auto *self = static_cast<Fiber *>(param);
+  for (;;) {
+    try {
+      self->task_();
+    } catch (...) {
+      // A task must not unwind past its fiber; treat as finished
+    }
+    self->task_ = nullptr;
+    self->finished_ = true;
+    self->waiting_for_write_ = false;
+    // Park until the pool hands out a new task and resumes us
+    SwitchToFiber(self->caller_);
+  }
+}
+
+// ── FiberPool
+// ─────────────────────────────────────────────────────────────────
+
+FiberPool &FiberPool::instance() {
+  static FiberPool pool;
+  return pool;
+}
+
+FiberPool::~FiberPool() {
+  for (Fiber *fiber : idle_) {
+    delete fiber;
+  }
+}
+
+Fiber *FiberPool::acquire(std::function<void()> task) {
+  Fiber *fiber = nullptr;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    if (!idle_.empty()) {
+      fiber = idle_.back();
+      idle_.pop_back();
+    }
+  }
+  if (!fiber) {
+    fiber = new Fiber(STACK_SIZE);
+  }
+  fiber->task_ = std::move(task);
+  fiber->finished_ = false;
+  fiber->waiting_for_write_ = false;
+  return fiber;
+}
+
+void FiberPool::release(Fiber *fiber) {
+  if (!fiber)
+    return;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    if (fiber->finished_ && idle_.size() < MAX_IDLE) {
+      idle_.push_back(fiber);
+      return;
+    }
+  }
+  delete fiber;
+}
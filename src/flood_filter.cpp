@@ -0,0 +1,109 @@
+/**
+ * @file flood_filter.cpp
+ * @brief Implementation of FloodFilter – rotating Bloom filters.
+ */
+
+#include "flood_filter.h"
+
+#include "compat.h"
+#include "crc32c.h"
+
+#include <limits>
+
+namespace {
+
+/// Marks a generation whose bits are being cleared.
+constexpr uint64_t CLEARING = std::numeric_limits<uint64_t>::max();
+
+/// Spread a 64-bit value over all bits (SplitMix64 finaliser).
+uint64_t mix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+} // namespace
+
+// ── Construction
+// ──────────────────────────────────────────────────────────────
+
+FloodFilter::FloodFilter(unsigned window_ms)
+    : half_ns_(static_cast<uint64_t>(window_ms < 2 ? 2 : window_ms) *
+               500000ull) {
+  for (Generation &generation : generations_) {
+    for (auto &word : generation.words) {
+      word.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+// ── Checking
+// ──────────────────────────────────────────────────────────────────
+
+bool FloodFilter::repeated(uint64_t sender, const std::string &text) {
+  // Periods start at 1, so a fresh generation (0) never looks current
+  uint64_t period = monotonic_ns() / half_ns_ + 1;
+  Generation &current = generations_[period & 1];
+  Generation &previous = generations_[(period - 1) & 1];
+
+  uint64_t held = current.period.load(std::memory_order_acquire);
+  if (held < period) { // CLEARING is never below
+    rotate(current, period);
+    held = current.period.load(std::memory_order_acquire);
+  }
+  bool use_current = held == period;
+  bool use_previous =
+      previous.period.load(std::memory_order_acquire) == period - 1;
+
+  // The sender is hashed in: the same line from two clients is fine
+  uint32_t crc = crc32c(text.data(), text.size());
+  uint64_t hash =
+      mix(mix(sender) ^ ((static_cast<uint64_t>(text.size()) << 32) | crc));
+  uint64_t h1 = hash;
+  uint64_t h2 = (hash >> 32) | 1;
+
+  bool in_current = use_current;
+  bool in_previous = use_previous;
+  for (unsigned i = 0; i < HASHES; ++i) {
+    std::size_t bit = static_cast<std::size_t>(h1 + i * h2) & (BITS - 1);
+    uint64_t mask = uint64_t{1} << (bit % 64);
+    if (use_current) {
+      // Record this copy while testing for the last one
+      uint64_t was = current.words[bit / 64].fetch_or(
+          mask, std::memory_order_relaxed);
+      in_current = in_current && (was & mask) != 0;
+    }
+    if (in_previous) {
+      in_previous = (previous.words[bit / 64].load(
+                         std::memory_order_relaxed) &
+                     mask) != 0;
+    }
+  }
+
+  // A filter rotated while we were at it may have been half cleared: its
+  // answer does not count (the bits set in it do no harm)
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (in_current &&
+      current.period.load(std::memory_order_relaxed) != period) {
+    in_current = false;
+  }
+  if (in_previous &&
+      previous.period.load(std::memory_order_relaxed) != period - 1) {
+    in_previous = false;
+  }
+  return in_current || in_previous;
+}
+
+void FloodFilter::rotate(Generation &generation, uint64_t period) {
+  uint64_t held = generation.period.load(std::memory_order_acquire);
+  // A thread that read the clock before the last rotation must not undo it
+  if (held >= period ||
+      !generation.period.compare_exchange_strong(held, CLEARING))
+    return; // someone else got there first
+  // A check that sees a cleared bit then sees CLEARING or later
+  std::atomic_thread_fence(std::memory_order_release);
+  for (auto &word : generation.words) {
+    word.store(0, std::memory_order_relaxed);
+  }
+  generation.period.store(period, std::memory_order_release);
+}
@@ -0,0 +1,347 @@
+/**
+ * @file history_archive.cpp
+ * @brief Implementation of HistoryArchive – compressed history segments.
+ */
+
+#include "history_archive.h"
+
+#include "lz_block.h"
+#include "metrics.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace history;
+
+namespace {
+
+const char ARCHIVE_TAG[] = "LCARC01\n";
+const char FOOTER_TAG[] = "LCARCEND";
+constexpr std::size_t TAG_LEN = 8;
+
+/// u32 packed_len, u32 raw_len, u32 crc32c(packed)
+constexpr std::size_t BLOCK_HEADER_LEN = 12;
+
+/// u64 first_seq, u64 offset, u32 packed_len, u32 raw_len
+constexpr std::size_t INDEX_ENTRY_LEN = 24;
+
+/// u64 index_offset, u64 last_seq, u32 blocks, u32 crc32c(index), tag
+constexpr std::size_t FOOTER_LEN = 32;
+
+} // namespace
+
+// ── Construction / Destruction
+// ────────────────────────────────────────────────
+
+HistoryArchive::HistoryArchive(const std::string &path) : path_(path) {
+  file_ = open_read(path);
+  if (file_ == INVALID_HANDLE_VALUE)
+    throw std::runtime_error("Cannot open history archive " + path);
+
+  // Footer, then the index it points to
+  file_bytes_ = file_size(file_);
+  char footer[FOOTER_LEN];
+  char tag[TAG_LEN];
+  uint64_t index_offset = 0;
+  uint32_t blocks = 0;
+  uint32_t crc = 0;
+  bool ok = file_bytes_ >= TAG_LEN + FOOTER_LEN && seek(file_, 0) &&
+            read_all(file_, tag, TAG_LEN) &&
+            std::memcmp(tag, ARCHIVE_TAG, TAG_LEN) == 0 &&
+            seek(file_, file_bytes_ - FOOTER_LEN) &&
+            read_all(file_, footer, FOOTER_LEN) &&
+            std::memcmp(footer + FOOTER_LEN - TAG_LEN, FOOTER_TAG, TAG_LEN) ==
+                0;
+  if (ok) {
+    WireReader r(footer, FOOTER_LEN);
+    r.get_u64(index_offset);
+    r.get_u64(last_seq_);
+    r.get_u32(blocks);
+    r.get_u32(crc);
+    ok = index_offset + uint64_t(blocks) * INDEX_ENTRY_LEN ==
+         file_bytes_ - FOOTER_LEN;
+  }
+  std::string index;
+  if (ok) {
+    index.resize(std::size_t(blocks) * INDEX_ENTRY_LEN);
+    ok = seek(file_, index_offset) &&
+         read_all(file_, &index[0], index.size()) &&
+         crc32c(index.data(), index.size()) == crc;
+  }
+  if (!ok) {
+    CloseHandle(file_);
+    throw std::runtime_error("History archive " + path + " is damaged");
+  }
+
+  WireReader r(index);
+  blocks_.resize(blocks);
+  for (Block &b : blocks_) {
+    r.get_u64(b.first_seq);
+    r.get_u64(b.offset);
+    r.get_u32(b.packed_len);
+    r.get_u32(b.raw_len);
+    raw_bytes_ += b.raw_len;
+  }
+}
+
+HistoryArchive::~HistoryArchive() { CloseHandle(file_); }
+
+// ── Building
+// ──────────────────────────────────────────────────────────────────
+
+bool HistoryArchive::build(const std::string &segment,
+                           const std::string &archive, const Pace &pace,
+                           ArchiveStats &stats) {
+  stats = ArchiveStats();
+  HANDLE in = open_read(segment);
+  if (in == INVALID_HANDLE_VALUE)
+    return false;
+  stats.raw_bytes = file_size(in);
+
+  std::string payload;
+  LogChange change;
+  LogEntry entry;
+  uint64_t paced = JOURNAL_TAG_LEN;
+  auto keep_pace = [&](uint64_t offset) {
+    if (offset - paced < BLOCK_BYTES)
+      return true;
+    std::size_t bytes = static_cast<std::size_t>(offset - paced);
+    paced = offset;
+    return pace(bytes);
+  };
+
+  // Pass 1: the final state of every edit and delete of a message that
+  // is itself in this segment (messages are numbered in file order)
+  uint64_t first_seq = 0;
+  std::unordered_map<uint64_t, LogEntry> folds;
+  {
+    RecordReader reader(in, JOURNAL_TAG_LEN);
+    while (reader.next(payload) && decode_change(payload, change, entry)) {
+      if (change == LogChange::Append) {
+        if (first_seq == 0)
+          first_seq = entry.seq;
+      } else if (first_seq != 0 && entry.seq >= first_seq) {
+        LogEntry &fold = folds[entry.seq];
+        if (change == LogChange::Delete) {
+          fold.deleted = true;
+          fold.text.clear();
+        } else {
+          fold.edited = true;
+          fold.text = entry.text;
+        }
+      }
+      if (!keep_pace(reader.offset())) {
+        CloseHandle(in);
+        return false;
+      }
+    }
+  }
+
+  // Pass 2: folded records, BLOCK_BYTES at a time
+  std::string tmp = archive + ".tmp";
+  HANDLE out = CreateFileA(tmp.c_str(), GENERIC_WRITE, 0, nullptr,
+                           CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (out == INVALID_HANDLE_VALUE) {
+    CloseHandle(in);
+    return false;
+  }
+  std::vector<Block> blocks;
+  std::string raw;
+  std::string packed;
+  uint64_t offset = TAG_LEN;
+  uint64_t block_first = 0;
+  uint64_t last_seq = 0;
+  bool ok = write_all(out, ARCHIVE_TAG, TAG_LEN);
+
+  auto flush_block = [&]() {
+    if (raw.empty() || !ok)
+      return;
+    packed.clear();
+    lz_compress(raw.data(), raw.size(), packed);
+    WireWriter header;
+    header.put_u32(static_cast<uint32_t>(packed.size()));
+    header.put_u32(static_cast<uint32_t>(raw.size()));
+    header.put_u32(crc32c(packed.data(), packed.size()));
+    ok = write_all(out, header.data().data(), BLOCK_HEADER_LEN) &&
+         write_all(out, packed.data(), packed.size());
+    Block b;
+    b.first_seq = block_first != 0 ? block_first : last_seq + 1;
+    b.offset = offset;
+    b.packed_len = static_cast<uint32_t>(packed.size());
+    b.raw_len = static_cast<uint32_t>(raw.size());
+    blocks.push_back(b);
+    offset += BLOCK_HEADER_LEN + packed.size();
+    raw.clear();
+    block_first = 0;
+  };
+
+  RecordReader reader(in, JOURNAL_TAG_LEN);
+  while (ok && reader.next(payload) && decode_change(payload, change, entry)) {
+    if (change == LogChange::Append) {
+      auto fold = folds.find(entry.seq);
+      if (fold != folds.end()) {
+        entry.edited = entry.edited || fold->second.edited;
+        entry.deleted = entry.deleted || fold->second.deleted;
+        entry.text = entry.deleted ? std::string() : fold->second.text;
+        payload = encode_change(change, entry);
+      }
+      if (block_first == 0)
+        block_first = entry.seq;
+      last_seq = entry.seq;
+    } else if (first_seq != 0 && entry.seq >= first_seq) {
+      ++stats.folded; // already applied to its message above
+      continue;
+    }
+    append_record(raw, payload);
+    ++stats.records;
+    if (raw.size() >= BLOCK_BYTES) {
+      flush_block();
+      if (!keep_pace(reader.offset()))
+        ok = false;
+    }
+  }
+  flush_block();
+  CloseHandle(in);
+
+  // Index and footer
+  WireWriter index;
+  for (const Block &b : blocks) {
+    index.put_u64(b.first_seq);
+    index.put_u64(b.offset);
+    index.put_u32(b.packed_len);
+    index.put_u32(b.raw_len);
+  }
+  WireWriter footer;
+  footer.put_u64(offset);
+  footer.put_u64(last_seq);
+  footer.put_u32(static_cast<uint32_t>(blocks.size()));
+  footer.put_u32(crc32c(index.data().data(), index.data().size()));
+  ok = ok && write_all(out, index.data().data(), index.data().size()) &&
+       write_all(out, footer.data().data(), footer.data().size()) &&
+       write_all(out, FOOTER_TAG, TAG_LEN) && FlushFileBuffers(out);
+  CloseHandle(out);
+
+  if (!ok || !MoveFileExA(tmp.c_str(), archive.c_str(),
+                          MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+    DeleteFileA(tmp.c_str());
+    return false;
+  }
+  stats.blocks = blocks.size();
+  stats.file_bytes = offset + index.data().size() + FOOTER_LEN;
+  return true;
+}
+
+// ── Reading
+// ───────────────────────────────────────────────────────────────────
+
+bool HistoryArchive::get(uint64_t seq, LogEntry &out) {
+  uint64_t t0 = monotonic_ns();
+  bool found = false;
+  std::string raw;
+  for (std::size_t i = locate(seq);
+       !found && i < blocks_.size() && blocks_[i].first_seq <= seq; ++i) {
+    if (!load(i, raw))
+      break;
+    each_record(raw, [&](LogChange change, const LogEntry &entry) {
+      if (change == LogChange::Append && entry.seq == seq) {
+        out = entry;
+        found = true;
+      }
+      return !found;
+    });
+  }
+  HubMetrics::instance().archive_seek.record(monotonic_ns() - t0);
+  return found;
+}
+
+bool HistoryArchive::read_from(uint64_t seq, const HistoryReplay &replay) {
+  for (std::size_t i = locate(seq); i < blocks_.size(); ++i) {
+    if (!read_block(i, replay))
+      return false;
+  }
+  return true;
+}
+
+bool HistoryArchive::read_block(std::size_t i, const HistoryReplay &replay) {
+  std::string raw;
+  return load(i, raw) &&
+         each_record(raw, [&](LogChange change, const LogEntry &e) {
+           replay(change, e);
+           return true;
+         });
+}
+
+bool HistoryArchive::verify() {
+  std::string raw;
+  for (std::size_t i = 0; i < blocks_.size(); ++i) {
+    if (!load(i, raw) ||
+        !each_record(raw, [](LogChange, const LogEntry &) { return true; }))
+      return false;
+  }
+  return true;
+}
+
+// ── Private helpers
+// ───────────────────────────────────────────────────────────
+
+std::size_t HistoryArchive::locate(uint64_t seq) const {
+  auto it = std::upper_bound(
+      blocks_.begin(), blocks_.end(), seq,
+      [](uint64_t s, const Block &b) { return s < b.first_seq; });
+  std::size_t i = static_cast<std::size_t>(it - blocks_.begin());
+  if (i == 0)
+    return 0;
+  --i;
+  // Edit-only blocks share the number of the block after them
+  while (i > 0 && blocks_[i - 1].first_seq == blocks_[i].first_seq) {
+    --i;
+  }
+  return i;
+}
+
+bool HistoryArchive::load(std::size_t i, std::string &raw) {
+  const Block &b = blocks_[i];
+  std::string block(BLOCK_HEADER_LEN + b.packed_len, '\0');
+  {
+    LockGuard<Mutex> lock(mutex_);
+    if (!seek(file_, b.offset) || !read_all(file_, &block[0], block.size()))
+      return false;
+  }
+  WireReader header(block.data(), BLOCK_HEADER_LEN);
+  uint32_t packed_len = 0;
+  uint32_t raw_len = 0;
+  uint32_t crc = 0;
+  header.get_u32(packed_len);
+  header.get_u32(raw_len);
+  header.get_u32(crc);
+  const char *packed = block.data() + BLOCK_HEADER_LEN;
+  return packed_len == b.packed_len && raw_len == b.raw_len &&
+         crc32c(packed, packed_len) == crc &&
+         lz_decompress(packed, packed_len, raw_len, raw);
+}
+
+bool HistoryArchive::each_record(
+    const std::string &raw,
+    const std::function<bool(LogChange, const LogEntry &)> &visit) {
+  std::size_t pos = 0;
+  std::string payload;
+  while (pos < raw.size()) {
+    const char *body = nullptr;
+    std::size_t body_len = 0;
+    std::size_t used =
+        parse_record(raw.data() + pos, raw.size() - pos, body, body_len);
+    LogChange change;
+    LogEntry entry;
+    if (used == 0)
+      return false;
+    payload.assign(body, body_len);
+    if (!decode_change(payload, change, entry))
+      return false;
+    if (!visit(change, entry))
+      return true;
+    pos += used;
+  }
+  return true;
+}
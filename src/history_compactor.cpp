@@ -0,0 +1,140 @@
+/**
+ * @file history_compactor.cpp
+ * @brief Implementation of HistoryCompactor – throttled segment archiving.
+ */
+
+#include "history_compactor.h"
+
+#include "history_archive.h"
+#include "history_file.h"
+#include "metrics.h"
+
+#include <iostream>
+
+using namespace history;
+
+namespace {
+
+/// Granularity of waits, so stop() is prompt.
+constexpr unsigned TICK_MS = 100;
+
+void count_archive(uint64_t raw_bytes, uint64_t file_bytes) {
+  HubMetrics &metrics = HubMetrics::instance();
+  metrics.archive_segments.fetch_add(1, std::memory_order_relaxed);
+  metrics.archive_raw_bytes.fetch_add(raw_bytes, std::memory_order_relaxed);
+  metrics.archive_bytes.fetch_add(file_bytes, std::memory_order_relaxed);
+}
+
+} // namespace
+
+// ── Construction / Destruction
+// ────────────────────────────────────────────────
+
+HistoryCompactor::HistoryCompactor(const std::string &path)
+    : path_(path), rng_(std::random_device()()) {}
+
+HistoryCompactor::~HistoryCompactor() { stop(); }
+
+// ── Lifecycle
+// ─────────────────────────────────────────────────────────────────
+
+void HistoryCompactor::start() {
+  if (running_.exchange(true))
+    return;
+  thread_ = Thread(&HistoryCompactor::run, this);
+}
+
+void HistoryCompactor::stop() {
+  if (!running_.exchange(false))
+    return;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+// ── Archiving
+// ─────────────────────────────────────────────────────────────────
+
+void HistoryCompactor::run() {
+  // Only spare cycles: chat traffic always wins
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_IDLE);
+
+  while (running_.load()) {
+    for (;;) {
+      std::string segment = HistoryFile::segment_path(path_, next_);
+      std::string archived = HistoryFile::archive_path(path_, next_);
+      if (file_exists(archived)) {
+        if (file_exists(segment)) {
+          // Archived, then stopped before the segment was removed
+          DeleteFileA((segment + ".idx").c_str());
+          DeleteFileA(segment.c_str());
+        }
+        try {
+          HistoryArchive arc(archived);
+          count_archive(arc.raw_bytes(), arc.file_bytes());
+        } catch (const std::exception &e) {
+          std::cerr << "[History] " << e.what() << "\n";
+        }
+      } else if (!file_exists(segment) || !archive(next_)) {
+        break; // not sealed yet, or stopping
+      }
+      ++next_;
+    }
+    for (unsigned waited = 0; running_.load() && waited < POLL_MS;
+         waited += TICK_MS) {
+      Sleep(TICK_MS);
+    }
+  }
+}
+
+bool HistoryCompactor::archive(unsigned n) {
+  std::string segment = HistoryFile::segment_path(path_, n);
+  std::string archived = HistoryFile::archive_path(path_, n);
+
+  // Hold reads to RATE_BYTES_PER_SEC, and give up promptly on stop()
+  uint64_t started = monotonic_ns();
+  uint64_t consumed = 0;
+  auto pace = [&](std::size_t bytes) {
+    consumed += bytes;
+    uint64_t due = consumed * 1000000000ull / RATE_BYTES_PER_SEC;
+    while (running_.load() && monotonic_ns() - started < due) {
+      Sleep(TICK_MS / 10);
+    }
+    return running_.load();
+  };
+
+  ArchiveStats stats;
+  if (!HistoryArchive::build(segment, archived, pace, stats)) {
+    if (running_.load()) {
+      std::cerr << "[History] Could not archive " << segment
+                << "; it stays uncompressed\n";
+    }
+    return running_.load();
+  }
+
+  // Only a segment whose archive reads back in full is removed
+  try {
+    HistoryArchive arc(archived);
+    if (!arc.verify())
+      throw std::runtime_error("History archive " + archived +
+                               " failed verification");
+    // Uniform over the whole range: rand() % span would never reach past
+    // RAND_MAX (32767 with MSVC) and favours the low numbers
+    if (arc.last_seq() != 0) {
+      std::uniform_int_distribution<uint64_t> pick(arc.first_seq(),
+                                                   arc.last_seq());
+      for (unsigned i = 0; i < SEEK_SAMPLES; ++i) {
+        LogEntry entry;
+        arc.get(pick(rng_), entry);
+      }
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "[History] " << e.what() << "; keeping " << segment << "\n";
+    DeleteFileA(archived.c_str());
+    return true;
+  }
+  DeleteFileA((segment + ".idx").c_str());
+  DeleteFileA(segment.c_str());
+  count_archive(stats.raw_bytes, stats.file_bytes);
+  return true;
+}
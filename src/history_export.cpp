@@ -0,0 +1,588 @@
+/**
+ * @file history_export.cpp
+ * @brief Implementation of HistoryExport – streaming JSON Lines / CSV.
+ */
+
+#include "history_export.h"
+
+#include "history_archive.h"
+#include "history_file.h"
+#include "hlc.h"
+#include "metrics.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EXPORT_SSE2 1
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+using namespace history;
+
+bool parse_export_format(const std::string &name, ExportFormat &format) {
+  if (name == "jsonl" || name == "json") {
+    format = ExportFormat::JsonLines;
+  } else if (name == "csv") {
+    format = ExportFormat::Csv;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+namespace {
+
+// ── Escaping
+// ──────────────────────────────────────────────────────────────────
+
+inline bool json_special(unsigned char c) {
+  return c < 0x20 || c == '"' || c == '\\';
+}
+
+inline bool csv_special(unsigned char c) {
+  return c == '"' || c == ',' || c == '\n' || c == '\r';
+}
+
+#ifdef EXPORT_SSE2
+
+inline unsigned lowest_bit(unsigned mask) {
+#if defined(_MSC_VER)
+  unsigned long i;
+  _BitScanForward(&i, mask);
+  return static_cast<unsigned>(i);
+#else
+  return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+inline __m128i load16(const char *p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+#endif
+
+/// @return First byte in [p, end) that JSON must escape, or @p end.
+const char *find_json_special(const char *p, const char *end) {
+#ifdef EXPORT_SSE2
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i ctrl = _mm_set1_epi8(0x1F);
+  for (; end - p >= 16; p += 16) {
+    __m128i v = load16(p);
+    // max(v, 0x1F) == 0x1F exactly when v <= 0x1F (unsigned)
+    __m128i hit = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hit));
+    if (mask != 0)
+      return p + lowest_bit(mask);
+  }
+#endif
+  for (; p < end; ++p) {
+    if (json_special(static_cast<unsigned char>(*p)))
+      return p;
+  }
+  return end;
+}
+
+/// @return First byte in [p, end) that forces CSV quoting, or @p end.
+const char *find_csv_special(const char *p, const char *end) {
+#ifdef EXPORT_SSE2
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i comma = _mm_set1_epi8(',');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+  for (; end - p >= 16; p += 16) {
+    __m128i v = load16(p);
+    __m128i hit = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, comma)),
+        _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hit));
+    if (mask != 0)
+      return p + lowest_bit(mask);
+  }
+#endif
+  for (; p < end; ++p) {
+    if (csv_special(static_cast<unsigned char>(*p)))
+      return p;
+  }
+  return end;
+}
+
+/// Append @p s as a quoted JSON string.
+void put_json_string(std::string &out, const std::string &s) {
+  static const char HEX[] = "0123456789abcdef";
+  const char *p = s.data();
+  const char *end = p + s.size();
+  out += '"';
+  for (;;) {
+    const char *stop = find_json_special(p, end);
+    out.append(p, stop);
+    if (stop == end)
+      break;
+    unsigned char c = static_cast<unsigned char>(*stop);
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      out += "\\u00";
+      out += HEX[c >> 4];
+      out += HEX[c & 0xF];
+    }
+    p = stop + 1;
+  }
+  out += '"';
+}
+
+/// Append @p s as a CSV field, quoted only if it has to be.
+void put_csv_field(std::string &out, const std::string &s) {
+  const char *p = s.data();
+  const char *end = p + s.size();
+  if (find_csv_special(p, end) == end) {
+    out.append(p, end);
+    return;
+  }
+  out += '"';
+  for (;;) {
+    const char *quote = static_cast<const char *>(
+        std::memchr(p, '"', static_cast<std::size_t>(end - p)));
+    if (quote == nullptr) {
+      out.append(p, end);
+      break;
+    }
+    out.append(p, quote + 1);
+    out += '"'; // "" inside a quoted field
+    p = quote + 1;
+  }
+  out += '"';
+}
+
+// ── Fields
+// ────────────────────────────────────────────────────────────────────
+
+void put_u64(std::string &out, uint64_t v) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = static_cast<char>('0' + v % 10);
+    v /= 10;
+  } while (v != 0);
+  while (n > 0) {
+    out += digits[--n];
+  }
+}
+
+void put_2(std::string &out, unsigned v) {
+  out += static_cast<char>('0' + v / 10);
+  out += static_cast<char>('0' + v % 10);
+}
+
+/// Append the wall-clock part of @p hlc as "YYYY-MM-DDTHH:MM:SS.mmmZ"
+/// (nothing if there is no stamp).
+void put_time(std::string &out, uint64_t hlc) {
+  if (hlc == 0)
+    return;
+  uint64_t ms = hlc_physical_ms(hlc);
+  uint64_t secs = ms / 1000;
+  unsigned day_secs = static_cast<unsigned>(secs % 86400);
+
+  // Days since 1970 to a civil date (proleptic Gregorian)
+  int64_t z = static_cast<int64_t>(secs / 86400) + 719468;
+  int64_t era = z / 146097;
+  unsigned doe = static_cast<unsigned>(z - era * 146097);
+  unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned mp = (5 * doy + 2) / 153;
+  unsigned day = doy - (153 * mp + 2) / 5 + 1;
+  unsigned month = mp < 10 ? mp + 3 : mp - 9;
+  uint64_t year = static_cast<uint64_t>(yoe + era * 400) + (month <= 2);
+
+  put_u64(out, year);
+  out += '-';
+  put_2(out, month);
+  out += '-';
+  put_2(out, day);
+  out += 'T';
+  put_2(out, day_secs / 3600);
+  out += ':';
+  put_2(out, day_secs / 60 % 60);
+  out += ':';
+  put_2(out, day_secs % 60);
+  out += '.';
+  unsigned milli = static_cast<unsigned>(ms % 1000);
+  out += static_cast<char>('0' + milli / 100);
+  put_2(out, milli % 100);
+  out += 'Z';
+}
+
+const char *op_name(LogChange change) {
+  switch (change) {
+  case LogChange::Edit:
+    return "edit";
+  case LogChange::Delete:
+    return "delete";
+  default:
+    return "message";
+  }
+}
+
+const char CSV_HEADER[] =
+    "seq,time,hlc,parent,op,sender,text,edited,deleted\r\n";
+
+void put_line(std::string &out, ExportFormat format, LogChange change,
+              const LogEntry &e) {
+  if (format == ExportFormat::Csv) {
+    put_u64(out, e.seq);
+    out += ',';
+    put_time(out, e.hlc);
+    out += ',';
+    put_u64(out, e.hlc);
+    out += ',';
+    put_u64(out, e.parent);
+    out += ',';
+    out += op_name(change);
+    out += ',';
+    put_csv_field(out, e.sender);
+    out += ',';
+    put_csv_field(out, e.text);
+    out += e.edited ? ",1" : ",0";
+    out += e.deleted ? ",1\r\n" : ",0\r\n";
+    return;
+  }
+  out += "{\"seq\":";
+  put_u64(out, e.seq);
+  out += ",\"time\":\"";
+  put_time(out, e.hlc);
+  out += "\",\"hlc\":";
+  put_u64(out, e.hlc);
+  out += ",\"parent\":";
+  put_u64(out, e.parent);
+  out += ",\"op\":\"";
+  out += op_name(change);
+  out += "\",\"sender\":";
+  put_json_string(out, e.sender);
+  out += ",\"text\":";
+  put_json_string(out, e.text);
+  out += e.edited ? ",\"edited\":true" : ",\"edited\":false";
+  out += e.deleted ? ",\"deleted\":true}\n" : ",\"deleted\":false}\n";
+}
+
+// ── Output
+// ────────────────────────────────────────────────────────────────────
+
+/**
+ * Two buffers: the caller fills one while a writer thread writes the
+ * other, so formatting and disk writes overlap.
+ */
+class Output {
+public:
+  explicit Output(const std::string &path) {
+    file_ = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr,
+                        CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE)
+      throw std::runtime_error("Cannot create " + path);
+    fill_.reserve(HistoryExport::OUT_BUFFER + 64 * 1024);
+    full_.reserve(fill_.capacity());
+    thread_ = Thread(&Output::run, this);
+  }
+
+  ~Output() {
+    close();
+    CloseHandle(file_);
+  }
+
+  Output(const Output &) = delete;
+  Output &operator=(const Output &) = delete;
+
+  /// The buffer to append to; call flush_if_full() after each line.
+  std::string &buffer() { return fill_; }
+
+  void flush_if_full() {
+    if (fill_.size() >= HistoryExport::OUT_BUFFER)
+      hand_off();
+  }
+
+  /// Write what is left and flush the file.
+  /// @throws std::runtime_error if any write failed.
+  void finish() {
+    if (!fill_.empty())
+      hand_off();
+    close();
+    if (failed_ || !FlushFileBuffers(file_))
+      throw std::runtime_error("Writing the export failed");
+  }
+
+  uint64_t bytes() const { return bytes_; }
+
+private:
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  Thread thread_;
+  Mutex mutex_; ///< Guards the fields below
+  CondVar changed_;
+  std::string full_;      ///< Owned by the writer while has_full_
+  bool has_full_ = false;
+  bool closing_ = false;
+  bool failed_ = false;
+  uint64_t bytes_ = 0;
+
+  std::string fill_; ///< Caller's side
+
+  void hand_off() {
+    {
+      LockGuard<Mutex> lock(mutex_);
+      while (has_full_ && !failed_) {
+        changed_.wait_for(mutex_, INFINITE);
+      }
+      if (failed_)
+        throw std::runtime_error("Writing the export failed");
+      fill_.swap(full_);
+      has_full_ = true;
+    }
+    changed_.notify_all();
+    fill_.clear();
+  }
+
+  void close() {
+    {
+      LockGuard<Mutex> lock(mutex_);
+      closing_ = true;
+    }
+    changed_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  void run() {
+    for (;;) {
+      {
+        LockGuard<Mutex> lock(mutex_);
+        while (!has_full_ && !closing_) {
+          changed_.wait_for(mutex_, INFINITE);
+        }
+        if (!has_full_)
+          return;
+      }
+      bool ok = write_all(file_, full_.data(), full_.size());
+      {
+        LockGuard<Mutex> lock(mutex_);
+        bytes_ += full_.size();
+        full_.clear();
+        has_full_ = false;
+        failed_ = failed_ || !ok;
+      }
+      changed_.notify_all();
+      if (!ok)
+        return;
+    }
+  }
+};
+
+// ── Input
+// ─────────────────────────────────────────────────────────────────────
+
+using PrefetchFn = BOOL(WINAPI *)(HANDLE, ULONG_PTR, void *, ULONG);
+
+/// WIN32_MEMORY_RANGE_ENTRY (newer SDKs only)
+struct MemoryRange {
+  void *address;
+  SIZE_T bytes;
+};
+
+/// PrefetchVirtualMemory (Windows 8+), or nullptr.
+PrefetchFn prefetch_fn() {
+  static const PrefetchFn fn = []() -> PrefetchFn {
+    HMODULE kernel = GetModuleHandleA("kernel32.dll");
+    FARPROC proc =
+        kernel ? GetProcAddress(kernel, "PrefetchVirtualMemory") : nullptr;
+    return reinterpret_cast<PrefetchFn>(reinterpret_cast<void (*)()>(proc));
+  }();
+  return fn;
+}
+
+/**
+ * A journal or segment mapped read-only. Opening never blocks the hub:
+ * it may keep appending, rename or delete the file meanwhile.
+ */
+class MappedFile {
+public:
+  /// @return false if @p path does not exist.
+  bool open(const std::string &path) {
+    file_ = CreateFileA(path.c_str(), GENERIC_READ,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                        nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+                        nullptr);
+    if (file_ == INVALID_HANDLE_VALUE)
+      return false;
+    size_ = file_size(file_);
+    if (size_ <= JOURNAL_TAG_LEN)
+      return true; // nothing recorded yet (and empty files cannot be mapped)
+    if (size_ != static_cast<SIZE_T>(size_))
+      throw std::runtime_error(path + " is too large to map");
+    mapping_ =
+        CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_ != nullptr) {
+      data_ = static_cast<const char *>(MapViewOfFile(
+          mapping_, FILE_MAP_READ, 0, 0, static_cast<SIZE_T>(size_)));
+    }
+    if (data_ == nullptr)
+      throw std::runtime_error("Cannot map " + path);
+    return true;
+  }
+
+  ~MappedFile() {
+    if (data_ != nullptr)
+      UnmapViewOfFile(data_);
+    if (mapping_ != nullptr)
+      CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE)
+      CloseHandle(file_);
+  }
+
+  const char *data() const { return data_; }
+  uint64_t size() const { return data_ != nullptr ? size_ : 0; }
+
+  /// Keep PREFETCH_BYTES ahead of @p pos in memory.
+  void advise(uint64_t pos) {
+    PrefetchFn prefetch = prefetch_fn();
+    if (prefetch == nullptr || pos + HistoryExport::PREFETCH_BYTES / 2 <
+                                   prefetched_)
+      return;
+    uint64_t from = prefetched_ > pos ? prefetched_ : pos;
+    uint64_t to = from + HistoryExport::PREFETCH_BYTES;
+    if (to > size_)
+      to = size_;
+    if (from >= to)
+      return;
+    MemoryRange range = {const_cast<char *>(data_ + from),
+                         static_cast<SIZE_T>(to - from)};
+    prefetch(GetCurrentProcess(), 1, &range, 0);
+    prefetched_ = to;
+  }
+
+private:
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE mapping_ = nullptr;
+  const char *data_ = nullptr;
+  uint64_t size_ = 0;
+  uint64_t prefetched_ = 0;
+};
+
+} // namespace
+
+// ── HistoryExport
+// ─────────────────────────────────────────────────────────────
+
+HistoryExport::HistoryExport(const std::string &history, ExportFormat format)
+    : history_(history), format_(format) {}
+
+ExportStats HistoryExport::write(const std::string &out_path) {
+  uint64_t t0 = monotonic_ns();
+  ExportStats stats;
+  Output out(out_path);
+  LogChange change;
+  LogEntry entry;
+  if (format_ == ExportFormat::Csv) {
+    out.buffer() += CSV_HEADER;
+  }
+
+  auto emit = [&](LogChange c, const LogEntry &e) {
+    put_line(out.buffer(), format_, c, e);
+    out.flush_if_full();
+    ++stats.records;
+  };
+
+  // Every record of a mapped journal or segment. @return false if one
+  // before the end was damaged (a journal's torn tail, if it is live).
+  auto export_mapped = [&](MappedFile &file) {
+    const char *data = file.data();
+    uint64_t size = file.size();
+    ++stats.files;
+    stats.input_bytes += size;
+    if (size == 0)
+      return true;
+    if (std::memcmp(data, JOURNAL_TAG, JOURNAL_TAG_LEN) != 0)
+      return false;
+    uint64_t pos = JOURNAL_TAG_LEN;
+    while (pos < size) {
+      file.advise(pos);
+      const char *payload = nullptr;
+      std::size_t len = 0;
+      std::size_t used = parse_record(data + pos,
+                                      static_cast<std::size_t>(size - pos),
+                                      payload, len);
+      if (used == 0 || !decode_change(payload, len, change, entry))
+        return false;
+      emit(change, entry);
+      pos += used;
+    }
+    return true;
+  };
+
+  // Sealed segments (or their archives), oldest first; the compactor
+  // may swap one for the other while we run
+  unsigned n = 1;
+  bool found = false;
+  auto export_sealed = [&]() {
+    std::string archive = HistoryFile::archive_path(history_, n);
+    if (!file_exists(archive)) {
+      std::string segment = HistoryFile::segment_path(history_, n);
+      MappedFile file;
+      if (file.open(segment)) {
+        if (!export_mapped(file))
+          throw std::runtime_error("History segment " + segment +
+                                   " is damaged");
+        return true;
+      }
+      if (!file_exists(archive))
+        return false;
+    }
+    HistoryArchive arc(archive);
+    ++stats.files;
+    stats.input_bytes += arc.file_bytes();
+    if (!arc.read_from(0, emit))
+      throw std::runtime_error("History archive " + archive + " is damaged");
+    return true;
+  };
+
+  for (;;) {
+    for (; export_sealed(); ++n) {
+      found = true;
+    }
+    // The live journal, unless it was sealed into segment n meanwhile
+    MappedFile live;
+    bool have_live = live.open(history_);
+    if (file_exists(HistoryFile::segment_path(history_, n)) ||
+        file_exists(HistoryFile::archive_path(history_, n)))
+      continue;
+    if (!have_live && !found)
+      throw std::runtime_error("No history at " + history_);
+    if (have_live) {
+      export_mapped(live); // stops at a record still being written
+    }
+    break;
+  }
+
+  out.finish();
+  stats.output_bytes = out.bytes();
+  stats.elapsed_ns = monotonic_ns() - t0;
+  return stats;
+}
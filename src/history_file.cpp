@@ -0,0 +1,405 @@
+/**
+ * @file history_file.cpp
+ * @brief Implementation of HistoryFile – checksummed journal and recovery.
+ */
+
+#include "history_file.h"
+
+#include "history_archive.h"
+#include "metrics.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+using namespace history;
+
+namespace {
+
+/// One entry of an index file.
+struct Checkpoint {
+  uint64_t offset = 0; ///< Record boundary in the journal
+  uint64_t seq = 0;    ///< Newest message before it
+  uint64_t at = 0;     ///< Where this checkpoint sits in the index
+};
+
+HANDLE open_file(const std::string &path) {
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                            FILE_SHARE_READ, nullptr, OPEN_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error("Cannot open history file " + path +
+                             " (error " + std::to_string(GetLastError()) +
+                             ")");
+  }
+  return file;
+}
+
+/// Cut @p file at @p offset and leave the file pointer there.
+bool truncate_at(HANDLE file, uint64_t offset) {
+  return seek(file, offset) && SetEndOfFile(file) != 0;
+}
+
+/// Read checkpoints up to the first damaged one.
+/// @param good Receives the index size that holds only intact ones.
+std::vector<Checkpoint> read_checkpoints(HANDLE index, uint64_t &good) {
+  std::vector<Checkpoint> checkpoints;
+  std::string payload;
+  good = 0;
+  if (index == INVALID_HANDLE_VALUE)
+    return checkpoints;
+  RecordReader reader(index, 0);
+  for (;;) {
+    Checkpoint cp;
+    cp.at = reader.offset();
+    if (!reader.next(payload))
+      break;
+    WireReader r(payload);
+    if (!r.get_u64(cp.offset) || !r.get_u64(cp.seq))
+      break;
+    checkpoints.push_back(cp);
+    good = reader.offset();
+  }
+  return checkpoints;
+}
+
+/**
+ * Pick where to start replaying: the newest checkpoint that leaves at
+ * least @p keep messages before the newest one, and whose record is
+ * intact. @return The tag's end if none qualifies.
+ */
+Checkpoint pick_start(HANDLE data, uint64_t size,
+                      const std::vector<Checkpoint> &checkpoints,
+                      std::size_t keep) {
+  Checkpoint start;
+  start.offset = JOURNAL_TAG_LEN;
+  if (checkpoints.empty())
+    return start;
+  std::string payload;
+  uint64_t newest = checkpoints.back().seq;
+  uint64_t target = newest > keep ? newest - keep : 0;
+  for (std::size_t i = checkpoints.size(); i-- > 0;) {
+    const Checkpoint &cp = checkpoints[i];
+    if (cp.seq > target || cp.offset < JOURNAL_TAG_LEN ||
+        cp.offset >= size)
+      continue;
+    if (RecordReader(data, cp.offset).next(payload))
+      return cp;
+  }
+  return start;
+}
+
+} // namespace
+
+// ── Construction / Destruction
+// ────────────────────────────────────────────────
+
+HistoryFile::HistoryFile(const std::string &path) : path_(path) {
+  open_live();
+  while (file_exists(segment_path(path_, segments_ + 1)) ||
+         file_exists(archive_path(path_, segments_ + 1))) {
+    ++segments_;
+  }
+}
+
+HistoryFile::~HistoryFile() {
+  stop();
+  close_live();
+}
+
+std::string HistoryFile::segment_path(const std::string &path, unsigned n) {
+  char suffix[32];
+  std::snprintf(suffix, sizeof(suffix), ".%06u.seg", n);
+  return path + suffix;
+}
+
+std::string HistoryFile::archive_path(const std::string &path, unsigned n) {
+  char suffix[32];
+  std::snprintf(suffix, sizeof(suffix), ".%06u.arc", n);
+  return path + suffix;
+}
+
+void HistoryFile::open_live() {
+  data_ = open_file(path_);
+  try {
+    uint64_t size = file_size(data_);
+    if (size < JOURNAL_TAG_LEN) {
+      // New, or died before the tag was written
+      if (!truncate_at(data_, 0) ||
+          !write_all(data_, JOURNAL_TAG, JOURNAL_TAG_LEN) ||
+          !FlushFileBuffers(data_)) {
+        throw std::runtime_error("Cannot write history file " + path_);
+      }
+    } else {
+      char tag[JOURNAL_TAG_LEN];
+      if (!seek(data_, 0) || !read_all(data_, tag, JOURNAL_TAG_LEN) ||
+          std::memcmp(tag, JOURNAL_TAG, JOURNAL_TAG_LEN) != 0) {
+        throw std::runtime_error(path_ + " is not a LAN Chat history file");
+      }
+    }
+    end_ = file_size(data_);
+    seek(data_, end_);
+    index_ = open_file(path_ + ".idx");
+    index_end_ = file_size(index_);
+    seek(index_, index_end_);
+  } catch (...) {
+    close_live();
+    throw;
+  }
+}
+
+void HistoryFile::close_live() {
+  if (index_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(index_);
+    index_ = INVALID_HANDLE_VALUE;
+  }
+  if (data_ != INVALID_HANDLE_VALUE) {
+    CloseHandle(data_);
+    data_ = INVALID_HANDLE_VALUE;
+  }
+}
+
+// ── Recovery
+// ──────────────────────────────────────────────────────────────────
+
+HistoryRecovery HistoryFile::recover(std::size_t keep, const Replay &replay) {
+  HistoryRecovery stats;
+  uint64_t t0 = monotonic_ns();
+  stats.file_bytes = file_size(data_);
+  std::string payload;
+
+  // Checkpoints, oldest first; the index may have a torn tail of its own
+  uint64_t index_good = 0;
+  std::vector<Checkpoint> checkpoints = read_checkpoints(index_, index_good);
+  Checkpoint start = pick_start(data_, stats.file_bytes, checkpoints, keep);
+  stats.skipped_bytes = start.offset - JOURNAL_TAG_LEN;
+  last_seq_ = start.seq;
+
+  // A young journal cannot fill the ring on its own
+  if (start.offset == JOURNAL_TAG_LEN && segments_ > 0) {
+    stats.records += replay_previous(keep, replay);
+  }
+
+  // Replay to the end, or to the first damaged record
+  uint64_t last_checkpoint = checkpoints.empty() ? 0 : checkpoints.back().offset;
+  RecordReader reader(data_, start.offset);
+  uint64_t good = start.offset;
+  for (;;) {
+    uint64_t at = reader.offset();
+    LogChange change;
+    LogEntry entry;
+    if (!reader.next(payload) || !decode_change(payload, change, entry))
+      break;
+    good = reader.offset();
+    if (change == LogChange::Append) {
+      last_seq_ = entry.seq;
+      if (at >= last_checkpoint)
+        ++since_checkpoint_;
+    }
+    replay(change, entry);
+    ++stats.records;
+  }
+
+  if (good < stats.file_bytes) {
+    stats.torn_bytes = stats.file_bytes - good;
+    truncate_at(data_, good);
+    FlushFileBuffers(data_);
+  }
+  end_ = good;
+  seek(data_, end_);
+
+  // Checkpoints past the cut would point into records written later
+  for (const Checkpoint &cp : checkpoints) {
+    if (cp.offset > good) {
+      index_good = cp.at;
+      break;
+    }
+  }
+  if (index_good < file_size(index_)) {
+    truncate_at(index_, index_good);
+    FlushFileBuffers(index_);
+  }
+  index_end_ = index_good;
+  seek(index_, index_end_);
+
+  stats.elapsed_ns = monotonic_ns() - t0;
+  return stats;
+}
+
+uint64_t HistoryFile::replay_previous(std::size_t keep, const Replay &replay) {
+  uint64_t records = 0;
+  auto count = [&](LogChange change, const LogEntry &entry) {
+    if (change == LogChange::Append)
+      last_seq_ = entry.seq;
+    replay(change, entry);
+    ++records;
+  };
+
+  std::string segment = segment_path(path_, segments_);
+  HANDLE data = open_read(segment);
+  if (data != INVALID_HANDLE_VALUE) {
+    // Sealed cleanly, so no tail to cut; the checkpoints still apply
+    HANDLE index = open_read(segment + ".idx");
+    uint64_t index_good = 0;
+    std::vector<Checkpoint> checkpoints = read_checkpoints(index, index_good);
+    if (index != INVALID_HANDLE_VALUE)
+      CloseHandle(index);
+    Checkpoint start =
+        pick_start(data, file_size(data), checkpoints, keep);
+    RecordReader reader(data, start.offset);
+    std::string payload;
+    LogChange change;
+    LogEntry entry;
+    while (reader.next(payload) && decode_change(payload, change, entry)) {
+      count(change, entry);
+    }
+    CloseHandle(data);
+    return records;
+  }
+
+  try {
+    HistoryArchive archive(archive_path(path_, segments_));
+    uint64_t last = archive.last_seq();
+    archive.read_from(last > keep ? last - keep : 0, count);
+  } catch (const std::exception &e) {
+    std::cerr << "[History] " << e.what() << "\n";
+  }
+  return records;
+}
+
+// ── Writing
+// ───────────────────────────────────────────────────────────────────
+
+void HistoryFile::record(LogChange change, const LogEntry &entry) {
+  std::string payload = encode_change(change, entry);
+  LockGuard<Mutex> lock(mutex_);
+  append_record(pending_, payload);
+  if (change == LogChange::Append) {
+    ++pending_entries_;
+    pending_last_ = entry.seq;
+  }
+  wake_.notify_all();
+}
+
+void HistoryFile::start() {
+  if (running_.exchange(true))
+    return;
+  thread_ = Thread(&HistoryFile::run, this);
+}
+
+void HistoryFile::stop() {
+  if (!running_.exchange(false))
+    return;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    wake_.notify_all();
+  }
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void HistoryFile::run() {
+  std::string batch;
+  for (;;) {
+    uint64_t entries = 0;
+    uint64_t last_seq = 0;
+    {
+      LockGuard<Mutex> lock(mutex_);
+      while (pending_.empty() && running_.load()) {
+        wake_.wait_for(mutex_, 100);
+      }
+      if (pending_.empty())
+        break; // stopped, and everything is written
+      batch.swap(pending_);
+      entries = pending_entries_;
+      last_seq = pending_last_;
+      pending_entries_ = 0;
+    }
+    write_batch(batch, entries, last_seq);
+    batch.clear();
+  }
+}
+
+void HistoryFile::write_batch(const std::string &batch, uint64_t entries,
+                              uint64_t last_seq) {
+  if (data_ == INVALID_HANDLE_VALUE)
+    return; // lost the journal in seal(); already reported
+  uint64_t start = end_;
+  uint64_t seq_before = last_seq_;
+  uint64_t t0 = monotonic_ns();
+  if (!write_all(data_, batch.data(), batch.size()) ||
+      !FlushFileBuffers(data_)) {
+    DWORD error = GetLastError();
+    // Cut the partial batch off so later ones stay readable
+    truncate_at(data_, start);
+    if (!failed_) {
+      failed_ = true;
+      std::cerr << "[History] Writing " << path_ << " failed (error " << error
+                << "); recent messages are not being saved\n";
+    }
+    return;
+  }
+  HubMetrics::instance().history_sync.record(monotonic_ns() - t0);
+  end_ = start + batch.size();
+  if (entries != 0)
+    last_seq_ = last_seq;
+
+  // The batch is on disk, so its first record is a safe place to start
+  if (since_checkpoint_ >= CHECKPOINT_EVERY) {
+    checkpoint(start, seq_before);
+    since_checkpoint_ = 0;
+  }
+  since_checkpoint_ += entries;
+
+  if (end_ >= SEGMENT_BYTES && !failed_) {
+    seal();
+  }
+}
+
+void HistoryFile::checkpoint(uint64_t offset, uint64_t seq) {
+  WireWriter w;
+  w.put_u64(offset);
+  w.put_u64(seq);
+  std::string record;
+  append_record(record, w.data());
+  if (!write_all(index_, record.data(), record.size()) ||
+      !FlushFileBuffers(index_)) {
+    // Recovery falls back to an older checkpoint; just do not leave half
+    // a record behind
+    truncate_at(index_, index_end_);
+    return;
+  }
+  index_end_ += record.size();
+}
+
+void HistoryFile::seal() {
+  std::string segment = segment_path(path_, segments_ + 1);
+  std::string index = path_ + ".idx";
+  close_live();
+
+  // The index goes first: a new journal must never meet old checkpoints
+  const DWORD flags = MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH;
+  bool moved = MoveFileExA(index.c_str(), (segment + ".idx").c_str(), flags) &&
+               MoveFileExA(path_.c_str(), segment.c_str(), flags);
+  if (moved) {
+    ++segments_;
+  } else if (!failed_) {
+    failed_ = true;
+    std::cerr << "[History] Cannot seal " << path_ << " (error "
+              << GetLastError() << "); it keeps growing\n";
+  }
+
+  try {
+    open_live(); // a fresh journal, or the same one if the move failed
+  } catch (const std::exception &e) {
+    std::cerr << "[History] " << e.what()
+              << "; recent messages are not being saved\n";
+    return;
+  }
+  if (moved) {
+    since_checkpoint_ = 0;
+  }
+}
@@ -0,0 +1,365 @@
+/**
+ * @file history_index.cpp
+ * @brief Implementation of HistoryIndex – chunk index for history queries.
+ */
+
+#include "history_index.h"
+
+#include "history_file.h"
+#include "hlc.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+using namespace history;
+
+namespace {
+
+/// Open a segment or journal for reading while the hub keeps writing,
+/// renaming and deleting it.
+HANDLE open_shared(const std::string &path) {
+  return CreateFileA(path.c_str(), GENERIC_READ,
+                     FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                     nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+}
+
+} // namespace
+
+// ── Construction / Destruction
+// ────────────────────────────────────────────────
+
+HistoryIndex::HistoryIndex(const std::string &path) : path_(path) {}
+
+HistoryIndex::~HistoryIndex() = default;
+
+uint64_t HistoryIndex::messages() const {
+  uint64_t n = 0;
+  for (const auto &s : sources_) {
+    n += s->messages;
+  }
+  return n;
+}
+
+std::size_t HistoryIndex::chunks() const {
+  std::size_t n = 0;
+  for (const auto &s : sources_) {
+    n += s->chunks.size();
+  }
+  return n;
+}
+
+// ── Following the history
+// ─────────────────────────────────────────────────────
+
+void HistoryIndex::refresh() {
+  for (auto &s : sources_) {
+    if (s->n != 0 && !s->archive)
+      use_archive(*s);
+  }
+
+  for (;;) {
+    unsigned sealed = count_sealed();
+    if (has_live_ && sealed > sealed_) {
+      // Sealed since we opened it: the same file under its segment name
+      Source &live = *sources_.back();
+      scan(live);
+      live.n = ++sealed_;
+      has_live_ = false;
+      continue;
+    }
+    if (!has_live_) {
+      while (sealed_ < sealed) {
+        add_sealed(sealed_ + 1);
+        ++sealed_;
+      }
+      if (!add_live())
+        break;
+      if (count_sealed() != sealed_) {
+        // Sealed while we opened it; which file we hold is unclear
+        sources_.pop_back();
+        has_live_ = false;
+        continue;
+      }
+    }
+    break;
+  }
+
+  if (has_live_) {
+    scan(*sources_.back());
+  }
+}
+
+unsigned HistoryIndex::count_sealed() const {
+  unsigned n = sealed_;
+  while (file_exists(HistoryFile::segment_path(path_, n + 1)) ||
+         file_exists(HistoryFile::archive_path(path_, n + 1))) {
+    ++n;
+  }
+  return n;
+}
+
+void HistoryIndex::add_sealed(unsigned n) {
+  std::unique_ptr<Source> s(new Source);
+  s->n = n;
+  sources_.push_back(std::move(s));
+  Source &added = *sources_.back();
+  use_archive(added);
+  if (added.archive)
+    return;
+  added.file = open_shared(HistoryFile::segment_path(path_, n));
+  if (added.file != INVALID_HANDLE_VALUE) {
+    scan(added);
+    return;
+  }
+  use_archive(added); // archived and deleted in between
+  if (!added.archive) {
+    std::cerr << "[History] Segment " << n << " of " << path_
+              << " is missing; queries skip it\n";
+  }
+}
+
+bool HistoryIndex::add_live() {
+  HANDLE file = open_shared(path_);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+  std::unique_ptr<Source> s(new Source);
+  s->file = file;
+  sources_.push_back(std::move(s));
+  has_live_ = true;
+  return true;
+}
+
+void HistoryIndex::use_archive(Source &s) {
+  std::string path = HistoryFile::archive_path(path_, s.n);
+  if (!file_exists(path))
+    return;
+  try {
+    s.archive.reset(new HistoryArchive(path));
+  } catch (const std::exception &) {
+    return; // still being renamed into place; next refresh
+  }
+  if (s.file != INVALID_HANDLE_VALUE) {
+    CloseHandle(s.file);
+    s.file = INVALID_HANDLE_VALUE;
+  }
+  s.chunks.clear();
+  s.messages = 0;
+  scan_archive(s);
+}
+
+// ── Indexing
+// ──────────────────────────────────────────────────────────────────
+
+void HistoryIndex::scan(Source &s) {
+  if (s.indexed == 0) {
+    char tag[JOURNAL_TAG_LEN];
+    if (file_size(s.file) < JOURNAL_TAG_LEN)
+      return; // not tagged yet
+    if (!seek(s.file, 0) || !read_all(s.file, tag, JOURNAL_TAG_LEN) ||
+        std::memcmp(tag, JOURNAL_TAG, JOURNAL_TAG_LEN) != 0) {
+      std::cerr << "[History] Segment " << s.n << " of " << path_
+                << " is not a history file; queries skip it\n";
+      s.indexed = UINT64_MAX;
+      return;
+    }
+    s.indexed = JOURNAL_TAG_LEN;
+  }
+  if (s.indexed == UINT64_MAX)
+    return;
+
+  // The live journal is numbered as the segment it will become
+  unsigned segment = s.n != 0 ? s.n : sealed_ + 1;
+  RecordReader reader(s.file, s.indexed);
+  std::string payload;
+  LogChange change;
+  LogEntry e;
+  uint64_t at = s.indexed;
+  while (reader.next(payload) && decode_change(payload, change, e)) {
+    if (change == LogChange::Append) {
+      if (s.chunks.empty() ||
+          s.chunks.back().end - s.chunks.back().begin >= CHUNK_BYTES) {
+        s.chunks.emplace_back();
+        s.chunks.back().begin = at;
+      }
+      Chunk &chunk = s.chunks.back();
+      note(chunk, e);
+      chunk.end = reader.offset();
+      chunk.rising_ms = chunk.max_ms;
+      if (s.chunks.size() > 1) {
+        chunk.rising_ms =
+            std::max(chunk.max_ms, s.chunks[s.chunks.size() - 2].rising_ms);
+      }
+      ++s.messages;
+    } else {
+      note_change(segment, change, e);
+    }
+    at = reader.offset();
+  }
+  s.indexed = at; // a record still being written is read next time
+}
+
+void HistoryIndex::scan_archive(Source &s) {
+  uint64_t rising = 0;
+  for (std::size_t i = 0; i < s.archive->blocks(); ++i) {
+    Chunk chunk;
+    chunk.begin = i;
+    chunk.end = i + 1;
+    bool intact =
+        s.archive->read_block(i, [&](LogChange change, const LogEntry &e) {
+          if (change == LogChange::Append) {
+            note(chunk, e);
+            ++s.messages;
+          } else {
+            note_change(s.n, change, e);
+          }
+        });
+    if (!intact) {
+      std::cerr << "[History] Archive " << s.n << " of " << path_
+                << " is damaged at block " << i << "; queries skip the rest\n";
+      break;
+    }
+    if (chunk.first_seq == 0)
+      continue; // only edits and deletes
+    rising = std::max(rising, chunk.max_ms);
+    chunk.rising_ms = rising;
+    s.chunks.push_back(std::move(chunk));
+  }
+}
+
+void HistoryIndex::note(Chunk &chunk, const LogEntry &e) {
+  if (chunk.first_seq == 0)
+    chunk.first_seq = e.seq;
+  chunk.last_seq = e.seq;
+  uint64_t ms = hlc_physical_ms(e.hlc);
+  chunk.min_ms = std::min(chunk.min_ms, ms);
+  chunk.max_ms = std::max(chunk.max_ms, ms);
+
+  auto id = sender_ids_.emplace(e.sender,
+                                static_cast<uint32_t>(sender_ids_.size()));
+  auto at = std::lower_bound(chunk.senders.begin(), chunk.senders.end(),
+                             id.first->second);
+  if (at == chunk.senders.end() || *at != id.first->second) {
+    chunk.senders.insert(at, id.first->second);
+  }
+}
+
+void HistoryIndex::note_change(unsigned segment, LogChange change,
+                               const LogEntry &e) {
+  Change &c = changes_[e.seq];
+  if (c.segment > segment)
+    return; // a later change is already known
+  c.segment = segment;
+  if (change == LogChange::Delete) {
+    c.deleted = true;
+    c.text.clear();
+  } else {
+    c.text = e.text;
+  }
+}
+
+// ── Queries
+// ───────────────────────────────────────────────────────────────────
+
+template <typename Visit>
+void HistoryIndex::read(Source &s, const Chunk &chunk, Visit visit) {
+  auto message = [&](const LogEntry &e) {
+    auto it = changes_.find(e.seq);
+    if (it == changes_.end()) {
+      if (!e.deleted)
+        visit(e);
+      return;
+    }
+    if (it->second.deleted)
+      return;
+    LogEntry changed = e;
+    changed.edited = true;
+    changed.text = it->second.text;
+    visit(changed);
+  };
+
+  if (s.archive) {
+    s.archive->read_block(static_cast<std::size_t>(chunk.begin),
+                          [&](LogChange change, const LogEntry &e) {
+                            if (change == LogChange::Append)
+                              message(e);
+                          });
+    return;
+  }
+
+  buf_.resize(static_cast<std::size_t>(chunk.end - chunk.begin));
+  if (!seek(s.file, chunk.begin) || !read_all(s.file, &buf_[0], buf_.size()))
+    return;
+  LogChange change;
+  LogEntry e;
+  std::size_t pos = 0;
+  while (pos < buf_.size()) {
+    const char *payload = nullptr;
+    std::size_t len = 0;
+    std::size_t used =
+        parse_record(buf_.data() + pos, buf_.size() - pos, payload, len);
+    if (used == 0 || !decode_change(payload, len, change, e))
+      return;
+    if (change == LogChange::Append)
+      message(e);
+    pos += used;
+  }
+}
+
+void HistoryIndex::range(uint64_t from_ms, uint64_t to_ms, uint64_t from_seq,
+                         uint64_t below_seq, std::size_t max,
+                         std::vector<LogEntry> &out) {
+  for (auto &sp : sources_) {
+    Source &s = *sp;
+    // Both rising_ms and last_seq only grow along a source
+    auto it = std::partition_point(
+        s.chunks.begin(), s.chunks.end(), [&](const Chunk &c) {
+          return c.rising_ms < from_ms || c.last_seq < from_seq;
+        });
+    for (; it != s.chunks.end(); ++it) {
+      if (out.size() >= max || it->first_seq >= below_seq)
+        return;
+      if (it->max_ms < from_ms || it->min_ms > to_ms)
+        continue;
+      read(s, *it, [&](const LogEntry &e) {
+        uint64_t ms = hlc_physical_ms(e.hlc);
+        if (out.size() < max && e.seq >= from_seq && e.seq < below_seq &&
+            ms >= from_ms && ms <= to_ms) {
+          out.push_back(e);
+        }
+      });
+    }
+  }
+}
+
+void HistoryIndex::by_sender(const std::string &sender, uint64_t below_seq,
+                             std::size_t max, std::vector<LogEntry> &out) {
+  auto id = sender_ids_.find(sender);
+  if (id == sender_ids_.end())
+    return;
+  std::vector<LogEntry> found;
+  for (auto sp = sources_.rbegin(); sp != sources_.rend(); ++sp) {
+    Source &s = **sp;
+    auto it = std::partition_point(
+        s.chunks.begin(), s.chunks.end(),
+        [&](const Chunk &c) { return c.first_seq < below_seq; });
+    while (it != s.chunks.begin()) {
+      --it;
+      if (out.size() >= max)
+        return;
+      if (!std::binary_search(it->senders.begin(), it->senders.end(),
+                              id->second))
+        continue;
+      found.clear();
+      read(s, *it, [&](const LogEntry &e) {
+        if (e.seq < below_seq && e.sender == sender)
+          found.push_back(e);
+      });
+      for (auto f = found.rbegin(); f != found.rend() && out.size() < max;
+           ++f) {
+        out.push_back(std::move(*f));
+      }
+    }
+  }
+}
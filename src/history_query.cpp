@@ -0,0 +1,233 @@
+/**
+ * @file history_query.cpp
+ * @brief Implementation of HistoryQuery – paged history queries.
+ */
+
+#include "history_query.h"
+
+#include "hlc.h"
+#include "metrics.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const std::string QUERY_PREFIX = "CMD:QUERY:";
+
+/// Read "<digits>" ending at ':' or the end of the string.
+/// @return false if malformed; @p p is left after the ':'.
+bool read_number(const char *&p, uint64_t &v) {
+  char *end = nullptr;
+  v = std::strtoull(p, &end, 10);
+  if (end == p || (*end != ':' && *end != '\0'))
+    return false;
+  p = *end == ':' ? end + 1 : end;
+  return true;
+}
+
+/// @return true if @p e belongs in a RANGE result.
+bool in_range(const LogEntry &e, uint64_t from_ms, uint64_t to_ms) {
+  uint64_t ms = hlc_physical_ms(e.hlc);
+  return !e.deleted && ms >= from_ms && ms <= to_ms;
+}
+
+} // namespace
+
+// ── Construction / Destruction
+// ────────────────────────────────────────────────
+
+HistoryQuery::HistoryQuery(Room &room, const std::string &history)
+    : room_(room), history_(history) {}
+
+HistoryQuery::~HistoryQuery() { stop(); }
+
+// ── Lifecycle
+// ─────────────────────────────────────────────────────────────────
+
+void HistoryQuery::start() {
+  if (running_.exchange(true))
+    return;
+  room_.set_query_handler(
+      [this](uint32_t client, const std::string &message) {
+        submit(client, message);
+      });
+  thread_ = Thread(&HistoryQuery::run, this);
+}
+
+void HistoryQuery::stop() {
+  if (!running_.exchange(false))
+    return;
+  wake_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  room_.set_query_handler(nullptr);
+}
+
+// ── Queries
+// ───────────────────────────────────────────────────────────────────
+
+void HistoryQuery::submit(uint32_t client, const std::string &message) {
+  Request r;
+  r.client = client;
+  r.queued_ns = monotonic_ns();
+  const char *p = message.c_str() + QUERY_PREFIX.size();
+  bool ok = read_number(p, r.id);
+  std::string kind;
+  if (ok) {
+    const char *colon = std::strchr(p, ':');
+    ok = colon != nullptr;
+    if (ok) {
+      kind.assign(p, colon);
+      p = colon + 1;
+    }
+  }
+  uint64_t count = 0;
+  if (ok && kind == "RANGE") {
+    ok = read_number(p, r.from_ms) && read_number(p, r.to_ms) &&
+         read_number(p, r.cursor) && r.from_ms <= r.to_ms;
+  } else if (ok && kind == "LAST") {
+    r.by_sender = true;
+    ok = read_number(p, count) && read_number(p, r.cursor) && count != 0;
+    r.count = static_cast<std::size_t>(count);
+    r.sender = p;
+    ok = ok && !r.sender.empty();
+  } else {
+    ok = false;
+  }
+  if (!ok) {
+    room_.send_to(client, "CMD:ERROR:bad history query");
+    return;
+  }
+
+  {
+    LockGuard<Mutex> lock(mutex_);
+    ok = pending_.size() < MAX_PENDING;
+    if (ok)
+      pending_.push_back(std::move(r));
+  }
+  if (!ok) {
+    room_.send_to(client, "CMD:ERROR:history is busy, try again shortly");
+    return;
+  }
+  wake_.notify_all();
+}
+
+void HistoryQuery::answer(const Request &r) {
+  std::vector<LogEntry> found;
+  std::size_t want = PAGE_MESSAGES;
+  uint64_t next = 0;
+  if (r.by_sender) {
+    // Not PAGE_MESSAGES itself: std::min would bind a reference to it, and
+    // C++14 gives a static constexpr member no definition to bind to
+    want = std::min(r.count, want);
+    run_last(r, want, found);
+    // More pages only if the client wants more and there are more
+    if (found.size() > want) {
+      found.resize(want);
+      if (r.count > want)
+        next = found.back().seq;
+    }
+  } else {
+    run_range(r, found);
+    if (found.size() > want) {
+      next = found[want].seq;
+      found.resize(want);
+    }
+  }
+
+  std::string frame = "CMD:RESULT:" + std::to_string(r.id) + ":" +
+                      std::to_string(next) + ":" +
+                      std::to_string(found.size());
+  for (const LogEntry &e : found) {
+    std::string text = e.text;
+    std::replace(text.begin(), text.end(), '\n', ' '); // one line each
+    frame += "\n" + std::to_string(e.seq) + ":" + std::to_string(e.hlc) +
+             ":" + std::to_string(e.parent) + ":[" + e.sender + "]: " + text;
+  }
+  room_.send_to(r.client, frame, SendClass::Bulk);
+  HubMetrics::instance().history_query.record(monotonic_ns() - r.queued_ns);
+}
+
+void HistoryQuery::run_range(const Request &r, std::vector<LogEntry> &out) {
+  std::size_t want = PAGE_MESSAGES + 1;
+  HubLog &log = room_.log();
+  uint64_t boundary = log.first_seq(); // the log has everything from here
+  if (boundary == 0)
+    boundary = UINT64_MAX;
+
+  if (index_ && r.cursor < boundary) {
+    index_->range(r.from_ms, r.to_ms, r.cursor, boundary, want, out);
+  }
+  if (out.size() >= want || boundary == UINT64_MAX)
+    return;
+  uint64_t after = std::max(r.cursor, boundary) - 1;
+  for (LogEntry &e : log.since(after, log.capacity())) {
+    if (out.size() >= want)
+      break;
+    if (in_range(e, r.from_ms, r.to_ms))
+      out.push_back(std::move(e));
+  }
+}
+
+void HistoryQuery::run_last(const Request &r, std::size_t count,
+                            std::vector<LogEntry> &out) {
+  std::size_t want = count + 1;
+  uint64_t below = r.cursor != 0 ? r.cursor : UINT64_MAX;
+  HubLog &log = room_.log();
+  std::vector<LogEntry> recent = log.since(0, log.capacity());
+  for (auto it = recent.rbegin(); it != recent.rend() && out.size() < want;
+       ++it) {
+    if (it->seq < below && !it->deleted && it->sender == r.sender)
+      out.push_back(std::move(*it));
+  }
+  if (!recent.empty()) {
+    below = std::min(below, recent.front().seq);
+  }
+  if (index_ && out.size() < want) {
+    index_->by_sender(r.sender, below, want - out.size(), out);
+  }
+}
+
+void HistoryQuery::run() {
+  // Live traffic first: queries use what the hub has to spare
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+
+  if (!history_.empty()) {
+    uint64_t t0 = monotonic_ns();
+    index_.reset(new HistoryIndex(history_));
+    index_->refresh();
+    std::cout << "\033[2K\r" << "[History] Indexed "
+              << index_->messages() << " messages (" << index_->chunks()
+              << " chunks) in " << (monotonic_ns() - t0) / 1000000
+              << " ms\n"
+              << "You: " << std::flush;
+  }
+
+  while (running_.load()) {
+    Request r;
+    bool have = false;
+    {
+      LockGuard<Mutex> lock(mutex_);
+      if (pending_.empty()) {
+        wake_.wait_for(mutex_, REFRESH_MS);
+      }
+      if (!pending_.empty() && running_.load()) {
+        r = std::move(pending_.front());
+        pending_.pop_front();
+        have = true;
+      }
+    }
+    // Cheap when nothing was written: a read at the journal's end and a
+    // few file probes
+    if (index_) {
+      index_->refresh();
+    }
+    if (have) {
+      answer(r);
+    }
+  }
+}
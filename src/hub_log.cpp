@@ -0,0 +1,230 @@
+/**
+ * @file hub_log.cpp
+ * @brief Implementation of HubLog – sequenced message history.
+ */
+
+#include "hub_log.h"
+
+#include <algorithm>
+
+// ── Construction
+// ──────────────────────────────────────────────────────────────
+
+HubLog::HubLog(std::size_t capacity) : capacity_(capacity ? capacity : 1) {}
+
+// ── Writers
+// ───────────────────────────────────────────────────────────────────
+
+void HubLog::set_journal(Journal journal) {
+  LockGuard<Mutex> lock(mutex_);
+  journal_ = std::move(journal);
+}
+
+bool HubLog::apply(const LogEntry &entry) {
+  LockGuard<Mutex> lock(mutex_);
+  if (entry.seq <= last_seq_)
+    return false;
+  if (journal_)
+    journal_(LogChange::Append, entry);
+  push(entry);
+  return true;
+}
+
+bool HubLog::edit(uint64_t seq, uint64_t author, const std::string &text) {
+  LockGuard<Mutex> lock(mutex_);
+  std::string sender;
+  Overlay *overlay = overlay_for(seq, author, sender);
+  if (!overlay)
+    return false;
+  overlay->text = text;
+  overlay->edited = true;
+  if (journal_) {
+    LogEntry change;
+    change.seq = seq;
+    change.sender = sender;
+    change.text = text;
+    journal_(LogChange::Edit, change);
+  }
+  return true;
+}
+
+bool HubLog::erase(uint64_t seq, uint64_t author) {
+  LockGuard<Mutex> lock(mutex_);
+  std::string sender;
+  Overlay *overlay = overlay_for(seq, author, sender);
+  if (!overlay)
+    return false;
+  overlay->text.clear();
+  overlay->deleted = true;
+  if (journal_) {
+    LogEntry change;
+    change.seq = seq;
+    change.sender = sender;
+    journal_(LogChange::Delete, change);
+  }
+  return true;
+}
+
+std::size_t HubLog::compact() {
+  LockGuard<Mutex> lock(mutex_);
+  std::size_t folded = overlays_.size();
+  for (auto &it : overlays_) {
+    // Entries trimmed off the ring since take their overlays with them
+    LogEntry *entry = find(it.first);
+    if (!entry)
+      continue;
+    if (it.second.deleted) {
+      entry->deleted = true;
+      entry->text.clear();
+    } else if (it.second.edited) {
+      entry->edited = true;
+      entry->text.swap(it.second.text);
+    }
+  }
+  overlays_.clear();
+  return folded;
+}
+
+void HubLog::push(LogEntry entry) {
+  last_seq_ = entry.seq;
+  if (entry.parent != 0) {
+    replies_[entry.parent].push_back(entry.seq);
+  }
+  entries_.push_back(std::move(entry));
+  while (entries_.size() > capacity_) {
+    const LogEntry &oldest = entries_.front();
+    // Oldest first, so a dropped reply is at the front of its thread
+    auto it = replies_.find(oldest.parent);
+    if (it != replies_.end() && !it->second.empty() &&
+        it->second.front() == oldest.seq) {
+      it->second.pop_front();
+      if (it->second.empty())
+        replies_.erase(it);
+    }
+    entries_.pop_front();
+  }
+  changed_.notify_all();
+}
+
+// ── Readers
+// ───────────────────────────────────────────────────────────────────
+
+uint64_t HubLog::last_seq() const {
+  LockGuard<Mutex> lock(mutex_);
+  return last_seq_;
+}
+
+uint64_t HubLog::first_seq() const {
+  LockGuard<Mutex> lock(mutex_);
+  return entries_.empty() ? 0 : entries_.front().seq;
+}
+
+std::size_t HubLog::overlay_count() const {
+  LockGuard<Mutex> lock(mutex_);
+  return overlays_.size();
+}
+
+std::vector<LogEntry> HubLog::since(uint64_t after_seq,
+                                    std::size_t max) const {
+  std::vector<LogEntry> out;
+  LockGuard<Mutex> lock(mutex_);
+  // Replicated logs may have gaps, so search rather than index
+  auto it = std::upper_bound(
+      entries_.begin(), entries_.end(), after_seq,
+      [](uint64_t seq, const LogEntry &e) { return seq < e.seq; });
+  for (; it != entries_.end() && out.size() < max; ++it) {
+    read(*it, out);
+  }
+  return out;
+}
+
+bool HubLog::get(uint64_t seq, LogEntry &out) const {
+  std::vector<LogEntry> found;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    const LogEntry *entry = find(seq);
+    if (!entry)
+      return false;
+    read(*entry, found);
+  }
+  out = std::move(found.front());
+  return true;
+}
+
+std::size_t HubLog::reply_count(uint64_t root) const {
+  LockGuard<Mutex> lock(mutex_);
+  auto it = replies_.find(root);
+  return it == replies_.end() ? 0 : it->second.size();
+}
+
+std::vector<LogEntry> HubLog::thread(uint64_t root, std::size_t max) const {
+  std::vector<LogEntry> out;
+  LockGuard<Mutex> lock(mutex_);
+  auto it = replies_.find(root);
+  if (it == replies_.end())
+    return out;
+  const std::deque<uint64_t> &seqs = it->second;
+  std::size_t skip = seqs.size() > max ? seqs.size() - max : 0;
+  for (std::size_t i = skip; i < seqs.size(); ++i) {
+    const LogEntry *entry = find(seqs[i]);
+    if (entry)
+      read(*entry, out);
+  }
+  return out;
+}
+
+bool HubLog::wait_newer(uint64_t after_seq, unsigned timeout_ms) const {
+  LockGuard<Mutex> lock(mutex_);
+  if (last_seq_ > after_seq)
+    return true;
+  changed_.wait_for(mutex_, timeout_ms);
+  return last_seq_ > after_seq;
+}
+
+// ── Private helpers
+// ───────────────────────────────────────────────────────────
+
+LogEntry *HubLog::find(uint64_t seq) {
+  const HubLog &self = *this;
+  return const_cast<LogEntry *>(self.find(seq));
+}
+
+const LogEntry *HubLog::find(uint64_t seq) const {
+  // Replicated logs may have gaps, so search rather than index
+  auto it = std::lower_bound(
+      entries_.begin(), entries_.end(), seq,
+      [](const LogEntry &e, uint64_t value) { return e.seq < value; });
+  if (it == entries_.end() || it->seq != seq)
+    return nullptr;
+  return &*it;
+}
+
+void HubLog::read(const LogEntry &entry, std::vector<LogEntry> &out) const {
+  out.push_back(entry);
+  auto ov = overlays_.find(entry.seq);
+  if (ov == overlays_.end())
+    return;
+  LogEntry &copy = out.back();
+  if (ov->second.deleted) {
+    copy.deleted = true;
+    copy.text.clear();
+  } else {
+    copy.edited = true;
+    copy.text = ov->second.text;
+  }
+}
+
+HubLog::Overlay *HubLog::overlay_for(uint64_t seq, uint64_t author,
+                                     std::string &sender) {
+  LogEntry *entry = find(seq);
+  if (!entry || entry->deleted)
+    return nullptr;
+  // Entries without a session here (other hubs, history) stay as they are
+  if (author != ANY_AUTHOR && (entry->author == 0 || entry->author != author))
+    return nullptr;
+  sender = entry->sender;
+  Overlay &overlay = overlays_[seq];
+  if (overlay.deleted)
+    return nullptr;
+  return &overlay;
+}
@@ -0,0 +1,847 @@
+/**
+ * @file io_loop.cpp
+ * @brief Implementation of IoLoop – shared Poll / BusyPoll / Completion
+ *        receive threads.
+ */
+
+#include "io_loop.h"
+
+#include "metrics.h"
+#include "thread_scaler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace {
+
+constexpr std::size_t NO_SHARD = static_cast<std::size_t>(-1);
+
+/// WSAPoll() timeout; wake-ups normally come from the waker socket.
+constexpr int POLL_TIMEOUT_MS = 500;
+
+/// Idle sweeps spent spinning with PAUSE before yielding the core.
+constexpr unsigned SPIN_PASSES = 1u << 12;
+
+/// Idle sweeps spent yielding before falling back to 1 ms sleeps.
+constexpr unsigned YIELD_PASSES = 1u << 15;
+
+/// Completions reaped per GetQueuedCompletionStatusEx() call.
+constexpr ULONG COMPLETION_BATCH = 64;
+
+/// Completion key used to wake an IO thread (no source attached).
+constexpr ULONG_PTR WAKE_KEY = 0;
+
+/// Back off according to how many consecutive sweeps found nothing.
+void idle_backoff(unsigned idle_passes) {
+  if (idle_passes < SPIN_PASSES) {
+    cpu_relax();
+  } else if (idle_passes < YIELD_PASSES) {
+    SwitchToThread();
+  } else {
+    Sleep(1);
+  }
+}
+
+} // namespace
+
+// ── Mode names
+// ────────────────────────────────────────────────────────────────
+
+bool parse_io_mode(const std::string &text, IoMode &out) {
+  if (text == "blocking") {
+    out = IoMode::Blocking;
+  } else if (text == "poll") {
+    out = IoMode::Poll;
+  } else if (text == "busy-poll" || text == "busypoll") {
+    out = IoMode::BusyPoll;
+  } else if (text == "iocp" || text == "completion") {
+    out = IoMode::Completion;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *io_mode_name(IoMode mode) {
+  switch (mode) {
+  case IoMode::Blocking:
+    return "blocking";
+  case IoMode::Poll:
+    return "poll";
+  case IoMode::BusyPoll:
+    return "busy-poll";
+  case IoMode::Completion:
+    return "iocp";
+  }
+  return "unknown";
+}
+
+// ── Completion state
+// ──────────────────────────────────────────────────────────
+
+/// Overlapped state for one source. Owned by the loop, not the source, so
+/// it can outlive the source until the kernel has finished with it.
+struct IoCompletion {
+  IoSource *source;
+  SOCKET sock;
+
+  Mutex mutex;           ///< Guards the fields below
+  unsigned pending = 0;  ///< Overlapped operations the kernel still owns
+  bool detached = false; ///< remove() ran; no callbacks, no new operations
+  bool closed = false;   ///< Receive side finished; do not re-arm
+  bool skip_inline = false; ///< Inline successes queue no completion packet
+
+  WSAOVERLAPPED recv_ov{};
+  WSAOVERLAPPED send_ov{};
+  std::vector<SharedFrame> inflight; ///< Keeps gathered send buffers alive
+  std::vector<WSABUF> bufs;
+
+  IoCompletion(IoSource *src, SOCKET s) : source(src), sock(s) {}
+};
+
+// ── Shard
+// ─────────────────────────────────────────────────────────────────────
+
+struct IoLoop::Shard {
+  std::size_t index = 0;
+
+  /// Held while sources are serviced. CRITICAL_SECTION is re-entrant, so a
+  /// source callback may call add()/remove() on its own shard.
+  Mutex mutex;
+  std::vector<IoSource *> sources; ///< nullptr = removed, awaiting compact()
+  bool dirty = false;
+
+  /// Sources added since the last pass. add() only touches this list, so it
+  /// never waits for a pass and is safe to call while holding other locks.
+  Mutex pending_mutex;
+  std::vector<IoSource *> pending;
+
+  /// Loopback UDP socket used to interrupt WSAPoll() (Poll mode).
+  SOCKET waker = INVALID_SOCKET;
+  sockaddr_in waker_addr{};
+
+  /// Completion port (Completion mode) and every live IoCompletion on it.
+  HANDLE port = nullptr;
+  Mutex contexts_mutex;
+  std::unordered_set<IoCompletion *> contexts;
+
+  Thread thread;
+
+  /// Load since the scaler last sampled it.
+  std::atomic<uint64_t> busy_ns{0};     ///< Time spent servicing sources
+  std::atomic<uint64_t> max_pass_ns{0}; ///< Longest single pass
+  std::atomic<uint64_t> owed{0};        ///< Reads cut short by the budget
+
+  ~Shard() {
+    if (waker != INVALID_SOCKET) {
+      ::closesocket(waker);
+    }
+    if (port) {
+      CloseHandle(port);
+    }
+    for (IoCompletion *ctx : contexts) {
+      delete ctx;
+    }
+  }
+
+  void open_waker() {
+    waker = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (waker == INVALID_SOCKET) {
+      throw std::runtime_error("IoLoop: waker socket() failed: " +
+                               std::to_string(WSAGetLastError()));
+    }
+    waker_addr.sin_family = AF_INET;
+    waker_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    waker_addr.sin_port = 0;
+    int len = sizeof(waker_addr);
+    if (::bind(waker, reinterpret_cast<sockaddr *>(&waker_addr),
+               sizeof(waker_addr)) == SOCKET_ERROR ||
+        ::getsockname(waker, reinterpret_cast<sockaddr *>(&waker_addr),
+                      &len) == SOCKET_ERROR) {
+      throw std::runtime_error("IoLoop: waker bind() failed: " +
+                               std::to_string(WSAGetLastError()));
+    }
+    u_long nb = 1;
+    ::ioctlsocket(waker, FIONBIO, &nb);
+  }
+
+  void wake() {
+    if (port) {
+      PostQueuedCompletionStatus(port, 0, WAKE_KEY, nullptr);
+    }
+    if (waker != INVALID_SOCKET) {
+      char b = 0;
+      ::sendto(waker, &b, 1, 0, reinterpret_cast<sockaddr *>(&waker_addr),
+               sizeof(waker_addr));
+    }
+  }
+
+  void drain_waker() {
+    char buf[64];
+    while (::recv(waker, buf, sizeof(buf), 0) > 0) {
+    }
+  }
+
+  void record_pass(uint64_t ns) {
+    busy_ns.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t longest = max_pass_ns.load(std::memory_order_relaxed);
+    while (ns > longest && !max_pass_ns.compare_exchange_weak(
+                               longest, ns, std::memory_order_relaxed)) {
+    }
+  }
+
+  /// @return Sources serviced here (takes the shard's locks).
+  std::size_t size() {
+    LockGuard<Mutex> lock(mutex);
+    LockGuard<Mutex> pending_lock(pending_mutex);
+    std::size_t n = 0;
+    for (IoSource *source : sources) {
+      n += source != nullptr;
+    }
+    for (IoSource *source : pending) {
+      n += source != nullptr;
+    }
+    return n;
+  }
+};
+
+// ── Construction / Destruction
+// ────────────────────────────────────────────────
+
+IoLoop::IoLoop(const IoOptions &options) : options_(options) {
+  if (options_.threads == 0) {
+    options_.threads = 1;
+  }
+  if (options_.max_threads <= options_.threads) {
+    options_.max_threads = 0; // fixed
+  }
+  unsigned count = std::max(options_.threads, options_.max_threads);
+  for (unsigned i = 0; i < count; ++i) {
+    shards_.push_back(std::unique_ptr<Shard>(new Shard()));
+    shards_.back()->index = i;
+  }
+  awake_.store(options_.threads);
+
+  if (options_.mode == IoMode::Completion) {
+    for (auto &shard : shards_) {
+      shard->port =
+          CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+      if (!shard->port) {
+        std::cerr << "[IoLoop] CreateIoCompletionPort failed ("
+                  << GetLastError() << "); falling back to poll\n";
+        for (auto &s : shards_) {
+          if (s->port) {
+            CloseHandle(s->port);
+            s->port = nullptr;
+          }
+        }
+        options_.mode = IoMode::Poll;
+        break;
+      }
+    }
+  }
+}
+
+IoLoop::~IoLoop() { stop(); }
+
+// ── Lifecycle
+// ─────────────────────────────────────────────────────────────────
+
+void IoLoop::start() {
+  if (running_.load())
+    return;
+  running_.store(true);
+  for (auto &shard : shards_) {
+    if (options_.mode == IoMode::Poll && shard->waker == INVALID_SOCKET) {
+      shard->open_waker();
+    }
+    shard->thread = Thread(&IoLoop::run_shard, this, shard.get());
+  }
+  if (options_.max_threads != 0) {
+    HubMetrics::instance().io_threads.store(awake_.load());
+    scaler_ = Thread(&IoLoop::run_scaler, this);
+  }
+}
+
+void IoLoop::stop() {
+  if (!running_.load())
+    return;
+  running_.store(false);
+  for (auto &shard : shards_) {
+    shard->wake();
+  }
+  {
+    LockGuard<Mutex> lock(park_mutex_);
+    park_cv_.notify_all();
+  }
+  for (auto &shard : shards_) {
+    if (shard->thread.joinable()) {
+      shard->thread.join();
+    }
+  }
+  if (scaler_.joinable()) {
+    scaler_.join();
+  }
+}
+
+// ── Registration
+// ──────────────────────────────────────────────────────────────
+
+void IoLoop::add(IoSource *source) {
+  std::size_t index = next_shard_.fetch_add(1) % awake_.load();
+  Shard &shard = *shards_[index];
+
+  if (options_.mode == IoMode::Completion) {
+    SOCKET sock = source->io_handle();
+    auto *ctx = new IoCompletion(source, sock);
+    {
+      LockGuard<Mutex> lock(shard.contexts_mutex);
+      shard.contexts.insert(ctx);
+    }
+    source->io_completion_ = ctx;
+    source->io_shard_.store(index);
+
+    // Associate once (the closest Winsock gets to registered descriptors)
+    // and skip completion packets for operations that finish inline.
+    HANDLE handle = reinterpret_cast<HANDLE>(sock);
+    if (CreateIoCompletionPort(handle, shard.port,
+                               reinterpret_cast<ULONG_PTR>(ctx), 0)) {
+      // May be refused (e.g. non-IFS layered providers); then every
+      // operation queues a packet and we must wait for it.
+      ctx->skip_inline = SetFileCompletionNotificationModes(
+                             handle, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS |
+                                         FILE_SKIP_SET_EVENT_ON_HANDLE) != 0;
+    } else {
+      LockGuard<Mutex> lock(ctx->mutex);
+      ctx->closed = true;
+    }
+    post_recv(shard, ctx);
+    return;
+  }
+
+  {
+    LockGuard<Mutex> lock(shard.pending_mutex);
+    shard.pending.push_back(source);
+    source->io_shard_.store(index);
+  }
+  shard.wake();
+}
+
+void IoLoop::remove(IoSource *source) {
+  for (;;) {
+    std::size_t index = source->io_shard_.load();
+    if (index >= shards_.size())
+      return;
+
+    Shard &shard = *shards_[index];
+    LockGuard<Mutex> lock(shard.mutex);
+    if (source->io_shard_.load() != index)
+      continue; // moved to another shard meanwhile
+
+    if (IoCompletion *ctx = source->io_completion_) {
+      {
+        LockGuard<Mutex> ctx_lock(ctx->mutex);
+        ctx->detached = true;
+        ctx->source = nullptr;
+      }
+      source->io_completion_ = nullptr;
+      source->io_shard_.store(NO_SHARD);
+      // Still owned by the kernel if an operation is in flight; the IO thread
+      // frees it when the last completion (the socket is about to close) lands
+      release_if_idle(shard, ctx);
+      return;
+    }
+
+    {
+      LockGuard<Mutex> pending_lock(shard.pending_mutex);
+      for (auto &slot : shard.pending) {
+        if (slot == source) {
+          slot = nullptr;
+        }
+      }
+    }
+    for (auto &slot : shard.sources) {
+      if (slot == source) {
+        slot = nullptr;
+        shard.dirty = true;
+      }
+    }
+    source->io_shard_.store(NO_SHARD);
+    return;
+  }
+}
+
+void IoLoop::notify(IoSource *source) {
+  source->io_notified_.store(true);
+  std::size_t index = source->io_shard_.load();
+  if (index < shards_.size()) {
+    shards_[index]->wake();
+  }
+}
+
+// ── IO threads
+// ────────────────────────────────────────────────────────────────
+
+void IoLoop::run_shard(Shard *shard) {
+  // Sources may switch to pooled fibers from their callbacks
+  ConvertThreadToFiber(nullptr);
+
+  unsigned idle_passes = 0;
+  while (running_.load()) {
+    if (shard->index >= awake_.load() &&
+        options_.mode != IoMode::Completion) {
+      if (!wait_awake(*shard))
+        break;
+      idle_passes = 0;
+      continue;
+    }
+    if (options_.mode == IoMode::Completion) {
+      completion_pass(*shard);
+    } else if (options_.mode == IoMode::BusyPoll) {
+      uint64_t t0 = monotonic_ns();
+      if (spin_pass(*shard)) {
+        shard->record_pass(monotonic_ns() - t0);
+        idle_passes = 0;
+      } else {
+        idle_backoff(idle_passes);
+        if (idle_passes < YIELD_PASSES)
+          ++idle_passes;
+      }
+    } else {
+      poll_pass(*shard);
+    }
+  }
+
+  ConvertFiberToThread();
+}
+
+bool IoLoop::wait_awake(Shard &shard) {
+  LockGuard<Mutex> lock(park_mutex_);
+  while (running_.load() && shard.index >= awake_.load()) {
+    park_cv_.wait_for(park_mutex_, INFINITE);
+  }
+  return running_.load();
+}
+
+void IoLoop::poll_pass(Shard &shard) {
+  std::vector<WSAPOLLFD> fds;
+  std::vector<std::size_t> slots;
+  bool owed = false; // a source ran out of budget last pass
+  {
+    LockGuard<Mutex> lock(shard.mutex);
+    compact(shard);
+    fds.reserve(shard.sources.size() + 1);
+    slots.reserve(shard.sources.size());
+
+    WSAPOLLFD waker{};
+    waker.fd = shard.waker;
+    waker.events = POLLRDNORM;
+    fds.push_back(waker);
+
+    for (std::size_t i = 0; i < shard.sources.size(); ++i) {
+      WSAPOLLFD pfd{};
+      pfd.fd = shard.sources[i]->io_handle();
+      pfd.events = POLLRDNORM;
+      if (shard.sources[i]->wants_write()) {
+        pfd.events |= POLLWRNORM;
+      }
+      fds.push_back(pfd);
+      slots.push_back(i);
+      owed = owed || shard.sources[i]->io_more_ ||
+             shard.sources[i]->io_notified_.load();
+    }
+  }
+
+  // Slots are stable until the next compact(), which only this thread runs,
+  // so indices captured above stay valid while we wait without the lock.
+  // Frames already buffered by a source cut short do not show up as
+  // readiness, so do not wait while one is owed its next turn.
+  int ready = ::WSAPoll(fds.data(), static_cast<ULONG>(fds.size()),
+                        owed ? 0 : POLL_TIMEOUT_MS);
+  if (ready < 0 || (ready == 0 && !owed))
+    return;
+
+  if (fds[0].revents != 0) {
+    shard.drain_waker();
+  }
+
+  // One budget per ready source per pass: round robin across the shard
+  uint64_t t0 = monotonic_ns();
+  {
+    LockGuard<Mutex> lock(shard.mutex);
+    for (std::size_t i = 1; i < fds.size(); ++i) {
+      IoSource *source = shard.sources[slots[i - 1]];
+      if (!source)
+        continue;
+      // Queued frames go out first, so a closing source still flushes
+      if ((fds[i].revents & POLLWRNORM) != 0 ||
+          source->io_notified_.exchange(false)) {
+        source->on_writable();
+      }
+      if (fds[i].revents != 0 || source->io_more_) {
+        service(shard, slots[i - 1]);
+      }
+    }
+  }
+  shard.record_pass(monotonic_ns() - t0);
+}
+
+bool IoLoop::spin_pass(Shard &shard) {
+  LockGuard<Mutex> lock(shard.mutex);
+  compact(shard);
+
+  bool progress = false;
+  for (std::size_t i = 0; i < shard.sources.size(); ++i) {
+    IoSource *source = shard.sources[i];
+    if (source && (source->wants_write() ||
+                   (source->io_notified_.load() &&
+                    source->io_notified_.exchange(false)))) {
+      source->on_writable();
+    }
+    if (service(shard, i)) {
+      progress = true;
+    }
+  }
+  return progress;
+}
+
+bool IoLoop::service(Shard &shard, std::size_t index) {
+  IoSource *source = shard.sources[index];
+  if (!source)
+    return false;
+
+  IoSource::Status status;
+  try {
+    status = source->on_readable(budget());
+  } catch (...) {
+    status = IoSource::Status::Closed;
+  }
+  source->io_more_ = status == IoSource::Status::More;
+  if (source->io_more_) {
+    shard.owed.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if (status == IoSource::Status::Closed) {
+    // Drop the source before notifying, so on_closed() may tear it down
+    if (shard.sources[index] == source) {
+      shard.sources[index] = nullptr;
+      shard.dirty = true;
+    }
+    source->io_shard_.store(NO_SHARD);
+    source->on_closed();
+    return true;
+  }
+  return status != IoSource::Status::Idle;
+}
+
+ReadBudget IoLoop::budget() const {
+  ReadBudget budget;
+  budget.frames = options_.read_frames;
+  budget.bytes = options_.read_bytes;
+  return budget;
+}
+
+// ── Completion mode
+// ───────────────────────────────────────────────────────────
+
+void IoLoop::post_recv(Shard &shard, IoCompletion *ctx) {
+  {
+    LockGuard<Mutex> lock(ctx->mutex);
+    ++ctx->pending;
+    std::memset(&ctx->recv_ov, 0, sizeof(ctx->recv_ov));
+    if (!ctx->closed) {
+      // Zero-byte receive: completes on readability without pinning a
+      // buffer per idle connection; data is read after it fires.
+      WSABUF none{0, nullptr};
+      DWORD flags = 0;
+      int rc = ::WSARecv(ctx->sock, &none, 1, nullptr, &flags, &ctx->recv_ov,
+                         nullptr);
+      if ((rc == SOCKET_ERROR && WSAGetLastError() == WSA_IO_PENDING) ||
+          (rc == 0 && !ctx->skip_inline)) {
+        return; // a completion packet will arrive
+      }
+    }
+  }
+  // Finished inline (data already there), failed, or closed: hand it to the
+  // IO thread as if it had completed so all dispatch stays on one thread.
+  PostQueuedCompletionStatus(shard.port, 0, reinterpret_cast<ULONG_PTR>(ctx),
+                             &ctx->recv_ov);
+}
+
+void IoLoop::requeue_recv(Shard &shard, IoCompletion *ctx) {
+  {
+    LockGuard<Mutex> lock(ctx->mutex);
+    ++ctx->pending;
+    std::memset(&ctx->recv_ov, 0, sizeof(ctx->recv_ov));
+  }
+  // Lands behind the completions already queued on the port, which gives
+  // the other ready sources their turn before this one reads again
+  PostQueuedCompletionStatus(shard.port, 0, reinterpret_cast<ULONG_PTR>(ctx),
+                             &ctx->recv_ov);
+}
+
+IoLoop::SendResult IoLoop::post_send(IoSource *source,
+                                     std::vector<SharedFrame> frames) {
+  IoCompletion *ctx = source->io_completion_;
+  if (!ctx || frames.empty())
+    return SendResult::Failed;
+
+  LockGuard<Mutex> lock(ctx->mutex);
+  if (ctx->detached)
+    return SendResult::Failed;
+
+  ctx->inflight = std::move(frames);
+  ctx->bufs.resize(ctx->inflight.size());
+  for (std::size_t i = 0; i < ctx->inflight.size(); ++i) {
+    ctx->bufs[i].len = static_cast<ULONG>(ctx->inflight[i]->size());
+    ctx->bufs[i].buf = const_cast<char *>(ctx->inflight[i]->data());
+  }
+
+  std::memset(&ctx->send_ov, 0, sizeof(ctx->send_ov));
+  ++ctx->pending;
+  int rc = ::WSASend(ctx->sock, ctx->bufs.data(),
+                     static_cast<DWORD>(ctx->bufs.size()), nullptr, 0,
+                     &ctx->send_ov, nullptr);
+  if (rc == 0 && ctx->skip_inline) {
+    // FILE_SKIP_COMPLETION_PORT_ON_SUCCESS: no packet will be queued
+    --ctx->pending;
+    ctx->inflight.clear();
+    return SendResult::Completed;
+  }
+  if (rc == 0 || WSAGetLastError() == WSA_IO_PENDING)
+    return SendResult::Pending;
+
+  --ctx->pending;
+  ctx->inflight.clear();
+  return SendResult::Failed;
+}
+
+void IoLoop::completion_pass(Shard &shard) {
+  OVERLAPPED_ENTRY entries[COMPLETION_BATCH];
+  ULONG count = 0;
+  if (!GetQueuedCompletionStatusEx(shard.port, entries, COMPLETION_BATCH,
+                                   &count, POLL_TIMEOUT_MS, FALSE)) {
+    return; // timeout
+  }
+
+  uint64_t t0 = monotonic_ns();
+  LockGuard<Mutex> lock(shard.mutex);
+  for (ULONG i = 0; i < count; ++i) {
+    if (entries[i].lpCompletionKey == WAKE_KEY)
+      continue;
+
+    auto *ctx = reinterpret_cast<IoCompletion *>(entries[i].lpCompletionKey);
+    LPOVERLAPPED ov = entries[i].lpOverlapped;
+    bool ok = ov->Internal == 0; // NTSTATUS STATUS_SUCCESS
+
+    IoSource *source = nullptr;
+    bool closed = false;
+    {
+      LockGuard<Mutex> ctx_lock(ctx->mutex);
+      --ctx->pending;
+      if (ov == &ctx->send_ov) {
+        ctx->inflight.clear();
+      } else if (!ok) {
+        ctx->closed = true;
+      }
+      source = ctx->source;
+      closed = ctx->closed;
+    }
+
+    if (source && ov == &ctx->send_ov) {
+      source->on_send_complete(ok);
+    } else if (source && ov == &ctx->recv_ov) {
+      IoSource::Status status = IoSource::Status::Closed;
+      if (!closed) {
+        try {
+          status = source->on_readable(budget());
+        } catch (...) {
+          status = IoSource::Status::Closed;
+        }
+      }
+      if (status == IoSource::Status::Closed) {
+        {
+          LockGuard<Mutex> ctx_lock(ctx->mutex);
+          ctx->closed = true;
+        }
+        source->on_closed(); // normally ends in remove(source)
+      } else if (status == IoSource::Status::More) {
+        shard.owed.fetch_add(1, std::memory_order_relaxed);
+        requeue_recv(shard, ctx);
+      } else {
+        post_recv(shard, ctx);
+      }
+    }
+
+    release_if_idle(shard, ctx);
+  }
+  shard.record_pass(monotonic_ns() - t0);
+}
+
+void IoLoop::release_if_idle(Shard &shard, IoCompletion *ctx) {
+  // Callers hold shard.mutex, so nothing else frees contexts meanwhile
+  LockGuard<Mutex> lock(shard.contexts_mutex);
+  if (shard.contexts.count(ctx) == 0)
+    return; // already released (e.g. by remove() from on_closed())
+  {
+    LockGuard<Mutex> ctx_lock(ctx->mutex);
+    if (!ctx->detached || ctx->pending != 0)
+      return;
+  }
+  shard.contexts.erase(ctx);
+  delete ctx;
+}
+
+// ── Thread scaling
+// ────────────────────────────────────────────────────────────
+
+void IoLoop::run_scaler() {
+  ThreadScaler scaler(options_.threads, options_.max_threads);
+  HubMetrics &metrics = HubMetrics::instance();
+  const uint64_t interval_ns = ThreadScaler::SAMPLE_MS * 1000000ull;
+
+  uint64_t last = monotonic_ns();
+  for (;;) {
+    {
+      LockGuard<Mutex> lock(park_mutex_);
+      if (running_.load()) {
+        park_cv_.wait_for(park_mutex_, ThreadScaler::SAMPLE_MS);
+      }
+      if (!running_.load())
+        return;
+    }
+    uint64_t now = monotonic_ns();
+    if (now - last < interval_ns / 2)
+      continue; // woken early by a change; let the interval fill up
+    uint64_t elapsed = now - last;
+    last = now;
+
+    // Shards past awake_ are parked (or, in Completion mode, only serve
+    // the connections they had): their load is not ours to spread
+    ScaleSample sample;
+    sample.awake = static_cast<unsigned>(awake_.load());
+    double busy = 0;
+    for (std::size_t i = 0; i < shards_.size(); ++i) {
+      Shard &shard = *shards_[i];
+      uint64_t busy_ns = shard.busy_ns.exchange(0);
+      uint64_t pass_ns = shard.max_pass_ns.exchange(0);
+      uint64_t owed = shard.owed.exchange(0);
+      if (i >= sample.awake)
+        continue;
+      busy += std::min(1.0, static_cast<double>(busy_ns) / elapsed);
+      sample.max_pass_ns = std::max(sample.max_pass_ns, pass_ns);
+      sample.owed += owed;
+    }
+    sample.busy = busy / sample.awake;
+    metrics.io_busy_pct.store(static_cast<uint64_t>(sample.busy * 100),
+                              std::memory_order_relaxed);
+
+    unsigned want = scaler.decide(sample);
+    if (want != sample.awake) {
+      scale_to(want);
+    }
+  }
+}
+
+void IoLoop::scale_to(std::size_t count) {
+  HubMetrics &metrics = HubMetrics::instance();
+  std::size_t awake = awake_.load();
+  bool move = options_.mode != IoMode::Completion;
+
+  if (count > awake) {
+    {
+      LockGuard<Mutex> lock(park_mutex_);
+      awake_.store(count);
+      park_cv_.notify_all();
+    }
+    // Each thread woken takes half of the fullest shard's connections
+    for (std::size_t i = awake; move && i < count; ++i) {
+      std::size_t fullest = 0;
+      std::size_t most = 0;
+      for (std::size_t j = 0; j < i; ++j) {
+        std::size_t n = shards_[j]->size();
+        if (n > most) {
+          most = n;
+          fullest = j;
+        }
+      }
+      migrate(*shards_[fullest], i, i + 1, false);
+    }
+    metrics.io_scale_ups.fetch_add(count - awake, std::memory_order_relaxed);
+  } else if (count < awake) {
+    {
+      // add() stops choosing them before their sources move out
+      LockGuard<Mutex> lock(park_mutex_);
+      awake_.store(count);
+    }
+    for (std::size_t i = count; move && i < awake; ++i) {
+      migrate(*shards_[i], 0, count, true);
+      shards_[i]->wake(); // leave WSAPoll() and park
+    }
+    metrics.io_scale_downs.fetch_add(awake - count,
+                                     std::memory_order_relaxed);
+  }
+  metrics.io_threads.store(count, std::memory_order_relaxed);
+}
+
+void IoLoop::migrate(Shard &from, std::size_t first, std::size_t last,
+                     bool all) {
+  {
+    // Waits for the pass in progress; slots are only cleared, never
+    // compacted, as the IO thread may hold indices from before its wait
+    LockGuard<Mutex> lock(from.mutex);
+    std::vector<IoSource *> moving;
+    std::size_t n = 0;
+    for (auto &slot : from.sources) {
+      if (slot && (all || n++ % 2 == 1)) {
+        moving.push_back(slot);
+        slot = nullptr;
+        from.dirty = true;
+      }
+    }
+    {
+      LockGuard<Mutex> pending_lock(from.pending_mutex);
+      for (auto &slot : from.pending) {
+        if (slot && (all || n++ % 2 == 1)) {
+          moving.push_back(slot);
+          slot = nullptr;
+        }
+      }
+    }
+    // Still under from.mutex, so remove() sees either shard consistently
+    for (std::size_t i = 0; i < moving.size(); ++i) {
+      Shard &to = *shards_[first + i % (last - first)];
+      LockGuard<Mutex> pending_lock(to.pending_mutex);
+      to.pending.push_back(moving[i]);
+      moving[i]->io_shard_.store(to.index);
+    }
+  }
+  for (std::size_t i = first; i < last; ++i) {
+    shards_[i]->wake();
+  }
+}
+
+void IoLoop::compact(Shard &shard) {
+  {
+    LockGuard<Mutex> lock(shard.pending_mutex);
+    for (IoSource *source : shard.pending) {
+      if (source)
+        shard.sources.push_back(source);
+    }
+    shard.pending.clear();
+  }
+
+  if (!shard.dirty)
+    return;
+  std::vector<IoSource *> live;
+  live.reserve(shard.sources.size());
+  for (IoSource *source : shard.sources) {
+    if (source)
+      live.push_back(source);
+  }
+  shard.sources.swap(live);
+  shard.dirty = false;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file link_writer.cpp
+ * @brief Implementation of LinkWriter – queued sends for server links.
+ */
+
+#include "link_writer.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+/// Most queued bytes gathered into one write.
+constexpr std::size_t MAX_WRITE_BYTES = 64 * 1024;
+
+} // namespace
+
+LinkWriter::LinkWriter(SocketWrapper &socket, std::size_t limit)
+    : socket_(socket), limit_(limit) {}
+
+LinkWriter::~LinkWriter() {
+  close();
+  join();
+}
+
+void LinkWriter::start() { thread_ = Thread(&LinkWriter::run, this); }
+
+bool LinkWriter::send(const SharedFrame &frame) {
+  LockGuard<Mutex> lock(mutex_);
+  if (closed_)
+    return false;
+  if (queued_bytes_ + frame->size() > limit_) {
+    // The peer stopped reading: cut it off rather than hold its backlog
+    close_locked();
+    return false;
+  }
+  queue_.push_back(frame);
+  queued_bytes_ += frame->size();
+  cv_.notify_all();
+  return true;
+}
+
+void LinkWriter::close() {
+  LockGuard<Mutex> lock(mutex_);
+  close_locked();
+}
+
+void LinkWriter::join() {
+  if (thread_.joinable() && !thread_.is_current()) {
+    thread_.join();
+  }
+}
+
+void LinkWriter::close_locked() {
+  closed_ = true;
+  queue_.clear();
+  queued_bytes_ = 0;
+  socket_.close();
+  cv_.notify_all();
+}
+
+void LinkWriter::run() {
+  LockGuard<Mutex> lock(mutex_);
+  while (!closed_) {
+    if (queue_.empty()) {
+      cv_.wait_for(mutex_, INFINITE);
+      continue;
+    }
+    // Everything queued goes out in one write, without the lock so that
+    // senders keep queueing meanwhile
+    std::string batch;
+    while (!queue_.empty() && batch.size() < MAX_WRITE_BYTES) {
+      batch += *queue_.front();
+      queued_bytes_ -= queue_.front()->size();
+      queue_.pop_front();
+    }
+    bool ok = true;
+    mutex_.unlock();
+    try {
+      socket_.send_frame(batch);
+    } catch (const std::exception &) {
+      ok = false;
+    }
+    mutex_.lock();
+    if (!ok) {
+      close_locked();
+    }
+  }
+}
@@ -0,0 +1,139 @@
+/**
+ * @file lz_block.cpp
+ * @brief Implementation of lz_compress() / lz_decompress().
+ */
+
+#include "lz_block.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr int HASH_BITS = 12;
+constexpr std::size_t MIN_MATCH = 4;
+constexpr std::size_t MAX_OFFSET = 65535;
+/// The format ends every block with at least this many literals...
+constexpr std::size_t LAST_LITERALS = 5;
+/// ...and starts no match closer than this to the end.
+constexpr std::size_t MATCH_LIMIT = 12;
+
+uint32_t read32(const unsigned char *p) {
+  uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+uint32_t hash4(uint32_t v) { return (v * 2654435761u) >> (32 - HASH_BITS); }
+
+/// Length continuation bytes: 255, 255, ..., remainder.
+void put_length(std::string &out, std::size_t n) {
+  for (; n >= 255; n -= 255) {
+    out.push_back(static_cast<char>(255));
+  }
+  out.push_back(static_cast<char>(n));
+}
+
+/// One sequence: literals, then a match (none if @p match_len is 0).
+void put_sequence(std::string &out, const unsigned char *lit,
+                  std::size_t lit_len, std::size_t offset,
+                  std::size_t match_len) {
+  std::size_t m = match_len ? match_len - MIN_MATCH : 0;
+  out.push_back(static_cast<char>(((lit_len < 15 ? lit_len : 15) << 4) |
+                                  (m < 15 ? m : 15)));
+  if (lit_len >= 15)
+    put_length(out, lit_len - 15);
+  out.append(reinterpret_cast<const char *>(lit), lit_len);
+  if (match_len == 0)
+    return;
+  out.push_back(static_cast<char>(offset & 0xFF));
+  out.push_back(static_cast<char>(offset >> 8));
+  if (m >= 15)
+    put_length(out, m - 15);
+}
+
+/// Read continuation bytes after a 15 nibble. @return false if truncated.
+bool get_length(const unsigned char *src, std::size_t len, std::size_t &ip,
+                std::size_t &n) {
+  unsigned char b;
+  do {
+    if (ip >= len)
+      return false;
+    b = src[ip++];
+    n += b;
+  } while (b == 255);
+  return true;
+}
+
+} // namespace
+
+void lz_compress(const char *src, std::size_t len, std::string &out) {
+  const unsigned char *in = reinterpret_cast<const unsigned char *>(src);
+  std::vector<uint32_t> table(std::size_t(1) << HASH_BITS, 0); // pos + 1
+  std::size_t anchor = 0;
+  std::size_t ip = 0;
+
+  if (len > MATCH_LIMIT) {
+    std::size_t limit = len - MATCH_LIMIT;
+    std::size_t match_end_max = len - LAST_LITERALS;
+    while (ip < limit) {
+      uint32_t word = read32(in + ip);
+      uint32_t &slot = table[hash4(word)];
+      std::size_t cand = slot;
+      slot = static_cast<uint32_t>(ip + 1);
+      if (cand == 0 || ip - (cand - 1) > MAX_OFFSET ||
+          read32(in + cand - 1) != word) {
+        ++ip;
+        continue;
+      }
+      std::size_t ref = cand - 1;
+      std::size_t match_len = MIN_MATCH;
+      while (ip + match_len < match_end_max &&
+             in[ref + match_len] == in[ip + match_len]) {
+        ++match_len;
+      }
+      put_sequence(out, in + anchor, ip - anchor, ip - ref, match_len);
+      ip += match_len;
+      anchor = ip;
+    }
+  }
+  put_sequence(out, in + anchor, len - anchor, 0, 0);
+}
+
+bool lz_decompress(const char *src, std::size_t len, std::size_t raw_len,
+                   std::string &out) {
+  const unsigned char *in = reinterpret_cast<const unsigned char *>(src);
+  out.resize(raw_len);
+  std::size_t ip = 0;
+  std::size_t op = 0;
+  while (ip < len) {
+    unsigned token = in[ip++];
+    std::size_t lit_len = token >> 4;
+    if (lit_len == 15 && !get_length(in, len, ip, lit_len))
+      return false;
+    if (lit_len > len - ip || lit_len > raw_len - op)
+      return false;
+    std::memcpy(&out[op], in + ip, lit_len);
+    ip += lit_len;
+    op += lit_len;
+    if (ip == len)
+      break; // the last sequence has no match
+
+    if (len - ip < 2)
+      return false;
+    std::size_t offset = in[ip] | (static_cast<std::size_t>(in[ip + 1]) << 8);
+    ip += 2;
+    std::size_t match_len = token & 15;
+    if (match_len == 15 && !get_length(in, len, ip, match_len))
+      return false;
+    match_len += MIN_MATCH;
+    if (offset == 0 || offset > op || match_len > raw_len - op)
+      return false;
+    // Byte by byte: the match may overlap what it is copying
+    for (std::size_t i = 0; i < match_len; ++i, ++op) {
+      out[op] = out[op - offset];
+    }
+  }
+  return op == raw_len;
+}
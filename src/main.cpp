@@ -9,6 +9,62 @@
  *   [C] Client – connects to the server by IP, sends/receives messages.
  *
  * Type "quit" or press Ctrl+C to exit.
+ *
+ * Server options (command line):
+ *   --io=blocking|poll|busy-poll|iocp
+ *                                  How client sockets are read (default:
+ *                                  blocking, one thread per client).
+ *   --io-threads=N                 IO threads for poll / busy-poll / iocp
+ *                                  (the fewest awake when scaling).
+ *   --io-threads-max=N             Wake up to N IO threads as load rises.
+ *   --busy-poll-usec=N             SO_BUSY_POLL budget where supported.
+ *   --out-mem=MB                   Memory for queued outbound frames
+ *                                  before slow clients spill to disk
+ *                                  (default 64, 0 = no limit).
+ *   --read-frames=N                Frames read from one client per IO pass
+ *                                  before the next gets a turn (default 32,
+ *                                  0 = no limit).
+ *   --read-kb=N                    The same, in KB read (default 64).
+ *   --port=N                       Client port (default 54000).
+ *   --ws-port=N                    Accept browsers (WebSocket) on this port.
+ *   --federation-port=N            Accept other hubs on this port.
+ *   --peer=HOST[:PORT]             Bridge this hub with another (repeatable).
+ *   --hub-name=NAME                Name shown to peer hubs.
+ *   --cluster-port=N               Join a failover cluster on this port.
+ *   --cluster-peer=HOST[:PORT]     Another cluster member (repeatable).
+ *   --priority=N                   Preferred leader when logs are equal.
+ *   --advertise=HOST:PORT          Client endpoint announced to clients.
+ *   --relay-port=N                 Accept relay servers on this port.
+ *   --relay-of=HOST:PORT           Run as a relay of that hub's relay port.
+ *   --history=PATH                 Keep the message log on disk at PATH.
+ *   --allow=FILE                   Only accept clients from these addresses
+ *                                  / CIDR ranges (one per line).
+ *   --deny=FILE                    Refuse clients from these (reloaded when
+ *                                  either file changes).
+ *   --conn-rate=N                  Connections per second per address.
+ *   --dup-window=SEC               Drop a line a client repeats within SEC
+ *                                  seconds.
+ *
+ * Export (runs instead of the [S]/[C] prompt, then exits):
+ *   --history=PATH --export=FILE   Write all of PATH's history to FILE.
+ *   --export-format=jsonl|csv      JSON Lines (default) or CSV.
+ *
+ * Client options:
+ *   --connect-timeout=MS           Give up on unreachable hubs after MS
+ *                                  (default 5000).
+ *
+ * The client accepts several hubs at the address prompt, separated by
+ * commas; it connects to whichever answers first.
+ *
+ * Client chat commands: /edit [#id] text, /delete [#id], /react #id emoji
+ * (without #id, /edit and /delete act on your last message), /reply #id
+ * text, /follow #id and /unfollow #id (threads you write in or reply to
+ * are followed for you), /history HH:MM [HH:MM] (today's messages in that
+ * time range), /history @name [N] (someone's last N messages) and /more
+ * (the next page of the last /history), /ping (round trip to the hub).
+ *
+ * Server console commands: /stats, /crash (exit at once, for failover
+ * testing), quit.
  */
 
 // Winsock must be included before windows.h
@@ -24,21 +80,45 @@
 #define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
 #endif
 
+#include "admission.h"
+#include "chat_frame.h"
 #include "chat_session.h"
 #include "client.h"
+#include "cluster.h"
 #include "compat.h"
+#include "federation.h"
+#include "history_compactor.h"
+#include "history_export.h"
+#include "history_file.h"
+#include "history_query.h"
+#include "hlc.h"
+#include "io_loop.h"
 #include "message.h"
+#include "message_ops.h"
+#include "metrics.h"
 #include "network_manager.h"
+#include "outbound_queue.h"
+#include "relay_node.h"
+#include "relay_tree.h"
 #include "room.h"
+#include "seq_window.h"
 #include "server.h"
 #include "version.h"
+#include "websocket.h"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <csignal>
+#include <cstdlib>
+#include <ctime>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <set>
+#include <sstream>
 #include <string>
+#include <vector>
 
 // ── ANSI colour helpers
 // ───────────────────────────────────────────────────────
@@ -121,95 +201,508 @@ static void print_local_ips() {
   freeaddrinfo(res);
 }
 
+/// @return The first LAN IPv4 address, or 127.0.0.1 if there is none.
+static std::string local_ipv4() {
+  std::string ip = "127.0.0.1";
+  char hostname[256];
+  if (gethostname(hostname, sizeof(hostname)) != 0)
+    return ip;
+
+  addrinfo hints{}, *res = nullptr;
+  hints.ai_family = AF_INET;
+  if (getaddrinfo(hostname, nullptr, &hints, &res) != 0)
+    return ip;
+  if (res) {
+    char buf[INET_ADDRSTRLEN];
+    auto *sa = reinterpret_cast<sockaddr_in *>(res->ai_addr);
+    compat_inet_ntop(AF_INET, &sa->sin_addr, buf, sizeof(buf));
+    ip = buf;
+  }
+  freeaddrinfo(res);
+  return ip;
+}
+
+// ── Command-line options
+// ──────────────────────────────────────────────────────
+
+/// Split "--name=value"; returns false if @p arg is not "--name=...".
+static bool flag_value(const std::string &arg, const char *name,
+                       std::string &value) {
+  std::string prefix = std::string("--") + name + "=";
+  if (arg.compare(0, prefix.size(), prefix) != 0)
+    return false;
+  value = arg.substr(prefix.size());
+  return true;
+}
+
+/// Server tuning collected from the command line.
+struct ServerOptions {
+  unsigned short port = DEFAULT_PORT;
+  unsigned short ws_port = 0; ///< WebSocket port for browsers (0 = none)
+  IoOptions io;
+  FederationOptions federation;
+  ClusterOptions cluster;
+  RelayTreeOptions relay_tree;
+  RelayNodeOptions relay_node;
+  AdmissionOptions admission;
+  unsigned dup_window_s = 0; ///< Repeat suppression window (0 = off)
+  std::string advertise; ///< Client endpoint for other hubs to hand out
+  std::string history;   ///< On-disk history journal ("" = memory only)
+  std::string export_to; ///< Export history here instead of running
+  ExportFormat export_format = ExportFormat::JsonLines;
+  unsigned int connect_timeout_ms = DEFAULT_CONNECT_TIMEOUT_MS; ///< Client
+};
+
+/// Parse known flags; unknown ones are reported and ignored.
+static ServerOptions parse_options(const std::vector<std::string> &args) {
+  ServerOptions opts;
+  for (const std::string &arg : args) {
+    std::string value;
+    if (flag_value(arg, "port", value)) {
+      opts.port = static_cast<unsigned short>(std::stoi(value));
+    } else if (flag_value(arg, "ws-port", value)) {
+      opts.ws_port = static_cast<unsigned short>(std::stoi(value));
+    } else if (flag_value(arg, "io", value)) {
+      if (!parse_io_mode(value, opts.io.mode)) {
+        std::cerr << ansi::RED << "[Options] Unknown IO mode '" << value
+                  << "' (blocking, poll, busy-poll, iocp)\n"
+                  << ansi::RESET;
+      }
+    } else if (flag_value(arg, "io-threads", value)) {
+      opts.io.threads = static_cast<unsigned>(std::stoul(value));
+    } else if (flag_value(arg, "io-threads-max", value)) {
+      opts.io.max_threads = static_cast<unsigned>(std::stoul(value));
+    } else if (flag_value(arg, "busy-poll-usec", value)) {
+      opts.io.busy_poll_usec = std::stoi(value);
+    } else if (flag_value(arg, "out-mem", value)) {
+      opts.io.out_budget = std::stoull(value) * 1024 * 1024;
+    } else if (flag_value(arg, "read-frames", value)) {
+      opts.io.read_frames = static_cast<unsigned>(std::stoul(value));
+    } else if (flag_value(arg, "read-kb", value)) {
+      opts.io.read_bytes = std::stoull(value) * 1024;
+    } else if (flag_value(arg, "federation-port", value)) {
+      opts.federation.port = static_cast<unsigned short>(std::stoi(value));
+    } else if (flag_value(arg, "peer", value)) {
+      opts.federation.peers.push_back(value);
+    } else if (flag_value(arg, "hub-name", value)) {
+      opts.federation.name = value;
+    } else if (flag_value(arg, "cluster-port", value)) {
+      opts.cluster.port = static_cast<unsigned short>(std::stoi(value));
+    } else if (flag_value(arg, "cluster-peer", value)) {
+      opts.cluster.members.push_back(value);
+    } else if (flag_value(arg, "priority", value)) {
+      opts.cluster.priority = static_cast<unsigned>(std::stoul(value));
+    } else if (flag_value(arg, "advertise", value)) {
+      opts.advertise = value;
+    } else if (flag_value(arg, "relay-port", value)) {
+      opts.relay_tree.port = static_cast<unsigned short>(std::stoi(value));
+    } else if (flag_value(arg, "relay-of", value)) {
+      opts.relay_node.upstream = value;
+    } else if (flag_value(arg, "history", value)) {
+      opts.history = value;
+    } else if (flag_value(arg, "allow", value)) {
+      opts.admission.allow_file = value;
+    } else if (flag_value(arg, "deny", value)) {
+      opts.admission.deny_file = value;
+    } else if (flag_value(arg, "conn-rate", value)) {
+      opts.admission.rate = static_cast<unsigned>(std::stoul(value));
+    } else if (flag_value(arg, "dup-window", value)) {
+      opts.dup_window_s = static_cast<unsigned>(std::stoul(value));
+    } else if (flag_value(arg, "export", value)) {
+      opts.export_to = value;
+    } else if (flag_value(arg, "export-format", value)) {
+      if (!parse_export_format(value, opts.export_format)) {
+        std::cerr << ansi::RED << "[Options] Unknown export format '" << value
+                  << "' (jsonl, csv)\n"
+                  << ansi::RESET;
+      }
+    } else if (flag_value(arg, "connect-timeout", value)) {
+      opts.connect_timeout_ms = static_cast<unsigned>(std::stoul(value));
+    } else {
+      std::cerr << ansi::YELLOW << "[Options] Ignoring unknown option " << arg
+                << "\n"
+                << ansi::RESET;
+    }
+  }
+  return opts;
+}
+
+// ── Export mode
+// ───────────────────────────────────────────────────────────────
+
+/// Write the history at --history to --export. @return Exit code.
+static int run_export(const ServerOptions &opts) {
+  if (opts.history.empty()) {
+    std::cerr << ansi::RED << "[Export] --export needs --history=PATH\n"
+              << ansi::RESET;
+    return 1;
+  }
+  std::cout << ansi::CYAN << "[Export] " << opts.history << " -> "
+            << opts.export_to << "...\n"
+            << ansi::RESET;
+  try {
+    HistoryExport exporter(opts.history, opts.export_format);
+    ExportStats stats = exporter.write(opts.export_to);
+    uint64_t ms = stats.elapsed_ns / 1000000;
+    std::cout << ansi::GREEN << "[Export] " << stats.records
+              << " records from " << stats.files << " files, "
+              << stats.input_bytes / (1024 * 1024) << " MiB -> "
+              << stats.output_bytes / (1024 * 1024) << " MiB in " << ms
+              << " ms";
+    if (ms != 0) {
+      std::cout << " (" << stats.output_bytes * 1000 / ms / (1024 * 1024)
+                << " MiB/s written)";
+    }
+    std::cout << "\n" << ansi::RESET;
+  } catch (const std::exception &e) {
+    std::cerr << ansi::RED << "[Export] " << e.what() << ansi::RESET << "\n";
+    return 1;
+  }
+  return 0;
+}
+
 // ── Server mode
 // ───────────────────────────────────────────────────────────────
 
+/// Multi-hub features the client handshake consults (any may be null).
+struct HubTopology {
+  const HubCluster *cluster = nullptr; ///< Failover members
+  RelayTree *tree = nullptr;           ///< This hub places clients on relays
+  const RelayNode *relay = nullptr;    ///< This server is a relay
+
+  /// @return Fallback hubs for "CMD:HUBS:", or empty if there are none.
+  std::string hubs() const {
+    if (cluster)
+      return cluster->client_endpoints();
+    if (relay)
+      return relay->client_endpoints();
+    return std::string();
+  }
+};
+
+/**
+ * @brief Version handshake with a newly accepted client.
+ *
+ * Runs on the client's own receive context (its thread, or a fiber on the
+ * IO loop), never on the accept thread, so a slow client or a large update
+ * transfer does not hold up other connections.
+ *
+ * Current clients may be redirected to a relay instead of joining here;
+ * the function then returns an empty name, which closes the connection.
+ *
+ * @param topology Failover / relay context for HUBS lists and placement.
+ * @return The client's username (its IP if it did not send one).
+ */
+static std::string greet_client(ClientHandler &conn, const std::string &ip,
+                                const Room &room,
+                                const HubTopology &topology) {
+  // Read the first message as the client's chosen username
+  std::string username = conn.read_frame();
+  if (username.empty()) {
+    username = ip;
+  }
+
+  // Read the second message — client version
+  std::string client_version = conn.read_frame();
+
+  // Check for version prefix
+  const std::string ver_prefix = "CMD:VERSION:";
+  std::string ver_str = "";
+  if (client_version.size() >= ver_prefix.size() &&
+      client_version.substr(0, ver_prefix.size()) == ver_prefix) {
+    ver_str = client_version.substr(ver_prefix.size());
+  }
+
+  // Compare versions and send update if needed
+  std::string relay;
+  if (!ver_str.empty() && ver_str != std::string(APP_VERSION)) {
+    // Client is outdated — read our own exe and send it
+    std::string exe_path = get_exe_path();
+    std::ifstream file(exe_path.c_str(), std::ios::binary | std::ios::ate);
+    if (file.is_open()) {
+      std::streamsize file_size = file.tellg();
+      file.seekg(0, std::ios::beg);
+
+      std::string exe_data(static_cast<std::size_t>(file_size), '\0');
+      file.read(&exe_data[0], file_size);
+      file.close();
+
+      // Tell client an update is available
+      std::string cmd = "CMD:UPDATE:" + std::to_string(file_size);
+      conn.write_frame(cmd);
+
+      // Send the exe binary
+      conn.write_binary(exe_data.data(),
+                        static_cast<uint32_t>(exe_data.size()));
+
+      std::cout << ansi::CLEAR_LINE << ansi::YELLOW
+                << "[Server] Sent update (v" << APP_VERSION << ") to "
+                << username << " (was v" << ver_str << ")\n"
+                << ansi::RESET << "You: " << std::flush;
+    } else {
+      conn.write_frame("CMD:OK");
+    }
+  } else if (ver_str == APP_VERSION && topology.tree &&
+             !(relay = topology.tree->place()).empty()) {
+    // Only current clients understand redirects
+    conn.write_frame("CMD:REDIRECT:" + relay);
+    return std::string();
+  } else {
+    conn.write_frame("CMD:OK");
+  }
+
+  // Current clients learn where to go if this hub fails
+  std::string hubs = topology.hubs();
+  if (!hubs.empty() && ver_str == APP_VERSION) {
+    conn.write_frame("CMD:HUBS:" + hubs);
+  }
+
+  std::size_t count = room.client_count() + 1;
+  std::cout << ansi::CLEAR_LINE << ansi::GREEN << "[Server] " << username
+            << " (" << ip << ") connected  (total: " << count << ")\n"
+            << ansi::RESET << "You: " << std::flush;
+  return username;
+}
+
+/**
+ * @brief Upgrade handshake and greeting for a browser on the WebSocket port.
+ *
+ * Runs on the client's receive context like greet_client(). Browsers get
+ * no updates, redirects or HUBS lists: after the upgrade they send their
+ * username and are told "CMD:OK".
+ *
+ * @return The browser's username, or empty to close the connection.
+ */
+static std::string greet_browser(ClientHandler &conn, const std::string &ip,
+                                 const Room &room) {
+  std::string response;
+  bool upgraded = websocket::answer_upgrade(conn.read_frame(), response);
+  conn.write_raw(response);
+  if (!upgraded)
+    return std::string();
+
+  std::string username = conn.read_frame();
+  if (username.empty())
+    return std::string();
+  conn.write_frame("CMD:OK");
+
+  std::size_t count = room.client_count() + 1;
+  std::cout << ansi::CLEAR_LINE << ansi::GREEN << "[Server] " << username
+            << " (" << ip << ", browser) connected  (total: " << count
+            << ")\n"
+            << ansi::RESET << "You: " << std::flush;
+  return username;
+}
+
 /**
  * @brief Run the server: accept unlimited clients, broadcast messages.
  *
  * The server's own stdin input is broadcast to ALL connected clients.
  * Client messages are forwarded to all OTHER clients and printed locally.
+ * "/stats" prints hub counters and latency percentiles.
  */
-static void run_server() {
+static void run_server(const ServerOptions &opts) {
   std::cout << "\n"
-            << ansi::CYAN << "[Server] Starting on port " << DEFAULT_PORT
-            << "...\n"
+            << ansi::CYAN << "[Server] Starting on port " << opts.port
+            << " (io: " << io_mode_name(opts.io.mode) << ")...\n"
             << ansi::RESET;
+  if (opts.ws_port != 0) {
+    std::cout << ansi::CYAN << "[Server] Browsers (WebSocket) on port "
+              << opts.ws_port << "\n"
+              << ansi::RESET;
+  }
 
   print_local_ips();
 
-  Server server(DEFAULT_PORT);
-  Room room;
-
-  // Register callback: each new connection gets added to the Room
-  server.set_on_new_client([&room](SocketWrapper sock, std::string ip) {
-    // Read the first message as the client's chosen username
-    std::string username;
+  Room room(opts.io);
+  room.set_flood_filter(opts.dup_window_s * 1000);
+  std::unique_ptr<HistoryFile> history;
+  std::unique_ptr<HistoryCompactor> compactor;
+  std::unique_ptr<HubCluster> cluster;
+  std::unique_ptr<RelayTree> tree;
+  std::unique_ptr<RelayNode> relay;
+  std::unique_ptr<MessageOps> ops;
+  std::unique_ptr<HistoryQuery> queries;
+  HubTopology topology; // filled in before the client port opens
+
+  // Who may connect is settled before the client ports open
+  std::unique_ptr<Admission> admission;
+  if (opts.admission.enabled()) {
     try {
-      username = sock.receive_message();
-    } catch (...) {
-      username = "";
+      admission.reset(new Admission(opts.admission));
+    } catch (const std::exception &e) {
+      std::cerr << ansi::RED << "[Server] " << e.what() << ansi::RESET << "\n";
+      return;
     }
-    if (username.empty()) {
-      username = ip;
+    admission->start();
+    std::cout << ansi::CYAN << "[Server] Admission: " << admission->describe()
+              << "\n"
+              << ansi::RESET;
+  }
+
+  std::string advertise = opts.advertise;
+  if (advertise.empty()) {
+    advertise = local_ipv4() + ":" + std::to_string(opts.port);
+  }
+
+  // Bring the log back from disk before anything can add to it
+  if (!opts.history.empty()) {
+    HubLog &log = room.log();
+    try {
+      history.reset(new HistoryFile(opts.history));
+      HistoryRecovery rec = history->recover(
+          log.capacity(), [&](LogChange change, const LogEntry &entry) {
+            if (change == LogChange::Append) {
+              room.restore(entry);
+            } else if (change == LogChange::Edit) {
+              log.edit(entry.seq, HubLog::ANY_AUTHOR, entry.text);
+            } else {
+              log.erase(entry.seq, HubLog::ANY_AUTHOR);
+            }
+          });
+      std::cout << ansi::CYAN << "[Server] History " << opts.history << ": "
+                << rec.records << " records replayed in "
+                << rec.elapsed_ns / 1000000 << " ms ("
+                << rec.skipped_bytes / (1024 * 1024)
+                << " MiB skipped by checkpoint";
+      if (rec.torn_bytes != 0) {
+        std::cout << ", " << rec.torn_bytes << " bytes of torn tail dropped";
+      }
+      std::cout << ")\n" << ansi::RESET;
+    } catch (const std::exception &e) {
+      std::cerr << ansi::RED << "[Server] " << e.what() << ansi::RESET << "\n";
+      return;
     }
+    HistoryFile *file = history.get();
+    log.set_journal([file](LogChange change, const LogEntry &entry) {
+      file->record(change, entry);
+    });
+    history->start();
+    compactor.reset(new HistoryCompactor(opts.history));
+    compactor->start();
+  }
 
-    // Read the second message — client version
-    std::string client_version;
+  // Each new connection gets added to the Room and greeted from its own
+  // receive context
+  auto on_new_client = [&room, &topology](SocketWrapper sock, std::string ip) {
+    room.add_client(std::move(sock), ip,
+                    [&room, &topology, ip](ClientHandler &conn) {
+                      return greet_client(conn, ip, room, topology);
+                    });
+  };
+
+  // Browsers join the same room after a WebSocket upgrade
+  auto on_new_browser = [&room](SocketWrapper sock, std::string ip) {
+    sock.set_protocol(WireProtocol::WebSocket);
+    room.add_client(std::move(sock), ip,
+                    [&room, ip](ClientHandler &conn) {
+                      return greet_browser(conn, ip, room);
+                    });
+  };
+
+  // Only the leader of a cluster listens for clients, so opening and
+  // closing the client ports follows the election
+  Mutex server_mutex;
+  std::unique_ptr<Server> server;
+  std::unique_ptr<Server> ws_server;
+  auto open_for_clients = [&]() {
+    LockGuard<Mutex> lock(server_mutex);
+    if (server)
+      return;
     try {
-      client_version = sock.receive_message();
-    } catch (...) {
-      client_version = "";
-    }
-
-    // Check for version prefix
-    const std::string ver_prefix = "CMD:VERSION:";
-    std::string ver_str = "";
-    if (client_version.size() >= ver_prefix.size() &&
-        client_version.substr(0, ver_prefix.size()) == ver_prefix) {
-      ver_str = client_version.substr(ver_prefix.size());
-    }
-
-    // Compare versions and send update if needed
-    if (!ver_str.empty() && ver_str != std::string(APP_VERSION)) {
-      // Client is outdated — read our own exe and send it
-      std::string exe_path = get_exe_path();
-      std::ifstream file(exe_path.c_str(), std::ios::binary | std::ios::ate);
-      if (file.is_open()) {
-        std::streamsize file_size = file.tellg();
-        file.seekg(0, std::ios::beg);
-
-        std::string exe_data(static_cast<std::size_t>(file_size), '\0');
-        file.read(&exe_data[0], file_size);
-        file.close();
-
-        // Tell client an update is available
-        std::string cmd = "CMD:UPDATE:" + std::to_string(file_size);
-        sock.send_message(cmd);
-
-        // Send the exe binary
-        sock.send_binary(exe_data.data(),
-                         static_cast<uint32_t>(exe_data.size()));
-
-        std::cout << ansi::CLEAR_LINE << ansi::YELLOW
-                  << "[Server] Sent update (v" << APP_VERSION << ") to "
-                  << username << " (was v" << ver_str << ")\n"
-                  << ansi::RESET << "You: " << std::flush;
-      } else {
-        sock.send_message("CMD:OK");
+      server.reset(new Server(opts.port));
+      server->set_on_new_client(on_new_client);
+      server->set_admission(admission.get());
+      server->start_accept_loop();
+      if (opts.ws_port != 0) {
+        ws_server.reset(new Server(opts.ws_port));
+        ws_server->set_on_new_client(on_new_browser);
+        ws_server->set_admission(admission.get());
+        ws_server->start_accept_loop();
       }
-    } else {
-      sock.send_message("CMD:OK");
+    } catch (const std::exception &e) {
+      server.reset();
+      ws_server.reset();
+      std::cerr << ansi::RED << "[Server] " << e.what() << ansi::RESET
+                << "\n";
+    }
+  };
+  auto close_for_clients = [&]() {
+    std::unique_ptr<Server> old;
+    std::unique_ptr<Server> old_ws;
+    {
+      LockGuard<Mutex> lock(server_mutex);
+      old.swap(server);
+      old_ws.swap(ws_server);
+    }
+    old.reset();
+    old_ws.reset();
+    room.stop_all(); // clients fail over to the new leader
+  };
+
+  // Bridge with other hubs before clients arrive (see Room's hook contract)
+  std::unique_ptr<Federation> federation;
+  if (opts.federation.enabled()) {
+    federation.reset(new Federation(room, opts.federation));
+    federation->start();
+    std::cout << ansi::CYAN << "[Server] Federation hub id " << std::hex
+              << federation->hub_id() << std::dec;
+    if (opts.federation.port != 0) {
+      std::cout << ", peers accepted on port " << opts.federation.port;
     }
+    std::cout << "\n" << ansi::RESET;
+  }
 
-    std::size_t count = room.client_count() + 1;
-    std::cout << ansi::CLEAR_LINE << ansi::GREEN << "[Server] " << username
-              << " (" << ip << ") connected  (total: " << count << ")\n"
-              << ansi::RESET << "You: " << std::flush;
-    room.add_client(std::move(sock), username);
-  });
+  if (opts.relay_tree.enabled()) {
+    RelayTreeOptions ro = opts.relay_tree;
+    ro.advertise = advertise;
+    tree.reset(new RelayTree(room, ro));
+    tree->start();
+    topology.tree = tree.get();
+    std::cout << ansi::CYAN << "[Server] Relays accepted on port " << ro.port
+              << "\n"
+              << ansi::RESET;
+  }
 
-  server.start_accept_loop();
+  if (opts.relay_node.enabled()) {
+    RelayNodeOptions rn = opts.relay_node;
+    rn.advertise = advertise;
+    relay.reset(new RelayNode(room, rn));
+    relay->start();
+    topology.relay = relay.get();
+    std::cout << ansi::CYAN << "[Server] Relaying for hub " << rn.upstream
+              << "\n"
+              << ansi::RESET;
+  } else {
+    // Relays pass ops up; the hub that numbers messages applies them
+    ops.reset(new MessageOps(room));
+    ops->start();
+  }
+
+  // Relays answer from the messages they have in memory
+  queries.reset(new HistoryQuery(room, opts.history));
+  queries->start();
+
+  if (opts.cluster.enabled()) {
+    ClusterOptions co = opts.cluster;
+    co.advertise = advertise;
+    cluster.reset(new HubCluster(room, co));
+    topology.cluster = cluster.get();
+    cluster->set_on_role_change([&](HubRole role) {
+      if (role == HubRole::Leader) {
+        open_for_clients();
+      } else {
+        close_for_clients();
+      }
+    });
+    cluster->start();
+    std::cout << ansi::CYAN << "[Server] Cluster port " << co.port
+              << ", clients will reach this hub at " << co.advertise
+              << " once it leads\n"
+              << ansi::RESET;
+  } else {
+    open_for_clients();
+  }
 
   std::cout << ansi::CYAN
             << "[Server] Waiting for clients... (type messages to broadcast)\n"
@@ -228,7 +721,45 @@ static void run_server() {
     if (line.empty())
       continue;
 
-    if (room.client_count() == 0) {
+    if (line == "/stats") {
+      std::cout << ansi::CYAN << "[Server] Hub statistics ("
+                << room.client_count() << " clients";
+      if (federation) {
+        std::cout << ", " << federation->peer_count() << " peer hubs";
+      }
+      std::cout << "):\n"
+                << HubMetrics::instance().report();
+      uint64_t queued = OutboundQueue::memory_bytes();
+      uint64_t spilled = OutboundQueue::spilled_bytes();
+      if (queued != 0 || spilled != 0) {
+        std::cout << "  out queues:  " << queued / 1024 << " KB in memory, "
+                  << spilled / 1024 << " KB spilled to disk\n";
+      }
+      if (cluster) {
+        std::cout << cluster->describe();
+      }
+      if (tree) {
+        std::cout << tree->describe();
+      }
+      std::cout << ansi::RESET;
+      continue;
+    }
+
+    if (line == "/crash") {
+      // Fault injection for failover testing: no goodbye to anyone
+      std::_Exit(3);
+    }
+
+    if (cluster && cluster->role() != HubRole::Leader) {
+      std::cout << ansi::YELLOW
+                << "[Server] Standby hub; chat happens on the leader.\n"
+                << ansi::RESET;
+      continue;
+    }
+
+    if (room.client_count() == 0 && !relay &&
+        (!federation || federation->peer_count() == 0) &&
+        (!tree || tree->relay_count() == 0)) {
       std::cout << ansi::YELLOW << "[Server] No clients connected yet.\n"
                 << ansi::RESET;
       continue;
@@ -244,17 +775,262 @@ static void run_server() {
             << room.client_count() << "\n"
             << ansi::RESET;
 
-  server.stop();
+  if (cluster) {
+    cluster->stop(); // no role changes from here on
+  }
+  {
+    LockGuard<Mutex> lock(server_mutex);
+    server.reset();
+    ws_server.reset();
+  }
+  if (tree) {
+    tree->stop();
+  }
+  if (relay) {
+    relay->stop();
+  }
   room.stop_all();
+  if (ops) {
+    ops->stop();
+  }
+  queries->stop();
+  if (federation) {
+    federation->stop();
+  }
+  if (compactor) {
+    compactor->stop(); // an unfinished archive is simply redone next time
+  }
+  if (history) {
+    room.log().set_journal(nullptr);
+    history->stop(); // everything logged is on disk from here
+  }
 }
 
 // ── Client mode
 // ───────────────────────────────────────────────────────────────
 
+/// How long a client keeps looking for a hub after losing its connection.
+constexpr unsigned FAILOVER_WINDOW_MS = 15000;
+
+/**
+ * @brief Split "host[:port]"; the port is left unchanged if absent.
+ * @return false if the host is empty or the port is not a number from 1 to
+ *         65535.
+ */
+static bool split_host_port(const std::string &endpoint, std::string &host,
+                            unsigned short &port) {
+  std::size_t colon = endpoint.rfind(':');
+  host = endpoint.substr(0, colon);
+  if (host.empty())
+    return false;
+  if (colon == std::string::npos)
+    return true;
+
+  std::string digits = endpoint.substr(colon + 1);
+  if (digits.empty() || digits.size() > 5 ||
+      digits.find_first_not_of("0123456789") != std::string::npos) {
+    return false;
+  }
+  unsigned long value = std::stoul(digits);
+  if (value == 0 || value > 65535)
+    return false;
+  port = static_cast<unsigned short>(value);
+  return true;
+}
+
+/// Split a comma-separated list, dropping empty items.
+static std::vector<std::string> split_list(const std::string &list) {
+  std::vector<std::string> out;
+  std::size_t start = 0;
+  while (start <= list.size()) {
+    std::size_t comma = list.find(',', start);
+    if (comma == std::string::npos)
+      comma = list.size();
+    if (comma > start)
+      out.push_back(list.substr(start, comma - start));
+    start = comma + 1;
+  }
+  return out;
+}
+
+/**
+ * @brief Send username and version, then read the server's verdict.
+ * @return "CMD:OK", "CMD:UPDATE:<size>", or empty if the server hung up.
+ */
+static std::string client_hello(SocketWrapper &conn,
+                                const std::string &username) {
+  conn.send_message(username);
+  conn.send_message(std::string("CMD:VERSION:") + APP_VERSION);
+  try {
+    return conn.receive_message();
+  } catch (...) {
+    return "";
+  }
+}
+
+/// Redirects followed before a connection attempt settles.
+constexpr int MAX_REDIRECTS = 3;
+
+/**
+ * @brief Connect to whichever hub answers first and say hello, following
+ * "CMD:REDIRECT:" answers (a hub with relays places clients on them).
+ * @param candidates Hubs to race, in order of preference.
+ * @param endpoint   Receives the hub that finally answered.
+ * @param out        Receives the connected socket.
+ * @return The hub's verdict ("CMD:OK", "CMD:UPDATE:<size>", or empty).
+ * @throws std::runtime_error if no hub can be reached.
+ */
+static std::string connect_hub(Client &client, const std::string &username,
+                               std::vector<std::string> candidates,
+                               std::string &endpoint, SocketWrapper &out) {
+  const std::string redirect = "CMD:REDIRECT:";
+  for (int hop = 0;; ++hop) {
+    SocketWrapper sock = client.connect_any(candidates, &endpoint);
+    std::string verdict = client_hello(sock, username);
+    if (verdict.compare(0, redirect.size(), redirect) == 0 &&
+        hop < MAX_REDIRECTS) {
+      candidates.assign(1, verdict.substr(redirect.size()));
+      continue;
+    }
+    out = std::move(sock);
+    return verdict;
+  }
+}
+
+/**
+ * @brief Turn a message or thread command into its frame.
+ *
+ *   /edit [#id] new text    /delete [#id]    /react #id emoji
+ *   /reply #id text         /follow #id      /unfollow #id
+ *
+ * @param own_last Number of the user's last message, used when "/edit" or
+ *                 "/delete" has no #id (0 if none yet).
+ * @param frame    Receives the frame to send; empty if @p error is set.
+ * @return false if @p line is not one of these commands (plain chat).
+ */
+static bool parse_client_op(const std::string &line, uint64_t own_last,
+                            std::string &frame, std::string &error) {
+  std::size_t space = line.find(' ');
+  std::string cmd = line.substr(0, space);
+  std::string rest = space == std::string::npos ? "" : line.substr(space + 1);
+  if (cmd != "/edit" && cmd != "/delete" && cmd != "/react" &&
+      cmd != "/reply" && cmd != "/follow" && cmd != "/unfollow")
+    return false;
+
+  frame.clear();
+  uint64_t id = own_last;
+  bool explicit_id = !rest.empty() && rest[0] == '#';
+  if (explicit_id) {
+    id = std::strtoull(rest.c_str() + 1, nullptr, 10);
+    space = rest.find(' ');
+    rest = space == std::string::npos ? "" : rest.substr(space + 1);
+  }
+
+  if (cmd == "/react" && (!explicit_id || rest.empty())) {
+    error = "Usage: /react #id emoji";
+  } else if (cmd == "/reply" && (!explicit_id || rest.empty())) {
+    error = "Usage: /reply #id text";
+  } else if ((cmd == "/follow" || cmd == "/unfollow") && !explicit_id) {
+    error = "Usage: " + cmd + " #id";
+  } else if (cmd == "/edit" && rest.empty()) {
+    error = "Usage: /edit [#id] new text";
+  } else if (id == 0) {
+    error = "Nothing of yours to change yet; name a message with #id";
+  } else if (cmd == "/edit") {
+    frame = "CMD:EDIT:" + std::to_string(id) + ":" + rest;
+  } else if (cmd == "/delete") {
+    frame = "CMD:DELETE:" + std::to_string(id);
+  } else if (cmd == "/reply") {
+    frame = "CMD:REPLY:" + std::to_string(id) + ":" + rest;
+  } else if (cmd == "/follow") {
+    frame = "CMD:FOLLOW:" + std::to_string(id);
+  } else if (cmd == "/unfollow") {
+    frame = "CMD:UNFOLLOW:" + std::to_string(id);
+  } else {
+    frame = "CMD:REACT:" + std::to_string(id) + ":" + rest;
+  }
+  return true;
+}
+
+/// The /history query being paged through (see history_query.h).
+struct ClientQuery {
+  uint64_t id = 0; ///< Results for older queries are ignored
+  bool by_sender = false;
+  uint64_t from_ms = 0;
+  uint64_t to_ms = 0;
+  std::size_t remaining = 0; ///< By sender: messages still wanted
+  std::string sender;
+  uint64_t next = 0; ///< Cursor for /more (0 = nothing more)
+
+  /// @return The query frame for the page starting at @p cursor.
+  std::string frame(uint64_t cursor) const {
+    std::string head = "CMD:QUERY:" + std::to_string(id) + ":";
+    if (by_sender) {
+      return head + "LAST:" + std::to_string(remaining) + ":" +
+             std::to_string(cursor) + ":" + sender;
+    }
+    return head + "RANGE:" + std::to_string(from_ms) + ":" +
+           std::to_string(to_ms) + ":" + std::to_string(cursor);
+  }
+};
+
+/// Parse "HH:MM" as that time today. @return ms since 1970, or 0.
+static uint64_t parse_clock_today(const std::string &text) {
+  unsigned hour = 0;
+  unsigned minute = 0;
+  char colon = 0;
+  std::istringstream in(text);
+  if (!(in >> hour >> colon >> minute) || colon != ':' || hour > 23 ||
+      minute > 59)
+    return 0;
+  std::time_t now = std::time(nullptr);
+  std::tm local = *std::localtime(&now);
+  local.tm_hour = static_cast<int>(hour);
+  local.tm_min = static_cast<int>(minute);
+  local.tm_sec = 0;
+  local.tm_isdst = -1;
+  std::time_t at = std::mktime(&local);
+  return at < 0 ? 0 : static_cast<uint64_t>(at) * 1000;
+}
+
+/**
+ * @brief Parse "/history HH:MM [HH:MM]" or "/history @name [N]" into
+ * @p q (keeping q.id).
+ * @return false with @p error set if malformed.
+ */
+static bool parse_history_command(const std::string &line, ClientQuery &q,
+                                  std::string &error) {
+  std::istringstream in(line.substr(8)); // after "/history"
+  std::string first, second;
+  in >> first >> second;
+  q.next = 0;
+  if (!first.empty() && first[0] == '@') {
+    q.by_sender = true;
+    q.sender = first.substr(1);
+    q.remaining = second.empty()
+                      ? 20
+                      : static_cast<std::size_t>(
+                            std::strtoul(second.c_str(), nullptr, 10));
+    if (!q.sender.empty() && q.remaining != 0)
+      return true;
+  } else {
+    q.by_sender = false;
+    q.from_ms = parse_clock_today(first);
+    q.to_ms = second.empty()
+                  ? static_cast<uint64_t>(std::time(nullptr)) * 1000
+                  : parse_clock_today(second) + 59999; // the whole minute
+    if (q.from_ms != 0 && q.to_ms >= q.from_ms)
+      return true;
+  }
+  error = "Usage: /history HH:MM [HH:MM]  or  /history @name [count]";
+  return false;
+}
+
 /**
  * @brief Run the client: connect to server, send/receive messages.
+ * @param connect_timeout_ms Deadline for each connection attempt.
  */
-static void run_client() {
+static void run_client(unsigned int connect_timeout_ms) {
   std::string username;
   std::cout << "\n"
             << ansi::CYAN << "[Client] Enter your username: " << ansi::RESET;
@@ -263,44 +1039,52 @@ static void run_client() {
     username = "Anonymous";
   }
 
-  std::string host;
-  std::cout << ansi::CYAN
-            << "[Client] Enter server IP address: " << ansi::RESET;
-  std::getline(std::cin, host);
+  // "IP[:PORT]", or several separated by commas to try them all at once
+  std::vector<std::string> entered;
+  std::string shown;
+  while (shown.empty()) {
+    std::string input;
+    std::cout << ansi::CYAN
+              << "[Client] Enter server IP address: " << ansi::RESET;
+    std::getline(std::cin, input);
 
-  if (host.empty()) {
-    std::cerr << ansi::RED << "No IP entered. Exiting.\n" << ansi::RESET;
-    return;
+    entered = split_list(input);
+    if (entered.empty()) {
+      std::cerr << ansi::RED << "No IP entered. Exiting.\n" << ansi::RESET;
+      return;
+    }
+    for (std::string &entry : entered) {
+      std::string host;
+      unsigned short port = DEFAULT_PORT;
+      if (!split_host_port(entry, host, port)) {
+        std::cerr << ansi::RED << "[Client] \"" << entry
+                  << "\" is not IP[:PORT] (port 1-65535). Try again.\n"
+                  << ansi::RESET;
+        shown.clear();
+        break;
+      }
+      entry = host + ":" + std::to_string(port);
+      shown += (shown.empty() ? "" : ", ") + entry;
+    }
   }
 
-  std::cout << ansi::CYAN << "[Client] Connecting to " << host << ":"
-            << DEFAULT_PORT << "...\n"
+  std::cout << ansi::CYAN << "[Client] Connecting to " << shown << "...\n"
             << ansi::RESET;
 
-  Client client;
-  SocketWrapper conn = client.connect_to(host, DEFAULT_PORT);
-
-  std::cout << ansi::GREEN << "[Client] Connected as \"" << username << "\"!\n"
+  // ── Version handshake on raw socket (before creating NetworkManager)
+  Client client(connect_timeout_ms);
+  SocketWrapper conn(INVALID_SOCKET);
+  std::string endpoint;
+  std::string server_response =
+      connect_hub(client, username, entered, endpoint, conn);
+
+  std::cout << ansi::GREEN << "[Client] Connected to " << endpoint << " as \""
+            << username << "\"!\n"
             << ansi::YELLOW << "  Type 'quit' or Ctrl+C to disconnect.\n"
             << ansi::RESET << "\n";
 
   ChatSession session;
 
-  // ── Version handshake on raw socket (before creating NetworkManager)
-  // Send username
-  conn.send_message(username);
-
-  // Send version
-  conn.send_message(std::string("CMD:VERSION:") + APP_VERSION);
-
-  // Read server response
-  std::string server_response;
-  try {
-    server_response = conn.receive_message();
-  } catch (...) {
-    server_response = "";
-  }
-
   if (server_response.substr(0, 11) == "CMD:UPDATE:") {
     // Server is sending us an updated exe
     std::cout << ansi::YELLOW
@@ -338,12 +1122,198 @@ static void run_client() {
   // ── Now hand socket to NetworkManager for normal chat
   NetworkManager nm(std::move(conn));
 
-  nm.set_on_message([&session](const std::string &text) {
+  // Where to go if the hub fails: updated by the leader's CMD:HUBS
+  Mutex hubs_mutex;
+  std::vector<std::string> hubs(1, endpoint);
+  for (const std::string &entry : entered) {
+    // The other hubs entered, or the hub that placed us on a relay
+    if (entry != endpoint)
+      hubs.push_back(entry);
+  }
+  std::string current = endpoint;
+  std::string moving_to; ///< Set by CMD:REDIRECT during a session
+  std::atomic<uint64_t> last_seq{0};
+  std::atomic<uint64_t> own_last{0}; ///< Our newest message, from CMD:ACK
+  SeqWindow seen; // receive thread only
+  // Thread replies arrive out of order (a whole thread on /follow), so
+  // they are deduplicated by number instead
+  std::set<uint64_t> seen_replies;  // receive thread only
+  std::set<uint64_t> following;     ///< Thread roots; under hubs_mutex
+  ClientQuery query;                ///< Last /history; under hubs_mutex
+
+  // Edits, deletes and reaction counts for messages already shown
+  auto print_note = [](const std::string &note, const char *colour) {
+    std::cout << ansi::CLEAR_LINE << colour << "  " << note << ansi::RESET
+              << "\n"
+              << ansi::GREEN << "You" << ansi::RESET << ": " << std::flush;
+  };
+
+  nm.set_on_message([&](const std::string &frame) {
+    std::string text = frame;
+    uint64_t ref = 0;
+    std::size_t ref_end = 0;
+    auto parse_ref = [&](std::size_t at) {
+      char *end = nullptr;
+      ref = std::strtoull(frame.c_str() + at, &end, 10);
+      ref_end = static_cast<std::size_t>(end - frame.c_str());
+      return ref_end < frame.size() ? frame.substr(ref_end + 1) : "";
+    };
+
+    if (frame.compare(0, 8, "CMD:ACK:") == 0) {
+      // Our own message got a number; everything before it has arrived
+      parse_ref(8);
+      own_last.store(ref);
+      if (ref > last_seq.load())
+        last_seq.store(ref);
+      return;
+    }
+    if (frame.compare(0, 9, "CMD:EDIT:") == 0) {
+      std::string edited = parse_ref(9);
+      print_note("#" + std::to_string(ref) + " edited: " + edited,
+                 ansi::MAGENTA);
+      return;
+    }
+    if (frame.compare(0, 11, "CMD:DELETE:") == 0) {
+      parse_ref(11);
+      print_note("#" + std::to_string(ref) + " deleted", ansi::YELLOW);
+      return;
+    }
+    if (frame.compare(0, 11, "CMD:REACTS:") == 0) {
+      // "<emoji>=<n>,..." → "<emoji> <n>  ..."
+      std::string counts;
+      for (const std::string &item : split_list(parse_ref(11))) {
+        std::size_t eq = item.rfind('=');
+        counts += "  " + item.substr(0, eq) + " " + item.substr(eq + 1);
+      }
+      print_note("#" + std::to_string(ref) +
+                     (counts.empty() ? " reactions cleared" : counts),
+                 ansi::CYAN);
+      return;
+    }
+    if (frame.compare(0, 11, "CMD:THREAD:") == 0) {
+      // A thread we do not follow grew
+      std::string count = parse_ref(11);
+      print_note("#" + std::to_string(ref) + " thread: " + count +
+                     (count == "1" ? " reply" : " replies"),
+                 ansi::CYAN);
+      return;
+    }
+    if (frame.compare(0, 9, "CMD:PONG:") == 0) {
+      uint64_t sent = std::strtoull(frame.c_str() + 9, nullptr, 10);
+      uint64_t us = (monotonic_ns() - sent) / 1000;
+      print_note("Round trip to the hub: " + std::to_string(us / 1000) + "." +
+                     std::to_string(us % 1000 / 100) + " ms",
+                 ansi::CYAN);
+      return;
+    }
+    if (frame.compare(0, 10, "CMD:ERROR:") == 0) {
+      print_note(frame.substr(10), ansi::RED);
+      return;
+    }
+    if (frame.compare(0, 11, "CMD:RESULT:") == 0) {
+      // "CMD:RESULT:<id>:<next>:<n>", then "<seq>:<hlc>:<parent>:<text>"
+      // lines
+      std::istringstream lines(frame);
+      std::string line;
+      std::getline(lines, line);
+      char *end = nullptr;
+      uint64_t id = std::strtoull(line.c_str() + 11, &end, 10);
+      uint64_t next = *end == ':' ? std::strtoull(end + 1, nullptr, 10) : 0;
+      std::size_t shown = 0;
+      bool by_sender = false;
+      {
+        LockGuard<Mutex> lock(hubs_mutex);
+        if (id != query.id)
+          return; // superseded by a newer /history
+        by_sender = query.by_sender;
+      }
+      std::cout << ansi::CLEAR_LINE;
+      while (std::getline(lines, line)) {
+        uint64_t seq = std::strtoull(line.c_str(), &end, 10);
+        uint64_t stamp = *end == ':' ? std::strtoull(end + 1, &end, 10) : 0;
+        uint64_t root = *end == ':' ? std::strtoull(end + 1, &end, 10) : 0;
+        if (*end != ':')
+          continue;
+        Message msg("", end + 1);
+        msg.timestamp = std::chrono::system_clock::time_point(
+            std::chrono::milliseconds(hlc_physical_ms(stamp)));
+        std::cout << ansi::CYAN << "  [" << msg.clock_time() << "] #" << seq
+                  << " " << ansi::RESET;
+        if (root != 0) {
+          std::cout << "(reply to #" << root << ") ";
+        }
+        std::cout << msg.content << "\n";
+        ++shown;
+      }
+      {
+        LockGuard<Mutex> lock(hubs_mutex);
+        query.next = next;
+        if (by_sender) {
+          query.remaining -= std::min(query.remaining, shown);
+        }
+      }
+      print_note(shown == 0 ? "No messages found"
+                 : next != 0 ? "/more for the next page"
+                             : "End of results",
+                 ansi::CYAN);
+      return;
+    }
+    if (frame.compare(0, 9, "CMD:HUBS:") == 0) {
+      LockGuard<Mutex> lock(hubs_mutex);
+      hubs = split_list(frame.substr(9));
+      return;
+    }
+    if (frame.compare(0, 13, "CMD:REDIRECT:") == 0) {
+      // Rebalancing: reconnect there and resume where we are
+      {
+        LockGuard<Mutex> lock(hubs_mutex);
+        moving_to = frame.substr(13);
+      }
+      nm.drop_connection();
+      return;
+    }
+    uint64_t hlc = 0;
+    ChatView chat;
+    if (ChatView::parse(frame.data(), frame.size(), chat)) {
+      // Drop what a failover replayed twice; thread replies arrive out of
+      // order, so they are deduplicated by number instead
+      uint64_t seq = chat.seq();
+      uint64_t root = chat.parent();
+      if (root == 0 ? !seen.accept(seq) : !seen_replies.insert(seq).second)
+        return;
+      if (seq > last_seq.load())
+        last_seq.store(seq);
+      hlc = chat.hlc();
+      text = "[" + chat.sender().str() + "]: " + chat.body().str();
+      if (root != 0) {
+        {
+          LockGuard<Mutex> lock(hubs_mutex);
+          following.insert(root);
+        }
+        text = "(reply to #" + std::to_string(root) + ") " + text;
+      }
+      if (chat.edited()) {
+        text += " (edited)";
+      }
+      ref = seq;
+    }
+
     // Normal chat message
     Message msg("", text);
+    if (hlc != 0) {
+      // Shown in hub time: our own clock may be off by seconds
+      msg.timestamp = std::chrono::system_clock::time_point(
+          std::chrono::milliseconds(hlc_physical_ms(hlc)));
+    }
     session.add(msg);
-    std::cout << ansi::CLEAR_LINE << ansi::MAGENTA << text << ansi::RESET
-              << "\n"
+    std::cout << ansi::CLEAR_LINE;
+    if (hlc != 0) {
+      std::cout << "[" << msg.clock_time() << "] ";
+    }
+    if (ref != 0) {
+      std::cout << "#" << ref << " "; // for /edit, /delete and /react
+    }
+    std::cout << ansi::MAGENTA << text << ansi::RESET << "\n"
               << ansi::GREEN << "You" << ansi::RESET << ": " << std::flush;
   });
 
@@ -354,6 +1324,82 @@ static void run_client() {
     g_shutdown.store(true);
   });
 
+  nm.set_reconnect([&](SocketWrapper &out, const std::atomic<bool> &running) {
+    std::string target;
+    {
+      LockGuard<Mutex> lock(hubs_mutex);
+      target.swap(moving_to);
+    }
+    if (target.empty()) {
+      std::cout << ansi::CLEAR_LINE << ansi::YELLOW
+                << "[Chat] Connection lost, looking for a hub...\n"
+                << ansi::RESET << std::flush;
+    }
+
+    uint64_t deadline = monotonic_ns() + FAILOVER_WINDOW_MS * 1000000ull;
+    while (running.load() && monotonic_ns() < deadline) {
+      std::vector<std::string> candidates;
+      std::string lost;
+      {
+        LockGuard<Mutex> lock(hubs_mutex);
+        candidates = hubs;
+        lost = current;
+      }
+      // The hub we just lost is the least likely to answer
+      std::stable_partition(
+          candidates.begin(), candidates.end(),
+          [&lost](const std::string &hub) { return hub != lost; });
+      if (!target.empty()) {
+        candidates.insert(candidates.begin(), target);
+        target.clear(); // only first in line on the first round
+      }
+
+      // Race them all; drop any that answers but will not take us
+      while (!candidates.empty() && running.load()) {
+        try {
+          std::string hub;
+          SocketWrapper sock(INVALID_SOCKET);
+          if (connect_hub(client, username, candidates, hub, sock) !=
+              "CMD:OK") {
+            auto end = std::remove(candidates.begin(), candidates.end(), hub);
+            if (end == candidates.end())
+              break; // a redirect target refused; start a new round
+            candidates.erase(end, candidates.end());
+            continue; // not the leader, or needs an update
+          }
+          if (last_seq.load() != 0) {
+            sock.send_message("CMD:RESUME:" +
+                              std::to_string(last_seq.load()));
+          }
+          {
+            // The new hub does not know which threads we follow
+            LockGuard<Mutex> lock(hubs_mutex);
+            for (uint64_t root : following) {
+              sock.send_message("CMD:FOLLOW:" + std::to_string(root));
+            }
+          }
+
+          {
+            LockGuard<Mutex> lock(hubs_mutex);
+            current = hub;
+          }
+          out = std::move(sock);
+          std::cout << ansi::CLEAR_LINE << ansi::GREEN << "[Chat] Reconnected to "
+                    << hub << "\n"
+                    << ansi::RESET << ansi::GREEN << "You" << ansi::RESET
+                    << ": " << std::flush;
+          return true;
+        } catch (const std::exception &) {
+          break; // none answered before the connect deadline
+        }
+      }
+      if (!running.load())
+        return false;
+      Sleep(100);
+    }
+    return false;
+  });
+
   nm.start();
 
   // Client chat loop
@@ -368,8 +1414,49 @@ static void run_client() {
     if (line.empty())
       continue;
 
-    Message msg("You", line);
-    session.add(msg);
+    std::string op, error;
+    if (line == "/ping") {
+      line = "CMD:PING:" + std::to_string(monotonic_ns());
+    } else if (line == "/more" || line.compare(0, 8, "/history") == 0) {
+      {
+        LockGuard<Mutex> lock(hubs_mutex);
+        if (line == "/more") {
+          if (query.next == 0) {
+            error = "Nothing more to show; start with /history";
+          } else {
+            op = query.frame(query.next);
+          }
+        } else {
+          ClientQuery next_query;
+          next_query.id = query.id + 1;
+          if (parse_history_command(line, next_query, error)) {
+            query = next_query;
+            op = query.frame(0);
+          }
+        }
+      }
+      if (!error.empty()) {
+        std::cout << ansi::RED << "  " << error << ansi::RESET << "\n";
+        continue;
+      }
+      line = op;
+    } else if (parse_client_op(line, own_last.load(), op, error)) {
+      if (!error.empty()) {
+        std::cout << ansi::RED << "  " << error << ansi::RESET << "\n";
+        continue;
+      }
+      line = op;
+      if (op.compare(0, 11, "CMD:FOLLOW:") == 0) {
+        LockGuard<Mutex> lock(hubs_mutex);
+        following.insert(std::strtoull(op.c_str() + 11, nullptr, 10));
+      } else if (op.compare(0, 13, "CMD:UNFOLLOW:") == 0) {
+        LockGuard<Mutex> lock(hubs_mutex);
+        following.erase(std::strtoull(op.c_str() + 13, nullptr, 10));
+      }
+    } else {
+      Message msg("You", line);
+      session.add(msg);
+    }
 
     try {
       nm.send(line);
@@ -392,10 +1479,21 @@ static void run_client() {
 // ── Main
 // ──────────────────────────────────────────────────────────────────────
 
-int main() {
+int main(int argc, char *argv[]) {
   enable_ansi_console();
   print_banner();
 
+  ServerOptions opts;
+  try {
+    opts = parse_options(std::vector<std::string>(argv + 1, argv + argc));
+  } catch (const std::exception &e) {
+    std::cerr << ansi::RED << "[Options] " << e.what() << ansi::RESET << "\n";
+    return 1;
+  }
+
+  if (!opts.export_to.empty())
+    return run_export(opts);
+
   std::signal(SIGINT, signal_handler);
 
   // Mode selection
@@ -412,9 +1510,9 @@ int main() {
 
   try {
     if (mode == 'S') {
-      run_server();
+      run_server(opts);
     } else {
-      run_client();
+      run_client(opts.connect_timeout_ms);
     }
   } catch (const std::exception &e) {
     std::cerr << ansi::RED << "[Fatal] " << e.what() << ansi::RESET << "\n";
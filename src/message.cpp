@@ -19,7 +19,7 @@ Message::Message(std::string sender, std::string content)
 // ── Formatting
 // ────────────────────────────────────────────────────────────────
 
-std::string Message::format() const {
+std::string Message::clock_time() const {
   // Convert timestamp to local time
   std::time_t t = std::chrono::system_clock::to_time_t(timestamp);
   std::tm local_tm{};
@@ -30,9 +30,12 @@ std::string Message::format() const {
     local_tm = *tmp;
 
   std::ostringstream oss;
-  oss << "[" << std::setw(2) << std::setfill('0') << local_tm.tm_hour << ":"
+  oss << std::setw(2) << std::setfill('0') << local_tm.tm_hour << ":"
       << std::setw(2) << std::setfill('0') << local_tm.tm_min << ":"
-      << std::setw(2) << std::setfill('0') << local_tm.tm_sec << "] " << sender
-      << ": " << content;
+      << std::setw(2) << std::setfill('0') << local_tm.tm_sec;
   return oss.str();
 }
+
+std::string Message::format() const {
+  return "[" + clock_time() + "] " + sender + ": " + content;
+}
@@ -0,0 +1,226 @@
+/**
+ * @file message_ops.cpp
+ * @brief Implementation of MessageOps – edits, deletes and reactions.
+ */
+
+#include "message_ops.h"
+
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const std::string EDIT_PREFIX = "CMD:EDIT:";
+const std::string DELETE_PREFIX = "CMD:DELETE:";
+const std::string REACT_PREFIX = "CMD:REACT:";
+
+/// Background thread granularity.
+constexpr unsigned TICK_MS = 50;
+
+bool starts_with(const std::string &text, const std::string &prefix) {
+  return text.compare(0, prefix.size(), prefix) == 0;
+}
+
+/// Parse "<seq>[:<rest>]" after @p prefix. @return false if malformed.
+bool parse_op(const std::string &message, const std::string &prefix,
+              uint64_t &seq, std::string &rest) {
+  const char *begin = message.c_str() + prefix.size();
+  char *end = nullptr;
+  seq = std::strtoull(begin, &end, 10);
+  if (end == begin || seq == 0)
+    return false;
+  rest.clear();
+  if (*end == ':') {
+    rest.assign(end + 1);
+  } else if (*end != '\0') {
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+// ── Construction / Destruction
+// ────────────────────────────────────────────────
+
+MessageOps::MessageOps(Room &room) : room_(room) {}
+
+MessageOps::~MessageOps() { stop(); }
+
+// ── Lifecycle
+// ─────────────────────────────────────────────────────────────────
+
+void MessageOps::start() {
+  if (running_.exchange(true))
+    return;
+  room_.set_op_handler([this](uint32_t sender_id, uint64_t author,
+                              const std::string &,
+                              const std::string &message) {
+    return handle(sender_id, author, message);
+  });
+  thread_ = Thread(&MessageOps::run, this);
+}
+
+void MessageOps::stop() {
+  if (!running_.exchange(false))
+    return;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  room_.set_op_handler(nullptr);
+}
+
+// ── Update frames
+// ─────────────────────────────────────────────────────────────
+
+std::string MessageOps::edit_frame(uint64_t seq, const std::string &text) {
+  return EDIT_PREFIX + std::to_string(seq) + ":" + text;
+}
+
+std::string MessageOps::delete_frame(uint64_t seq) {
+  return DELETE_PREFIX + std::to_string(seq);
+}
+
+bool MessageOps::apply_update(HubLog &log, const std::string &frame,
+                              uint64_t &seq) {
+  std::string arg;
+  if (starts_with(frame, EDIT_PREFIX)) {
+    if (parse_op(frame, EDIT_PREFIX, seq, arg))
+      return log.edit(seq, HubLog::ANY_AUTHOR, arg);
+  } else if (starts_with(frame, DELETE_PREFIX)) {
+    if (parse_op(frame, DELETE_PREFIX, seq, arg))
+      return log.erase(seq, HubLog::ANY_AUTHOR);
+  }
+  seq = 0;
+  return false;
+}
+
+// ── Ops
+// ───────────────────────────────────────────────────────────────────────
+
+bool MessageOps::handle(uint32_t sender_id, uint64_t author,
+                        const std::string &message) {
+  uint64_t seq = 0;
+  std::string arg;
+
+  if (starts_with(message, EDIT_PREFIX)) {
+    if (!parse_op(message, EDIT_PREFIX, seq, arg) || arg.empty()) {
+      room_.send_to(sender_id, "CMD:ERROR:usage: /edit #id new text");
+    } else if (!room_.log().edit(seq, author, arg)) {
+      room_.send_to(sender_id, "CMD:ERROR:cannot edit #" +
+                                   std::to_string(seq) +
+                                   " (not yours, deleted or too old)");
+    } else {
+      room_.send_update(edit_frame(seq, arg), seq);
+    }
+    return true;
+  }
+
+  if (starts_with(message, DELETE_PREFIX)) {
+    if (!parse_op(message, DELETE_PREFIX, seq, arg)) {
+      room_.send_to(sender_id, "CMD:ERROR:usage: /delete #id");
+    } else if (!room_.log().erase(seq, author)) {
+      room_.send_to(sender_id, "CMD:ERROR:cannot delete #" +
+                                   std::to_string(seq) +
+                                   " (not yours, deleted or too old)");
+    } else {
+      {
+        LockGuard<Mutex> lock(mutex_);
+        reactions_.erase(seq);
+        dirty_.erase(seq);
+      }
+      room_.send_update(delete_frame(seq), seq);
+    }
+    return true;
+  }
+
+  if (starts_with(message, REACT_PREFIX)) {
+    if (!parse_op(message, REACT_PREFIX, seq, arg) || arg.empty() ||
+        arg.size() > MAX_REACTION_BYTES ||
+        arg.find_first_of(":,= ") != std::string::npos) {
+      room_.send_to(sender_id, "CMD:ERROR:usage: /react #id emoji");
+    } else if (!react(seq, author, arg)) {
+      room_.send_to(sender_id, "CMD:ERROR:no message #" +
+                                   std::to_string(seq));
+    }
+    return true;
+  }
+
+  return false;
+}
+
+bool MessageOps::react(uint64_t seq, uint64_t author,
+                       const std::string &emoji) {
+  HubLog &log = room_.log();
+  if (seq < log.first_seq() || seq > log.last_seq())
+    return false;
+
+  LockGuard<Mutex> lock(mutex_);
+  std::set<uint64_t> &who = reactions_[seq][emoji];
+  if (!who.insert(author).second) {
+    who.erase(author); // second time takes it back
+  }
+  dirty_.insert(seq);
+  return true;
+}
+
+// ── Background work
+// ───────────────────────────────────────────────────────────
+
+void MessageOps::flush_reactions() {
+  std::vector<std::pair<uint64_t, std::string>> updates;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    for (uint64_t seq : dirty_) {
+      auto it = reactions_.find(seq);
+      if (it == reactions_.end())
+        continue;
+      std::string frame = "CMD:REACTS:" + std::to_string(seq) + ":";
+      bool first = true;
+      for (auto r = it->second.begin(); r != it->second.end();) {
+        if (r->second.empty()) {
+          r = it->second.erase(r);
+          continue;
+        }
+        frame += (first ? "" : ",") + r->first + "=" +
+                 std::to_string(r->second.size());
+        first = false;
+        ++r;
+      }
+      updates.emplace_back(seq, frame); // all taken back: an empty list
+      if (it->second.empty())
+        reactions_.erase(it);
+    }
+    dirty_.clear();
+
+    // Forget counts for messages that have left the log
+    uint64_t oldest = room_.log().first_seq();
+    while (!reactions_.empty() && reactions_.begin()->first < oldest) {
+      reactions_.erase(reactions_.begin());
+    }
+  }
+
+  for (const auto &update : updates) {
+    room_.send_update(update.second, update.first);
+  }
+}
+
+void MessageOps::run() {
+  unsigned since_compact = 0;
+  unsigned since_flush = 0;
+  while (running_.load()) {
+    Sleep(TICK_MS);
+    since_flush += TICK_MS;
+    since_compact += TICK_MS;
+    if (since_flush >= REACT_FLUSH_MS) {
+      since_flush = 0;
+      flush_reactions();
+    }
+    if (since_compact >= COMPACT_MS) {
+      since_compact = 0;
+      room_.log().compact();
+    }
+  }
+  flush_reactions();
+}
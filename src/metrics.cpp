@@ -0,0 +1,189 @@
+/**
+ * @file metrics.cpp
+ * @brief Implementation of LatencyHistogram and HubMetrics.
+ */
+
+#include "metrics.h"
+
+#include <iomanip>
+#include <sstream>
+
+// ── LatencyHistogram
+// ──────────────────────────────────────────────────────────
+
+LatencyHistogram::LatencyHistogram() { reset(); }
+
+int LatencyHistogram::bucket_of(uint64_t ns) {
+  if (ns < (1u << SUB_BITS)) {
+    return static_cast<int>(ns); // small values map 1:1
+  }
+  int msb = 63;
+  while ((ns >> msb) == 0) {
+    --msb;
+  }
+  // Top SUB_BITS bits below the leading one select the sub-bucket
+  int sub = static_cast<int>((ns >> (msb - SUB_BITS)) & ((1u << SUB_BITS) - 1));
+  return ((msb - SUB_BITS + 1) << SUB_BITS) + sub;
+}
+
+uint64_t LatencyHistogram::bucket_upper(int index) {
+  if (index < (1 << SUB_BITS)) {
+    return static_cast<uint64_t>(index);
+  }
+  int msb = (index >> SUB_BITS) + SUB_BITS - 1;
+  uint64_t sub = static_cast<uint64_t>(index & ((1 << SUB_BITS) - 1));
+  uint64_t base = (uint64_t{1} << msb) | (sub << (msb - SUB_BITS));
+  return base + (uint64_t{1} << (msb - SUB_BITS)) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+  buckets_[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+
+  uint64_t prev = max_.load(std::memory_order_relaxed);
+  while (ns > prev &&
+         !max_.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {
+  }
+}
+
+uint64_t LatencyHistogram::percentile_ns(double p) const {
+  uint64_t total = count();
+  if (total == 0) {
+    return 0;
+  }
+  auto rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(total));
+  if (rank >= total) {
+    rank = total - 1;
+  }
+
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKETS; ++i) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen > rank) {
+      uint64_t upper = bucket_upper(i);
+      uint64_t max = max_.load(std::memory_order_relaxed);
+      return upper < max ? upper : max;
+    }
+  }
+  return max_.load(std::memory_order_relaxed);
+}
+
+std::string LatencyHistogram::summary() const {
+  auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(1) << "n=" << count()
+      << "  p50=" << us(percentile_ns(50.0))
+      << "us  p99=" << us(percentile_ns(99.0))
+      << "us  p99.9=" << us(percentile_ns(99.9))
+      << "us  max=" << us(max_.load(std::memory_order_relaxed)) << "us";
+  return oss.str();
+}
+
+void LatencyHistogram::reset() {
+  for (auto &b : buckets_) {
+    b.store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+// ── HubMetrics
+// ────────────────────────────────────────────────────────────────
+
+HubMetrics &HubMetrics::instance() {
+  static HubMetrics metrics;
+  return metrics;
+}
+
+std::string HubMetrics::report() const {
+  std::ostringstream oss;
+  oss << "  frames in:   " << frames_in.load(std::memory_order_relaxed) << "\n"
+      << "  frames out:  " << frames_out.load(std::memory_order_relaxed)
+      << "\n"
+      << "  egress:      " << bytes_out.load(std::memory_order_relaxed) / 1024
+      << " KB\n"
+      << "  hub latency: " << hub_latency.summary() << "\n";
+  if (fed_in.load(std::memory_order_relaxed) != 0 ||
+      fed_out.load(std::memory_order_relaxed) != 0) {
+    oss << "  fed in:      " << fed_in.load(std::memory_order_relaxed)
+        << " (+" << fed_duplicates.load(std::memory_order_relaxed)
+        << " duplicates, " << fed_skipped.load(std::memory_order_relaxed)
+        << " skipped)\n"
+        << "  fed out:     " << fed_out.load(std::memory_order_relaxed)
+        << "\n"
+        << "  fed latency: " << fed_latency.summary() << "\n";
+  }
+  if (relay_frames_out.load(std::memory_order_relaxed) != 0) {
+    oss << "  relay out:   " << relay_frames_out.load(std::memory_order_relaxed)
+        << "\n"
+        << "  relay hop:   " << relay_hop.summary() << "\n"
+        << "  relay fan:   " << relay_fanout.summary() << "\n";
+  }
+  if (seq_wait.count() != 0) {
+    oss << "  seq wait:    " << seq_wait.summary() << "\n";
+  }
+  if (history_sync.count() != 0) {
+    oss << "  history:     " << history_sync.summary() << "\n";
+  }
+  uint64_t archived = archive_raw_bytes.load(std::memory_order_relaxed);
+  if (archived != 0) {
+    uint64_t packed = archive_bytes.load(std::memory_order_relaxed);
+    oss << "  archive:     "
+        << archive_segments.load(std::memory_order_relaxed) << " segments, "
+        << archived / 1024 << " KB -> " << packed / 1024 << " KB ("
+        << packed * 100 / archived << "%)\n";
+  }
+  if (archive_seek.count() != 0) {
+    oss << "  arc seek:    " << archive_seek.summary() << "\n";
+  }
+  if (history_query.count() != 0) {
+    oss << "  query:       " << history_query.summary() << "\n";
+  }
+  if (io_threads.load(std::memory_order_relaxed) != 0) {
+    oss << "  io threads:  " << io_threads.load(std::memory_order_relaxed)
+        << " awake, " << io_busy_pct.load(std::memory_order_relaxed)
+        << "% busy (" << io_scale_ups.load(std::memory_order_relaxed)
+        << " woken, " << io_scale_downs.load(std::memory_order_relaxed)
+        << " parked)\n";
+  }
+  uint64_t denied = conn_denied.load(std::memory_order_relaxed);
+  uint64_t limited = conn_limited.load(std::memory_order_relaxed);
+  if (denied != 0 || limited != 0) {
+    oss << "  refused:     " << denied << " by address lists, " << limited
+        << " over the connection rate\n";
+  }
+  if (dup_suppressed.load(std::memory_order_relaxed) != 0) {
+    oss << "  repeats:     "
+        << dup_suppressed.load(std::memory_order_relaxed)
+        << " lines dropped\n";
+  }
+  return oss.str();
+}
+
+void HubMetrics::reset() {
+  hub_latency.reset();
+  frames_in.store(0, std::memory_order_relaxed);
+  frames_out.store(0, std::memory_order_relaxed);
+  fed_latency.reset();
+  fed_in.store(0, std::memory_order_relaxed);
+  fed_out.store(0, std::memory_order_relaxed);
+  fed_duplicates.store(0, std::memory_order_relaxed);
+  fed_skipped.store(0, std::memory_order_relaxed);
+  bytes_out.store(0, std::memory_order_relaxed);
+  relay_hop.reset();
+  relay_fanout.reset();
+  relay_frames_out.store(0, std::memory_order_relaxed);
+  seq_wait.reset();
+  history_sync.reset();
+  archive_seek.reset();
+  archive_segments.store(0, std::memory_order_relaxed);
+  archive_raw_bytes.store(0, std::memory_order_relaxed);
+  archive_bytes.store(0, std::memory_order_relaxed);
+  history_query.reset();
+  io_scale_ups.store(0, std::memory_order_relaxed);
+  io_scale_downs.store(0, std::memory_order_relaxed);
+  conn_denied.store(0, std::memory_order_relaxed);
+  conn_limited.store(0, std::memory_order_relaxed);
+  dup_suppressed.store(0, std::memory_order_relaxed);
+}
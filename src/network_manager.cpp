@@ -26,6 +26,10 @@ void NetworkManager::set_on_disconnect(std::function<void()> cb) {
   on_disconnect_ = std::move(cb);
 }
 
+void NetworkManager::set_reconnect(ReconnectCallback cb) {
+  reconnect_ = std::move(cb);
+}
+
 // ── Lifecycle
 // ─────────────────────────────────────────────────────────────────
 
@@ -40,7 +44,11 @@ void NetworkManager::stop() {
   if (!running_.load())
     return;
   running_.store(false);
-  socket_.close(); // unblocks recv_all in the receive thread
+  {
+    // Locked: the receive thread may be swapping in a new socket
+    LockGuard<Mutex> lock(send_mutex_);
+    socket_.close(); // unblocks recv_all in the receive thread
+  }
   if (recv_thread_.joinable()) {
     recv_thread_.join();
   }
@@ -51,9 +59,28 @@ void NetworkManager::stop() {
 
 void NetworkManager::send(const std::string &message) {
   LockGuard<Mutex> lock(send_mutex_);
-  if (socket_.is_valid()) {
-    socket_.send_message(message);
+  if (!reconnect_) {
+    if (socket_.is_valid()) {
+      socket_.send_message(message);
+    }
+    return;
   }
+
+  // Keep order: nothing overtakes messages held during a reconnect
+  if (held_.empty() && socket_.is_valid()) {
+    try {
+      socket_.send_message(message);
+      return;
+    } catch (const std::exception &) {
+      socket_.close(); // the receive thread notices and reconnects
+    }
+  }
+  held_.push_back(message);
+}
+
+void NetworkManager::drop_connection() {
+  LockGuard<Mutex> lock(send_mutex_);
+  socket_.close();
 }
 
 // ── Private: receive loop
@@ -66,11 +93,14 @@ void NetworkManager::receive_loop() {
       msg = socket_.receive_message();
     } catch (...) {
       // Socket error – treat as disconnect
-      break;
+      msg.clear();
     }
 
     if (msg.empty()) {
-      // Peer disconnected gracefully
+      // Peer disconnected (or failed); try to carry on elsewhere
+      if (running_.load() && reconnect_ && reconnect()) {
+        continue;
+      }
       break;
     }
 
@@ -85,3 +115,32 @@ void NetworkManager::receive_loop() {
     on_disconnect_();
   }
 }
+
+bool NetworkManager::reconnect() {
+  {
+    LockGuard<Mutex> lock(send_mutex_);
+    socket_.close();
+  }
+
+  SocketWrapper fresh(INVALID_SOCKET);
+  if (!reconnect_(fresh, running_)) {
+    return false;
+  }
+
+  LockGuard<Mutex> lock(send_mutex_);
+  socket_ = std::move(fresh);
+  if (!running_.load()) {
+    socket_.close(); // stop() ran while we were connecting
+    return false;
+  }
+  while (!held_.empty()) {
+    try {
+      socket_.send_message(held_.front());
+    } catch (const std::exception &) {
+      socket_.close(); // next receive fails and reconnects again
+      break;
+    }
+    held_.pop_front();
+  }
+  return true;
+}
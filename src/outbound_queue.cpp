@@ -0,0 +1,359 @@
+/**
+ * @file outbound_queue.cpp
+ * @brief Implementation of OutboundQueue – priority lanes, budgeted memory,
+ *        spill files.
+ */
+
+#include "outbound_queue.h"
+
+#include "history_record.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <deque>
+#include <memory>
+#include <string>
+
+namespace {
+
+std::atomic<uint64_t> g_memory{0};     ///< Bytes in memory, all queues
+std::atomic<uint64_t> g_spilled{0};    ///< Bytes in spill files, all queues
+std::atomic<uint64_t> g_backlogged{0}; ///< Queues holding anything
+
+/// Round-robin weights, indexed by SendClass (Control is strict priority).
+constexpr int64_t WEIGHT[SEND_CLASSES] = {0, 8, 2, 1};
+
+constexpr std::size_t CONTROL = static_cast<std::size_t>(SendClass::Control);
+
+/// Create a spill file. @return INVALID_HANDLE_VALUE if it cannot be.
+HANDLE open_spill_file() {
+  char dir[MAX_PATH];
+  char path[MAX_PATH];
+  DWORD len = GetTempPathA(MAX_PATH, dir);
+  if (len == 0 || len > MAX_PATH ||
+      GetTempFileNameA(dir, "lcq", 0, path) == 0)
+    return INVALID_HANDLE_VALUE;
+  HANDLE file = CreateFileA(
+      path, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+      FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    std::cerr << "[Queue] Cannot create a spill file in " << dir
+              << " (error " << GetLastError() << ")\n";
+    DeleteFileA(path);
+  }
+  return file;
+}
+
+/// The hub-wide spill thread's work list.
+struct SpillState {
+  Mutex mutex;
+  CondVar cv;                       ///< Work queued, or a queue let go
+  std::deque<OutboundQueue *> due;  ///< Queues waiting to be spilled
+  OutboundQueue *busy = nullptr;    ///< Queue being spilled
+  Thread thread;                    ///< Started on the first spill
+};
+
+SpillState &spill_state() {
+  // Never destroyed: the thread may still be running at exit
+  static SpillState *state = new SpillState;
+  return *state;
+}
+
+} // namespace
+
+// ── Construction / Destruction
+// ────────────────────────────────────────────────
+
+OutboundQueue::OutboundQueue(uint64_t budget) : budget_(budget) {
+  lanes_[turn_].deficit = WEIGHT[turn_] * QUANTUM;
+}
+
+OutboundQueue::~OutboundQueue() {
+  {
+    // Off the spill thread's list, and out of its hands
+    SpillState &state = spill_state();
+    LockGuard<Mutex> lock(state.mutex);
+    state.due.erase(std::remove(state.due.begin(), state.due.end(), this),
+                    state.due.end());
+    while (state.busy == this) {
+      state.cv.wait_for(state.mutex, INFINITE);
+    }
+  }
+  clear();
+  for (Lane &lane : lanes_) {
+    if (lane.file != INVALID_HANDLE_VALUE) {
+      CloseHandle(lane.file); // FILE_FLAG_DELETE_ON_CLOSE removes it
+    }
+  }
+}
+
+// ── Public API
+// ────────────────────────────────────────────────────────────────
+
+void OutboundQueue::push(const SharedFrame &frame, SendClass cls) {
+  LockGuard<Mutex> lock(mutex_);
+  Lane &lane = lanes_[static_cast<std::size_t>(cls)];
+  lane.frames.push_back(frame);
+  lane.bytes += frame->size();
+  bytes_ += frame->size();
+  uint64_t total = g_memory.fetch_add(frame->size()) + frame->size();
+  update_backlogged();
+
+  // Over budget: the queues over their fair share make room, down to half
+  // of it so that they do not spill again on the very next frame
+  if (budget_ != 0 && total > budget_ && !spill_failed_) {
+    uint64_t share = budget_ / std::max<uint64_t>(g_backlogged.load(), 1);
+    if (bytes_ > share) {
+      keep_ = share / 2;
+      schedule_spill();
+    }
+  }
+}
+
+bool OutboundQueue::take(std::vector<SharedFrame> &batch, std::size_t max) {
+  LockGuard<Mutex> lock(mutex_);
+  bool ok = true;
+  if (!lanes_[CONTROL].frames.empty()) {
+    // Strict priority, and on its own so that it completes quickly
+    take_from(lanes_[CONTROL], batch, max);
+  } else if (!empty()) {
+    // Deficit round robin over the weighted lanes; every move credits the
+    // lane moved to, so one in debt is served again within a few rounds
+    for (;;) {
+      Lane &lane = lanes_[turn_];
+      if (lane.empty()) {
+        lane.deficit = 0; // no credit saved up while idle
+        next_turn();
+        continue;
+      }
+      if (lane.deficit <= 0) {
+        next_turn();
+        continue;
+      }
+      std::size_t before = batch.size();
+      std::size_t sent = take_from(lane, batch, max);
+      ok = batch.size() > before;
+      lane.deficit -= static_cast<int64_t>(sent);
+      if (lane.deficit <= 0 || lane.empty()) {
+        next_turn();
+      }
+      break;
+    }
+  }
+  if (!ok) {
+    clear();
+  }
+  update_backlogged();
+  return ok;
+}
+
+bool OutboundQueue::empty() const {
+  LockGuard<Mutex> lock(mutex_);
+  for (const Lane &lane : lanes_) {
+    if (!lane.empty())
+      return false;
+  }
+  return true;
+}
+
+void OutboundQueue::clear() {
+  LockGuard<Mutex> lock(mutex_);
+  for (Lane &lane : lanes_) {
+    clear_lane(lane);
+  }
+  update_backlogged();
+}
+
+uint64_t OutboundQueue::memory_bytes() { return g_memory.load(); }
+
+uint64_t OutboundQueue::spilled_bytes() { return g_spilled.load(); }
+
+// ── Private
+// ───────────────────────────────────────────────────────────────────
+
+std::size_t OutboundQueue::take_from(Lane &lane,
+                                     std::vector<SharedFrame> &batch,
+                                     std::size_t max) {
+  if (!lane.segments.empty()) {
+    // The spill file holds the lane's oldest frames: they go first
+    std::size_t len = lane.segments.front();
+    auto chunk = std::make_shared<std::string>(len, '\0');
+    LockGuard<Mutex> file_lock(file_mutex_);
+    if (!history::seek(lane.file, lane.read_at) ||
+        !history::read_all(lane.file, &(*chunk)[0], len)) {
+      std::cerr << "[Queue] Cannot read spilled frames back (error "
+                << GetLastError() << ")\n";
+      return 0;
+    }
+    lane.segments.pop_front();
+    lane.read_at += len;
+    g_spilled.fetch_sub(len);
+    if (lane.segments.empty() && !lane.writing) {
+      // Drained: start the file over rather than let it grow
+      lane.read_at = lane.write_at = 0;
+      if (history::seek(lane.file, 0)) {
+        SetEndOfFile(lane.file);
+      }
+    }
+    batch.push_back(std::move(chunk));
+    return len;
+  }
+  if (!lane.cut.empty()) {
+    // Its turn came before the spill thread wrote it: send it from memory
+    lane.frames.insert(lane.frames.begin(), lane.cut.begin(), lane.cut.end());
+    lane.cut.clear();
+    ++lane.cuts;
+  }
+
+  std::size_t taken = 0;
+  while (!lane.frames.empty() && batch.size() < max &&
+         (taken == 0 ||
+          taken + lane.frames.front()->size() <= MAX_BATCH_BYTES)) {
+    taken += lane.frames.front()->size();
+    batch.push_back(std::move(lane.frames.front()));
+    lane.frames.pop_front();
+  }
+  lane.bytes -= taken;
+  bytes_ -= taken;
+  g_memory.fetch_sub(taken);
+  return taken;
+}
+
+void OutboundQueue::next_turn() {
+  turn_ = turn_ + 1 < SEND_CLASSES ? turn_ + 1 : CONTROL + 1;
+  Lane &lane = lanes_[turn_];
+  lane.deficit = std::min(lane.deficit + WEIGHT[turn_] * QUANTUM,
+                          WEIGHT[turn_] * QUANTUM);
+}
+
+void OutboundQueue::schedule_spill() {
+  if (spill_due_)
+    return;
+  spill_due_ = true;
+  SpillState &state = spill_state();
+  LockGuard<Mutex> lock(state.mutex);
+  if (!state.thread.joinable()) {
+    state.thread = Thread(&OutboundQueue::spill_main);
+  }
+  state.due.push_back(this);
+  state.cv.notify_all();
+}
+
+void OutboundQueue::spill() {
+  LockGuard<Mutex> lock(mutex_);
+  while (bytes_ > keep_ && !spill_failed_) {
+    // Lowest classes first; control frames always stay in memory
+    Lane *lane = nullptr;
+    for (std::size_t i = SEND_CLASSES - 1; i > CONTROL; --i) {
+      if (!lanes_[i].frames.empty()) {
+        lane = &lanes_[i];
+        break;
+      }
+    }
+    if (!lane)
+      break;
+
+    // A segment of whole frames, so that take() never splits one
+    std::size_t len = 0;
+    while (!lane->frames.empty() && bytes_ - len > keep_ &&
+           (len == 0 ||
+            len + lane->frames.front()->size() <= SPILL_CHUNK)) {
+      len += lane->frames.front()->size();
+      lane->cut.push_back(std::move(lane->frames.front()));
+      lane->frames.pop_front();
+    }
+    std::vector<SharedFrame> frames(lane->cut.begin(), lane->cut.end());
+    uint32_t cuts = lane->cuts;
+    uint64_t at = lane->write_at;
+    lane->writing = true;
+
+    // Write without the lock, so that broadcasts keep queueing meanwhile
+    mutex_.unlock();
+    std::string out;
+    out.reserve(len);
+    for (const SharedFrame &frame : frames) {
+      out.append(*frame);
+    }
+    bool ok = write_segment(*lane, at, out);
+    DWORD error = ok ? 0 : GetLastError();
+    mutex_.lock();
+
+    lane->writing = false;
+    if (lane->cuts != cuts)
+      continue; // sent or dropped meanwhile: what was written is unused
+    if (!ok) {
+      // Disk full: keep the frames in memory, in order
+      std::cerr << "[Queue] Cannot spill to disk (error " << error
+                << "); keeping frames in memory\n";
+      lane->frames.insert(lane->frames.begin(), lane->cut.begin(),
+                          lane->cut.end());
+      lane->cut.clear();
+      spill_failed_ = true;
+      break;
+    }
+    lane->cut.clear();
+    lane->segments.push_back(static_cast<uint32_t>(len));
+    lane->write_at += len;
+    lane->bytes -= len;
+    bytes_ -= len;
+    g_memory.fetch_sub(len);
+    g_spilled.fetch_add(len);
+  }
+  spill_due_ = false;
+}
+
+bool OutboundQueue::write_segment(Lane &lane, uint64_t at,
+                                  const std::string &data) {
+  LockGuard<Mutex> lock(file_mutex_);
+  if (lane.file == INVALID_HANDLE_VALUE) {
+    lane.file = open_spill_file();
+    if (lane.file == INVALID_HANDLE_VALUE)
+      return false;
+  }
+  return history::seek(lane.file, at) &&
+         history::write_all(lane.file, data.data(), data.size());
+}
+
+void OutboundQueue::spill_main() {
+  SpillState &state = spill_state();
+  LockGuard<Mutex> lock(state.mutex);
+  for (;;) {
+    if (state.due.empty()) {
+      state.cv.wait_for(state.mutex, INFINITE);
+      continue;
+    }
+    OutboundQueue *queue = state.due.front();
+    state.due.pop_front();
+    state.busy = queue; // its destructor waits until we let go
+    state.mutex.unlock();
+    queue->spill();
+    state.mutex.lock();
+    state.busy = nullptr;
+    state.cv.notify_all();
+  }
+}
+
+void OutboundQueue::clear_lane(Lane &lane) {
+  lane.frames.clear();
+  lane.cut.clear();
+  ++lane.cuts; // a write in progress is dropped
+  g_memory.fetch_sub(lane.bytes);
+  bytes_ -= lane.bytes;
+  lane.bytes = 0;
+  g_spilled.fetch_sub(lane.write_at - lane.read_at);
+  lane.segments.clear();
+  lane.read_at = lane.write_at = 0;
+}
+
+void OutboundQueue::update_backlogged() {
+  bool now = !empty();
+  if (now != backlogged_) {
+    backlogged_ = now;
+    if (now) {
+      g_backlogged.fetch_add(1);
+    } else {
+      g_backlogged.fetch_sub(1);
+    }
+  }
+}
@@ -0,0 +1,240 @@
+/**
+ * @file relay_node.cpp
+ * @brief Implementation of RelayNode – relay side of the relay tree.
+ */
+
+#include "relay_node.h"
+
+#include "relay_tree.h"
+#include "wire.h"
+
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+/// Delay before redialing a hub that dropped or refused the link.
+constexpr int REDIAL_MS = 1000;
+constexpr int TICK_MS = 100;
+
+SharedFrame encode(const WireWriter &w) {
+  const std::string &wire = w.data();
+  return SocketWrapper::encode_frame(wire.data(),
+                                     static_cast<uint32_t>(wire.size()));
+}
+
+} // namespace
+
+// ── Construction / Destruction
+// ────────────────────────────────────────────────
+
+RelayNode::RelayNode(Room &room, const RelayNodeOptions &options)
+    : room_(room), options_(options) {}
+
+RelayNode::~RelayNode() { stop(); }
+
+// ── Lifecycle
+// ─────────────────────────────────────────────────────────────────
+
+void RelayNode::start() {
+  if (running_.load())
+    return;
+  running_.store(true);
+
+  room_.set_upstream([this](uint32_t sender_id, const std::string &sender,
+                            const std::string &text) {
+    WireWriter w;
+    w.put_u8(relay::UP);
+    w.put_u32(sender_id);
+    w.put_str(sender);
+    w.put_str(text);
+    if (!send_up(encode(w))) {
+      std::cout << "\033[2K\r" << "[Relay] Hub unreachable; message from "
+                << sender << " dropped\n"
+                << "You: " << std::flush;
+    }
+  });
+
+  link_thread_ = Thread(&RelayNode::link_loop, this);
+  load_thread_ = Thread(&RelayNode::load_loop, this);
+}
+
+void RelayNode::stop() {
+  if (!running_.exchange(false))
+    return;
+
+  {
+    LockGuard<Mutex> lock(mutex_);
+    if (link_) {
+      link_->close();
+    }
+  }
+  if (link_thread_.joinable()) {
+    link_thread_.join();
+  }
+  if (load_thread_.joinable()) {
+    load_thread_.join();
+  }
+}
+
+// ── Hub link
+// ──────────────────────────────────────────────────────────────────
+
+void RelayNode::link_loop() {
+  std::size_t colon = options_.upstream.rfind(':');
+  std::string host = options_.upstream.substr(0, colon);
+  unsigned short port =
+      colon == std::string::npos
+          ? DEFAULT_PORT
+          : static_cast<unsigned short>(
+                std::stoi(options_.upstream.substr(colon + 1)));
+
+  while (running_.load()) {
+    try {
+      std::unique_ptr<SocketWrapper> sock(
+          new SocketWrapper(client_.connect_to(host, port)));
+      SocketWrapper *raw = sock.get();
+      {
+        LockGuard<Mutex> lock(mutex_);
+        if (!running_.load())
+          break;
+        link_ = std::move(sock);
+      }
+      serve(*raw);
+    } catch (const std::exception &) {
+      // Hub not up (yet); retry below
+    }
+
+    std::unique_ptr<SocketWrapper> dead;
+    {
+      LockGuard<Mutex> lock(mutex_);
+      dead.swap(link_);
+    }
+    if (connected_.exchange(false)) {
+      std::cout << "\033[2K\r" << "[Relay] Lost the hub; retrying\n"
+                << "You: " << std::flush;
+    }
+
+    for (int waited = 0; waited < REDIAL_MS && running_.load();
+         waited += TICK_MS) {
+      Sleep(TICK_MS);
+    }
+  }
+}
+
+void RelayNode::serve(SocketWrapper &link) {
+  WireWriter hello;
+  hello.put_u8(relay::HELLO);
+  hello.put_str(options_.advertise);
+  if (!send_up(encode(hello)))
+    return;
+
+  std::string frame;
+  if (!link.receive_binary(frame))
+    return;
+  WireReader welcome(frame);
+  uint8_t type = 0;
+  std::string hub;
+  if (!welcome.get_u8(type) || type != relay::WELCOME || !welcome.get_str(hub))
+    return;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    hub_endpoint_ = hub;
+  }
+  connected_.store(true);
+  std::cout << "\033[2K\r" << "[Relay] Linked to hub " << hub << "\n"
+            << "You: " << std::flush;
+
+  uint64_t received = 0;
+  while (running_.load() && link.receive_binary(frame)) {
+    WireReader reader(frame);
+    if (!reader.get_u8(type))
+      return;
+
+    if (type == relay::FANOUT) {
+      uint64_t hub_ns = 0;
+      uint32_t exclude = 0;
+      LogEntry entry;
+      if (!reader.get_u64(hub_ns) || !reader.get_u32(exclude) ||
+          !reader.get_u64(entry.seq) || !reader.get_u64(entry.hlc) ||
+          !reader.get_u64(entry.parent) || !reader.get_str(entry.sender) || !reader.get_str(entry.text)) {
+        return;
+      }
+      // Sampled echo lets the hub measure the first hop without clocks
+      if (++received % relay::ACK_EVERY == 0) {
+        WireWriter ack;
+        ack.put_u8(relay::ACK);
+        ack.put_u64(hub_ns);
+        send_up(encode(ack));
+      }
+
+      // Our own client wrote it: log it under that client's session, so
+      // that it follows the thread if this message becomes a root
+      if (exclude != 0) {
+        entry.author = room_.session_key(exclude);
+      }
+
+      uint64_t t0 = monotonic_ns();
+      bool fresh = room_.deliver(entry, exclude);
+      if (fresh) {
+        last_fanout_ns_.store(monotonic_ns() - t0);
+      }
+      // Our own clients' messages were printed when they arrived
+      if (fresh && exclude == 0) {
+        std::cout << "\033[2K\r" << "[" << entry.sender << "]: " << entry.text
+                  << "\n"
+                  << "You: " << std::flush;
+      }
+    } else if (type == relay::UPDATE) {
+      std::string update;
+      if (reader.get_str(update)) {
+        room_.send_update(update);
+      }
+    } else if (type == relay::SHED) {
+      uint32_t count = 0;
+      std::string endpoint;
+      if (reader.get_u32(count) && reader.get_str(endpoint)) {
+        room_.redirect_clients(count, endpoint);
+      }
+    }
+  }
+}
+
+bool RelayNode::send_up(const SharedFrame &frame) {
+  LockGuard<Mutex> lock(mutex_);
+  if (!link_ || !link_->is_valid())
+    return false;
+  try {
+    link_->send_frame(*frame);
+    return true;
+  } catch (const std::exception &) {
+    link_->close(); // the link thread notices and redials
+    return false;
+  }
+}
+
+void RelayNode::load_loop() {
+  while (running_.load()) {
+    if (connected_.load()) {
+      WireWriter w;
+      w.put_u8(relay::LOAD);
+      w.put_u32(static_cast<uint32_t>(room_.client_count()));
+      w.put_u64(last_fanout_ns_.exchange(0));
+      send_up(encode(w));
+    }
+    for (unsigned waited = 0; waited < LOAD_INTERVAL_MS && running_.load();
+         waited += TICK_MS) {
+      Sleep(TICK_MS);
+    }
+  }
+}
+
+// ── Queries
+// ───────────────────────────────────────────────────────────────────
+
+std::string RelayNode::client_endpoints() const {
+  LockGuard<Mutex> lock(mutex_);
+  if (hub_endpoint_.empty())
+    return options_.advertise;
+  return options_.advertise + "," + hub_endpoint_;
+}
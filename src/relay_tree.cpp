@@ -0,0 +1,516 @@
+/**
+ * @file relay_tree.cpp
+ * @brief Implementation of RelayTree – hub side of two-level fan-out.
+ */
+
+#include "relay_tree.h"
+
+#include "link_writer.h"
+#include "metrics.h"
+#include "wire.h"
+
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+/// How often the hub rebalances clients across relays.
+constexpr int BALANCE_INTERVAL_MS = 1000;
+constexpr int BALANCE_TICK_MS = 100;
+
+SharedFrame encode(const WireWriter &w) {
+  const std::string &wire = w.data();
+  return SocketWrapper::encode_frame(wire.data(),
+                                     static_cast<uint32_t>(wire.size()));
+}
+
+SharedFrame fanout_frame(uint64_t hub_ns, uint32_t exclude,
+                         const LogEntry &entry) {
+  WireWriter w;
+  w.put_u8(relay::FANOUT);
+  w.put_u64(hub_ns);
+  w.put_u32(exclude);
+  w.put_u64(entry.seq);
+  w.put_u64(entry.hlc);
+  w.put_u64(entry.parent);
+  w.put_str(entry.sender);
+  w.put_str(entry.text);
+  return encode(w);
+}
+
+} // namespace
+
+// ── RelayLink
+// ─────────────────────────────────────────────────────────────────
+
+/**
+ * One connected relay. Its thread handles frames from the relay; fan-out
+ * frames are queued for a LinkWriter by whichever thread broadcast the
+ * message, so a slow relay never holds up the hub's fan-out.
+ */
+class RelayTree::RelayLink {
+public:
+  RelayLink(RelayTree &tree, SocketWrapper socket, uint32_t id)
+      : tree_(tree), socket_(std::move(socket)), id_(id) {
+    socket_.set_no_delay(true);
+  }
+
+  ~RelayLink() {
+    close();
+    join();
+  }
+
+  RelayLink(const RelayLink &) = delete;
+  RelayLink &operator=(const RelayLink &) = delete;
+
+  void start() {
+    writer_.start();
+    thread_ = Thread(&RelayLink::run, this);
+  }
+
+  void close() { writer_.close(); }
+
+  /// Wait for both threads (not from either of them).
+  void join() {
+    writer_.join();
+    if (thread_.joinable() && !thread_.is_current()) {
+      thread_.join();
+    }
+  }
+
+  /**
+   * @brief Queue @p frame for the relay. Never blocks.
+   * @return false if the relay is gone (its thread retires the link).
+   */
+  bool send(const SharedFrame &frame) { return writer_.send(frame); }
+
+  /// Room id used as the sender of this relay's clients' messages.
+  uint32_t id() const { return id_; }
+
+  /// Relay-local client to skip when a message comes back (own thread).
+  uint32_t exclude() const { return exclude_; }
+
+  const std::string &endpoint() const { return endpoint_; }
+
+  std::atomic<bool> ready{false};   ///< HELLO done
+  std::atomic<uint32_t> load{0};    ///< Clients, as last reported (+ placed)
+
+private:
+  RelayTree &tree_;
+  SocketWrapper socket_;
+  LinkWriter writer_{socket_};
+  uint32_t id_;
+  uint32_t exclude_ = 0;
+  std::string endpoint_; ///< Written before ready is set
+  Thread thread_;
+  /// Relay-local client id → id reserved for it here (own thread only)
+  std::unordered_map<uint32_t, uint32_t> sessions_;
+
+  /// @return The session key @p client_id's messages are logged under;
+  /// each relay client gets its own, as if it were connected here.
+  uint64_t session_of(uint32_t client_id) {
+    auto it = sessions_.find(client_id);
+    if (it == sessions_.end()) {
+      it = sessions_.emplace(client_id, tree_.room_.reserve_id()).first;
+    }
+    return tree_.room_.session_key(it->second);
+  }
+
+  void run() {
+    try {
+      serve();
+    } catch (const std::exception &) {
+      // Malformed frame or socket error: drop the relay
+    }
+    close(); // stops the writer too
+    tree_.link_closed(this);
+  }
+
+  void serve() {
+    std::string frame;
+    if (!socket_.receive_binary(frame))
+      return;
+    WireReader hello(frame);
+    uint8_t type = 0;
+    if (!hello.get_u8(type) || type != relay::HELLO ||
+        !hello.get_str(endpoint_)) {
+      return;
+    }
+
+    WireWriter w;
+    w.put_u8(relay::WELCOME);
+    w.put_str(tree_.options_.advertise);
+    if (!send(encode(w)))
+      return;
+    ready.store(true);
+
+    std::cout << "\033[2K\r" << "[Relay] " << endpoint_ << " joined\n"
+              << "You: " << std::flush;
+
+    HubMetrics &metrics = HubMetrics::instance();
+    while (tree_.running_.load() && socket_.receive_binary(frame)) {
+      WireReader reader(frame);
+      if (!reader.get_u8(type))
+        return;
+
+      if (type == relay::UP) {
+        uint32_t client_id = 0;
+        std::string sender, text;
+        if (!reader.get_u32(client_id) || !reader.get_str(sender) ||
+            !reader.get_str(text)) {
+          return;
+        }
+        uint64_t rx_ns = monotonic_ns();
+        metrics.frames_in.fetch_add(1, std::memory_order_relaxed);
+
+        // The fan-out tap runs on this thread and reads exclude_ to keep
+        // the message from echoing back to its author
+        exclude_ = client_id;
+        tree_.room_.submit(id_, sender, text, rx_ns, session_of(client_id));
+        exclude_ = 0;
+
+        if (text.compare(0, 4, "CMD:") != 0) {
+          std::cout << "\033[2K\r" << "[" << sender << "]: " << text << "\n"
+                    << "You: " << std::flush;
+        }
+      } else if (type == relay::ACK) {
+        uint64_t hub_ns = 0;
+        if (reader.get_u64(hub_ns)) {
+          metrics.relay_hop.record((monotonic_ns() - hub_ns) / 2);
+        }
+      } else if (type == relay::LOAD) {
+        uint32_t clients = 0;
+        uint64_t fanout_ns = 0;
+        if (reader.get_u32(clients) && reader.get_u64(fanout_ns)) {
+          load.store(clients);
+          if (fanout_ns != 0)
+            metrics.relay_fanout.record(fanout_ns);
+        }
+      }
+    }
+  }
+};
+
+// ── Construction / Destruction
+// ────────────────────────────────────────────────
+
+RelayTree::RelayTree(Room &room, const RelayTreeOptions &options)
+    : room_(room), options_(options) {}
+
+RelayTree::~RelayTree() { stop(); }
+
+// ── Lifecycle
+// ─────────────────────────────────────────────────────────────────
+
+void RelayTree::start() {
+  if (running_.load())
+    return;
+
+  room_.add_fanout_tap([this](const LogEntry &entry, uint32_t sender_id) {
+    on_fanout(entry, sender_id);
+  });
+  room_.add_update_tap([this](const std::string &frame) { on_update(frame); });
+
+  listener_.reset(new Server(options_.port));
+  listener_->set_on_new_client(
+      [this](SocketWrapper sock, std::string) { add_link(std::move(sock)); });
+
+  running_.store(true);
+  listener_->start_accept_loop();
+  balance_thread_ = Thread(&RelayTree::balance_loop, this);
+}
+
+void RelayTree::stop() {
+  if (!running_.exchange(false))
+    return;
+
+  if (listener_) {
+    listener_->stop();
+  }
+  if (balance_thread_.joinable()) {
+    balance_thread_.join();
+  }
+
+  // Relay threads are joined outside the lock; a closing one takes it
+  std::vector<std::shared_ptr<RelayLink>> links;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    for (auto &link : links_) {
+      link->close();
+    }
+    links.swap(links_);
+  }
+  for (auto &link : links) {
+    link->join();
+  }
+  links.clear();
+  reap_retired();
+}
+
+// ── Link management
+// ───────────────────────────────────────────────────────────
+
+void RelayTree::add_link(SocketWrapper socket) {
+  std::shared_ptr<RelayLink> link(
+      new RelayLink(*this, std::move(socket), room_.reserve_id()));
+  RelayLink *raw = link.get();
+
+  LockGuard<Mutex> lock(mutex_);
+  if (!running_.load())
+    return;
+  links_.push_back(std::move(link));
+  raw->start();
+}
+
+void RelayTree::link_closed(RelayLink *link) {
+  bool was_ready = link->ready.load();
+  {
+    LockGuard<Mutex> lock(mutex_);
+    for (auto it = links_.begin(); it != links_.end(); ++it) {
+      if (it->get() == link) {
+        retired_.push_back(std::move(*it));
+        links_.erase(it);
+        break;
+      }
+    }
+  }
+  if (was_ready && running_.load()) {
+    // Its clients fail over to the hub and are placed again
+    std::cout << "\033[2K\r" << "[Relay] " << link->endpoint() << " left\n"
+              << "You: " << std::flush;
+  }
+}
+
+void RelayTree::reap_retired() {
+  std::vector<std::shared_ptr<RelayLink>> dead;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    dead.swap(retired_);
+  }
+  // Join relay threads outside the lock. A fan-out still queueing may hold
+  // the last reference; by then it only frees memory.
+  for (auto &link : dead) {
+    link->join();
+  }
+}
+
+// ── Fan-out
+// ───────────────────────────────────────────────────────────────────
+
+std::vector<std::shared_ptr<RelayTree::RelayLink>>
+RelayTree::ready_links() const {
+  std::vector<std::shared_ptr<RelayLink>> ready;
+  LockGuard<Mutex> lock(mutex_);
+  ready.reserve(links_.size());
+  for (auto &link : links_) {
+    if (link->ready.load())
+      ready.push_back(link);
+  }
+  return ready;
+}
+
+void RelayTree::on_fanout(const LogEntry &entry, uint32_t sender_id) {
+  uint64_t hub_ns = monotonic_ns();
+  SharedFrame frame = fanout_frame(hub_ns, 0, entry);
+
+  HubMetrics &metrics = HubMetrics::instance();
+  uint64_t sent = 0, bytes = 0;
+
+  // Queue outside mutex_: placement and rebalancing never wait on fan-out
+  for (auto &link : ready_links()) {
+    // Only the author's relay needs its own copy (with the author skipped)
+    SharedFrame out = link->id() == sender_id
+                          ? fanout_frame(hub_ns, link->exclude(), entry)
+                          : frame;
+    if (link->send(out)) {
+      ++sent;
+      bytes += out->size();
+    }
+  }
+  metrics.relay_frames_out.fetch_add(sent, std::memory_order_relaxed);
+  metrics.bytes_out.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void RelayTree::on_update(const std::string &frame) {
+  WireWriter w;
+  w.put_u8(relay::UPDATE);
+  w.put_str(frame);
+  SharedFrame out = encode(w);
+
+  HubMetrics &metrics = HubMetrics::instance();
+  uint64_t sent = 0;
+
+  for (auto &link : ready_links()) {
+    if (link->send(out))
+      ++sent;
+  }
+  metrics.relay_frames_out.fetch_add(sent, std::memory_order_relaxed);
+  metrics.bytes_out.fetch_add(sent * out->size(), std::memory_order_relaxed);
+}
+
+// ── Placement / rebalancing
+// ───────────────────────────────────────────────────
+
+void RelayTree::shape(std::size_t total, std::size_t &active,
+                      std::size_t &per_node) const {
+  std::size_t ready = 0;
+  for (auto &link : links_) {
+    if (link->ready.load())
+      ++ready;
+  }
+  std::size_t root = static_cast<std::size_t>(
+      std::ceil(std::sqrt(static_cast<double>(total ? total : 1))));
+  active = ready < root ? ready : root;
+  // The hub serves a share of clients itself, like one more relay
+  per_node = (total + active) / (active + 1);
+  if (per_node == 0)
+    per_node = 1;
+}
+
+RelayTree::RelayLink *RelayTree::least_loaded(std::size_t active,
+                                              const RelayLink *skip) const {
+  RelayLink *best = nullptr;
+  std::size_t seen = 0;
+  for (auto &link : links_) {
+    if (!link->ready.load())
+      continue;
+    if (seen++ == active)
+      break;
+    if (link.get() != skip && (!best || link->load.load() < best->load.load()))
+      best = link.get();
+  }
+  return best;
+}
+
+std::string RelayTree::place() {
+  std::size_t direct = room_.client_count();
+
+  LockGuard<Mutex> lock(mutex_);
+  std::size_t total = direct + 1;
+  for (auto &link : links_) {
+    if (link->ready.load())
+      total += link->load.load();
+  }
+
+  std::size_t active = 0, per_node = 0;
+  shape(total, active, per_node);
+  if (active == 0 || direct < per_node)
+    return std::string();
+
+  RelayLink *relay = least_loaded(active, nullptr);
+  if (!relay)
+    return std::string();
+  // Count the client now so a burst of joins spreads out
+  relay->load.fetch_add(1);
+  return relay->endpoint();
+}
+
+void RelayTree::balance_loop() {
+  while (running_.load()) {
+    reap_retired();
+    rebalance();
+    for (int waited = 0; waited < BALANCE_INTERVAL_MS && running_.load();
+         waited += BALANCE_TICK_MS) {
+      Sleep(BALANCE_TICK_MS);
+    }
+  }
+}
+
+void RelayTree::rebalance() {
+  std::size_t direct = room_.client_count();
+  std::size_t hub_excess = 0;
+  std::string hub_target;
+
+  {
+    LockGuard<Mutex> lock(mutex_);
+    std::size_t total = direct;
+    for (auto &link : links_) {
+      if (link->ready.load())
+        total += link->load.load();
+    }
+
+    std::size_t active = 0, per_node = 0;
+    shape(total, active, per_node);
+    if (active == 0)
+      return;
+    std::size_t slack = per_node / 8 > 2 ? per_node / 8 : 2;
+
+    // Relays past the first `active` drain completely; the rest drain to
+    // per_node when they are over by more than the slack
+    std::size_t index = 0;
+    for (auto &link : links_) {
+      if (!link->ready.load())
+        continue;
+      bool in_use = index++ < active;
+      std::size_t load = link->load.load();
+      std::size_t keep = in_use ? per_node + slack : 0;
+      if (load <= keep)
+        continue;
+
+      std::size_t shed = load - (in_use ? per_node : 0);
+      RelayLink *to = least_loaded(active, link.get());
+      std::string endpoint;
+      if (to && to->load.load() < per_node) {
+        endpoint = to->endpoint();
+      } else if (direct < per_node) {
+        endpoint = options_.advertise; // the hub itself has room
+      } else if (to) {
+        endpoint = to->endpoint();
+      } else {
+        continue;
+      }
+
+      WireWriter w;
+      w.put_u8(relay::SHED);
+      w.put_u32(static_cast<uint32_t>(shed));
+      w.put_str(endpoint);
+      if (link->send(encode(w))) {
+        link->load.fetch_sub(static_cast<uint32_t>(shed));
+        if (to && endpoint == to->endpoint())
+          to->load.fetch_add(static_cast<uint32_t>(shed));
+      }
+    }
+
+    if (direct > per_node + slack) {
+      RelayLink *to = least_loaded(active, nullptr);
+      if (to) {
+        hub_excess = direct - per_node;
+        hub_target = to->endpoint();
+        to->load.fetch_add(static_cast<uint32_t>(hub_excess));
+      }
+    }
+  }
+
+  // Outside our lock: the room takes its own
+  if (hub_excess != 0) {
+    room_.redirect_clients(hub_excess, hub_target);
+  }
+}
+
+// ── Queries
+// ───────────────────────────────────────────────────────────────────
+
+std::size_t RelayTree::relay_count() const {
+  LockGuard<Mutex> lock(mutex_);
+  std::size_t count = 0;
+  for (auto &link : links_) {
+    if (link->ready.load())
+      ++count;
+  }
+  return count;
+}
+
+std::string RelayTree::describe() const {
+  std::ostringstream oss;
+  LockGuard<Mutex> lock(mutex_);
+  for (auto &link : links_) {
+    if (link->ready.load()) {
+      oss << "  relay " << link->endpoint() << ": " << link->load.load()
+          << " clients\n";
+    }
+  }
+  return oss.str();
+}
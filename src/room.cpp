@@ -5,17 +5,73 @@
 
 #include "room.h"
 
+#include "chat_frame.h"
+#include "metrics.h"
+
+#include <cstdlib>
 #include <iostream>
+#include <random>
+
+namespace {
+
+/// Most entries resent to one reconnecting client.
+constexpr std::size_t REPLAY_MAX = 512;
+
+const std::string PING_PREFIX = "CMD:PING:";
+const std::string RESUME_PREFIX = "CMD:RESUME:";
+const std::string REPLY_PREFIX = "CMD:REPLY:";
+const std::string FOLLOW_PREFIX = "CMD:FOLLOW:";
+const std::string UNFOLLOW_PREFIX = "CMD:UNFOLLOW:";
+const std::string QUERY_PREFIX = "CMD:QUERY:";
+
+/// @return The number after @p prefix in @p message, or 0.
+uint64_t number_after(const std::string &message, const std::string &prefix) {
+  return std::strtoull(message.c_str() + prefix.size(), nullptr, 10);
+}
+
+/// Random, non-zero salt for this room's session keys.
+uint32_t make_session_salt() {
+  std::random_device rd;
+  uint32_t salt = rd() ^ static_cast<uint32_t>(monotonic_ns());
+  return salt != 0 ? salt : 1;
+}
 
-// ── Destruction
-// ───────────────────────────────────────────────────────────────
+} // namespace
 
-Room::~Room() { stop_all(); }
+// ── Construction / Destruction
+// ────────────────────────────────────────────────
+
+Room::Room(const IoOptions &io)
+    : out_budget_(io.out_budget), session_salt_(make_session_salt()) {
+  roster_.store(new Roster);
+  if (io.mode != IoMode::Blocking) {
+    io_.reset(new IoLoop(io));
+    io_->start();
+  }
+  reaper_ = Thread(&Room::reap_loop, this);
+}
+
+Room::~Room() {
+  {
+    LockGuard<Mutex> lock(mutex_);
+    closing_ = true;
+    reap_cv_.notify_all();
+  }
+  reaper_.join();
+  stop_all();
+  if (io_) {
+    io_->stop();
+  }
+  delete roster_.load(); // stop_all() waited for the last reader
+}
 
 // ── Client management
 // ─────────────────────────────────────────────────────────
 
-uint32_t Room::add_client(SocketWrapper socket, const std::string &name) {
+uint32_t Room::add_client(SocketWrapper socket, const std::string &name,
+                          ClientHandler::Handshake handshake) {
+  reap_retired();
+
   LockGuard<Mutex> lock(mutex_);
 
   uint32_t id = next_id_++;
@@ -23,60 +79,432 @@ uint32_t Room::add_client(SocketWrapper socket, const std::string &name) {
   // Build callbacks that capture 'this' (Room outlives all handlers)
   auto on_msg = [this](uint32_t sender_id, const std::string &sender_name,
                        const std::string &message) {
-    // Print on server console (clear current line first)
-    std::cout << "\033[2K\r" << "[" << sender_name << "]: " << message << "\n"
-              << "You: " << std::flush;
-    // Forward to all other clients
-    broadcast(sender_id, sender_name, message);
+    if (message.compare(0, PING_PREFIX.size(), PING_PREFIX) == 0) {
+      // Echoed ahead of any backlog, so the client measures the network
+      send_to(sender_id, "CMD:PONG:" + message.substr(PING_PREFIX.size()));
+      return;
+    }
+    if (message.compare(0, RESUME_PREFIX.size(), RESUME_PREFIX) == 0) {
+      try {
+        replay(sender_id, std::stoull(message.substr(RESUME_PREFIX.size())));
+      } catch (const std::exception &) {
+        // Malformed resume point; the client just misses the replay
+      }
+      return;
+    }
+    if (message.compare(0, FOLLOW_PREFIX.size(), FOLLOW_PREFIX) == 0) {
+      follow(sender_id, number_after(message, FOLLOW_PREFIX), true);
+      return;
+    }
+    if (message.compare(0, UNFOLLOW_PREFIX.size(), UNFOLLOW_PREFIX) == 0) {
+      follow(sender_id, number_after(message, UNFOLLOW_PREFIX), false);
+      return;
+    }
+    if (message.compare(0, QUERY_PREFIX.size(), QUERY_PREFIX) == 0) {
+      if (query_handler_) {
+        query_handler_(sender_id, message);
+      } else {
+        send_to(sender_id, "CMD:ERROR:this hub does not answer queries");
+      }
+      return;
+    }
+
+    uint64_t rx_ns = monotonic_ns();
+    HubMetrics::instance().frames_in.fetch_add(1, std::memory_order_relaxed);
+
+    // Forward to all other clients first; console output is slow and must
+    // not sit on the hub's latency path.
+    submit(sender_id, sender_name, message, rx_ns);
+
+    // Print on server console (clear current line first); ops are not chat
+    if (message.compare(0, 4, "CMD:") != 0) {
+      std::cout << "\033[2K\r" << "[" << sender_name << "]: " << message
+                << "\n"
+                << "You: " << std::flush;
+    }
   };
 
   auto on_disc = [this](uint32_t disc_id) { remove_client(disc_id); };
 
   auto handler = std::make_unique<ClientHandler>(
-      id, name, std::move(socket), std::move(on_msg), std::move(on_disc));
+      id, name, std::move(socket), std::move(on_msg), std::move(on_disc),
+      io_.get(), std::move(handshake), out_budget_);
 
+  if (handler->protocol() == WireProtocol::WebSocket) {
+    websocket_clients_.fetch_add(1);
+  }
   clients_.emplace(id, std::move(handler));
+  publish_roster();
   return id;
 }
 
 void Room::remove_client(uint32_t id) {
-  LockGuard<Mutex> lock(mutex_);
-  auto it = clients_.find(id);
-  if (it != clients_.end()) {
-    std::cout << "\033[2K\r" << "[Room] " << it->second->name()
-              << " disconnected. Active clients: " << (clients_.size() - 1)
-              << "\n"
-              << "You: " << std::flush;
-    // stop() closes the socket; the thread will exit on its own
-    it->second->stop();
+  std::unique_ptr<ClientHandler> handler;
+  std::size_t remaining = 0;
+  uint64_t stamp = 0;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    auto it = clients_.find(id);
+    if (it == clients_.end())
+      return;
+    handler = std::move(it->second);
     clients_.erase(it);
+    stamp = publish_roster();
+    if (handler->protocol() == WireProtocol::WebSocket) {
+      websocket_clients_.fetch_sub(1);
+    }
+    for (auto ft = followers_.begin(); ft != followers_.end(); ++ft) {
+      ft->second.erase(id);
+    }
+    for (auto jt = clients_.begin(); jt != clients_.end(); ++jt) {
+      if (jt->second->joined())
+        ++remaining;
+    }
+  }
+
+  if (handler->joined()) {
+    std::cout << "\033[2K\r" << "[Room] " << handler->name()
+              << " disconnected. Active clients: " << remaining << "\n"
+              << "You: " << std::flush;
   }
+
+  // stop() closes the socket and may wait for an IO thread, so it runs
+  // without the room lock; the thread will exit on its own
+  handler->stop();
+
+  LockGuard<Mutex> lock(mutex_);
+  retired_.push_back(Retired{stamp, std::move(handler)});
+  reap_cv_.notify_all();
+}
+
+void Room::reap_retired() {
+  std::vector<Retired> dead;
+  {
+    // A fan-out that loaded the roster before the handler left may still
+    // be sending to it; those wait for a later call
+    LockGuard<Mutex> lock(mutex_);
+    EpochDomain &epochs = EpochDomain::instance();
+    std::vector<Retired> kept;
+    for (Retired &retired : retired_) {
+      if (epochs.reclaimable(retired.stamp)) {
+        dead.push_back(std::move(retired));
+      } else {
+        kept.push_back(std::move(retired));
+      }
+    }
+    retired_.swap(kept);
+  }
+  // Destructors join receive threads; run them outside the lock
+}
+
+void Room::reap_loop() {
+  LockGuard<Mutex> lock(mutex_);
+  while (!closing_) {
+    if (retired_.empty()) {
+      reap_cv_.wait_for(mutex_, INFINITE);
+      continue;
+    }
+    // Fan-outs hold their guard only while queueing, so this is short
+    mutex_.unlock();
+    EpochDomain::instance().synchronize();
+    reap_retired();
+    mutex_.lock();
+  }
+}
+
+uint64_t Room::publish_roster() {
+  auto *roster = new Roster;
+  roster->members.reserve(clients_.size());
+  for (auto it = clients_.begin(); it != clients_.end(); ++it) {
+    roster->members.emplace_back(it->first, it->second.get());
+  }
+  const Roster *old = roster_.exchange(roster);
+
+  EpochDomain &epochs = EpochDomain::instance();
+  uint64_t stamp = epochs.advance();
+  epochs.retire([old] { delete old; });
+  return stamp;
 }
 
 // ── Broadcast
 // ─────────────────────────────────────────────────────────────────
 
-void Room::broadcast(uint32_t sender_id, const std::string &sender_name,
-                     const std::string &message) {
-  // Format: "[SenderName]: message"
-  std::string payload = "[" + sender_name + "]: " + message;
+void Room::submit(uint32_t sender_id, const std::string &sender_name,
+                  const std::string &message, uint64_t rx_ns,
+                  uint64_t author) {
+  if (author == 0) {
+    author = session_key(sender_id);
+  }
+  if (op_handler_ && op_handler_(sender_id, author, sender_name, message))
+    return;
+  // Before the relay hop too, so a flood costs no uplink either
+  if (flood_ && flood_->repeated(author, message)) {
+    HubMetrics::instance().dup_suppressed.fetch_add(
+        1, std::memory_order_relaxed);
+    send_to(sender_id, "CMD:ERROR:repeated message not sent");
+    return;
+  }
+  if (upstream_) {
+    upstream_(sender_id, sender_name, message);
+    return;
+  }
 
-  LockGuard<Mutex> lock(mutex_);
-  for (auto it = clients_.begin(); it != clients_.end(); ++it) {
-    if (it->first != sender_id && it->second->is_active()) {
-      it->second->send(payload);
-    }
+  if (message.compare(0, REPLY_PREFIX.size(), REPLY_PREFIX) != 0) {
+    publish(sender_id, sender_name, message, rx_ns, 0, author);
+    return;
+  }
+
+  // "CMD:REPLY:<seq>:<text>"; a reply to a reply joins the same thread
+  std::size_t colon = message.find(':', REPLY_PREFIX.size());
+  uint64_t parent = number_after(message, REPLY_PREFIX);
+  LogEntry target;
+  if (colon == std::string::npos || parent == 0 ||
+      !log_.get(parent, target)) {
+    send_to(sender_id, "CMD:ERROR:no message #" + std::to_string(parent) +
+                           " to reply to");
+    return;
+  }
+  publish(sender_id, sender_name, message.substr(colon + 1), rx_ns,
+          target.parent != 0 ? target.parent : parent, author);
+}
+
+uint64_t Room::broadcast(uint32_t sender_id, const std::string &sender_name,
+                         const std::string &message, uint64_t rx_ns,
+                         uint64_t origin_hlc) {
+  LogEntry entry;
+  entry.sender = sender_name;
+  entry.text = message;
+  post(entry, sender_id, rx_ns, origin_hlc);
+  return entry.seq;
+}
+
+void Room::publish(uint32_t sender_id, const std::string &sender_name,
+                   const std::string &message, uint64_t rx_ns,
+                   uint64_t parent, uint64_t author) {
+  LogEntry entry;
+  entry.parent = parent;
+  entry.author = author;
+  entry.sender = sender_name;
+  entry.text = message;
+  post(entry, sender_id, rx_ns, 0);
+  if (on_local_message_) {
+    on_local_message_(entry);
   }
 }
 
+void Room::post(LogEntry &entry, uint32_t exclude_id, uint64_t rx_ns,
+                uint64_t origin_hlc) {
+  // Numbered on arrival and encoded in parallel with other senders; only
+  // logging and queueing wait for the messages numbered before this one.
+  // The turn owns the number from here, so a throw still lets later
+  // messages through.
+  Sequencer::Ticket ticket = sequencer_.next(origin_hlc);
+  Sequencer::Turn turn(sequencer_, ticket.seq);
+  entry.seq = ticket.seq;
+  entry.hlc = ticket.hlc;
+  FrameSet frames = chat_frame(entry);
+
+  // In the turn: the log, then pushes onto per-client, relay and peer
+  // queues, none of which waits on a socket. The turn ends on return.
+  turn.wait();
+  log_.apply(entry);
+  fanout(entry, frames, exclude_id, rx_ns);
+}
+
+bool Room::deliver(const LogEntry &entry, uint32_t exclude_id) {
+  if (!restore(entry))
+    return false;
+  FrameSet frames = chat_frame(entry);
+  fanout(entry, frames, exclude_id, 0);
+  return true;
+}
+
+bool Room::restore(const LogEntry &entry) {
+  if (!log_.apply(entry))
+    return false;
+  sequencer_.advance(entry.seq, entry.hlc);
+  return true;
+}
+
 void Room::broadcast_all(const std::string &sender_name,
                          const std::string &message) {
-  std::string payload = "[" + sender_name + "]: " + message;
+  if (upstream_) {
+    upstream_(0, sender_name, message);
+  } else {
+    publish(0, sender_name, message);
+  }
+}
+
+FrameSet Room::chat_frame(const LogEntry &entry) const {
+  FrameSet frames([&entry](WireProtocol protocol) {
+    return encode_chat(protocol, entry);
+  });
+  frames.prepare(WireProtocol::Native);
+  if (websocket_clients_.load() != 0) {
+    frames.prepare(WireProtocol::WebSocket);
+  }
+  return frames;
+}
+
+void Room::fanout(const LogEntry &entry, FrameSet &frames, uint32_t exclude_id,
+                  uint64_t rx_ns) {
+  // A reply goes in full to its thread's followers only; everyone else
+  // gets the thread's new reply count
+  std::string thread;
+  LogEntry root;
+  if (entry.parent != 0) {
+    thread = "CMD:THREAD:" + std::to_string(entry.parent) + ":" +
+             std::to_string(log_.reply_count(entry.parent));
+    log_.get(entry.parent, root);
+  }
+  FrameSet count(std::move(thread));
+
+  // Following a thread is the only state here behind the room lock;
+  // the followers are copied so that the sends can run without it
+  std::unordered_set<uint32_t> following;
+  if (entry.parent != 0) {
+    LockGuard<Mutex> lock(mutex_);
+    auto found = followers_.find(entry.parent);
+    if (found == followers_.end()) {
+      // First reply: the thread's author follows it, if that connection
+      // is still here (found by session, not by a name anyone can take)
+      found = followers_.emplace(entry.parent,
+                                 std::unordered_set<uint32_t>()).first;
+      uint32_t author = client_of(root.author);
+      if (clients_.count(author))
+        found->second.insert(author);
+    }
+    if (clients_.count(exclude_id))
+      found->second.insert(exclude_id); // and so does every replier
+    following = found->second;
+  }
+
+  HubMetrics &metrics = HubMetrics::instance();
+  uint64_t sent = 0;
+  uint64_t bytes = 0;
+  {
+    EpochDomain::Guard guard;
+    const Roster *roster = roster_.load();
+    ClientHandler *author = nullptr;
+
+    for (const auto &member : roster->members) {
+      ClientHandler *client = member.second;
+      if (member.first == exclude_id) {
+        author = client;
+        continue;
+      }
+      if (!client->is_active())
+        continue;
+      WireProtocol protocol = client->protocol();
+      if (entry.parent != 0 && !following.count(member.first)) {
+        const SharedFrame &wire = count.get(protocol);
+        client->send_frame(wire, SendClass::Presence);
+        bytes += wire->size();
+        continue;
+      }
+      const SharedFrame &wire = frames.get(protocol);
+      client->send_frame(wire);
+      bytes += wire->size();
+      if (sent++ == 0 && rx_ns != 0) {
+        metrics.hub_latency.record(monotonic_ns() - rx_ns);
+      }
+    }
+
+    // The author learns its message's number, to edit or delete it later
+    if (author && author->is_active()) {
+      author->send("CMD:ACK:" + std::to_string(entry.seq),
+                   SendClass::Control);
+    }
+  }
+  metrics.frames_out.fetch_add(sent, std::memory_order_relaxed);
+  metrics.bytes_out.fetch_add(bytes, std::memory_order_relaxed);
+
+  for (const FanoutTap &tap : taps_) {
+    tap(entry, exclude_id);
+  }
+}
 
+void Room::send_update(const std::string &frame, uint64_t after_seq) {
+  // The changed message was logged in its turn, so this wait is at most
+  // the rest of that fan-out
+  if (after_seq != 0) {
+    sequencer_.wait_published(after_seq);
+  }
+  // Edits and reactions keep pace with the messages they change
+  send_control(frame, SendClass::Chat);
+  for (const UpdateTap &tap : update_taps_) {
+    tap(frame);
+  }
+}
+
+void Room::send_to(uint32_t id, const std::string &frame, SendClass cls) {
   LockGuard<Mutex> lock(mutex_);
-  for (auto it = clients_.begin(); it != clients_.end(); ++it) {
-    if (it->second->is_active()) {
-      it->second->send(payload);
+  auto it = clients_.find(id);
+  if (it != clients_.end() && it->second->is_active()) {
+    it->second->send(frame, cls);
+  }
+}
+
+void Room::send_control(const std::string &frame, SendClass cls) {
+  FrameSet frames(frame);
+
+  EpochDomain::Guard guard;
+  for (const auto &member : roster_.load()->members) {
+    ClientHandler *client = member.second;
+    if (client->is_active()) {
+      client->send_frame(frames.get(client->protocol()), cls);
+    }
+  }
+}
+
+void Room::replay(uint32_t id, uint64_t after_seq) {
+  std::vector<LogEntry> missed = log_.since(after_seq, REPLAY_MAX);
+
+  LockGuard<Mutex> lock(mutex_);
+  auto it = clients_.find(id);
+  if (it == clients_.end() || !it->second->is_active())
+    return;
+
+  ClientHandler &client = *it->second;
+  for (const LogEntry &entry : missed) {
+    // Skip the client's own lines by session, never by name: a namesake's
+    // are still missed (and the client's SeqWindow drops any repeat)
+    if (entry.deleted || client_of(entry.author) == id)
+      continue;
+    if (entry.parent != 0) {
+      auto ft = followers_.find(entry.parent);
+      if (ft == followers_.end() || !ft->second.count(id))
+        continue; // threads are resent on CMD:FOLLOW
+    }
+    client.send_frame(encode_chat(client.protocol(), entry));
+  }
+}
+
+void Room::follow(uint32_t id, uint64_t root, bool on) {
+  if (root == 0)
+    return;
+  std::vector<LogEntry> replies;
+  if (on) {
+    replies = log_.thread(root, REPLAY_MAX);
+  }
+
+  LockGuard<Mutex> lock(mutex_);
+  auto it = clients_.find(id);
+  if (it == clients_.end())
+    return;
+  if (!on) {
+    auto ft = followers_.find(root);
+    if (ft != followers_.end())
+      ft->second.erase(id);
+    return;
+  }
+
+  followers_[root].insert(id);
+  // Catch up on the thread so far
+  for (const LogEntry &entry : replies) {
+    if (!entry.deleted) {
+      it->second->send_frame(encode_chat(it->second->protocol(), entry),
+                             SendClass::Bulk);
     }
   }
 }
@@ -84,15 +512,83 @@ void Room::broadcast_all(const std::string &sender_name,
 // ── Utilities
 // ─────────────────────────────────────────────────────────────────
 
-std::size_t Room::client_count() const {
+void Room::set_on_local_message(LocalMessageHook hook) {
+  on_local_message_ = std::move(hook);
+}
+
+void Room::add_fanout_tap(FanoutTap tap) { taps_.push_back(std::move(tap)); }
+
+void Room::set_upstream(UpstreamHook hook) { upstream_ = std::move(hook); }
+
+void Room::set_op_handler(OpHandler handler) {
+  op_handler_ = std::move(handler);
+}
+
+void Room::set_flood_filter(unsigned window_ms) {
+  flood_.reset(window_ms != 0 ? new FloodFilter(window_ms) : nullptr);
+}
+
+void Room::set_query_handler(QueryHandler handler) {
+  query_handler_ = std::move(handler);
+}
+
+void Room::add_update_tap(UpdateTap tap) {
+  update_taps_.push_back(std::move(tap));
+}
+
+uint32_t Room::client_of(uint64_t author) const {
+  if (author >> 32 != session_salt_)
+    return 0;
+  return static_cast<uint32_t>(author);
+}
+
+uint32_t Room::reserve_id() {
   LockGuard<Mutex> lock(mutex_);
-  return clients_.size();
+  return next_id_++;
 }
 
-void Room::stop_all() {
+std::size_t Room::redirect_clients(std::size_t count,
+                                   const std::string &endpoint) {
+  FrameSet frames("CMD:REDIRECT:" + endpoint);
+  std::size_t asked = 0;
+
+  EpochDomain::Guard guard;
+  for (const auto &member : roster_.load()->members) {
+    if (asked == count)
+      break;
+    ClientHandler *client = member.second;
+    if (client->is_active()) {
+      client->send_frame(frames.get(client->protocol()), SendClass::Control);
+      ++asked;
+    }
+  }
+  return asked;
+}
+
+std::size_t Room::client_count() const {
   LockGuard<Mutex> lock(mutex_);
+  std::size_t count = 0;
   for (auto it = clients_.begin(); it != clients_.end(); ++it) {
+    if (it->second->joined())
+      ++count;
+  }
+  return count;
+}
+
+void Room::stop_all() {
+  std::unordered_map<uint32_t, std::unique_ptr<ClientHandler>> clients;
+  {
+    LockGuard<Mutex> lock(mutex_);
+    clients.swap(clients_);
+    websocket_clients_.store(0);
+    publish_roster();
+  }
+  // Stop and destroy outside the lock: an IO thread may be blocked on it
+  for (auto it = clients.begin(); it != clients.end(); ++it) {
     it->second->stop();
   }
-  clients_.clear();
+  // A fan-out that loaded the old roster may still be walking it
+  EpochDomain::instance().synchronize();
+  clients.clear();
+  reap_retired();
 }
@@ -0,0 +1,82 @@
+/**
+ * @file sequencer.cpp
+ * @brief Implementation of Sequencer – ordered message numbering.
+ */
+
+#include "sequencer.h"
+
+#include "compat.h"
+#include "metrics.h"
+
+namespace {
+
+/// Waits spent spinning with PAUSE before yielding the core. A turn is
+/// usually one fan-out, so most waits end within the spin.
+constexpr unsigned SPIN_PASSES = 1u << 10;
+
+} // namespace
+
+// ── Tickets
+// ───────────────────────────────────────────────────────────────────
+
+Sequencer::Ticket Sequencer::next(uint64_t origin_hlc) {
+  Ticket ticket;
+  ticket.seq = next_.fetch_add(1, std::memory_order_relaxed);
+  if (origin_hlc != 0) {
+    // Later local messages must stamp after it
+    clock_.observe(origin_hlc);
+    ticket.hlc = origin_hlc;
+  } else {
+    ticket.hlc = clock_.now();
+  }
+  return ticket;
+}
+
+void Sequencer::advance(uint64_t seq, uint64_t hlc) {
+  if (hlc != 0) {
+    clock_.observe(hlc);
+  }
+  if (next_.load(std::memory_order_relaxed) <= seq) {
+    next_.store(seq + 1, std::memory_order_relaxed);
+  }
+  if (done_.load(std::memory_order_relaxed) < seq) {
+    done_.store(seq, std::memory_order_release);
+  }
+}
+
+void Sequencer::wait_published(uint64_t seq) const {
+  // Spin, then yield
+  for (unsigned pass = 0; done_.load(std::memory_order_acquire) < seq;
+       ++pass) {
+    if (pass < SPIN_PASSES) {
+      cpu_relax();
+    } else {
+      SwitchToThread();
+    }
+  }
+}
+
+// ── Turns
+// ─────────────────────────────────────────────────────────────────────
+
+Sequencer::Turn::Turn(Sequencer &sequencer, uint64_t seq)
+    : sequencer_(sequencer), seq_(seq) {}
+
+void Sequencer::Turn::wait() {
+  if (waited_)
+    return;
+  waited_ = true;
+  if (sequencer_.done_.load(std::memory_order_acquire) + 1 == seq_)
+    return;
+
+  // Another thread holds an earlier ticket
+  uint64_t t0 = monotonic_ns();
+  sequencer_.wait_published(seq_ - 1);
+  HubMetrics::instance().seq_wait.record(monotonic_ns() - t0);
+}
+
+Sequencer::Turn::~Turn() {
+  // Also on the way out of an exception: the number is skipped, not held
+  wait();
+  sequencer_.done_.store(seq_, std::memory_order_release);
+}
@@ -77,6 +77,8 @@ void Server::set_on_new_client(NewClientCallback cb) {
   on_new_client_ = std::move(cb);
 }
 
+void Server::set_admission(Admission *admission) { admission_ = admission; }
+
 // ── Multi-client accept loop
 // ──────────────────────────────────────────────────
 
@@ -113,6 +115,16 @@ void Server::accept_loop() {
       break;
     }
 
+    if (admission_ && admission_->check(ntohl(client_addr.sin_addr.s_addr)) !=
+                          Admission::Verdict::Admit) {
+      // Reset rather than close: nothing lingers for a flooding peer
+      LINGER reset{1, 0};
+      ::setsockopt(client_sock, SOL_SOCKET, SO_LINGER,
+                   reinterpret_cast<const char *>(&reset), sizeof(reset));
+      ::closesocket(client_sock);
+      continue;
+    }
+
     std::string ip = peer_ip(client_addr);
 
     if (on_new_client_) {
@@ -6,6 +6,9 @@
 
 #include "socket_wrapper.h"
 
+#include "fiber.h"
+#include "websocket.h"
+
 #include <cstdint>
 #include <cstring>
 #include <stdexcept>
@@ -16,15 +19,32 @@
 SocketWrapper::SocketWrapper(SOCKET sock) : sock_(sock) {}
 
 SocketWrapper::SocketWrapper(SocketWrapper &&other) noexcept
-    : sock_(other.sock_) {
+    : sock_(other.sock_), non_blocking_(other.non_blocking_),
+      rx_buf_(std::move(other.rx_buf_)), rx_off_(other.rx_off_),
+      protocol_(other.protocol_), ws_open_(other.ws_open_),
+      ws_partial_(std::move(other.ws_partial_)),
+      ws_fragmented_(other.ws_fragmented_),
+      control_sender_(std::move(other.control_sender_)) {
   other.sock_ = INVALID_SOCKET;
+  other.non_blocking_ = false;
+  other.rx_off_ = 0;
 }
 
 SocketWrapper &SocketWrapper::operator=(SocketWrapper &&other) noexcept {
   if (this != &other) {
     close();
     sock_ = other.sock_;
+    non_blocking_ = other.non_blocking_;
+    rx_buf_ = std::move(other.rx_buf_);
+    rx_off_ = other.rx_off_;
+    protocol_ = other.protocol_;
+    ws_open_ = other.ws_open_;
+    ws_partial_ = std::move(other.ws_partial_);
+    ws_fragmented_ = other.ws_fragmented_;
+    control_sender_ = std::move(other.control_sender_);
     other.sock_ = INVALID_SOCKET;
+    other.non_blocking_ = false;
+    other.rx_off_ = 0;
   }
   return *this;
 }
@@ -48,16 +68,48 @@ void SocketWrapper::send_message(const std::string &message) {
   if (!is_valid()) {
     throw std::runtime_error("send_message: socket is not valid");
   }
+  send_frame(*encode_frame(protocol_, message));
+}
 
-  // Encode the message length as a 4-byte big-endian uint32
-  auto len = static_cast<uint32_t>(message.size());
+SharedFrame SocketWrapper::encode_frame(const std::string &message) {
+  return encode_frame(message.data(), static_cast<uint32_t>(message.size()));
+}
+
+SharedFrame SocketWrapper::encode_frame(const char *data, uint32_t len) {
+  // Encode the message length as a 4-byte big-endian uint32 in front of the
+  // body. Header and body travel in one write: two small writes would let
+  // Nagle hold the body back until the header is acknowledged.
   uint32_t net_len = htonl(len);
 
-  if (!send_all(reinterpret_cast<const char *>(&net_len), sizeof(net_len))) {
-    throw std::runtime_error("send_message: failed to send length header");
+  auto frame = std::make_shared<std::string>(sizeof(net_len) + len, '\0');
+  std::memcpy(&(*frame)[0], &net_len, sizeof(net_len));
+  if (len > 0) {
+    std::memcpy(&(*frame)[sizeof(net_len)], data, len);
+  }
+  return frame;
+}
+
+SharedFrame SocketWrapper::encode_frame(WireProtocol protocol,
+                                       const std::string &message) {
+  return protocol == WireProtocol::WebSocket ? websocket::encode_frame(message)
+                                             : encode_frame(message);
+}
+
+const SharedFrame &FrameSet::get(WireProtocol protocol) {
+  SharedFrame &frame = frames_[static_cast<int>(protocol)];
+  if (!frame) {
+    frame = encode_ ? encode_(protocol)
+                    : SocketWrapper::encode_frame(protocol, message_);
   }
-  if (len > 0 && !send_all(message.data(), static_cast<int>(len))) {
-    throw std::runtime_error("send_message: failed to send message body");
+  return frame;
+}
+
+void SocketWrapper::send_frame(const std::string &wire) {
+  if (!is_valid()) {
+    throw std::runtime_error("send_frame: socket is not valid");
+  }
+  if (!send_all(wire.data(), static_cast<int>(wire.size()))) {
+    throw std::runtime_error("send_frame: failed to send message");
   }
 }
 
@@ -66,6 +118,26 @@ std::string SocketWrapper::receive_message() {
     return {};
   }
 
+  if (protocol_ == WireProtocol::WebSocket) {
+    std::string out;
+    for (;;) {
+      RecvStatus status = next_websocket_message(out);
+      if (status == RecvStatus::Message)
+        return out;
+      if (status == RecvStatus::Closed)
+        return {};
+      int result = fill_rx_buf();
+      if (result == SOCKET_ERROR && non_blocking_ &&
+          WSAGetLastError() == WSAEWOULDBLOCK) {
+        if (!wait_ready(false))
+          return {};
+        continue;
+      }
+      if (result == SOCKET_ERROR || result == 0)
+        return {};
+    }
+  }
+
   // Read 4-byte length header
   uint32_t net_len = 0;
   if (!recv_all(reinterpret_cast<char *>(&net_len), sizeof(net_len))) {
@@ -90,13 +162,265 @@ std::string SocketWrapper::receive_message() {
   return buf;
 }
 
+// ── Non-blocking receive
+// ──────────────────────────────────────────────────────
+
+SocketWrapper::RecvStatus
+SocketWrapper::try_receive_message(std::string &out) {
+  if (!is_valid()) {
+    return RecvStatus::Closed;
+  }
+
+  constexpr uint32_t MAX_MSG = 64u * 1024u * 1024u;
+
+  for (;;) {
+    // Extract a complete frame if one is already buffered
+    std::size_t avail = rx_buf_.size() - rx_off_;
+    if (protocol_ == WireProtocol::WebSocket) {
+      RecvStatus status = next_websocket_message(out);
+      if (status != RecvStatus::WouldBlock)
+        return status;
+    } else if (avail >= sizeof(uint32_t)) {
+      uint32_t net_len = 0;
+      std::memcpy(&net_len, rx_buf_.data() + rx_off_, sizeof(net_len));
+      uint32_t len = ntohl(net_len);
+      if (len == 0) {
+        return RecvStatus::Closed; // same meaning as receive_message()
+      }
+      if (len > MAX_MSG) {
+        throw std::runtime_error("receive_message: message too large");
+      }
+      if (avail >= sizeof(net_len) + len) {
+        out.assign(rx_buf_, rx_off_ + sizeof(net_len), len);
+        rx_off_ += sizeof(net_len) + len;
+        if (rx_off_ == rx_buf_.size()) {
+          rx_buf_.clear();
+          rx_off_ = 0;
+        }
+        return RecvStatus::Message;
+      }
+    }
+
+    int result = fill_rx_buf();
+    if (result == 0) {
+      return RecvStatus::Closed;
+    }
+    if (result == SOCKET_ERROR) {
+      if (WSAGetLastError() != WSAEWOULDBLOCK)
+        return RecvStatus::Closed;
+      if (rx_buf_.empty()) {
+        // Drained and idle: hand the buffer back rather than keep up to
+        // a frame's worth of capacity per quiet connection
+        std::string().swap(rx_buf_);
+      }
+      return RecvStatus::WouldBlock;
+    }
+  }
+}
+
+int SocketWrapper::fill_rx_buf() {
+  // Compact before growing so the buffer holds at most one partial frame
+  if (rx_off_ > 0) {
+    rx_buf_.erase(0, rx_off_);
+    rx_off_ = 0;
+  }
+
+  char chunk[16 * 1024];
+  int result = ::recv(sock_, chunk, sizeof(chunk), 0);
+  if (result > 0) {
+    rx_buf_.append(chunk, static_cast<std::size_t>(result));
+  }
+  return result;
+}
+
+// ── Non-blocking send
+// ─────────────────────────────────────────────────────────
+
+SocketWrapper::SendStatus SocketWrapper::try_send(const std::string &wire,
+                                                  std::size_t &offset) {
+  if (!is_valid()) {
+    return SendStatus::Closed;
+  }
+  while (offset < wire.size()) {
+    int result = ::send(sock_, wire.data() + offset,
+                        static_cast<int>(wire.size() - offset), 0);
+    if (result == SOCKET_ERROR) {
+      return WSAGetLastError() == WSAEWOULDBLOCK ? SendStatus::WouldBlock
+                                                 : SendStatus::Closed;
+    }
+    if (result == 0) {
+      return SendStatus::Closed;
+    }
+    offset += static_cast<std::size_t>(result);
+  }
+  return SendStatus::Sent;
+}
+
+bool SocketWrapper::wait_writable(unsigned timeout_ms) {
+  if (!is_valid())
+    return false;
+  fd_set set;
+  FD_ZERO(&set);
+  FD_SET(sock_, &set);
+  timeval tv;
+  tv.tv_sec = static_cast<long>(timeout_ms / 1000);
+  tv.tv_usec = static_cast<long>(timeout_ms % 1000) * 1000;
+  return ::select(0, nullptr, &set, nullptr, &tv) > 0;
+}
+
+// ── WebSocket receive
+// ─────────────────────────────────────────────────────────
+
+SocketWrapper::RecvStatus
+SocketWrapper::next_websocket_message(std::string &out) {
+  for (;;) {
+    std::size_t avail = rx_buf_.size() - rx_off_;
+
+    if (!ws_open_) {
+      // The upgrade request comes first, ended by a blank line
+      std::size_t end = rx_buf_.find("\r\n\r\n", rx_off_);
+      if (end == std::string::npos) {
+        if (avail > websocket::MAX_REQUEST)
+          throw std::runtime_error("websocket: upgrade request too large");
+        return RecvStatus::WouldBlock;
+      }
+      end += 4;
+      out.assign(rx_buf_, rx_off_, end - rx_off_);
+      rx_off_ = end;
+      ws_open_ = true;
+      return RecvStatus::Message;
+    }
+
+    websocket::Frame frame;
+    std::size_t used =
+        websocket::decode_frame(&rx_buf_[0] + rx_off_, avail, frame);
+    if (used == 0)
+      return RecvStatus::WouldBlock;
+    const char *payload = rx_buf_.data() + rx_off_ + frame.header;
+    std::size_t offset = rx_off_;
+    rx_off_ += used;
+
+    switch (frame.opcode) {
+    case websocket::PING:
+      send_control(websocket::encode_frame(websocket::PONG, payload,
+                                           frame.length));
+      continue;
+    case websocket::PONG:
+      continue;
+    case websocket::CLOSE:
+      // Echo the status code, then the hub closes the connection
+      send_control(websocket::encode_frame(
+          websocket::CLOSE, payload, frame.length < 2 ? frame.length : 2));
+      return RecvStatus::Closed;
+    case websocket::TEXT:
+    case websocket::BINARY:
+      if (ws_fragmented_)
+        throw std::runtime_error("websocket: interleaved message");
+      if (frame.fin) {
+        if (frame.length == 0)
+          continue; // an empty message would read as a disconnect
+        out.assign(rx_buf_, offset + frame.header, frame.length);
+        return RecvStatus::Message;
+      }
+      ws_partial_.assign(payload, frame.length);
+      ws_fragmented_ = true;
+      continue;
+    case websocket::CONTINUATION:
+      if (!ws_fragmented_)
+        throw std::runtime_error("websocket: stray continuation");
+      if (ws_partial_.size() + frame.length > websocket::MAX_MESSAGE)
+        throw std::runtime_error("websocket: message too large");
+      ws_partial_.append(payload, frame.length);
+      if (!frame.fin)
+        continue;
+      ws_fragmented_ = false;
+      if (ws_partial_.empty())
+        continue;
+      out.swap(ws_partial_);
+      ws_partial_.clear();
+      return RecvStatus::Message;
+    default:
+      throw std::runtime_error("websocket: unknown opcode");
+    }
+  }
+}
+
+void SocketWrapper::send_control(const SharedFrame &frame) {
+  if (control_sender_) {
+    control_sender_(frame);
+    return;
+  }
+  try {
+    send_frame(*frame);
+  } catch (...) {
+    // The receive side reports the disconnect
+  }
+}
+
+// ── Socket options
+// ────────────────────────────────────────────────────────────
+
+void SocketWrapper::set_non_blocking(bool enabled) {
+  if (!is_valid())
+    return;
+  u_long mode = enabled ? 1 : 0;
+  if (::ioctlsocket(sock_, FIONBIO, &mode) == 0) {
+    non_blocking_ = enabled;
+  }
+}
+
+void SocketWrapper::set_no_delay(bool enabled) {
+  if (!is_valid())
+    return;
+  int opt = enabled ? 1 : 0;
+  ::setsockopt(sock_, IPPROTO_TCP, TCP_NODELAY,
+               reinterpret_cast<const char *>(&opt), sizeof(opt));
+}
+
+bool SocketWrapper::set_busy_poll(int usec) {
+#ifdef SO_BUSY_POLL
+  if (!is_valid())
+    return false;
+  return ::setsockopt(sock_, SOL_SOCKET, SO_BUSY_POLL,
+                      reinterpret_cast<const char *>(&usec),
+                      sizeof(usec)) == 0;
+#else
+  (void)usec;
+  return false;
+#endif
+}
+
 // ── Private Helpers
 // ───────────────────────────────────────────────────────────
 
+bool SocketWrapper::wait_ready(bool for_write) {
+  // On a pooled fiber, suspend instead of blocking the IO thread; the loop
+  // resumes us when the socket is ready and the caller simply retries.
+  if (Fiber *fiber = Fiber::current()) {
+    fiber->set_waiting_for_write(for_write);
+    Fiber::yield();
+    fiber->set_waiting_for_write(false);
+    return is_valid();
+  }
+
+  fd_set set;
+  FD_ZERO(&set);
+  FD_SET(sock_, &set);
+  int result = for_write ? ::select(0, nullptr, &set, nullptr, nullptr)
+                         : ::select(0, &set, nullptr, nullptr, nullptr);
+  return result > 0;
+}
+
 bool SocketWrapper::send_all(const char *buf, int len) {
   int sent = 0;
   while (sent < len) {
     int result = ::send(sock_, buf + sent, len - sent, 0);
+    if (result == SOCKET_ERROR && non_blocking_ &&
+        WSAGetLastError() == WSAEWOULDBLOCK) {
+      if (!wait_ready(true))
+        return false;
+      continue;
+    }
     if (result == SOCKET_ERROR || result == 0) {
       return false;
     }
@@ -107,8 +431,30 @@ bool SocketWrapper::send_all(const char *buf, int len) {
 
 bool SocketWrapper::recv_all(char *buf, int len) {
   int received = 0;
+
+  // Serve bytes already read ahead by try_receive_message() first
+  std::size_t buffered = rx_buf_.size() - rx_off_;
+  if (buffered > 0) {
+    std::size_t take =
+        buffered < static_cast<std::size_t>(len) ? buffered
+                                                 : static_cast<std::size_t>(len);
+    std::memcpy(buf, rx_buf_.data() + rx_off_, take);
+    rx_off_ += take;
+    if (rx_off_ == rx_buf_.size()) {
+      rx_buf_.clear();
+      rx_off_ = 0;
+    }
+    received = static_cast<int>(take);
+  }
+
   while (received < len) {
     int result = ::recv(sock_, buf + received, len - received, 0);
+    if (result == SOCKET_ERROR && non_blocking_ &&
+        WSAGetLastError() == WSAEWOULDBLOCK) {
+      if (!wait_ready(false))
+        return false;
+      continue;
+    }
     if (result == SOCKET_ERROR || result == 0) {
       return false;
     }
@@ -0,0 +1,53 @@
+/**
+ * @file thread_scaler.cpp
+ * @brief Implementation of ThreadScaler – IO thread count from load samples.
+ */
+
+#include "thread_scaler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr double HOT_BUSY = 0.70;
+constexpr double VERY_HOT_BUSY = 0.90;
+constexpr double OWED_BUSY = 0.50;
+constexpr uint64_t HOT_PASS_NS = 2000000;
+constexpr double COLD_BUSY = 0.35;
+
+constexpr unsigned HOT_SAMPLES = 2;
+constexpr unsigned COLD_SAMPLES = 40;
+
+} // namespace
+
+ThreadScaler::ThreadScaler(unsigned min, unsigned max)
+    : min_(std::max(min, 1u)), max_(std::max(max, std::max(min, 1u))) {}
+
+unsigned ThreadScaler::decide(const ScaleSample &sample) {
+  unsigned awake = std::min(std::max(sample.awake, min_), max_);
+
+  bool hot = sample.busy >= HOT_BUSY || sample.max_pass_ns >= HOT_PASS_NS ||
+             (sample.owed != 0 && sample.busy >= OWED_BUSY);
+  // The same work spread over one thread fewer
+  bool cold = !hot && awake > min_ &&
+              sample.busy * awake / (awake - 1) < COLD_BUSY;
+
+  hot_ = hot ? hot_ + 1 : 0;
+  cold_ = cold ? cold_ + 1 : 0;
+
+  unsigned want = awake;
+  if (hot_ >= HOT_SAMPLES && awake < max_) {
+    want = sample.busy >= VERY_HOT_BUSY ? awake * 2 : awake + 1;
+  } else if (cold_ >= COLD_SAMPLES) {
+    // Keep just enough threads to stay under COLD_BUSY
+    unsigned need =
+        static_cast<unsigned>(std::ceil(sample.busy * awake / COLD_BUSY));
+    want = std::min(awake - 1, std::max(need, 1u));
+  }
+  want = std::min(std::max(want, min_), max_);
+  if (want != awake) {
+    hot_ = cold_ = 0;
+  }
+  return want;
+}
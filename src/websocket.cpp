@@ -0,0 +1,298 @@
+/**
+ * @file websocket.cpp
+ * @brief Implementation of the WebSocket upgrade handshake and frame codec.
+ */
+
+#include "websocket.h"
+
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+namespace websocket {
+
+namespace {
+
+/// Appended to the browser's key before hashing (RFC 6455, 1.3).
+const char *const KEY_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+/// Largest control frame payload (RFC 6455, 5.5).
+constexpr std::size_t MAX_CONTROL = 125;
+
+uint32_t rotl(uint32_t v, int n) { return (v << n) | (v >> (32 - n)); }
+
+/// SHA-1 of @p data; only used for the handshake key.
+void sha1(const std::string &data, unsigned char digest[20]) {
+  uint32_t h[5] = {0x67452301u, 0xEFCDAB89u, 0x98BADCFEu, 0x10325476u,
+                   0xC3D2E1F0u};
+
+  std::string msg = data;
+  uint64_t bits = static_cast<uint64_t>(data.size()) * 8;
+  msg.push_back(static_cast<char>(0x80));
+  while (msg.size() % 64 != 56) {
+    msg.push_back('\0');
+  }
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    msg.push_back(static_cast<char>((bits >> shift) & 0xFF));
+  }
+
+  for (std::size_t block = 0; block < msg.size(); block += 64) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+      const unsigned char *p =
+          reinterpret_cast<const unsigned char *>(msg.data()) + block + i * 4;
+      w[i] = (static_cast<uint32_t>(p[0]) << 24) |
+             (static_cast<uint32_t>(p[1]) << 16) |
+             (static_cast<uint32_t>(p[2]) << 8) | p[3];
+    }
+    for (int i = 16; i < 80; ++i) {
+      w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999u;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1u;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDCu;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6u;
+      }
+      uint32_t t = rotl(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rotl(b, 30);
+      b = a;
+      a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+
+  for (int i = 0; i < 5; ++i) {
+    digest[i * 4] = static_cast<unsigned char>(h[i] >> 24);
+    digest[i * 4 + 1] = static_cast<unsigned char>(h[i] >> 16);
+    digest[i * 4 + 2] = static_cast<unsigned char>(h[i] >> 8);
+    digest[i * 4 + 3] = static_cast<unsigned char>(h[i]);
+  }
+}
+
+std::string base64(const unsigned char *data, std::size_t len) {
+  static const char digits[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  for (std::size_t i = 0; i < len; i += 3) {
+    uint32_t v = static_cast<uint32_t>(data[i]) << 16;
+    if (i + 1 < len)
+      v |= static_cast<uint32_t>(data[i + 1]) << 8;
+    if (i + 2 < len)
+      v |= data[i + 2];
+    out.push_back(digits[(v >> 18) & 0x3F]);
+    out.push_back(digits[(v >> 12) & 0x3F]);
+    out.push_back(i + 1 < len ? digits[(v >> 6) & 0x3F] : '=');
+    out.push_back(i + 2 < len ? digits[v & 0x3F] : '=');
+  }
+  return out;
+}
+
+std::string lower(std::string s) {
+  for (char &c : s) {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  return s;
+}
+
+std::string trim(const std::string &s) {
+  std::size_t begin = s.find_first_not_of(" \t");
+  if (begin == std::string::npos)
+    return std::string();
+  std::size_t end = s.find_last_not_of(" \t");
+  return s.substr(begin, end - begin + 1);
+}
+
+/// @return true if the comma-separated @p list holds @p token (any case).
+bool has_token(const std::string &list, const char *token) {
+  std::string rest = lower(list);
+  std::size_t start = 0;
+  while (start <= rest.size()) {
+    std::size_t comma = rest.find(',', start);
+    if (comma == std::string::npos)
+      comma = rest.size();
+    if (trim(rest.substr(start, comma - start)) == token)
+      return true;
+    start = comma + 1;
+  }
+  return false;
+}
+
+/// XOR @p len bytes at @p p with the 4-byte @p mask, eight at a time.
+void unmask(char *p, std::size_t len, const unsigned char mask[4]) {
+  uint64_t wide = 0;
+  for (int i = 0; i < 8; ++i) {
+    wide |= static_cast<uint64_t>(mask[i % 4]) << (8 * i);
+  }
+  std::size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t v;
+    std::memcpy(&v, p + i, 8);
+    v ^= wide; // little-endian: byte i gets mask[i % 4]
+    std::memcpy(p + i, &v, 8);
+  }
+  for (; i < len; ++i) {
+    p[i] = static_cast<char>(p[i] ^ mask[i % 4]);
+  }
+}
+
+} // namespace
+
+// ── Handshake
+// ─────────────────────────────────────────────────────────────────
+
+std::string accept_key(const std::string &key) {
+  unsigned char digest[20];
+  sha1(key + KEY_GUID, digest);
+  return base64(digest, sizeof(digest));
+}
+
+bool answer_upgrade(const std::string &request, std::string &response) {
+  response = "HTTP/1.1 400 Bad Request\r\n"
+             "Content-Type: text/plain\r\n"
+             "Connection: close\r\n"
+             "\r\n"
+             "This port speaks WebSocket.\r\n";
+
+  std::size_t eol = request.find("\r\n");
+  if (eol == std::string::npos || request.compare(0, 4, "GET ") != 0)
+    return false;
+
+  std::string upgrade, connection, version, key;
+  std::size_t pos = eol + 2;
+  while (pos < request.size()) {
+    eol = request.find("\r\n", pos);
+    if (eol == std::string::npos || eol == pos)
+      break;
+    std::string line = request.substr(pos, eol - pos);
+    pos = eol + 2;
+    std::size_t colon = line.find(':');
+    if (colon == std::string::npos)
+      continue;
+    std::string name = lower(trim(line.substr(0, colon)));
+    std::string value = trim(line.substr(colon + 1));
+    if (name == "upgrade") {
+      upgrade = value;
+    } else if (name == "connection") {
+      connection = value;
+    } else if (name == "sec-websocket-version") {
+      version = value;
+    } else if (name == "sec-websocket-key") {
+      key = value;
+    }
+  }
+
+  if (!has_token(upgrade, "websocket") || !has_token(connection, "upgrade") ||
+      key.empty())
+    return false;
+  if (version != "13") {
+    response = "HTTP/1.1 426 Upgrade Required\r\n"
+               "Sec-WebSocket-Version: 13\r\n"
+               "Connection: close\r\n"
+               "\r\n";
+    return false;
+  }
+
+  response = "HTTP/1.1 101 Switching Protocols\r\n"
+             "Upgrade: websocket\r\n"
+             "Connection: Upgrade\r\n"
+             "Sec-WebSocket-Accept: " +
+             accept_key(key) + "\r\n\r\n";
+  return true;
+}
+
+// ── Frames
+// ────────────────────────────────────────────────────────────────────
+
+std::size_t write_header(uint8_t opcode, std::size_t len, char *out) {
+  out[0] = static_cast<char>(0x80 | opcode); // FIN: never fragmented
+  if (len < 126) {
+    out[1] = static_cast<char>(len);
+  } else if (len <= 0xFFFF) {
+    out[1] = 126;
+    out[2] = static_cast<char>((len >> 8) & 0xFF);
+    out[3] = static_cast<char>(len & 0xFF);
+  } else {
+    out[1] = 127;
+    uint64_t wide = len;
+    for (int i = 0; i < 8; ++i) {
+      out[2 + i] = static_cast<char>((wide >> (56 - 8 * i)) & 0xFF);
+    }
+  }
+  return header_size(len);
+}
+
+SharedFrame encode_frame(uint8_t opcode, const char *data, std::size_t len) {
+  // Header and payload in one buffer, like SocketWrapper::encode_frame()
+  std::size_t header = header_size(len);
+  auto frame = std::make_shared<std::string>(header + len, '\0');
+  char *p = &(*frame)[0];
+  write_header(opcode, len, p);
+  if (len > 0) {
+    std::memcpy(p + header, data, len);
+  }
+  return frame;
+}
+
+std::size_t decode_frame(char *data, std::size_t size, Frame &out) {
+  if (size < 2)
+    return 0;
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+  if ((p[0] & 0x70) != 0)
+    throw std::runtime_error("websocket: reserved bits set");
+  if ((p[1] & 0x80) == 0)
+    throw std::runtime_error("websocket: unmasked client frame");
+
+  Frame f;
+  f.fin = (p[0] & 0x80) != 0;
+  f.opcode = p[0] & 0x0F;
+  uint64_t len = p[1] & 0x7F;
+  std::size_t header = 2;
+  if (len == 126) {
+    if (size < 4)
+      return 0;
+    len = (static_cast<uint64_t>(p[2]) << 8) | p[3];
+    header = 4;
+  } else if (len == 127) {
+    if (size < 10)
+      return 0;
+    len = 0;
+    for (int i = 0; i < 8; ++i) {
+      len = (len << 8) | p[2 + i];
+    }
+    header = 10;
+  }
+  if ((f.opcode & 0x08) != 0 && (!f.fin || len > MAX_CONTROL))
+    throw std::runtime_error("websocket: bad control frame");
+  if (len > MAX_MESSAGE)
+    throw std::runtime_error("websocket: message too large");
+
+  header += 4; // mask key
+  if (size < header || size - header < len)
+    return 0;
+
+  f.header = header;
+  f.length = static_cast<std::size_t>(len);
+  unmask(data + header, f.length, p + header - 4);
+  out = f;
+  return header + f.length;
+}
+
+} // namespace websocket
@@ -0,0 +1,176 @@
+/**
+ * @file chat_frame_test.cpp
+ * @brief encode_chat() and ChatView: every field, both wire protocols, no
+ * allocation once the pool is warm, and frames that must not parse.
+ */
+
+#include "chat_frame.h"
+#include "websocket.h"
+
+#include "check.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+// Counts heap allocations, to check that a warm broadcast makes none
+static std::size_t allocations = 0;
+
+void *operator new(std::size_t size) {
+  ++allocations;
+  void *p = std::malloc(size != 0 ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+static LogEntry sample() {
+  LogEntry e;
+  e.seq = 0x0102030405060708ull;
+  e.hlc = 0x1112131415161718ull;
+  e.parent = 42;
+  e.sender = "alice";
+  e.text = std::string("hi\0there", 8); // bodies may hold any byte
+  e.edited = true;
+  return e;
+}
+
+/// @return The chat frame inside @p wire, without its native length prefix.
+static std::string native_payload(const std::string &wire) {
+  uint32_t len = 0;
+  for (int i = 0; i < 4; ++i) {
+    len = (len << 8) | static_cast<unsigned char>(wire[i]);
+  }
+  CHECK_EQ(std::size_t(len), wire.size() - 4);
+  return wire.substr(4);
+}
+
+static void check_fields(const ChatView &v, const LogEntry &e) {
+  CHECK_EQ(unsigned(v.kind()), unsigned(CHAT_KIND));
+  CHECK_EQ(v.seq(), e.seq);
+  CHECK_EQ(v.hlc(), e.hlc);
+  CHECK_EQ(v.parent(), e.parent);
+  CHECK_EQ(v.sender().str(), e.sender);
+  CHECK_EQ(v.body().str(), e.text);
+  CHECK_EQ(v.edited(), e.edited);
+}
+
+static void native_round_trip() {
+  LogEntry e = sample();
+  SharedFrame wire = encode_chat(WireProtocol::Native, e);
+  std::string frame = native_payload(*wire);
+  CHECK_EQ(frame.size(), chat_size(e));
+
+  ChatView v;
+  CHECK(ChatView::parse(frame.data(), frame.size(), v));
+  check_fields(v, e);
+
+  // Little-endian on the wire, whatever reads it
+  CHECK_EQ(unsigned(static_cast<unsigned char>(frame[8])), 0x08u);
+  CHECK_EQ(unsigned(static_cast<unsigned char>(frame[15])), 0x01u);
+
+  // Never mistaken for a text command
+  CHECK(frame[0] != 'C');
+}
+
+static void websocket_round_trip() {
+  LogEntry e = sample();
+  e.text.assign(300, 'w'); // past the 125-byte short length
+  SharedFrame wire = encode_chat(WireProtocol::WebSocket, e);
+  std::size_t header = websocket::header_size(chat_size(e));
+  CHECK_EQ(wire->size(), header + chat_size(e));
+  CHECK_EQ(unsigned(static_cast<unsigned char>((*wire)[0]) & 0x0F),
+           unsigned(websocket::BINARY));
+
+  ChatView v;
+  CHECK(ChatView::parse(wire->data() + header, wire->size() - header, v));
+  check_fields(v, e);
+}
+
+static void empty_and_unedited() {
+  LogEntry e;
+  e.seq = 1;
+  SharedFrame wire = encode_chat(WireProtocol::Native, e);
+  std::string frame = native_payload(*wire);
+  CHECK_EQ(frame.size(), CHAT_HEADER);
+  ChatView v;
+  CHECK(ChatView::parse(frame.data(), frame.size(), v));
+  check_fields(v, e);
+}
+
+static void long_sender_is_cut() {
+  LogEntry e = sample();
+  e.sender.assign(70000, 's');
+  SharedFrame wire = encode_chat(WireProtocol::Native, e);
+  std::string frame = native_payload(*wire);
+  ChatView v;
+  CHECK(ChatView::parse(frame.data(), frame.size(), v));
+  CHECK_EQ(v.sender().size, std::size_t(0xFFFF));
+  CHECK_EQ(v.body().str(), e.text);
+}
+
+static void pooled_buffers_are_rewritten() {
+  // A big frame, then a small one that may reuse its buffer
+  LogEntry big = sample();
+  big.text.assign(5000, 'B');
+  encode_chat(WireProtocol::Native, big);
+  LogEntry small = sample();
+  small.text = "s";
+  for (int i = 0; i < 10; ++i) {
+    SharedFrame wire = encode_chat(WireProtocol::Native, small);
+    std::string frame = native_payload(*wire);
+    ChatView v;
+    CHECK(ChatView::parse(frame.data(), frame.size(), v));
+    check_fields(v, small);
+  }
+}
+
+static void warm_pool_allocates_nothing() {
+  LogEntry e = sample();
+  for (int i = 0; i < 4; ++i) {
+    encode_chat(WireProtocol::Native, e); // warm the buffer and block
+  }
+  std::size_t before = allocations;
+  for (int i = 0; i < 100; ++i) {
+    SharedFrame wire = encode_chat(WireProtocol::Native, e);
+    SharedFrame copy = wire; // a second owner, as for two clients
+  }
+  CHECK_EQ(allocations - before, std::size_t(0));
+}
+
+static void refuses_malformed() {
+  LogEntry e = sample();
+  std::string frame = native_payload(*encode_chat(WireProtocol::Native, e));
+
+  ChatView v;
+  CHECK(ChatView::parse(frame.data(), frame.size(), v));
+  uint64_t seq = v.seq();
+
+  // parse() leaves its output alone on failure
+  for (std::size_t len = 0; len < frame.size(); ++len) {
+    CHECK(!ChatView::parse(frame.data(), len, v));
+  }
+  std::string longer = frame + "x";
+  CHECK(!ChatView::parse(longer.data(), longer.size(), v));
+  std::string text = "CMD:ACK:12";
+  text.resize(CHAT_HEADER, ' ');
+  CHECK(!ChatView::parse(text.data(), text.size(), v));
+  std::string kind = frame;
+  kind[0] = 0x02;
+  CHECK(!ChatView::parse(kind.data(), kind.size(), v));
+  CHECK_EQ(v.seq(), seq);
+}
+
+int main() {
+  native_round_trip();
+  websocket_round_trip();
+  empty_and_unedited();
+  long_sender_is_cut();
+  pooled_buffers_are_rewritten();
+  warm_pool_allocates_nothing();
+  refuses_malformed();
+  return check_result();
+}
@@ -0,0 +1,51 @@
+#pragma once
+/**
+ * @file check.h
+ * @brief Minimal assertions for the test programs.
+ *
+ * A failed CHECK prints the expression and its location and marks the run
+ * failed; the test carries on so one run reports every failure.
+ *
+ * Usage:
+ *   CHECK(window.accept(1));
+ *   CHECK_EQ(crc32c("123456789", 9), 0xE3069283u);
+ *   return check_result();
+ */
+
+#include <iostream>
+
+/// Failed checks so far in this process.
+inline int &check_failures() {
+  static int failures = 0;
+  return failures;
+}
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond             \
+                << ") failed\n";                                               \
+      ++check_failures();                                                      \
+    }                                                                          \
+  } while (0)
+
+#define CHECK_EQ(actual, expected)                                             \
+  do {                                                                         \
+    auto check_a_ = (actual);                                                  \
+    auto check_e_ = (expected);                                                \
+    if (!(check_a_ == check_e_)) {                                             \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": " #actual " is "          \
+                << check_a_ << ", expected " << check_e_ << "\n";              \
+      ++check_failures();                                                      \
+    }                                                                          \
+  } while (0)
+
+/// @return The process exit code: 0 if every check passed.
+inline int check_result() {
+  if (check_failures() != 0) {
+    std::cerr << check_failures() << " check(s) failed\n";
+    return 1;
+  }
+  std::cout << "All checks passed\n";
+  return 0;
+}
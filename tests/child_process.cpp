@@ -0,0 +1,113 @@
+/**
+ * @file child_process.cpp
+ * @brief Implementation of ChildProcess.
+ */
+
+#include "child_process.h"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+ChildProcess::~ChildProcess() { stop(); }
+
+void ChildProcess::start(const std::string &exe, const std::string &args,
+                         const std::string &log_path) {
+  SECURITY_ATTRIBUTES inherit = {sizeof(inherit), nullptr, TRUE};
+
+  HANDLE read_end = nullptr;
+  HANDLE write_end = nullptr;
+  if (!CreatePipe(&read_end, &write_end, &inherit, 0))
+    throw std::runtime_error("CreatePipe failed");
+  // Only the child's end is inherited
+  SetHandleInformation(write_end, HANDLE_FLAG_INHERIT, 0);
+
+  HANDLE log = CreateFileA(log_path.c_str(), GENERIC_WRITE,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE, &inherit,
+                           CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (log == INVALID_HANDLE_VALUE) {
+    CloseHandle(read_end);
+    CloseHandle(write_end);
+    throw std::runtime_error("cannot create " + log_path);
+  }
+
+  STARTUPINFOA si = {};
+  si.cb = sizeof(si);
+  si.dwFlags = STARTF_USESTDHANDLES;
+  si.hStdInput = read_end;
+  si.hStdOutput = log;
+  si.hStdError = log;
+
+  std::string cmd = "\"" + exe + "\" " + args;
+  std::vector<char> line(cmd.begin(), cmd.end());
+  line.push_back('\0');
+
+  PROCESS_INFORMATION pi = {};
+  BOOL ok = CreateProcessA(nullptr, line.data(), nullptr, nullptr, TRUE, 0,
+                           nullptr, nullptr, &si, &pi);
+  CloseHandle(read_end);
+  CloseHandle(log);
+  if (!ok) {
+    CloseHandle(write_end);
+    throw std::runtime_error("cannot start " + exe);
+  }
+  CloseHandle(pi.hThread);
+  process_ = pi.hProcess;
+  input_ = write_end;
+  log_path_ = log_path;
+}
+
+void ChildProcess::type(const std::string &line) {
+  if (!input_)
+    return;
+  std::string text = line + "\n";
+  DWORD written = 0;
+  WriteFile(input_, text.data(), static_cast<DWORD>(text.size()), &written,
+            nullptr);
+}
+
+bool ChildProcess::exited() { return wait(0); }
+
+bool ChildProcess::wait(unsigned timeout_ms) {
+  if (!process_)
+    return true;
+  return WaitForSingleObject(process_, timeout_ms) == WAIT_OBJECT_0;
+}
+
+void ChildProcess::kill() {
+  if (process_) {
+    TerminateProcess(process_, 9);
+    WaitForSingleObject(process_, INFINITE);
+  }
+}
+
+void ChildProcess::stop() {
+  if (!process_)
+    return;
+  type("quit");
+  if (!wait(5000)) {
+    kill();
+  }
+  CloseHandle(input_);
+  CloseHandle(process_);
+  input_ = nullptr;
+  process_ = nullptr;
+}
+
+std::string ChildProcess::output() const {
+  std::ifstream in(log_path_.c_str(), std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+bool wait_for_output(const ChildProcess &child, const std::string &text,
+                     unsigned timeout_ms) {
+  for (unsigned waited = 0;; waited += 50) {
+    if (child.output().find(text) != std::string::npos)
+      return true;
+    if (waited >= timeout_ms)
+      return false;
+    Sleep(50);
+  }
+}
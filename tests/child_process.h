@@ -0,0 +1,70 @@
+#pragma once
+/**
+ * @file child_process.h
+ * @brief Runs LAN_Chat as a child process for the hub tests.
+ *
+ * The child's console input is a pipe, so the test answers its prompts and
+ * types server commands ("/stats", "/crash", "quit"); its output goes to a
+ * log file the test can search.
+ *
+ * Usage:
+ *   ChildProcess hub;
+ *   hub.start(exe, "--port=55010 --federation-port=55011", "hub_a.log");
+ *   hub.type("S");
+ *   ...
+ *   hub.stop();
+ */
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+#include <string>
+
+/**
+ * @class ChildProcess
+ * @brief One child process with piped input and logged output.
+ */
+class ChildProcess {
+public:
+  ChildProcess() = default;
+  ~ChildProcess();
+
+  ChildProcess(const ChildProcess &) = delete;
+  ChildProcess &operator=(const ChildProcess &) = delete;
+
+  /**
+   * @brief Start @p exe with @p args; output is appended to @p log_path.
+   * @throws std::runtime_error if the process cannot be started.
+   */
+  void start(const std::string &exe, const std::string &args,
+             const std::string &log_path);
+
+  /// Type one line at the child's console.
+  void type(const std::string &line);
+
+  /// @return true if the child has exited.
+  bool exited();
+
+  /// Wait up to @p timeout_ms for the child to exit. @return true if it did.
+  bool wait(unsigned timeout_ms);
+
+  /// End the child at once (a crash, as far as its peers can tell).
+  void kill();
+
+  /// Ask the child to quit; kill it if it has not exited within 5 s.
+  void stop();
+
+  /// @return Everything the child has printed so far.
+  std::string output() const;
+
+private:
+  HANDLE process_ = nullptr;
+  HANDLE input_ = nullptr; ///< Write end of the child's stdin pipe
+  std::string log_path_;
+};
+
+/// @return true if @p child prints @p text within @p timeout_ms.
+bool wait_for_output(const ChildProcess &child, const std::string &text,
+                     unsigned timeout_ms);
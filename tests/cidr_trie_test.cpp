@@ -0,0 +1,180 @@
+/**
+ * @file cidr_trie_test.cpp
+ * @brief CidrTrie: parsing, longest-prefix rules, and lookups before and
+ * after pack() against a linear scan, with and without the jump table.
+ */
+
+#include "cidr_trie.h"
+
+#include "check.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using Rule = CidrTrie::Rule;
+
+/// @return @p text as a host-order address (it must parse as a /32).
+static uint32_t ip(const char *text) {
+  uint32_t address = 0;
+  unsigned bits = 0;
+  CHECK(CidrTrie::parse(text, address, bits));
+  CHECK_EQ(bits, 32u);
+  return address;
+}
+
+/// @return The rule for @p text, as a number CHECK_EQ can print.
+static unsigned rule_of(const CidrTrie &trie, const char *text) {
+  return static_cast<unsigned>(trie.lookup(ip(text)));
+}
+
+static void insert(CidrTrie &trie, const char *text, Rule rule) {
+  uint32_t network = 0;
+  unsigned bits = 0;
+  CHECK(CidrTrie::parse(text, network, bits));
+  trie.insert(network, bits, rule);
+}
+
+static const unsigned NONE = static_cast<unsigned>(Rule::None);
+static const unsigned ALLOW = static_cast<unsigned>(Rule::Allow);
+static const unsigned DENY = static_cast<unsigned>(Rule::Deny);
+
+static void parsing() {
+  uint32_t network = 0;
+  unsigned bits = 0;
+  CHECK(CidrTrie::parse("10.1.2.3", network, bits));
+  CHECK_EQ(network, 0x0A010203u);
+  CHECK_EQ(bits, 32u);
+  CHECK(CidrTrie::parse("192.168.0.0/16", network, bits));
+  CHECK_EQ(network, 0xC0A80000u);
+  CHECK_EQ(bits, 16u);
+  CHECK(CidrTrie::parse("0.0.0.0/0", network, bits));
+  CHECK_EQ(bits, 0u);
+
+  const char *bad[] = {"",          "10.1.2",     "10.1.2.3.4", "256.1.1.1",
+                       "10.1.2.3/",  "10.1.2.3/33", "10.1.2.3 ",  "a.b.c.d",
+                       "1.2.3.0001", "-1.2.3.4",   "10..2.3",    "1.2.3.4/x"};
+  for (const char *text : bad) {
+    CHECK(!CidrTrie::parse(text, network, bits));
+  }
+}
+
+static void longest_prefix() {
+  CidrTrie trie;
+  CHECK_EQ(rule_of(trie, "10.0.0.1"), NONE);
+
+  insert(trie, "10.0.0.0/8", Rule::Allow);
+  insert(trie, "10.0.5.0/24", Rule::Deny);
+  insert(trie, "10.0.5.7", Rule::Allow);
+  insert(trie, "10.0.4.0/23", Rule::Allow); // splits a run
+  trie.pack();
+
+  CHECK_EQ(rule_of(trie, "10.9.9.9"), ALLOW);
+  CHECK_EQ(rule_of(trie, "10.0.5.1"), DENY);
+  CHECK_EQ(rule_of(trie, "10.0.5.7"), ALLOW);
+  CHECK_EQ(rule_of(trie, "10.0.4.200"), ALLOW);
+  CHECK_EQ(rule_of(trie, "11.0.0.0"), NONE);
+  CHECK_EQ(rule_of(trie, "9.255.255.255"), NONE);
+  CHECK_EQ(trie.size(), std::size_t(4));
+}
+
+static void edges() {
+  CidrTrie trie;
+  insert(trie, "0.0.0.0/0", Rule::Deny);
+  insert(trie, "255.255.255.255", Rule::Allow);
+  insert(trie, "192.168.1.77/24", Rule::Allow); // host bits ignored
+  trie.pack();
+  CHECK_EQ(rule_of(trie, "1.2.3.4"), DENY);
+  CHECK_EQ(rule_of(trie, "255.255.255.255"), ALLOW);
+  CHECK_EQ(rule_of(trie, "255.255.255.254"), DENY);
+  CHECK_EQ(rule_of(trie, "192.168.1.1"), ALLOW);
+
+  // The same prefix on both lists stays denied, in either order
+  CidrTrie both;
+  insert(both, "172.16.0.0/12", Rule::Deny);
+  insert(both, "172.16.0.0/12", Rule::Allow);
+  insert(both, "172.20.0.0/16", Rule::Allow);
+  insert(both, "172.20.0.0/16", Rule::Deny);
+  both.pack();
+  CHECK_EQ(rule_of(both, "172.17.0.1"), DENY);
+  CHECK_EQ(rule_of(both, "172.20.0.1"), DENY);
+  CHECK_EQ(both.size(), std::size_t(2));
+}
+
+/// A prefix and its rule, for the linear-scan reference.
+struct Entry {
+  uint32_t network;
+  unsigned bits;
+  Rule rule;
+};
+
+static uint32_t next_random(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/// The longest matching entry's rule, Deny winning a tie.
+static Rule reference(const std::vector<Entry> &entries, uint32_t address) {
+  Rule found = Rule::None;
+  int longest = -1;
+  for (const Entry &e : entries) {
+    uint32_t mask = e.bits == 0 ? 0 : ~uint32_t{0} << (32 - e.bits);
+    if ((address & mask) != (e.network & mask))
+      continue;
+    int bits = static_cast<int>(e.bits);
+    if (bits > longest) {
+      found = e.rule;
+      longest = bits;
+    } else if (bits == longest && e.rule == Rule::Deny) {
+      found = Rule::Deny;
+    }
+  }
+  return found;
+}
+
+/// Random prefixes clustered in a few /8s, so that they nest and split.
+static void against_scan(std::size_t count) {
+  uint32_t state = 2463534242u + static_cast<uint32_t>(count);
+  std::vector<Entry> entries;
+  CidrTrie trie;
+  for (std::size_t i = 0; i < count; ++i) {
+    uint32_t network = (next_random(state) & 0x03FFFFFFu) | 0x0A000000u;
+    unsigned bits = 8 + next_random(state) % 25;
+    Rule rule = next_random(state) % 3 == 0 ? Rule::Deny : Rule::Allow;
+    entries.push_back(Entry{network, bits, rule});
+    trie.insert(network, bits, rule);
+  }
+
+  // Addresses near the prefixes, and anywhere
+  std::vector<uint32_t> probes;
+  for (const Entry &e : entries) {
+    probes.push_back(e.network);
+    probes.push_back(e.network ^ (next_random(state) & 0xFFu));
+  }
+  for (int i = 0; i < 2000; ++i) {
+    probes.push_back(next_random(state));
+  }
+
+  std::size_t wrong = 0;
+  for (uint32_t address : probes) {
+    if (trie.lookup(address) != reference(entries, address))
+      ++wrong;
+  }
+  trie.pack();
+  for (uint32_t address : probes) {
+    if (trie.lookup(address) != reference(entries, address))
+      ++wrong;
+  }
+  CHECK_EQ(wrong, std::size_t(0));
+}
+
+int main() {
+  parsing();
+  longest_prefix();
+  edges();
+  against_scan(300);                 // below JUMP_NODES: plain walk
+  against_scan(CidrTrie::JUMP_NODES); // enough nodes for the jump table
+  return check_result();
+}
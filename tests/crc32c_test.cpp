@@ -0,0 +1,78 @@
+/**
+ * @file crc32c_test.cpp
+ * @brief crc32c(): published vectors, chaining, every length and alignment.
+ */
+
+#include "crc32c.h"
+
+#include "check.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/// Bit-at-a-time CRC-32C, the definition both fast paths must match.
+static uint32_t reference(const unsigned char *p, std::size_t len) {
+  uint32_t crc = ~0u;
+  for (std::size_t i = 0; i < len; ++i) {
+    crc ^= p[i];
+    for (int k = 0; k < 8; ++k) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+    }
+  }
+  return ~crc;
+}
+
+static void published_vectors() {
+  CHECK_EQ(crc32c("", 0), 0u);
+  CHECK_EQ(crc32c("123456789", 9), 0xE3069283u);
+
+  // RFC 3720 (iSCSI), appendix B.4
+  unsigned char buf[32];
+  std::memset(buf, 0x00, sizeof(buf));
+  CHECK_EQ(crc32c(buf, sizeof(buf)), 0x8A9136AAu);
+  std::memset(buf, 0xFF, sizeof(buf));
+  CHECK_EQ(crc32c(buf, sizeof(buf)), 0x62A8AB43u);
+  for (int i = 0; i < 32; ++i) {
+    buf[i] = static_cast<unsigned char>(i);
+  }
+  CHECK_EQ(crc32c(buf, sizeof(buf)), 0x46DD794Eu);
+  for (int i = 0; i < 32; ++i) {
+    buf[i] = static_cast<unsigned char>(31 - i);
+  }
+  CHECK_EQ(crc32c(buf, sizeof(buf)), 0x113FDB5Cu);
+}
+
+static void chaining() {
+  std::string text = "The quick brown fox jumps over the lazy dog";
+  uint32_t whole = crc32c(text.data(), text.size());
+  for (std::size_t cut = 0; cut <= text.size(); ++cut) {
+    uint32_t crc = crc32c(text.data(), cut);
+    crc = crc32c(text.data() + cut, text.size() - cut, crc);
+    CHECK_EQ(crc, whole);
+  }
+}
+
+static void lengths_and_alignments() {
+  // Covers the 8-byte, 4-byte and single-byte steps from every offset
+  std::vector<unsigned char> data(300);
+  uint32_t x = 12345;
+  for (unsigned char &b : data) {
+    x = x * 1103515245u + 12345u;
+    b = static_cast<unsigned char>(x >> 16);
+  }
+  for (std::size_t offset = 0; offset < 8; ++offset) {
+    for (std::size_t len = 0; len + offset <= data.size(); len += 7) {
+      const unsigned char *p = data.data() + offset;
+      CHECK_EQ(crc32c(p, len), reference(p, len));
+    }
+  }
+}
+
+int main() {
+  published_vectors();
+  chaining();
+  lengths_and_alignments();
+  return check_result();
+}
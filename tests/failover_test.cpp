@@ -0,0 +1,164 @@
+/**
+ * @file failover_test.cpp
+ * @brief A three-hub cluster loses its leader while a real client watches.
+ *
+ * Hubs A (highest priority), B and C form a cluster on loopback. A
+ * LAN_Chat client process connects to A and a scripted client talks
+ * through it. Then A is killed without warning. The test checks that
+ *
+ *   - a standby takes over and the watching client reconnects to it on its
+ *     own, and reports how long that took;
+ *   - every line, sent before or after the kill, is shown to the watcher
+ *     exactly once (the client resumes from its sequence position).
+ *
+ * Usage: failover_test <path to LAN_Chat>
+ */
+
+#include "child_process.h"
+#include "test_client.h"
+
+#include "check.h"
+#include "compat.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace {
+
+constexpr int HUBS = 3;
+constexpr unsigned short BASE_PORT = 56210; ///< Hub i: client port + 10 * i
+constexpr int LINES = 50; ///< Sent before and again after the kill
+
+unsigned short client_port(int hub) {
+  return static_cast<unsigned short>(BASE_PORT + 10 * hub);
+}
+unsigned short cluster_port(int hub) {
+  return static_cast<unsigned short>(client_port(hub) + 1);
+}
+
+/// A line the watcher can be searched for without prefix matches.
+std::string line_text(const char *phase, int n) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%s#%03d#", phase, n);
+  return buf;
+}
+
+std::size_t count_of(const std::string &haystack, const std::string &text) {
+  std::size_t n = 0;
+  for (std::size_t at = haystack.find(text); at != std::string::npos;
+       at = haystack.find(text, at + 1)) {
+    ++n;
+  }
+  return n;
+}
+
+/// Wait until @p watcher has shown every line of @p phase.
+bool wait_for_lines(const ChildProcess &watcher, const char *phase) {
+  return wait_for_output(watcher, line_text(phase, LINES), 10000);
+}
+
+/// Join whichever of hubs B and C leads now.
+std::unique_ptr<TestClient> join_new_leader() {
+  for (int round = 0; round < 100; ++round) {
+    for (int hub = 1; hub < HUBS; ++hub) {
+      try {
+        return std::unique_ptr<TestClient>(
+            new TestClient(client_port(hub), "talker", 100));
+      } catch (const std::exception &) {
+        // Standbys do not listen for clients
+      }
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: failover_test <path to LAN_Chat>\n";
+    return 2;
+  }
+  const std::string exe = argv[1];
+
+  ChildProcess hubs[HUBS];
+  for (int i = 0; i < HUBS; ++i) {
+    std::string args = "--port=" + std::to_string(client_port(i)) +
+                       " --cluster-port=" + std::to_string(cluster_port(i)) +
+                       " --advertise=127.0.0.1:" +
+                       std::to_string(client_port(i)) +
+                       " --priority=" + std::to_string(HUBS - i);
+    for (int peer = 0; peer < HUBS; ++peer) {
+      if (peer != i) {
+        args += " --cluster-peer=127.0.0.1:" +
+                std::to_string(cluster_port(peer));
+      }
+    }
+    hubs[i].start(exe, args,
+                  "failover_hub_" + std::string(1, 'A' + i) + ".log");
+    hubs[i].type("S");
+  }
+  CHECK(wait_for_output(hubs[0], "[Cluster] Now leader", 15000));
+  if (check_failures() != 0)
+    return check_result();
+
+  // The watcher is LAN_Chat's own client, so its failover logic is tested
+  ChildProcess watcher;
+  watcher.start(exe, "--connect-timeout=1000", "failover_client.log");
+  watcher.type("C");
+  watcher.type("watcher");
+  watcher.type("127.0.0.1:" + std::to_string(client_port(0)));
+  CHECK(wait_for_output(watcher, "Connected to", 10000));
+
+  std::unique_ptr<TestClient> talker(
+      new TestClient(client_port(0), "talker"));
+  for (int n = 1; n <= LINES; ++n) {
+    talker->say(line_text("before", n));
+  }
+  CHECK(wait_for_lines(watcher, "before"));
+  Sleep(500); // let the standbys copy the last lines
+
+  // ── Kill the leader without a goodbye
+  hubs[0].kill();
+  uint64_t killed_ns = monotonic_ns();
+  bool back = wait_for_output(watcher, "Reconnected to", 10000);
+  uint64_t back_ms = (monotonic_ns() - killed_ns) / 1000000;
+  CHECK(back);
+  std::cout << "Watcher reconnected " << back_ms
+            << " ms after the leader was killed (50 ms resolution)\n";
+
+  talker = join_new_leader();
+  CHECK(talker != nullptr);
+  if (talker) {
+    for (int n = 1; n <= LINES; ++n) {
+      talker->say(line_text("after", n));
+    }
+    CHECK(wait_for_lines(watcher, "after"));
+  }
+
+  std::string shown = watcher.output();
+  int missing = 0, repeated = 0;
+  for (const char *phase : {"before", "after"}) {
+    for (int n = 1; n <= LINES; ++n) {
+      std::size_t count = count_of(shown, line_text(phase, n));
+      missing += count == 0;
+      repeated += count > 1;
+    }
+  }
+  std::cout << "Watcher: " << missing << " lines missing, " << repeated
+            << " shown twice\n";
+  CHECK_EQ(missing, 0);
+  CHECK_EQ(repeated, 0);
+
+  if (talker) {
+    talker->close();
+  }
+  watcher.stop();
+  for (ChildProcess &hub : hubs) {
+    hub.stop();
+  }
+  return check_result();
+}
@@ -0,0 +1,241 @@
+/**
+ * @file federation_test.cpp
+ * @brief Three federated hubs in separate processes on loopback.
+ *
+ * Hubs A, B and C are linked in a full mesh (B dials A, C dials both).
+ * Each hub has one client that listens and one that talks.
+ *
+ *   latency   A's talker sends a paced line every millisecond; the
+ *             listeners report sent → received, locally on A and across
+ *             one federation hop on B and C.
+ *   capacity  All three talkers send as fast as they can; every listener
+ *             must receive every line exactly once. Reports lines delivered
+ *             per second, all listeners together.
+ *
+ * Usage: federation_test <path to LAN_Chat>
+ */
+
+#include "child_process.h"
+#include "test_client.h"
+
+#include "check.h"
+#include "compat.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int HUBS = 3;
+constexpr unsigned short BASE_PORT = 56110; ///< Hub i: client port + 10 * i
+constexpr int LATENCY_LINES = 2000;
+constexpr int CAPACITY_LINES = 20000; ///< Per talker
+constexpr unsigned DEADLINE_MS = 60000;
+
+unsigned short client_port(int hub) {
+  return static_cast<unsigned short>(BASE_PORT + 10 * hub);
+}
+unsigned short federation_port(int hub) {
+  return static_cast<unsigned short>(client_port(hub) + 1);
+}
+
+/// One hub's listener: counts and times what arrives on its own thread.
+struct Listener {
+  std::unique_ptr<TestClient> client;
+  Thread thread;
+  Mutex mutex;
+  std::vector<uint64_t> latency_ns;           ///< "lat" lines
+  std::vector<std::vector<bool>> seen;        ///< "cap" lines per talker
+  std::atomic<uint64_t> capacity_lines{0};
+  std::atomic<uint64_t> duplicates{0};
+  std::atomic<uint64_t> last_ns{0};
+
+  void run() {
+    ChatMessage msg;
+    while (client->receive(msg)) {
+      uint64_t now = monotonic_ns();
+      unsigned long long sent = 0;
+      int talker = 0, index = 0;
+      if (std::sscanf(msg.text.c_str(), "lat %llu", &sent) == 1) {
+        LockGuard<Mutex> lock(mutex);
+        latency_ns.push_back(now - sent);
+      } else if (std::sscanf(msg.text.c_str(), "cap %d %d", &talker,
+                             &index) == 2 &&
+                 talker >= 0 && talker < HUBS && index >= 0 &&
+                 index < CAPACITY_LINES) {
+        LockGuard<Mutex> lock(mutex);
+        if (seen[talker][index]) {
+          duplicates.fetch_add(1);
+        } else {
+          seen[talker][index] = true;
+          capacity_lines.fetch_add(1);
+          last_ns.store(now);
+        }
+      }
+    }
+  }
+};
+
+/// Reads (and drops) what a talker is sent, so the hub never backs up.
+void drain(TestClient *client) {
+  ChatMessage msg;
+  while (client->receive(msg)) {
+  }
+}
+
+uint64_t percentile(std::vector<uint64_t> v, double p) {
+  if (v.empty())
+    return 0;
+  std::sort(v.begin(), v.end());
+  return v[static_cast<std::size_t>(p * (v.size() - 1))];
+}
+
+void print_latency(const char *label, const std::vector<uint64_t> &v) {
+  std::cout << "  " << label << ": " << v.size() << " lines, p50 "
+            << percentile(v, 0.50) / 1000 << " us, p99 "
+            << percentile(v, 0.99) / 1000 << " us, max "
+            << percentile(v, 1.0) / 1000 << " us\n";
+}
+
+/// @return Occurrences of @p text in @p haystack.
+std::size_t count_of(const std::string &haystack, const std::string &text) {
+  std::size_t n = 0;
+  for (std::size_t at = haystack.find(text); at != std::string::npos;
+       at = haystack.find(text, at + 1)) {
+    ++n;
+  }
+  return n;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: federation_test <path to LAN_Chat>\n";
+    return 2;
+  }
+  const std::string exe = argv[1];
+
+  ChildProcess hubs[HUBS];
+  for (int i = 0; i < HUBS; ++i) {
+    std::string args = "--port=" + std::to_string(client_port(i)) +
+                       " --federation-port=" +
+                       std::to_string(federation_port(i)) + " --hub-name=" +
+                       static_cast<char>('A' + i);
+    for (int peer = 0; peer < i; ++peer) {
+      args += " --peer=127.0.0.1:" + std::to_string(federation_port(peer));
+    }
+    hubs[i].start(exe, args,
+                  "federation_hub_" + std::string(1, 'A' + i) + ".log");
+    hubs[i].type("S");
+  }
+
+  // Every hub links to the other two
+  for (int i = 0; i < HUBS; ++i) {
+    bool linked = false;
+    for (unsigned waited = 0; waited < 15000 && !linked; waited += 100) {
+      linked = count_of(hubs[i].output(), "Linked to hub") >= HUBS - 1;
+      if (!linked)
+        Sleep(100);
+    }
+    CHECK(linked);
+  }
+  if (check_failures() != 0)
+    return check_result();
+
+  Listener listeners[HUBS];
+  std::unique_ptr<TestClient> talkers[HUBS];
+  Thread drains[HUBS];
+  for (int i = 0; i < HUBS; ++i) {
+    std::string hub(1, static_cast<char>('a' + i));
+    listeners[i].client.reset(new TestClient(client_port(i), "listen_" + hub));
+    listeners[i].seen.assign(HUBS, std::vector<bool>(CAPACITY_LINES));
+    listeners[i].thread = Thread(&Listener::run, &listeners[i]);
+    talkers[i].reset(new TestClient(client_port(i), "talk_" + hub));
+    drains[i] = Thread(drain, talkers[i].get());
+  }
+
+  // ── Latency: one paced line per millisecond from hub A
+  for (int n = 0; n < LATENCY_LINES; ++n) {
+    talkers[0]->say("lat " + std::to_string(monotonic_ns()));
+    Sleep(1);
+  }
+  for (unsigned waited = 0; waited < 5000; waited += 50) {
+    bool all = true;
+    for (Listener &l : listeners) {
+      LockGuard<Mutex> lock(l.mutex);
+      all = all && l.latency_ns.size() >= LATENCY_LINES;
+    }
+    if (all)
+      break;
+    Sleep(50);
+  }
+  std::cout << "Latency (sent on A → received):\n";
+  for (int i = 0; i < HUBS; ++i) {
+    LockGuard<Mutex> lock(listeners[i].mutex);
+    std::string label = std::string(1, static_cast<char>('A' + i)) +
+                        (i == 0 ? " (local)" : " (1 hop)");
+    print_latency(label.c_str(), listeners[i].latency_ns);
+    CHECK_EQ(listeners[i].latency_ns.size(), std::size_t(LATENCY_LINES));
+  }
+
+  // ── Capacity: every talker at full speed
+  uint64_t start_ns = monotonic_ns();
+  std::vector<Thread> senders;
+  for (int i = 0; i < HUBS; ++i) {
+    senders.push_back(Thread(
+        [](TestClient *talker, int id) {
+          for (int n = 0; n < CAPACITY_LINES; ++n) {
+            talker->say("cap " + std::to_string(id) + " " + std::to_string(n));
+          }
+        },
+        talkers[i].get(), i));
+  }
+  for (Thread &t : senders) {
+    t.join();
+  }
+  const uint64_t expected = uint64_t(HUBS) * CAPACITY_LINES;
+  for (unsigned waited = 0; waited < DEADLINE_MS; waited += 50) {
+    bool all = true;
+    for (Listener &l : listeners) {
+      all = all && l.capacity_lines.load() >= expected;
+    }
+    if (all)
+      break;
+    Sleep(50);
+  }
+  uint64_t end_ns = start_ns;
+  uint64_t delivered = 0;
+  std::cout << "Capacity (" << HUBS << " talkers x " << CAPACITY_LINES
+            << " lines):\n";
+  for (int i = 0; i < HUBS; ++i) {
+    Listener &l = listeners[i];
+    std::cout << "  " << static_cast<char>('A' + i) << ": "
+              << l.capacity_lines.load() << " / " << expected
+              << " received, " << l.duplicates.load() << " duplicates\n";
+    CHECK_EQ(l.capacity_lines.load(), expected);
+    CHECK_EQ(l.duplicates.load(), uint64_t(0));
+    delivered += l.capacity_lines.load();
+    end_ns = std::max(end_ns, l.last_ns.load());
+  }
+  double seconds = static_cast<double>(end_ns - start_ns) / 1e9;
+  if (seconds > 0) {
+    std::cout << "  " << delivered << " deliveries in " << seconds << " s = "
+              << static_cast<uint64_t>(delivered / seconds) << " lines/s\n";
+  }
+
+  for (int i = 0; i < HUBS; ++i) {
+    listeners[i].client->close();
+    talkers[i]->close();
+    listeners[i].thread.join();
+    drains[i].join();
+    hubs[i].stop();
+  }
+  return check_result();
+}
@@ -0,0 +1,106 @@
+/**
+ * @file flood_filter_test.cpp
+ * @brief FloodFilter: repeats by sender session, expiry, and checks from
+ * several threads across rotations.
+ */
+
+#include "flood_filter.h"
+
+#include "check.h"
+#include "compat.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+static void repeats_by_sender() {
+  FloodFilter filter(60000);
+  const uint64_t ana = (uint64_t{7} << 32) | 1;
+  const uint64_t ben = (uint64_t{7} << 32) | 2;
+
+  CHECK(!filter.repeated(ana, "spam"));
+  CHECK(filter.repeated(ana, "spam"));
+  CHECK(filter.repeated(ana, "spam"));
+  // Someone else, or another line, is not a repeat
+  CHECK(!filter.repeated(ben, "spam"));
+  CHECK(!filter.repeated(ana, "spam!"));
+  CHECK(!filter.repeated(ana, ""));
+  CHECK(filter.repeated(ana, ""));
+
+  // The same client ID under another salt is another session
+  CHECK(!filter.repeated((uint64_t{8} << 32) | 1, "spam"));
+}
+
+static void expires() {
+  FloodFilter filter(200);
+  const uint64_t ana = 1;
+  CHECK(!filter.repeated(ana, "hello"));
+  CHECK(filter.repeated(ana, "hello"));
+  Sleep(450); // past a whole window, whatever the phase
+  CHECK(!filter.repeated(ana, "hello"));
+
+  // Resent steadily, it stays a repeat across rotations
+  std::size_t missed = 0;
+  for (int i = 0; i < 12; ++i) {
+    Sleep(50);
+    if (!filter.repeated(ana, "hello"))
+      ++missed;
+  }
+  CHECK_EQ(missed, std::size_t(0));
+}
+
+/// Per thread: fresh lines are never repeats, and a line sent twice in a
+/// row always is, while other threads rotate the filters underneath.
+struct Worker {
+  FloodFilter *filter = nullptr;
+  uint64_t sender = 0;
+  uint64_t until_ns = 0;
+  std::size_t lines = 0;
+  std::size_t false_repeats = 0;
+  std::size_t missed_repeats = 0;
+
+  void run() {
+    while (monotonic_ns() < until_ns) {
+      std::string line = "line " + std::to_string(lines++);
+      if (filter->repeated(sender, line))
+        ++false_repeats;
+      if (!filter->repeated(sender, line))
+        ++missed_repeats;
+      Sleep(1);
+    }
+  }
+};
+
+static void concurrent_rotation() {
+  FloodFilter filter(1000); // rotates every 500 ms
+  std::vector<Worker> workers(3);
+  uint64_t until = monotonic_ns() + 2600000000ull;
+  for (std::size_t i = 0; i < workers.size(); ++i) {
+    workers[i].filter = &filter;
+    workers[i].sender = i + 1;
+    workers[i].until_ns = until;
+  }
+  std::vector<Thread> threads;
+  for (Worker &worker : workers) {
+    threads.emplace_back(&Worker::run, &worker);
+  }
+  for (Thread &thread : threads) {
+    thread.join();
+  }
+
+  std::size_t lines = 0;
+  for (const Worker &worker : workers) {
+    lines += worker.lines;
+    CHECK_EQ(worker.false_repeats, std::size_t(0));
+    CHECK_EQ(worker.missed_repeats, std::size_t(0));
+  }
+  CHECK(lines > 0);
+}
+
+int main() {
+  repeats_by_sender();
+  expires();
+  concurrent_rotation();
+  return check_result();
+}
@@ -0,0 +1,111 @@
+/**
+ * @file lz_block_test.cpp
+ * @brief lz_compress() / lz_decompress(): round trips and malformed blocks.
+ */
+
+#include "lz_block.h"
+
+#include "check.h"
+
+#include <cstdint>
+#include <string>
+
+/// @return true if @p raw survives compression and decompression.
+static bool round_trips(const std::string &raw, std::size_t *packed_size) {
+  std::string packed;
+  lz_compress(raw.data(), raw.size(), packed);
+  if (packed_size)
+    *packed_size = packed.size();
+  std::string back;
+  return lz_decompress(packed.data(), packed.size(), raw.size(), back) &&
+         back == raw;
+}
+
+static std::string noise(std::size_t len, uint32_t seed) {
+  std::string s(len, '\0');
+  for (char &c : s) {
+    seed = seed * 1103515245u + 12345u;
+    c = static_cast<char>(seed >> 16);
+  }
+  return s;
+}
+
+static void short_inputs() {
+  // Below the shortest block that may hold a match, and just above it
+  for (std::size_t len = 0; len <= 40; ++len) {
+    CHECK(round_trips(std::string(len, 'x'), nullptr));
+    CHECK(round_trips(noise(len, static_cast<uint32_t>(len)), nullptr));
+  }
+}
+
+static void repetitive() {
+  std::size_t packed = 0;
+  // One long overlapping match, with length continuation bytes
+  std::string run(100000, 'a');
+  CHECK(round_trips(run, &packed));
+  CHECK(packed < 1000);
+
+  std::string chat;
+  for (int i = 0; i < 2000; ++i) {
+    chat += "[alice]: see you at " + std::to_string(i % 24) + ":00\n";
+    chat += "[bob]: ok, message #" + std::to_string(i) + " received\n";
+  }
+  CHECK(round_trips(chat, &packed));
+  CHECK(packed < chat.size() / 3);
+}
+
+static void incompressible_and_far() {
+  std::size_t packed = 0;
+  std::string raw = noise(70000, 7);
+  CHECK(round_trips(raw, &packed));
+  CHECK(packed < raw.size() + raw.size() / 200 + 16); // literal overhead
+
+  // A repeat further back than the 16-bit offset reaches
+  std::string block = noise(1000, 9);
+  std::string far = block + noise(70000, 11) + block;
+  CHECK(round_trips(far, nullptr));
+}
+
+static void appends_to_output() {
+  std::string out = "header";
+  lz_compress("payload payload payload", 23, out);
+  CHECK_EQ(out.compare(0, 6, "header"), 0);
+  std::string back;
+  CHECK(lz_decompress(out.data() + 6, out.size() - 6, 23, back));
+  CHECK_EQ(back, std::string("payload payload payload"));
+}
+
+static void malformed() {
+  std::string raw;
+  for (int i = 0; i < 200; ++i) {
+    raw += "repeat " + std::to_string(i % 7) + "; ";
+  }
+  std::string packed;
+  lz_compress(raw.data(), raw.size(), packed);
+  std::string back;
+
+  // Wrong expected size, either way
+  CHECK(!lz_decompress(packed.data(), packed.size(), raw.size() - 1, back));
+  CHECK(!lz_decompress(packed.data(), packed.size(), raw.size() + 1, back));
+
+  // Every truncation is refused, never read past
+  for (std::size_t len = 0; len < packed.size(); ++len) {
+    CHECK(!lz_decompress(packed.data(), len, raw.size(), back));
+  }
+
+  // A match reaching back before the start of the output
+  const char bad[] = {0x14, 'a', 0x05, 0x00, 0x00, 'b'};
+  CHECK(!lz_decompress(bad, sizeof(bad), 9, back));
+  // Offset 0
+  const char zero[] = {0x14, 'a', 0x00, 0x00, 0x00, 'b'};
+  CHECK(!lz_decompress(zero, sizeof(zero), 9, back));
+}
+
+int main() {
+  short_inputs();
+  repetitive();
+  incompressible_and_far();
+  appends_to_output();
+  malformed();
+  return check_result();
+}
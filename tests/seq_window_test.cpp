@@ -0,0 +1,78 @@
+/**
+ * @file seq_window_test.cpp
+ * @brief SeqWindow: duplicates, reordering, late arrivals and gaps.
+ */
+
+#include "seq_window.h"
+
+#include "check.h"
+
+#include <cstdint>
+
+static void in_order_and_duplicates() {
+  SeqWindow w;
+  for (uint64_t seq = 1; seq <= 10000; ++seq) {
+    CHECK(w.accept(seq));
+  }
+  CHECK(!w.accept(10000));
+  CHECK(!w.accept(1));
+  CHECK(!w.accept(5000));
+  CHECK_EQ(w.highest(), uint64_t(10000));
+  CHECK_EQ(w.skipped(), uint64_t(0));
+}
+
+static void reordered_within_window() {
+  SeqWindow w;
+  CHECK(w.accept(1));
+  // Everything up to the window width late is still accepted once
+  CHECK(w.accept(SeqWindow::WINDOW + 1));
+  for (uint64_t seq = SeqWindow::WINDOW; seq >= 2; --seq) {
+    CHECK(w.accept(seq));
+  }
+  for (uint64_t seq = 1; seq <= SeqWindow::WINDOW + 1; ++seq) {
+    CHECK(!w.accept(seq));
+  }
+  CHECK_EQ(w.skipped(), uint64_t(0));
+}
+
+static void late_beyond_window() {
+  SeqWindow w;
+  CHECK(w.accept(1));
+  // 2 goes missing while a full window of newer numbers arrives
+  for (uint64_t seq = 3; seq <= SeqWindow::WINDOW + 2; ++seq) {
+    CHECK(w.accept(seq));
+  }
+  CHECK_EQ(w.skipped(), uint64_t(1));
+  CHECK(!w.accept(2)); // given up: refused, never taken for new
+  CHECK(w.accept(SeqWindow::WINDOW + 3));
+  CHECK_EQ(w.skipped(), uint64_t(1));
+}
+
+static void large_jump() {
+  SeqWindow w;
+  CHECK(w.accept(1));
+  CHECK(w.accept(1000000));
+  CHECK_EQ(w.skipped(), uint64_t(1000000 - 2 - SeqWindow::WINDOW + 1));
+  CHECK(w.accept(1000000 - 5)); // still in the window
+  CHECK(!w.accept(1000000 - SeqWindow::WINDOW));
+  CHECK(!w.accept(1000000));
+}
+
+static void starts_at_first_number() {
+  SeqWindow w;
+  CHECK(w.accept(500));
+  CHECK(!w.accept(499)); // before the sequence started here
+  CHECK(w.accept(502));
+  CHECK(w.accept(501));
+  CHECK(!w.accept(501));
+  CHECK_EQ(w.highest(), uint64_t(502));
+}
+
+int main() {
+  in_order_and_duplicates();
+  reordered_within_window();
+  late_beyond_window();
+  large_jump();
+  starts_at_first_number();
+  return check_result();
+}
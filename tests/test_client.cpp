@@ -0,0 +1,71 @@
+/**
+ * @file test_client.cpp
+ * @brief Implementation of TestClient.
+ */
+
+#include "test_client.h"
+
+#include "chat_frame.h"
+#include "client.h"
+#include "compat.h"
+#include "version.h"
+
+#include <stdexcept>
+
+namespace {
+
+/// Join over @p socket; @return true if the hub answered "CMD:OK".
+bool join(SocketWrapper &socket, const std::string &name) {
+  socket.send_message(name);
+  socket.send_message(std::string("CMD:VERSION:") + APP_VERSION);
+  return socket.receive_message() == "CMD:OK";
+}
+
+} // namespace
+
+TestClient::TestClient(unsigned short port, const std::string &name,
+                       unsigned timeout_ms)
+    : socket_(INVALID_SOCKET) {
+  Client client(1000);
+  uint64_t deadline = monotonic_ns() + uint64_t(timeout_ms) * 1000000;
+  for (;;) {
+    try {
+      SocketWrapper socket = client.connect_to("127.0.0.1", port);
+      if (join(socket, name)) {
+        socket_ = std::move(socket);
+        return;
+      }
+    } catch (const std::exception &) {
+      // Not listening yet (or a standby that has not taken over)
+    }
+    if (monotonic_ns() > deadline) {
+      throw std::runtime_error("no hub let " + name + " in on port " +
+                               std::to_string(port));
+    }
+    Sleep(100);
+  }
+}
+
+void TestClient::say(const std::string &text) { socket_.send_message(text); }
+
+bool TestClient::receive(ChatMessage &out) {
+  for (;;) {
+    std::string frame;
+    try {
+      frame = socket_.receive_message();
+    } catch (const std::exception &) {
+      return false;
+    }
+    if (frame.empty())
+      return false;
+
+    ChatView chat;
+    if (!ChatView::parse(frame.data(), frame.size(), chat))
+      continue; // CMD:..., edits, presence
+    out.seq = chat.seq();
+    out.hlc = chat.hlc();
+    out.sender = chat.sender().str();
+    out.text = chat.body().str();
+    return true;
+  }
+}
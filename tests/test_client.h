@@ -0,0 +1,57 @@
+#pragma once
+/**
+ * @file test_client.h
+ * @brief A scripted chat client for the hub tests.
+ *
+ * Joins a hub the way LAN_Chat's client does (username, version, then
+ * "CMD:OK") and reads chat frames in place with ChatView.
+ *
+ * Usage:
+ *   TestClient alice(55010, "alice");
+ *   alice.say("hello");
+ *   ChatMessage msg;
+ *   while (bob.receive(msg)) { ... }
+ */
+
+#include "socket_wrapper.h"
+
+#include <cstdint>
+#include <string>
+
+/// One chat message as a client received it.
+struct ChatMessage {
+  uint64_t seq = 0;
+  uint64_t hlc = 0;
+  std::string sender;
+  std::string text;
+};
+
+/**
+ * @class TestClient
+ * @brief One connection to a hub on 127.0.0.1.
+ */
+class TestClient {
+public:
+  /**
+   * @brief Connect and join as @p name, retrying while the hub starts.
+   * @throws std::runtime_error if the hub does not let us in within
+   *         @p timeout_ms.
+   */
+  TestClient(unsigned short port, const std::string &name,
+             unsigned timeout_ms = 10000);
+
+  /// Send one line of chat.
+  void say(const std::string &text);
+
+  /**
+   * @brief Block until the next chat message; other frames are skipped.
+   * @return false once the connection is closed.
+   */
+  bool receive(ChatMessage &out);
+
+  /// Close the connection; unblocks receive() on another thread.
+  void close() { socket_.close(); }
+
+private:
+  SocketWrapper socket_;
+};